@@ -0,0 +1,351 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class BitGame<W, H, Fleet>:
+ *  A compact version of Game for one set of rules: a W by H board and the
+ *  ships listed in Fleet (a FleetOf<sizes...>). It is for the server to judge
+ *  shots at a fleet without a full Game per player. Every board is a
+ *  BoardMask with one bit per space (bit y*W+x), sized to the fewest 64 bit
+ *  words that hold W*H bits, so the mask loops are unrolled for each set of
+ *  rules. A 10x10 fleet and both maps fit in about 150 bytes, and a shot is
+ *  answered with a few ANDs.
+ *
+ * class JudgedFleet:
+ *  What the server sees of a BitGame, whatever the rules (see GameRules.h for
+ *  picking them at runtime)
+ *
+ * BitGame()
+ *  Empty boards, no ships placed
+ * bool PlaceShip(short size, bool horizontal, short x, short y)
+ *  Places the first unplaced 'size'-space ship (0 based x and y). Unlike
+ *  Game, ships can't overlap, and there have to be ships of that size left.
+ * void CalculateMoveResults(...)
+ *  Same answers as Game::CalculateMoveResults
+ * void SetPlayCoord(short x, short y), void SetPlayHitCoord(short x, short y)
+ *  Same as the Game ones, for the target map
+ ***********************************/
+
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// One bit per space of a board, low word first
+template <int Words>
+struct BoardMask
+{
+	uint64_t word[Words];
+};
+
+// Ships a set of rules plays with, by size
+template <short... Sizes>
+struct FleetOf
+{
+	static const int count = sizeof...(Sizes);
+	// Size of ship 'shipNum'
+	static short Size(int shipNum)
+	{
+		static const short sizes[] = {Sizes...};
+		return sizes[shipNum];
+	}
+};
+
+/****************************************************************
+* Get the mask with just bit 'bit' set
+*
+* Preconditions:
+*  bit < 64*Words
+* Postcondition:
+*  mask returned
+****************************************************************/
+template <int Words>
+inline BoardMask<Words> maskBit(unsigned int bit)
+{
+	BoardMask<Words> mask;
+	uint64_t one = ((uint64_t)1) << (bit & 63);
+	for (int i = 0; i < Words; ++i)
+	{
+		mask.word[i] = (bit >> 6) == (unsigned int)i ? one : 0;
+	}
+	return mask;
+}
+
+/****************************************************************
+* Get the spaces set in both a and b
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  a AND b returned
+****************************************************************/
+template <int Words>
+inline BoardMask<Words> maskAnd(const BoardMask<Words> & a, const BoardMask<Words> & b)
+{
+	BoardMask<Words> mask;
+	for (int i = 0; i < Words; ++i)
+	{
+		mask.word[i] = a.word[i] & b.word[i];
+	}
+	return mask;
+}
+
+/****************************************************************
+* Get the spaces set in a but not b
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  a AND NOT b returned
+****************************************************************/
+template <int Words>
+inline BoardMask<Words> maskAndNot(const BoardMask<Words> & a, const BoardMask<Words> & b)
+{
+	BoardMask<Words> mask;
+	for (int i = 0; i < Words; ++i)
+	{
+		mask.word[i] = a.word[i] & ~b.word[i];
+	}
+	return mask;
+}
+
+/****************************************************************
+* Add the spaces set in b to a
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  a is a OR b
+****************************************************************/
+template <int Words>
+inline void maskSet(BoardMask<Words> & a, const BoardMask<Words> & b)
+{
+	for (int i = 0; i < Words; ++i)
+	{
+		a.word[i] |= b.word[i];
+	}
+}
+
+/****************************************************************
+* Check if any space is set in a
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  true returned if a has a bit set
+****************************************************************/
+template <int Words>
+inline bool maskAny(const BoardMask<Words> & a)
+{
+	uint64_t any = 0;
+	for (int i = 0; i < Words; ++i)
+	{
+		any |= a.word[i];
+	}
+	return 0 != any;
+}
+
+/****************************************************************
+* Get a mask with no spaces set
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  empty mask returned
+****************************************************************/
+template <int Words>
+inline BoardMask<Words> maskEmpty()
+{
+	BoardMask<Words> mask;
+	for (int i = 0; i < Words; ++i)
+	{
+		mask.word[i] = 0;
+	}
+	return mask;
+}
+
+class JudgedFleet
+{
+public:
+	virtual ~JudgedFleet() {}
+	// Board size
+	virtual short Width() const = 0;
+	virtual short Height() const = 0;
+	// Number of ships in a full fleet
+	virtual int ShipCount() const = 0;
+	// Size of ship 'shipNum'
+	virtual short ShipSize(int shipNum) const = 0;
+	// Places the first unplaced 'size'-space ship (0 based x and y). False if
+	// it would hang off the board, overlap another ship, or there are no
+	// ships of that size left to place.
+	virtual bool PlaceShip(short size, bool horizontal, short x, short y) = 0;
+	// Calulates the results of the other player's move at x,y. 'shipSize' is
+	// the size of the ship that was hit (if any). 'win' is true if they just
+	// won. 'sink' is if they sunk a ship. 'hit' is if they hit a ship.
+	virtual void CalculateMoveResults(short x, short y, bool & hit, short & shipSize,
+	bool & sink, bool & win) = 0;
+};
+
+template <short W, short H, class Fleet>
+class BitGame : public JudgedFleet
+{
+	static_assert(W > 0 && H > 0 && Fleet::count > 0, "BitGame needs a board and ships");
+public:
+	// The rules, for building tables of them
+	static const short width = W;
+	static const short height = H;
+	static const int shipCount = Fleet::count;
+	// Create a new game object
+	BitGame();
+	short Width() const { return W; }
+	short Height() const { return H; }
+	int ShipCount() const { return Fleet::count; }
+	short ShipSize(int shipNum) const { return Fleet::Size(shipNum); }
+	bool PlaceShip(short size, bool horizontal, short x, short y);
+	// Records where we sucessfully hit another ship on the other player's board
+	void SetPlayHitCoord(short x, short y);
+	// Marks where the user targeted on the other player's map
+	void SetPlayCoord(short x, short y);
+	void CalculateMoveResults(short x, short y, bool & hit, short & shipSize,
+	bool & sink, bool & win);
+protected:
+	// 64 bit words per board
+	static const int Words = (W*H+63)/64;
+	typedef BoardMask<Words> Mask;
+	// Spaces any ship is on
+	Mask occupied;
+	// Spaces of our ocean the other player fired at
+	Mask shot;
+	// Spaces each ship is on (ship i is Fleet::Size(i) spaces)
+	Mask ships[Fleet::count];
+	// Where we fired on the other player's board, and where that hit
+	Mask targetShot;
+	Mask targetHit;
+};
+
+/****************************************************************
+* Create a new game object
+* Preconditions:
+*  None
+* Postcondition:
+*  Game boards empty. Ships not placed.
+****************************************************************/
+template <short W, short H, class Fleet>
+BitGame<W, H, Fleet>::BitGame(): occupied(maskEmpty<Words>()), shot(occupied), targetShot(occupied), targetHit(occupied)
+{
+	for (int shipNum = 0; shipNum < Fleet::count; ++shipNum)
+	{
+		ships[shipNum] = occupied;
+	}
+}
+
+/***************************************************************
+* Places the first unplaced 'size'-space ship
+* Preconditions:
+*  x and y 0 based
+* Postcondition:
+*  Ship placed on the board and true returned, or false returned (and
+*  nothing changed) if it would hang off the board, it would overlap another
+*  ship, or every ship that size was placed already
+****************************************************************/
+template <short W, short H, class Fleet>
+bool BitGame<W, H, Fleet>::PlaceShip(short size, bool horizontal, short x, short y)
+{
+	if (x < 0 || y < 0 ||
+		(horizontal && (x+size > W || y >= H)) ||
+		(!horizontal && (y+size > H || x >= W)))
+	{
+		return false;
+	}
+	int shipNum = 0;
+	while (shipNum < Fleet::count && (Fleet::Size(shipNum) != size || maskAny(ships[shipNum])))
+	{
+		++shipNum;
+	}
+	if (Fleet::count == shipNum)
+	{
+		return false;
+	}
+	Mask ship = maskEmpty<Words>();
+	for (int j = 0; j < size; ++j)
+	{
+		if (horizontal)
+		{
+			maskSet(ship, maskBit<Words>(y*W + x+j));
+		}
+		else
+		{
+			maskSet(ship, maskBit<Words>((y+j)*W + x));
+		}
+	}
+	if (maskAny(maskAnd(ship, occupied)))
+	{
+		return false;
+	}
+	ships[shipNum] = ship;
+	maskSet(occupied, ship);
+	return true;
+}
+
+/****************************************************************
+* Records where we sucessfully hit another ship on the other player's board
+* Preconditions:
+*  x < W and y < H
+* Postcondition:
+*  That place on the map marked as a sucessfull hit
+****************************************************************/
+template <short W, short H, class Fleet>
+void BitGame<W, H, Fleet>::SetPlayHitCoord(short x, short y)
+{
+	maskSet(targetHit, maskBit<Words>(y*W + x));
+}
+
+/****************************************************************
+* Marks where the user targeted on the other player's map
+* Preconditions:
+*  x < W and y < H
+* Postcondition:
+*  That place on the map marked as having been fired at
+****************************************************************/
+template <short W, short H, class Fleet>
+void BitGame<W, H, Fleet>::SetPlayCoord(short x, short y)
+{
+	maskSet(targetShot, maskBit<Words>(y*W + x));
+}
+
+/*****************************************************************
+* Calulates the results of the other player's move at x,y
+*
+* Preconditions:
+*  x < W and y < H
+* Postcondition:
+*  Space marked as fired at. Results set the same way as
+*  Game::CalculateMoveResults: hit only for a ship space not hit before,
+*  shipSize 0 and sink and win false otherwise
+****************************************************************/
+template <short W, short H, class Fleet>
+void BitGame<W, H, Fleet>::CalculateMoveResults(short x, short y, bool & hit, short & shipSize, bool & sink, bool & win)
+{
+	Mask space = maskBit<Words>(y*W + x);
+	// A ship there that wasn't hit already
+	hit = maskAny(maskAnd(maskAndNot(occupied, shot), space));
+	maskSet(shot, space);
+	shipSize = 0;
+	sink = false;
+	win = false;
+	if (!hit)
+	{
+		return;
+	}
+	// Only the ship that was hit has this bit set
+	for (int i = 0; i < Fleet::count; ++i)
+	{
+		if (maskAny(maskAnd(ships[i], space)))
+		{
+			shipSize = Fleet::Size(i);
+			sink = !maskAny(maskAndNot(ships[i], shot));
+		}
+	}
+	win = !maskAny(maskAndNot(occupied, shot));
+}
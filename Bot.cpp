@@ -0,0 +1,461 @@
+#include "Bot.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the computer players.
+ ************************************/
+
+#include <algorithm>
+
+/****************************************************************
+* Get the sizes of the ships in a fleet
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes, sizes returned in fleet order
+****************************************************************/
+static std::vector<short> fleetSizes(const JudgedFleet & fleet)
+{
+	std::vector<short> sizes;
+	for (int i = 0; i < fleet.ShipCount(); ++i)
+	{
+		sizes.push_back(fleet.ShipSize(i));
+	}
+	return sizes;
+}
+
+/****************************************************************
+* Start a bot's picture of the other player's board
+*
+* Preconditions:
+*  width*height <= BOT_MAX_SPACES
+* Postcondition:
+*  Every space unknown, every ship afloat
+****************************************************************/
+BotBrain::BotBrain(short width, short height, const std::vector<short> & sizes, unsigned int seed): heatmap(width, height, sizes), random(seed)
+{
+
+}
+
+/****************************************************************
+* Pick the next space to fire at
+*
+* Preconditions:
+*  Some space not fired at yet
+* Postcondition:
+*  x and y (0 based) set to the unknown space with the highest score on the
+*  heatmap, ties picked at random
+****************************************************************/
+void BotBrain::NextShot(short & x, short & y)
+{
+	const std::vector<unsigned int> & density = heatmap.Calculate();
+	short width = heatmap.Width();
+	// Best unknown space, picking evenly between ties
+	int best = -1;
+	unsigned int ties = 0;
+	for (int space = 0; space < width*heatmap.Height(); ++space)
+	{
+		if (!heatmap.IsUnknown(space % width, space / width))
+		{
+			continue;
+		}
+		if (-1 == best || density[space] > density[best])
+		{
+			best = space;
+			ties = 1;
+		}
+		else if (density[space] == density[best] && 0 == random() % ++ties)
+		{
+			best = space;
+		}
+	}
+	if (-1 == best)
+	{
+		// Nothing left, shouldn't happen
+		best = 0;
+	}
+	x = best % width;
+	y = best / width;
+}
+
+/****************************************************************
+* Learn the results of a shot
+*
+* Preconditions:
+*  x and y 0 based and on the board
+* Postcondition:
+*  results added to the heatmap
+****************************************************************/
+void BotBrain::Record(short x, short y, bool hit, short shipSize, bool sink)
+{
+	heatmap.Record(x, y, hit, shipSize, sink);
+}
+
+/****************************************************************
+* Start hunting on an empty board
+*
+* Preconditions:
+*  width and height > 0
+* Postcondition:
+*  Nothing fired at, no targets
+****************************************************************/
+HuntTarget::HuntTarget(short Width, short Height, unsigned int seed): width(Width), height(Height), fired(Width*Height, false), targets(), random(seed)
+{
+
+}
+
+/****************************************************************
+* Queue a space next to a hit to try
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  x, y added to the targets if it is on the board and not fired at
+****************************************************************/
+void HuntTarget::AddTarget(short x, short y)
+{
+	if (x >= 0 && y >= 0 && x < width && y < height && !fired[y*width + x])
+	{
+		targets.push_back(y*width + x);
+	}
+}
+
+/****************************************************************
+* Pick the next space to fire at
+*
+* Preconditions:
+*  Some space not fired at yet
+* Postcondition:
+*  x and y (0 based) set to the newest target not fired at yet, or else a
+*  random space not fired at (one of the checkerboard's if one turns up)
+****************************************************************/
+void HuntTarget::NextShot(short & x, short & y)
+{
+	int space = -1;
+	while (-1 == space && !targets.empty())
+	{
+		if (!fired[targets.back()])
+		{
+			space = targets.back();
+		}
+		targets.pop_back();
+	}
+	// Ships of 2 or more always cover a checkerboard space, so try those first
+	for (int tries = 0; -1 == space && tries < 128; ++tries)
+	{
+		int guess = random() % (width*height);
+		if (!fired[guess] && (tries >= 64 || 0 == (guess % width + guess / width) % 2))
+		{
+			space = guess;
+		}
+	}
+	for (int guess = 0; -1 == space && guess < width*height; ++guess)
+	{
+		if (!fired[guess])
+		{
+			space = guess;
+		}
+	}
+	if (-1 == space)
+	{
+		// Nothing left, shouldn't happen
+		space = 0;
+	}
+	fired[space] = true;
+	x = space % width;
+	y = space / width;
+}
+
+/****************************************************************
+* Learn the results of a shot
+*
+* Preconditions:
+*  x and y 0 based and on the board
+* Postcondition:
+*  space marked fired at, and on a hit the spaces next to it queued
+****************************************************************/
+void HuntTarget::Record(short x, short y, bool hit, short shipSize, bool sink)
+{
+	fired[y*width + x] = true;
+	if (hit)
+	{
+		AddTarget(x-1, y);
+		AddTarget(x+1, y);
+		AddTarget(x, y-1);
+		AddTarget(x, y+1);
+	}
+}
+
+/****************************************************************
+* Shuffle every space of a board
+*
+* Preconditions:
+*  width and height > 0
+* Postcondition:
+*  Spaces in a random order, none fired at
+****************************************************************/
+RandomShots::RandomShots(short Width, short Height, unsigned int seed): width(Width), order(Width*Height), next(0)
+{
+	std::mt19937 random(seed);
+	for (int space = 0; space < Width*Height; ++space)
+	{
+		order[space] = space;
+	}
+	std::shuffle(order.begin(), order.end(), random);
+}
+
+/****************************************************************
+* Pick the next space to fire at
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  x and y (0 based) set to the next space in the shuffled order (back to the
+*  start once they have all been fired at)
+****************************************************************/
+void RandomShots::NextShot(short & x, short & y)
+{
+	int space = order[next++ % order.size()];
+	x = space % width;
+	y = space / width;
+}
+
+/****************************************************************
+* Learn the results of a shot
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Nothing, it fires the same way whatever it hits
+****************************************************************/
+void RandomShots::Record(short x, short y, bool hit, short shipSize, bool sink)
+{
+
+}
+
+/****************************************************************
+* Make a strategy by name
+*
+* Preconditions:
+*  sizes the ships the other player has
+* Postcondition:
+*  "heatmap", "hunt" or "random" strategy returned, nullptr for any other
+*  name
+****************************************************************/
+std::shared_ptr<ShotStrategy> makeStrategy(const std::string & name, const GameRules & rules, const std::vector<short> & sizes, unsigned int seed)
+{
+	if ("heatmap" == name)
+	{
+		return std::make_shared<BotBrain>(rules.width, rules.height, sizes, seed);
+	}
+	if ("hunt" == name)
+	{
+		return std::make_shared<HuntTarget>(rules.width, rules.height, seed);
+	}
+	if ("random" == name)
+	{
+		return std::make_shared<RandomShots>(rules.width, rules.height, seed);
+	}
+	return nullptr;
+}
+
+/****************************************************************
+* Look up a way of placing a fleet
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  BOT_PLACE_RANDOM for "random", BOT_PLACE_EDGES for "edges", -1 otherwise
+****************************************************************/
+int findPlacement(const std::string & name)
+{
+	if ("random" == name)
+	{
+		return BOT_PLACE_RANDOM;
+	}
+	if ("edges" == name)
+	{
+		return BOT_PLACE_EDGES;
+	}
+	return -1;
+}
+
+/****************************************************************
+* Place every ship of a fleet
+*
+* Preconditions:
+*  Nothing placed in fleet yet, and room on the board for all of it
+* Postcondition:
+*  Each ship placed at a random spot (for BOT_PLACE_EDGES, a random spot
+*  along an edge if one is free after BOT_EDGE_TRIES tries), and added to
+*  ships (0 based) if it isn't nullptr
+****************************************************************/
+void placeFleet(JudgedFleet & fleet, int placement, std::mt19937 & random, std::vector<Ship> * ships)
+{
+	short width = fleet.Width();
+	short height = fleet.Height();
+	for (int i = 0; i < fleet.ShipCount(); ++i)
+	{
+		short size = fleet.ShipSize(i);
+		bool placed = false;
+		bool horizontal = false;
+		short x = 0, y = 0;
+		for (int tries = 0; BOT_PLACE_EDGES == placement && !placed && tries < BOT_EDGE_TRIES; ++tries)
+		{
+			// Top, bottom, left or right
+			int edge = random() % 4;
+			horizontal = edge < 2;
+			short along = random() % ((horizontal ? width : height) - size + 1);
+			x = horizontal ? along : (2 == edge ? 0 : width-1);
+			y = horizontal ? (0 == edge ? 0 : height-1) : along;
+			placed = fleet.PlaceShip(size, horizontal, x, y);
+		}
+		while (!placed)
+		{
+			horizontal = random() & 1;
+			x = random() % width;
+			y = random() % height;
+			placed = fleet.PlaceShip(size, horizontal, x, y);
+		}
+		if (ships)
+		{
+			ships->push_back(Ship(size));
+			ships->back().Place(horizontal, x, y);
+		}
+	}
+}
+
+/****************************************************************
+* Set up a bot for one game
+*
+* Preconditions:
+*  botCanPlay(Rules)
+* Postcondition:
+*  Fleet placed at random, nothing fired at yet
+****************************************************************/
+BotPlayer::BotPlayer(const GameRules & Rules, unsigned int seed): rules(Rules), fleet(Rules.MakeFleet()), brain(Rules.width, Rules.height, fleetSizes(*fleet), seed)
+{
+	std::mt19937 place(seed ^ 0x5bd1e995);
+	placeFleet(*fleet, BOT_PLACE_RANDOM, place);
+}
+
+/****************************************************************
+* Get the rules of the game
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes, rules returned
+****************************************************************/
+const GameRules & BotPlayer::GetRules() const
+{
+	return rules;
+}
+
+/****************************************************************
+* Get where the bot's ships are
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  fleet returned
+****************************************************************/
+JudgedFleet & BotPlayer::GetFleet()
+{
+	return *fleet;
+}
+
+/****************************************************************
+* Get what the bot knows of the other player's board
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  brain returned
+****************************************************************/
+BotBrain & BotPlayer::GetBrain()
+{
+	return brain;
+}
+
+/****************************************************************
+* Check if bots play by a set of rules
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  true returned if the board is small enough for a BotBrain
+****************************************************************/
+bool botCanPlay(const GameRules & rules)
+{
+	return rules.width*rules.height <= BOT_MAX_SPACES;
+}
+
+/****************************************************************
+* Play two computer players against each other in memory
+*
+* Preconditions:
+*  sides' placements BOT_PLACE_* numbers
+* Postcondition:
+*  Game played to the end. Returns 0 if the side that moved first won, 1 if
+*  the other one did, and -1 if a strategy name is unknown or nobody won
+*  after every space of both boards was fired at. shots set to how many
+*  shots each side fired.
+****************************************************************/
+int playMatch(const GameRules & rules, const MatchSide sides[2], unsigned int seed, int shots[2])
+{
+	std::mt19937 random(seed);
+	std::shared_ptr<JudgedFleet> fleets[2];
+	std::shared_ptr<ShotStrategy> strategies[2];
+	for (int side = 0; side < 2; ++side)
+	{
+		fleets[side] = rules.MakeFleet();
+		placeFleet(*fleets[side], sides[side].placement, random);
+		shots[side] = 0;
+	}
+	// Both fleets have the same ships
+	std::vector<short> sizes = fleetSizes(*fleets[0]);
+	for (int side = 0; side < 2; ++side)
+	{
+		strategies[side] = makeStrategy(sides[side].strategy, rules, sizes, random());
+		if (!strategies[side])
+		{
+			return -1;
+		}
+	}
+	int maxShots = rules.width*rules.height;
+	for (int turn = 0; shots[turn] < maxShots; turn = 1 - turn)
+	{
+		short x, y, shipSize = 0;
+		bool hit, sink, win = false;
+		strategies[turn]->NextShot(x, y);
+		fleets[1 - turn]->CalculateMoveResults(x, y, hit, shipSize, sink, win);
+		strategies[turn]->Record(x, y, hit, shipSize, sink);
+		++shots[turn];
+		if (win)
+		{
+			return turn;
+		}
+	}
+	return -1;
+}
+
+/****************************************************************
+* Play two bots against each other in memory
+*
+* Preconditions:
+*  botCanPlay(rules)
+* Postcondition:
+*  Game played to the end. Returns 0 if the bot that moved first won, 1 if
+*  the other one did. shots set to how many shots were fired in all.
+****************************************************************/
+int playBotMatch(const GameRules & rules, unsigned int seed, int & shots)
+{
+	const MatchSide bots[2] = {{"heatmap", BOT_PLACE_RANDOM}, {"heatmap", BOT_PLACE_RANDOM}};
+	int sideShots[2];
+	int winner = playMatch(rules, bots, seed, sideShots);
+	shots = sideShots[0] + sideShots[1];
+	return winner;
+}
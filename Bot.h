@@ -0,0 +1,153 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Computer players.
+ *
+ * class ShotStrategy:
+ *  How a computer player picks where to fire. The ones there are:
+ *   BotBrain ("heatmap"): the best space on a Heatmap of its shots so far
+ *    (see Heatmap.h), picking at random between ties so it isn't
+ *    predictable. This is what the server's bots use.
+ *   HuntTarget ("hunt"): random spaces in a checkerboard until it hits
+ *    something, then the spaces next to each hit until it sinks
+ *   RandomShots ("random"): every space once, in a random order
+ *
+ * class BotPlayer:
+ *  One bot's side of one game: its fleet (placed at random) and its brain.
+ *
+ * std::shared_ptr<ShotStrategy> makeStrategy(...)
+ *  Make a strategy by name
+ * int findPlacement(const std::string & name)
+ *  Look up a way of placing a fleet (BOT_PLACE_*) by name
+ * void placeFleet(JudgedFleet & fleet, int placement, std::mt19937 & random, std::vector<Ship> * ships)
+ *  Place every ship of a fleet (and say where, for an ACTION_FLEET)
+ * bool botCanPlay(const GameRules & rules)
+ *  Whether a bot will play a game with those rules
+ * int playMatch(const GameRules & rules, const MatchSide sides[2], unsigned int seed, int shots[2])
+ *  Play two computer players against each other in memory, no sockets
+ * int playBotMatch(const GameRules & rules, unsigned int seed, int & shots)
+ *  Play two of the server's bots against each other in memory
+ ***********************************/
+
+#include <vector>
+#include <random>
+#include <memory>
+#include <string>
+#include "GameRules.h"
+#include "Heatmap.h"
+#include "Ship.h"
+
+// ConnRef::reactor of a bot in the name index and lobby list (fd is the
+// bot's number)
+#define BOT_REACTOR -2
+// Bots are named this followed by their number
+#define BOT_NAME_PREFIX "cpu"
+// Biggest board (in spaces) bots play on
+#define BOT_MAX_SPACES 256
+
+// Ways of placing a fleet: anywhere at random, or against the edges of the
+// board where there is room
+#define BOT_PLACE_RANDOM 0
+#define BOT_PLACE_EDGES 1
+// Random spots along the edges tried for a ship before giving up on them
+#define BOT_EDGE_TRIES 32
+
+class ShotStrategy
+{
+public:
+	virtual ~ShotStrategy() {}
+	// Pick the next space to fire at (0 based)
+	virtual void NextShot(short & x, short & y) = 0;
+	// Learn the results of firing at x, y (0 based)
+	virtual void Record(short x, short y, bool hit, short shipSize, bool sink) = 0;
+};
+
+// One side of a match between computer players: its strategy's name and
+// how it places its fleet (BOT_PLACE_*)
+typedef struct
+{
+	std::string strategy;
+	int placement;
+} MatchSide;
+
+class BotBrain : public ShotStrategy
+{
+public:
+	// Nothing fired at yet, on a width by height board with ships of 'sizes'
+	BotBrain(short width, short height, const std::vector<short> & sizes, unsigned int seed);
+	void NextShot(short & x, short & y);
+	void Record(short x, short y, bool hit, short shipSize, bool sink);
+private:
+	// What it knows of the other player's board
+	Heatmap heatmap;
+	std::mt19937 random;
+};
+
+class HuntTarget : public ShotStrategy
+{
+public:
+	// Nothing fired at yet, on a width by height board
+	HuntTarget(short width, short height, unsigned int seed);
+	void NextShot(short & x, short & y);
+	void Record(short x, short y, bool hit, short shipSize, bool sink);
+private:
+	// Queue a space next to a hit, if it is on the board and not fired at
+	void AddTarget(short x, short y);
+	short width;
+	short height;
+	// Spaces fired at (y*width+x)
+	std::vector<bool> fired;
+	// Spaces next to hits, still to try (last first)
+	std::vector<int> targets;
+	std::mt19937 random;
+};
+
+class RandomShots : public ShotStrategy
+{
+public:
+	// Every space of a width by height board, shuffled
+	RandomShots(short width, short height, unsigned int seed);
+	void NextShot(short & x, short & y);
+	void Record(short x, short y, bool hit, short shipSize, bool sink);
+private:
+	short width;
+	// Spaces (y*width+x) in the order they get fired at
+	std::vector<int> order;
+	unsigned int next;
+};
+
+class BotPlayer
+{
+public:
+	// A bot for a game with 'rules', fleet placed at random
+	BotPlayer(const GameRules & rules, unsigned int seed);
+	// The rules of the game
+	const GameRules & GetRules() const;
+	// Where the bot's ships are (shots at the bot are judged against it)
+	JudgedFleet & GetFleet();
+	// What the bot knows of the other player's board
+	BotBrain & GetBrain();
+private:
+	const GameRules & rules;
+	std::shared_ptr<JudgedFleet> fleet;
+	BotBrain brain;
+};
+
+// Make the strategy called 'name' for a game with 'rules', against ships of
+// 'sizes'. nullptr if there isn't one by that name.
+std::shared_ptr<ShotStrategy> makeStrategy(const std::string & name, const GameRules & rules, const std::vector<short> & sizes, unsigned int seed);
+// Look up a way of placing a fleet (BOT_PLACE_*) by name, -1 if unknown
+int findPlacement(const std::string & name);
+// Place every ship of an empty fleet the 'placement' (BOT_PLACE_*) way. Where
+// each one went is added to 'ships' if it isn't nullptr.
+void placeFleet(JudgedFleet & fleet, int placement, std::mt19937 & random, std::vector<Ship> * ships = nullptr);
+// Whether a bot will play a game with 'rules'
+bool botCanPlay(const GameRules & rules);
+// Play two computer players against each other in memory. Returns which one
+// won (0 moves first), with the number of shots each fired in 'shots'.
+int playMatch(const GameRules & rules, const MatchSide sides[2], unsigned int seed, int shots[2]);
+// Play two bots against each other in memory. Returns which one won (0 moves
+// first), with the number of shots fired in 'shots'.
+int playBotMatch(const GameRules & rules, unsigned int seed, int & shots);
@@ -0,0 +1,160 @@
+#include "BufferPool.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the per thread buffer pools.
+ ************************************/
+
+#include "Metrics.h"
+
+/***************************************************************
+* Create an empty pool
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Pool with nothing on its free lists, not counting anything
+****************************************************************/
+BufferPool::BufferPool(): metrics(NULL)
+{
+	
+}
+
+/***************************************************************
+* Free everything on the free lists
+*
+* Preconditions:
+*  Thread that owned the pool is exiting
+* Postcondition:
+*  Free buffers given back to the heap (not counted, the metrics may be gone
+*  by now)
+****************************************************************/
+BufferPool::~BufferPool()
+{
+	for (int i = 0; i < BUFFER_POOL_CLASSES; ++i)
+	{
+		for (auto& buf: freeLists[i])
+		{
+			delete [] buf;
+		}
+		freeLists[i].clear();
+	}
+}
+
+/***************************************************************
+* Get the calling thread's pool
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  pool returned, created the first time a thread asks
+****************************************************************/
+BufferPool & BufferPool::Local()
+{
+	static thread_local BufferPool pool;
+	return pool;
+}
+
+/***************************************************************
+* Size class for 'size' bytes
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  index of the smallest class that holds 'size' bytes returned, or -1 if
+*  it's bigger than all of them
+****************************************************************/
+int BufferPool::ClassFor(unsigned int size)
+{
+	unsigned int classSize = BUFFER_POOL_SMALLEST;
+	for (int i = 0; i < BUFFER_POOL_CLASSES; ++i)
+	{
+		if (size <= classSize)
+		{
+			return i;
+		}
+		classSize *= 4;
+	}
+	return -1;
+}
+
+/***************************************************************
+* Get a buffer of at least 'size' bytes
+*
+* Preconditions:
+*  size > 0
+* Postcondition:
+*  buffer returned (from the free list if there is one), 'capacity' set to how
+*  big it really is. Give it back with Put().
+****************************************************************/
+char * BufferPool::Get(unsigned int size, unsigned int & capacity)
+{
+	int sizeClass = ClassFor(size);
+	if (-1 == sizeClass)
+	{
+		capacity = size;
+		if (metrics)
+		{
+			metrics->PoolHeapAllocated();
+		}
+		return new char[size];
+	}
+	capacity = BUFFER_POOL_SMALLEST << (2 * sizeClass);
+	std::vector<char *> & freeList = freeLists[sizeClass];
+	if (freeList.empty())
+	{
+		if (metrics)
+		{
+			metrics->PoolHeapAllocated();
+		}
+		return new char[capacity];
+	}
+	if (metrics)
+	{
+		metrics->PoolReused();
+	}
+	char * buf = freeList.back();
+	freeList.pop_back();
+	return buf;
+}
+
+/***************************************************************
+* Give back a buffer Get() returned
+*
+* Preconditions:
+*  buf and capacity as Get() returned them (from any thread's pool), buf not
+*  used after this
+* Postcondition:
+*  buf on this pool's free list for its class, or freed if the list is full
+*  or it isn't one of the class sizes
+****************************************************************/
+void BufferPool::Put(char * buf, unsigned int capacity)
+{
+	int sizeClass = ClassFor(capacity);
+	if (-1 != sizeClass && (unsigned int)(BUFFER_POOL_SMALLEST << (2 * sizeClass)) == capacity &&
+		freeLists[sizeClass].size() < BUFFER_POOL_MAX_FREE)
+	{
+		freeLists[sizeClass].push_back(buf);
+		return;
+	}
+	delete [] buf;
+	if (metrics)
+	{
+		metrics->PoolHeapFreed();
+	}
+}
+
+/***************************************************************
+* Count heap allocations, frees and reuses in 'sink'
+*
+* Preconditions:
+*  Called from the thread that owns this pool, sink only written by that
+*  thread (a reactor's Metrics from its own thread), or NULL
+* Postcondition:
+*  Get() and Put() count into sink from now on, or stop counting if NULL
+****************************************************************/
+void BufferPool::CountInto(Metrics * sink)
+{
+	metrics = sink;
+}
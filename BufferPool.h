@@ -0,0 +1,63 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class BufferPool:
+ *  Reuses the buffers connections read names and write lists into, instead
+ *  of going back to the heap for every message. Buffers come in a few size
+ *  classes (BUFFER_POOL_SMALLEST bytes, then 4x bigger each class up), and
+ *  freed ones wait on their class's free list for the next Get().
+ *
+ *  Each thread has its own pool (Local()), so no locking. A buffer can be
+ *  put back into a different thread's pool than the one it came from (when a
+ *  connection moves to another reactor), it is just plain heap memory.
+ *
+ *  A reactor's thread hands its pool the reactor's Metrics (CountInto()),
+ *  so heap allocations, frees and reuses show up on the stats socket and "no
+ *  allocations while playing" can be checked. Other threads' pools don't
+ *  count anything.
+ *
+ * Local()
+ *  The calling thread's pool
+ * Get(unsigned int size, unsigned int & capacity)
+ *  A buffer of at least 'size' bytes
+ * Put(char * buf, unsigned int capacity)
+ *  Give a buffer from Get() back
+ * CountInto(Metrics * sink)
+ *  Count heap allocations, frees and reuses in 'sink' from now on
+ ***********************************/
+
+#include <vector>
+
+class Metrics;
+
+// Smallest buffer handed out, the size classes go up by 4x from here
+#define BUFFER_POOL_SMALLEST 64
+// 64, 256, 1K, 4K, 16K, 64K. Bigger than that goes straight to the heap.
+#define BUFFER_POOL_CLASSES 6
+// Most freed buffers kept per class per thread, past this they go back to the
+// heap
+#define BUFFER_POOL_MAX_FREE 1024
+
+class BufferPool
+{
+public:
+	// Get the calling thread's pool
+	static BufferPool & Local();
+	// Get a buffer of at least 'size' bytes, 'capacity' set to its real size
+	char * Get(unsigned int size, unsigned int & capacity);
+	// Give back a buffer Get() returned (from any thread's pool)
+	void Put(char * buf, unsigned int capacity);
+	// Count heap allocations, frees and reuses in 'sink' (NULL to stop)
+	void CountInto(Metrics * sink);
+	// Free everything on the free lists
+	~BufferPool();
+private:
+	BufferPool();
+	// Size class for 'size' bytes, or -1 if too big for any
+	static int ClassFor(unsigned int size);
+	std::vector<char *> freeLists[BUFFER_POOL_CLASSES];
+	// Owning thread's reactor metrics, NULL if nothing is counted
+	Metrics * metrics;
+};
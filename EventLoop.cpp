@@ -0,0 +1,294 @@
+#include "EventLoop.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the epoll wrapper that drives the server's main loop.
+ ************************************/
+
+extern "C"
+{
+	#include <unistd.h>
+	#include <errno.h>
+	// for perror
+	#include <stdio.h>
+}
+
+/***************************************************************
+* Create the epoll instance (or just track interest if !useEpoll)
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  epoll instance created, nothing being watched. GetFD() returns -1 if the
+*  kernel wouldn't give us one. Without epoll, GetFD() returns -1 and Wait()
+*  can't be used; interest changes are collected for TakeChanged() instead.
+****************************************************************/
+EventLoop::EventLoop(bool UseEpoll): epollFd(-1), useEpoll(UseEpoll)
+{
+	if (!useEpoll)
+	{
+		return;
+	}
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (-1 == epollFd)
+	{
+		perror("Trouble creating the epoll instance");
+	}
+}
+
+/***************************************************************
+* Close the epoll instance
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  epoll fd closed (the watched fds themselves are left alone)
+****************************************************************/
+EventLoop::~EventLoop()
+{
+	if (-1 != epollFd)
+	{
+		close(epollFd);
+		epollFd = -1;
+	}
+}
+
+/***************************************************************
+* Check if interest changes go to epoll
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, false returned for the io_uring backend's loop
+****************************************************************/
+bool EventLoop::UsesEpoll() const
+{
+	return useEpoll;
+}
+
+/***************************************************************
+* Get the epoll fd (-1 if creating it failed)
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, epoll fd returned
+****************************************************************/
+int EventLoop::GetFD() const
+{
+	return epollFd;
+}
+
+/***************************************************************
+* Push the wanted events for 'fd' to the kernel if they changed
+*
+* Preconditions:
+*  fd a valid, open fd
+* Postcondition:
+*  fd registered with epoll for 'events'. No syscall made if that is what
+*  was registered already. Without epoll, fd just noted as changed.
+****************************************************************/
+void EventLoop::SetInterest(int fd, unsigned int events)
+{
+	if (fd < 0)
+	{
+		return;
+	}
+	if ((unsigned int)fd >= interest.size())
+	{
+		interest.resize(fd+1, 0);
+		registered.resize(fd+1, false);
+		inChanged.resize(fd+1, false);
+	}
+	if (registered[fd] && interest[fd] == events)
+	{
+		// Nothing changed, don't bother the kernel
+		return;
+	}
+	if (!useEpoll)
+	{
+		registered[fd] = true;
+		interest[fd] = events;
+		NoteChanged(fd);
+		return;
+	}
+	struct epoll_event event;
+	event.events = events;
+	event.data.u64 = 0;
+	event.data.fd = fd;
+	int op = registered[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (-1 == epoll_ctl(epollFd, op, fd, &event))
+	{
+		// Could have been closed and reopened behind our back, try the other op
+		op = (EPOLL_CTL_MOD == op) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+		if (-1 == epoll_ctl(epollFd, op, fd, &event))
+		{
+			perror("Trouble updating epoll interest");
+			return;
+		}
+	}
+	registered[fd] = true;
+	interest[fd] = events;
+}
+
+/***************************************************************
+* Start watching 'fd' for reads
+*
+* Preconditions:
+*  fd a valid, open fd
+* Postcondition:
+*  Wait() will report fd when it is readable
+****************************************************************/
+void EventLoop::AddRead(int fd)
+{
+	SetInterest(fd, (WantsWrite(fd) ? EPOLLOUT : 0) | EPOLLIN);
+}
+
+/***************************************************************
+* Stop watching 'fd' for reads
+*
+* Preconditions:
+*  fd a valid, open fd
+* Postcondition:
+*  Wait() will no longer report fd being readable
+****************************************************************/
+void EventLoop::RemoveRead(int fd)
+{
+	SetInterest(fd, WantsWrite(fd) ? EPOLLOUT : 0);
+}
+
+/***************************************************************
+* Start watching 'fd' for writes
+*
+* Preconditions:
+*  fd a valid, open fd
+* Postcondition:
+*  Wait() will report fd when it is writable
+****************************************************************/
+void EventLoop::AddWrite(int fd)
+{
+	SetInterest(fd, (WantsRead(fd) ? EPOLLIN : 0) | EPOLLOUT);
+}
+
+/***************************************************************
+* Stop watching 'fd' for writes
+*
+* Preconditions:
+*  fd a valid, open fd
+* Postcondition:
+*  Wait() will no longer report fd being writable
+****************************************************************/
+void EventLoop::RemoveWrite(int fd)
+{
+	SetInterest(fd, WantsRead(fd) ? EPOLLIN : 0);
+}
+
+/***************************************************************
+* Stop watching 'fd' completely
+*
+* Preconditions:
+*  fd not closed yet (closing removes it from epoll anyway, but we still
+*  need to forget our copy of the interest)
+* Postcondition:
+*  fd removed from the epoll set
+****************************************************************/
+void EventLoop::Remove(int fd)
+{
+	if (fd < 0 || (unsigned int)fd >= registered.size() || !registered[fd])
+	{
+		return;
+	}
+	if (useEpoll)
+	{
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+	else
+	{
+		NoteChanged(fd);
+	}
+	registered[fd] = false;
+	interest[fd] = 0;
+}
+
+/***************************************************************
+* Remember that the interest for 'fd' changed
+*
+* Preconditions:
+*  fd within the per-fd vectors
+* Postcondition:
+*  fd in 'changed' (only once)
+****************************************************************/
+void EventLoop::NoteChanged(int fd)
+{
+	if (!inChanged[fd])
+	{
+		inChanged[fd] = true;
+		changed.push_back(fd);
+	}
+}
+
+/***************************************************************
+* Check if 'fd' is being watched for reads
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if fd is watched for reads
+****************************************************************/
+bool EventLoop::WantsRead(int fd) const
+{
+	return fd >= 0 && (unsigned int)fd < interest.size() && (interest[fd] & EPOLLIN);
+}
+
+/***************************************************************
+* Check if 'fd' is being watched for writes
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if fd is watched for writes
+****************************************************************/
+bool EventLoop::WantsWrite(int fd) const
+{
+	return fd >= 0 && (unsigned int)fd < interest.size() && (interest[fd] & EPOLLOUT);
+}
+
+/***************************************************************
+* Wait for ready fds. Returns how many were put in 'events', or -1
+*
+* Preconditions:
+*  events points to at least maxEvents epoll_event structs, timeout in ms or
+*  -1 to wait as long as it takes
+* Postcondition:
+*  Blocks until something is ready or the timeout passes (0 returned then).
+*  Being interrupted by a signal is not an error, 0 is returned in that case
+****************************************************************/
+int EventLoop::Wait(struct epoll_event * events, int maxEvents, int timeout)
+{
+	int readyCount = epoll_wait(epollFd, events, maxEvents, timeout);
+	if (-1 == readyCount && EINTR == errno)
+	{
+		return 0;
+	}
+	return readyCount;
+}
+
+/***************************************************************
+* Get (and forget) the fds whose interest changed, when not using epoll
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  'fds' replaced with the fds whose interest changed since the last call
+*  (each listed once), change list emptied
+****************************************************************/
+void EventLoop::TakeChanged(std::vector<int> & fds)
+{
+	fds.clear();
+	fds.swap(changed);
+	for (auto fd: fds)
+	{
+		inChanged[fd] = false;
+	}
+}
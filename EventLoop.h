@@ -0,0 +1,88 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class EventLoop:
+ *  Wraps an epoll instance for the server. Keeps track of which connections
+ *  want to be told about reads and/or writes, and only hands back the file
+ *  descriptors that are actually ready, so a wakeup costs O(ready fds) instead
+ *  of O(all connections) like select() did.
+ *
+ * AddRead(int fd)/RemoveRead(int fd)
+ *  Start/stop watching 'fd' for being readable (replaces FD_SET/FD_CLR on the
+ *  old read set)
+ * AddWrite(int fd)/RemoveWrite(int fd)
+ *  Start/stop watching 'fd' for being writable (replaces FD_SET/FD_CLR on the
+ *  old write set)
+ * Remove(int fd)
+ *  Forget about 'fd' entirely. Call before closing it.
+ * Wait(struct epoll_event * events, int maxEvents, int timeout)
+ *  Block until at least one fd is ready (or 'timeout' ms pass, -1 for no
+ *  limit), and fill in 'events' with them
+ * TakeChanged(std::vector<int> & fds)
+ *  Only used when the loop was made without epoll (the io_uring backend): get
+ *  the fds whose interest changed since last time, so the caller can queue
+ *  recvs/sends for them itself. The handlers don't need to know which backend
+ *  is running, they call AddRead() etc. either way.
+ ***********************************/
+
+#include <vector>
+
+extern "C"
+{
+	#include <sys/epoll.h>
+}
+
+// Max number of ready fds handed back by one call to EventLoop::Wait
+#define EVENT_LOOP_MAX_EVENTS 256
+
+class EventLoop
+{
+public:
+	// Create the epoll instance (or just track interest if !useEpoll)
+	EventLoop(bool useEpoll = true);
+	// Close the epoll instance
+	~EventLoop();
+	// Get the epoll fd (-1 if creating it failed)
+	int GetFD() const;
+	// Check if interest changes go to epoll (false for the io_uring backend)
+	bool UsesEpoll() const;
+	// Start watching 'fd' for reads
+	void AddRead(int fd);
+	// Stop watching 'fd' for reads
+	void RemoveRead(int fd);
+	// Start watching 'fd' for writes
+	void AddWrite(int fd);
+	// Stop watching 'fd' for writes
+	void RemoveWrite(int fd);
+	// Stop watching 'fd' completely
+	void Remove(int fd);
+	// Check if 'fd' is being watched for reads
+	bool WantsRead(int fd) const;
+	// Check if 'fd' is being watched for writes
+	bool WantsWrite(int fd) const;
+	// Wait for ready fds. Returns how many were put in 'events', or -1
+	int Wait(struct epoll_event * events, int maxEvents, int timeout = -1);
+	// Get (and forget) the fds whose interest changed, when not using epoll
+	void TakeChanged(std::vector<int> & fds);
+private:
+	// Not copyable, it owns the epoll fd
+	EventLoop(const EventLoop & loop);
+	const EventLoop & operator=(const EventLoop & rhs);
+	// Push the wanted events for 'fd' to the kernel if they changed
+	void SetInterest(int fd, unsigned int events);
+	// Remember that the interest for 'fd' changed (when !useEpoll)
+	void NoteChanged(int fd);
+	int epollFd;
+	// Events currently registered for each fd, indexed by fd
+	std::vector<unsigned int> interest;
+	// Whether each fd has been added to the epoll set yet, indexed by fd
+	std::vector<bool> registered;
+	// Whether interest changes go to epoll, or just get recorded in 'changed'
+	bool useEpoll;
+	// fds whose interest changed since the last TakeChanged(), when !useEpoll
+	std::vector<int> changed;
+	// Whether each fd is in 'changed' already, indexed by fd
+	std::vector<bool> inChanged;
+};
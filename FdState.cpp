@@ -1,8 +1,25 @@
 #include "FdState.h"
+#include "BufferPool.h"
 #include <cstring>
+#include <utility>
+#include <algorithm>
 extern "C"
 {
 	#include <unistd.h>
+	#include <errno.h>
+}
+
+/***************************************************************
+* Create an empty state tracker (a free slab slot)
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  Fd state tracker created for no fd, in FD_STATE_FREE
+****************************************************************/
+FdState::FdState(): FdState(-1, FD_STATE_FREE)
+{
+	
 }
 
 /***************************************************************
@@ -13,7 +30,7 @@ extern "C"
 * Postcondition:
 *  Fd state tracker created, with no reads/writes in progress
 ****************************************************************/
-FdState::FdState(int Fd, short State): fd(Fd), state(State), name(""), otherPlayer(nullptr), readPtr(-1), writePtr(-1), readSize(0), writeSize(0), readBuf(nullptr), writeBuf(nullptr), readInProgress(false), writeInProgress(false), lastMoveWin(false)
+FdState::FdState(int Fd, short State): fd(Fd), serial(0), state(State), name(""), otherPlayer({-1, -1, 0}), inviter({-1, -1, 0}), invitee({-1, -1, 0}), listCursor({"", "", 0, 0, false, true}), readPtr(-1), writePtr(0), readSize(0), readBuf(nullptr), readCapacity(0), aheadBuf(nullptr), aheadCapacity(0), aheadStart(0), aheadEnd(0), writeQueue(), writeHead(0), readInProgress(false), writeInProgress(false), lastMoveWin(false), judged(false), fleet(), rules(0), bot(), bytesRead(0), bytesWritten(0), relayStart(0)
 {
 	
 }
@@ -26,21 +43,22 @@ FdState::FdState(int Fd, short State): fd(Fd), state(State), name(""), otherPlay
 * Postcondition:
 *  *this is a copy of 's'
 ****************************************************************/
-FdState::FdState(const FdState & s): fd(s.fd), state(s.state), name(s.name), otherPlayer(s.otherPlayer), readPtr(s.readPtr), writePtr(s.writePtr), readSize(s.readSize), writeSize(s.writeSize), readBuf(nullptr), writeBuf(nullptr), readInProgress(s.readInProgress), writeInProgress(s.writeInProgress), lastMoveWin(s.lastMoveWin)
+FdState::FdState(const FdState & s): fd(s.fd), serial(s.serial), state(s.state), name(s.name), otherPlayer(s.otherPlayer), inviter(s.inviter), invitee(s.invitee), listCursor(s.listCursor), readPtr(s.readPtr), writePtr(s.writePtr), readSize(s.readSize), readBuf(nullptr), readCapacity(0), aheadBuf(nullptr), aheadCapacity(0), aheadStart(0), aheadEnd(0), writeQueue(), writeHead(0), readInProgress(s.readInProgress), writeInProgress(s.writeInProgress), lastMoveWin(s.lastMoveWin), judged(s.judged), fleet(s.fleet), rules(s.rules), bot(s.bot), bytesRead(s.bytesRead), bytesWritten(s.bytesWritten), relayStart(s.relayStart)
 {
-	// deep copy these two
-	//char * readBuf;
-	//char * writeBuf;
-	if (s.readBuf)
-	{
-		this->readBuf = new char[this->readSize];
-		memmove(this->readBuf, s.readBuf, this->readSize);
-	}
-	if (s.writeBuf)
-	{
-		this->writeBuf = new char[this->writeSize];
-		memmove(this->writeBuf, s.writeBuf, this->writeSize);
-	}
+	CopyBuffers(s);
+}
+
+/***************************************************************
+* Take over another state class's buffers instead of copying them
+* 
+* Preconditions:
+*  's' is a valid FdState object that is about to be thrown away or reused
+* Postcondition:
+*  *this is what 's' was, 's' left with no buffers
+****************************************************************/
+FdState::FdState(FdState && s): fd(s.fd), serial(s.serial), state(s.state), name(std::move(s.name)), otherPlayer(s.otherPlayer), inviter(s.inviter), invitee(s.invitee), listCursor(std::move(s.listCursor)), readPtr(s.readPtr), writePtr(s.writePtr), readSize(s.readSize), readBuf(nullptr), readCapacity(0), aheadBuf(nullptr), aheadCapacity(0), aheadStart(0), aheadEnd(0), writeQueue(), writeHead(0), readInProgress(s.readInProgress), writeInProgress(s.writeInProgress), lastMoveWin(s.lastMoveWin), judged(s.judged), fleet(std::move(s.fleet)), rules(s.rules), bot(std::move(s.bot)), bytesRead(s.bytesRead), bytesWritten(s.bytesWritten), relayStart(s.relayStart)
+{
+	TakeBuffers(s);
 }
 
 /***************************************************************
@@ -53,41 +71,79 @@ FdState::FdState(const FdState & s): fd(s.fd), state(s.state), name(s.name), oth
 ****************************************************************/
 const FdState & FdState::operator=(const FdState & rhs)
 {
+	if (this == &rhs)
+	{
+		return *this;
+	}
 	this->fd = rhs.fd;
+	this->serial = rhs.serial;
 	this->state = rhs.state;
 	this->name = rhs.name;
 	this->otherPlayer = rhs.otherPlayer;
+	this->inviter = rhs.inviter;
+	this->invitee = rhs.invitee;
+	this->listCursor = rhs.listCursor;
 	this->readPtr = rhs.readPtr;
 	this->writePtr = rhs.writePtr;
 	this->readSize = rhs.readSize;
-	this->writeSize = rhs.writeSize;
 	this->readInProgress = rhs.readInProgress;
 	this->writeInProgress = rhs.writeInProgress;
 	this->lastMoveWin = rhs.lastMoveWin;
+	this->judged = rhs.judged;
+	this->fleet = rhs.fleet;
+	this->rules = rhs.rules;
+	this->bot = rhs.bot;
+	this->bytesRead = rhs.bytesRead;
+	this->bytesWritten = rhs.bytesWritten;
+	this->relayStart = rhs.relayStart;
 	// If any memory is currently allocated, free it
-	if (this->readBuf)
-	{
-		delete [] this->readBuf;
-		this->readBuf = nullptr;
-	}
-	// If any memory is currently allocated, free it
-	if (this->writeBuf)
-	{
-		delete [] this->writeBuf;
-		this->writeBuf = nullptr;
-	}
+	ReleaseBuffer(readBuf, readCapacity);
+	ReleaseBuffer(aheadBuf, aheadCapacity);
+	ClearWrites();
 	// If any memory is currently allocated in the source, copy it
-	if (rhs.readBuf)
-	{
-		this->readBuf = new char[this->readSize];
-		memmove(this->readBuf, rhs.readBuf, this->readSize);
-	}
-	// If any memory is currently allocated in the source, copy it
-	if (rhs.writeBuf)
+	CopyBuffers(rhs);
+	return *this;
+}
+
+/***************************************************************
+* Set one state tracking class equal to another, taking its buffers
+* 
+* Preconditions:
+*  rhs a valid FdState object that is about to be thrown away or reused
+* Postcondition:
+*  *this set to what rhs was, our old buffers freed, rhs left with no buffers
+****************************************************************/
+const FdState & FdState::operator=(FdState && rhs)
+{
+	if (this == &rhs)
 	{
-		this->writeBuf = new char[this->writeSize];
-		memmove(this->writeBuf, rhs.writeBuf, this->writeSize);
+		return *this;
 	}
+	this->fd = rhs.fd;
+	this->serial = rhs.serial;
+	this->state = rhs.state;
+	this->name = std::move(rhs.name);
+	this->otherPlayer = rhs.otherPlayer;
+	this->inviter = rhs.inviter;
+	this->invitee = rhs.invitee;
+	this->listCursor = std::move(rhs.listCursor);
+	this->readPtr = rhs.readPtr;
+	this->writePtr = rhs.writePtr;
+	this->readSize = rhs.readSize;
+	this->readInProgress = rhs.readInProgress;
+	this->writeInProgress = rhs.writeInProgress;
+	this->lastMoveWin = rhs.lastMoveWin;
+	this->judged = rhs.judged;
+	this->fleet = std::move(rhs.fleet);
+	this->rules = rhs.rules;
+	this->bot = std::move(rhs.bot);
+	this->bytesRead = rhs.bytesRead;
+	this->bytesWritten = rhs.bytesWritten;
+	this->relayStart = rhs.relayStart;
+	ReleaseBuffer(readBuf, readCapacity);
+	ReleaseBuffer(aheadBuf, aheadCapacity);
+	ClearWrites();
+	TakeBuffers(rhs);
 	return *this;
 }
 
@@ -103,16 +159,154 @@ FdState::~FdState()
 {
 	readInProgress = false;
 	readSize = 0;
-	// delete on nullptr is safe so no check
-	delete [] readBuf;
-	readBuf = nullptr;
+	ReleaseBuffer(readBuf, readCapacity);
+	ReleaseBuffer(aheadBuf, aheadCapacity);
 	readPtr = -1;
 	writeInProgress = false;
-	writeSize = 0;
-	// delete on nullptr is safe so no check
-	delete [] writeBuf;
-	writeBuf = nullptr;
-	writePtr = -1;
+	ClearWrites();
+}
+
+/***************************************************************
+* Make 'buf' big enough for 'size' bytes
+* 
+* Preconditions:
+*  buf and capacity one of our buffer pairs, inlineBuf the matching inline
+*  buffer
+* Postcondition:
+*  buf points at the inline buffer if 'size' fits in it, otherwise at a pool
+*  buffer of at least 'size' bytes (kept if it already was one that big).
+*  Contents not kept.
+****************************************************************/
+void FdState::ReserveBuffer(char *& buf, unsigned int & capacity, char * inlineBuf, short size)
+{
+	if (size <= FD_STATE_INLINE_BUFFER)
+	{
+		ReleaseBuffer(buf, capacity);
+		buf = inlineBuf;
+		return;
+	}
+	if (capacity >= (unsigned int)size)
+	{
+		return;
+	}
+	ReleaseBuffer(buf, capacity);
+	buf = BufferPool::Local().Get(size, capacity);
+}
+
+/***************************************************************
+* Let go of 'buf'
+* 
+* Preconditions:
+*  buf and capacity one of our buffer pairs
+* Postcondition:
+*  pool buffer (capacity > 0) given back to this thread's pool, buf nullptr
+*  and capacity 0
+****************************************************************/
+void FdState::ReleaseBuffer(char *& buf, unsigned int & capacity)
+{
+	if (capacity > 0)
+	{
+		BufferPool::Local().Put(buf, capacity);
+	}
+	buf = nullptr;
+	capacity = 0;
+}
+
+/***************************************************************
+* Copy another state class's buffers
+* 
+* Preconditions:
+*  our buffers released and write queue empty, sizes already copied from s
+* Postcondition:
+*  our buffers, read-ahead bytes and queued writes hold the same bytes as
+*  s's (in our own storage, shared writes still shared)
+****************************************************************/
+void FdState::CopyBuffers(const FdState & s)
+{
+	if (s.readBuf && readSize > 0)
+	{
+		ReserveBuffer(readBuf, readCapacity, readInline, readSize);
+		memcpy(readBuf, s.readBuf, readSize);
+	}
+	aheadStart = 0;
+	aheadEnd = 0;
+	if (s.HasBufferedRead())
+	{
+		aheadBuf = BufferPool::Local().Get(FD_STATE_READ_AHEAD, aheadCapacity);
+		aheadEnd = s.aheadEnd - s.aheadStart;
+		memcpy(aheadBuf, s.aheadBuf + s.aheadStart, aheadEnd);
+	}
+	for (unsigned int i = s.writeHead; i < s.writeQueue.size(); ++i)
+	{
+		const WriteSegment & segment = s.writeQueue[i];
+		if (segment.shared)
+		{
+			QueueWriteShared(segment.shared);
+		}
+		else
+		{
+			QueueWrite(SegmentData(segment), segment.size);
+		}
+	}
+	writePtr = s.writePtr;
+}
+
+/***************************************************************
+* Take over another state class's buffers
+* 
+* Preconditions:
+*  our buffers released and write queue empty
+* Postcondition:
+*  pool buffers, read-ahead bytes and queued writes moved over as is, inline
+*  read buffer copied into ours, s left with no buffers or writes
+****************************************************************/
+void FdState::TakeBuffers(FdState & s)
+{
+	if (s.readBuf == s.readInline)
+	{
+		memcpy(readInline, s.readInline, FD_STATE_INLINE_BUFFER);
+		readBuf = readInline;
+	}
+	else
+	{
+		readBuf = s.readBuf;
+		readCapacity = s.readCapacity;
+	}
+	aheadBuf = s.aheadBuf;
+	aheadCapacity = s.aheadCapacity;
+	aheadStart = s.aheadStart;
+	aheadEnd = s.aheadEnd;
+	writeQueue.swap(s.writeQueue);
+	writeHead = s.writeHead;
+	s.readBuf = nullptr;
+	s.readCapacity = 0;
+	s.aheadBuf = nullptr;
+	s.aheadCapacity = 0;
+	s.aheadStart = 0;
+	s.aheadEnd = 0;
+	s.writeHead = 0;
+	s.writePtr = 0;
+}
+
+/***************************************************************
+* Give back every queued write's buffer and empty the queue
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  pool buffers returned to this thread's pool, shared buffers let go of,
+*  queue empty (keeping its room)
+****************************************************************/
+void FdState::ClearWrites()
+{
+	for (auto& segment: writeQueue)
+	{
+		ReleaseBuffer(segment.pooled, segment.capacity);
+		segment.shared.reset();
+	}
+	writeQueue.clear();
+	writeHead = 0;
+	writePtr = 0;
 }
 
 /***************************************************************
@@ -154,6 +348,167 @@ bool FdState::GetLastMoveWin()
 	return lastMoveWin;
 }
 
+/***************************************************************
+* Set whether the player asked for the server to judge shots at their fleet
+* in their next game
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  judged flag saved
+****************************************************************/
+void FdState::SetJudged(bool Judged)
+{
+	this->judged = Judged;
+}
+
+/***************************************************************
+* Check if the player asked for the server to judge shots at their fleet
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, judged flag returned
+****************************************************************/
+bool FdState::GetJudged() const
+{
+	return judged;
+}
+
+/***************************************************************
+* Set the fleet shots at this player are judged against
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  fleet saved (nullptr to go back to the clients judging shots)
+****************************************************************/
+void FdState::SetFleet(const std::shared_ptr<JudgedFleet> & Fleet)
+{
+	this->fleet = Fleet;
+}
+
+/***************************************************************
+* Get the fleet shots at this player are judged against
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, fleet returned (nullptr if the other player's client
+*  judges the shots)
+****************************************************************/
+JudgedFleet * FdState::GetFleet() const
+{
+	return fleet.get();
+}
+
+/***************************************************************
+* Set the rules of the game this player asked for or was invited to
+* 
+* Preconditions:
+*  rules one of the GAME_RULES_* numbers
+* Postcondition:
+*  rules saved
+****************************************************************/
+void FdState::SetRules(unsigned char Rules)
+{
+	this->rules = Rules;
+}
+
+/***************************************************************
+* Get the rules of the game this player asked for or was invited to
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, rules returned
+****************************************************************/
+unsigned char FdState::GetRules() const
+{
+	return rules;
+}
+
+/***************************************************************
+* Set the bot this player is playing against
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  bot saved (nullptr once the game is over)
+****************************************************************/
+void FdState::SetBot(const std::shared_ptr<BotPlayer> & Bot)
+{
+	this->bot = Bot;
+}
+
+/***************************************************************
+* Get the bot this player is playing against
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, bot returned (empty if not playing one)
+****************************************************************/
+const std::shared_ptr<BotPlayer> & FdState::GetBot() const
+{
+	return bot;
+}
+
+/***************************************************************
+* Get how many bytes have been read from the connection
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, bytes that reads have taken (from the socket or
+*  handed over with ReadFrom()) since the connection was accepted returned.
+*  Bytes read ahead count once a read takes them.
+****************************************************************/
+uint64_t FdState::GetBytesRead() const
+{
+	return bytesRead;
+}
+
+/***************************************************************
+* Get how many bytes have been written to the connection
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, bytes that went out since the connection was accepted
+*  returned
+****************************************************************/
+uint64_t FdState::GetBytesWritten() const
+{
+	return bytesWritten;
+}
+
+/***************************************************************
+* Set when the frame being relayed to this player was read
+* 
+* Preconditions:
+*  start from metricsNow(), or 0
+* Postcondition:
+*  start saved, until the relay's write finishes
+****************************************************************/
+void FdState::SetRelayStart(uint64_t start)
+{
+	this->relayStart = start;
+}
+
+/***************************************************************
+* Get when the frame being relayed to this player was read
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, time returned (0 if nothing is being relayed)
+****************************************************************/
+uint64_t FdState::GetRelayStart() const
+{
+	return relayStart;
+}
+
 /***************************************************************
 * Get the Fd that is wrapped in this state class
 * 
@@ -167,6 +522,32 @@ int FdState::GetFD() const
 	return fd;
 }
 
+/***************************************************************
+* Get the number that is unique to this connection (even if the fd is reused)
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, serial number returned (0 if never set)
+****************************************************************/
+unsigned int FdState::GetSerial() const
+{
+	return serial;
+}
+
+/***************************************************************
+* Set the number that is unique to this connection
+* 
+* Preconditions:
+*  Serial not handed out to any other connection
+* Postcondition:
+*  serial number saved
+****************************************************************/
+void FdState::SetSerial(unsigned int Serial)
+{
+	this->serial = Serial;
+}
+
 /***************************************************************
 * Get the state that this connection is in
 * 
@@ -220,64 +601,205 @@ std::string FdState::GetName() const
 }
 
 /***************************************************************
-* Get a pointer to the other player in the game (only valid 
-* while connection is participating in a game -- otherwise nullptr)
+* Get a handle to the other player in the game (only valid 
+* while connection is participating in a game)
 * 
 * Preconditions:
-*  Connection is participating in a game (or the caller is checking for a
-*  nullptr return)
+*  Connection is participating in a game (or the caller checks what the
+*  handle finds)
 * Postcondition:
-*  No object changes, pointer to other player object returned or nullptr
+*  No object changes, handle to other player returned. Its serial is 0 if
+*  there isn't one, and it finds nothing once they are gone.
 ****************************************************************/
-FdState * FdState::GetOtherPlayer() const
+ConnRef FdState::GetOtherPlayer() const
 {
 	return otherPlayer;
 }
 
 /***************************************************************
-* Set the pointer to the other player in the game (only valid 
-* while connection is participating in a game -- otherwise should be reset
-* to nullptr)
+* Check if we are paired with another player
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if an other player handle is set (they
+*  may have gone away since)
+****************************************************************/
+bool FdState::HasOtherPlayer() const
+{
+	return 0 != otherPlayer.serial;
+}
+
+/***************************************************************
+* Set the handle to the other player in the game (only valid 
+* while connection is participating in a game -- otherwise should be
+* cleared)
 * 
 * Preconditions:
-*  other a valid pointer to another connection participating in a game (or null)
+*  other a handle to another connection participating in a game
 * Postcondition:
-*  saved other player connection pointer updated
+*  saved other player handle updated
 ****************************************************************/
-void FdState::SetOtherPlayer(FdState * other)
+void FdState::SetOtherPlayer(const ConnRef & other)
 {
 	this->otherPlayer = other;
 }
 
+/***************************************************************
+* Forget about the other player
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  other player handle cleared
+****************************************************************/
+void FdState::ClearOtherPlayer()
+{
+	this->otherPlayer = {-1, -1, 0};
+}
+
+/***************************************************************
+* Get where the player that invited us lives (only valid while answering
+* an invitation or waiting for the inviter to join the game)
+* 
+* Preconditions:
+*  Connection was sent an invitation (or caller checks for a -1 reactor)
+* Postcondition:
+*  No object changes, reference to the inviting connection returned
+****************************************************************/
+ConnRef FdState::GetInviter() const
+{
+	return inviter;
+}
+
+/***************************************************************
+* Remember where the player that invited us lives
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  saved inviter reference updated
+****************************************************************/
+void FdState::SetInviter(const ConnRef & Inviter)
+{
+	this->inviter = Inviter;
+}
+
+/***************************************************************
+* Get where the player we invited lives (only valid while waiting for
+* their answer)
+* 
+* Preconditions:
+*  Connection is in FD_STATE_REQD_GAME
+* Postcondition:
+*  No object changes, reference to the invited player returned
+****************************************************************/
+ConnRef FdState::GetInvitee() const
+{
+	return invitee;
+}
+
+/***************************************************************
+* Remember where the player we invited lives
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  saved invitee reference updated
+****************************************************************/
+void FdState::SetInvitee(const ConnRef & Invitee)
+{
+	this->invitee = Invitee;
+}
+
+/***************************************************************
+* Get how far along sending a players page is
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  cursor returned, changes to it are kept
+****************************************************************/
+ListCursor & FdState::GetListCursor()
+{
+	return listCursor;
+}
+
 /***************************************************************
 * Reads once and returns true if that's all we were trying to get
 * 
 * Preconditions:
 *  SetRead called since the last time this returned 1
 * Postcondition:
-*  returns 0 if some, but not all data was successfully read
+*  Bytes already read ahead used first. Only if there are none, one read()
+*  of up to FD_STATE_READ_AHEAD bytes is made, and whatever this read
+*  doesn't want is kept for the next ones.
+*  returns 0 if some, but not all data was successfully read (or nothing was
+*   ready yet on a non-blocking socket)
 *  returns 1 if the rest of the data was successfully read
 *  returns -2 if we hit the end of the file
-*  returns -3 of there was some other error
+*  returns -3 of there was some other error (or no read was set up)
 ****************************************************************/
 int FdState::Read()
 {
-	int readCount = read(fd, readBuf+readPtr, readSize-readPtr);
-	if (readCount > 0)
+	if (ReadRemaining() <= 0)
 	{
-		readPtr += readCount;
-		if (readPtr == readSize)
+		return -3;
+	}
+	if (!HasBufferedRead())
+	{
+		int fillResult = FillReadAhead();
+		if (1 != fillResult)
 		{
-			readInProgress = false;
-			return 1;
+			return fillResult;
 		}
-		return 0;
+	}
+	int count = std::min<int>(ReadRemaining(), aheadEnd - aheadStart);
+	int readResult = ReadFrom(aheadBuf + aheadStart, count);
+	aheadStart += count;
+	if (aheadStart == aheadEnd)
+	{
+		aheadStart = 0;
+		aheadEnd = 0;
+	}
+	return readResult;
+}
+
+/***************************************************************
+* Read whatever the socket has into the empty read-ahead buffer
+* 
+* Preconditions:
+*  No bytes read ahead
+* Postcondition:
+*  read-ahead buffer taken from the pool the first time
+*  returns 1 if some bytes were read
+*  returns 0 if nothing was ready yet on a non-blocking socket
+*  returns -2 if we hit the end of the file
+*  returns -3 of there was some other error
+****************************************************************/
+int FdState::FillReadAhead()
+{
+	if (nullptr == aheadBuf)
+	{
+		aheadBuf = BufferPool::Local().Get(FD_STATE_READ_AHEAD, aheadCapacity);
+	}
+	int readCount = read(fd, aheadBuf, aheadCapacity);
+	if (readCount > 0)
+	{
+		aheadStart = 0;
+		aheadEnd = readCount;
+		return 1;
 	}
 	else if (readCount == 0)
 	{
 		// End of file
 		return -2;
 	}
+	else if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+	{
+		// Non-blocking socket wasn't actually ready, try again later
+		return 0;
+	}
 	else
 	{
 		// Error
@@ -286,35 +808,59 @@ int FdState::Read()
 }
 
 /***************************************************************
-* Writes once and returns true if that's all we were trying to write
+* Check if bytes were read ahead that no read has asked for yet
 * 
 * Preconditions:
-*  SetWrite called since the last time this returned 1
+*  None
+* Postcondition:
+*  No object changes, true returned if Read() would use them instead of
+*  going to the socket
+****************************************************************/
+bool FdState::HasBufferedRead() const
+{
+	return aheadStart < aheadEnd;
+}
+
+/***************************************************************
+* Writes once (everything queued, as far as the socket takes it) and returns
+* true if the queue is empty after
+* 
+* Preconditions:
+*  QueueWrite or QueueWriteShared called since the last time this returned 1
 *  
 * Postcondition:
-*  returns 0 if some, but not all data was successfully written
+*  Up to FD_STATE_MAX_IOV queued messages handed to one writev(), the ones
+*  that went out all the way dropped from the queue
+*  returns 0 if some, but not all data was successfully written (or the
+*   non-blocking socket had no room yet)
 *  returns 1 if the rest of the data was successfully written
 *  returns -2 if we hit the end of the file
 *  returns -3 of there was some other error
 ****************************************************************/
 int FdState::Write()
 {
-	int writeCount = write(fd, writeBuf+writePtr, writeSize-writePtr);
+	struct iovec iov[FD_STATE_MAX_IOV];
+	int iovCount = GetWriteRemaining(iov, FD_STATE_MAX_IOV);
+	if (0 == iovCount)
+	{
+		writeInProgress = false;
+		return 1;
+	}
+	int writeCount = writev(fd, iov, iovCount);
 	if (writeCount > 0)
 	{
-		writePtr += writeCount;
-		if (writePtr == writeSize)
-		{
-			writeInProgress = false;
-			return 1;
-		}
-		return 0;
+		return Wrote(writeCount);
 	}
 	else if (writeCount == 0)
 	{
 		// End of file
 		return -2;
 	}
+	else if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+	{
+		// Non-blocking socket wasn't actually ready, try again later
+		return 0;
+	}
 	else
 	{
 		// Error
@@ -323,30 +869,210 @@ int FdState::Write()
 }
 
 /***************************************************************
-* Set up what we want to write
+* Take bytes that were already received for us (io_uring backend)
 * 
 * Preconditions:
-*  Write not already in progress, 'size' the number of bytes to transfer, 'buff'
-*   a pointer to the data to write
+*  SetRead called since the last time this (or Read()) returned 1, 
+*  0 < count <= ReadRemaining()
 * Postcondition:
-*  Connection set up to be ready to write data with ::Write(), data in 'buff'
-*  copied to internal buffer
+*  data copied into the read buffer
+*  returns 0 if more data is still wanted
+*  returns 1 if that completed the read
 ****************************************************************/
-void FdState::SetWrite(const char * buff, short size)
+int FdState::ReadFrom(const char * data, int count)
 {
-	if (size > 0)
+	memcpy(readBuf+readPtr, data, count);
+	readPtr += count;
+	bytesRead += count;
+	if (readPtr == readSize)
+	{
+		readInProgress = false;
+		return 1;
+	}
+	return 0;
+}
+
+/***************************************************************
+* How many more bytes the current read wants
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, byte count returned (0 if the read is complete or
+*  there never was one)
+****************************************************************/
+int FdState::ReadRemaining() const
+{
+	if (readPtr < 0)
+	{
+		return 0;
+	}
+	return readSize - readPtr;
+}
+
+/***************************************************************
+* Point 'iov' at the queued bytes that haven't gone out yet
+* 
+* Preconditions:
+*  iov has room for 'max' entries
+* Postcondition:
+*  No object changes. First 'max' queued messages (less what has already
+*  been written of the first one) filled into iov in order, how many returned
+*  (0 if nothing is queued). Warning: pointers invalidated by QueueWrite(),
+*  Write() and Wrote()
+****************************************************************/
+int FdState::GetWriteRemaining(struct iovec * iov, int max) const
+{
+	int count = 0;
+	for (unsigned int i = writeHead; i < writeQueue.size() && count < max; ++i)
 	{
-		writeSize = size;
-		if (writeBuf != nullptr)
+		const WriteSegment & segment = writeQueue[i];
+		// Only the first one can be partly written
+		short skip = (i == writeHead) ? writePtr : 0;
+		iov[count].iov_base = (void *)(SegmentData(segment) + skip);
+		iov[count].iov_len = segment.size - skip;
+		++count;
+	}
+	return count;
+}
+
+/***************************************************************
+* Note that 'count' bytes were written for us
+* 
+* Preconditions:
+*  0 < count <= the total size GetWriteRemaining() gave
+* Postcondition:
+*  messages that went out all the way dropped from the queue
+*  returns 0 if there is still more to write
+*  returns 1 if the rest of the data has been written
+****************************************************************/
+int FdState::Wrote(int count)
+{
+	bytesWritten += count;
+	while (count > 0 && writeHead < writeQueue.size())
+	{
+		int left = writeQueue[writeHead].size - writePtr;
+		if (count < left)
 		{
-			delete [] writeBuf;
+			writePtr += count;
+			return 0;
 		}
-		writeBuf = new char[size];
-		writePtr = 0;
-		for (int i=0; i < size; ++i)
+		count -= left;
+		PopWrite();
+	}
+	if (HasWrite())
+	{
+		return 0;
+	}
+	writeInProgress = false;
+	return 1;
+}
+
+/***************************************************************
+* Check if anything is waiting to be written
+* 
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if the outbound queue isn't empty
+****************************************************************/
+bool FdState::HasWrite() const
+{
+	return writeHead < writeQueue.size();
+}
+
+/***************************************************************
+* Add a message to the end of what we want to write
+* 
+* Preconditions:
+*  'size' the number of bytes to transfer, 'buff' a pointer to the data to
+*  write
+* Postcondition:
+*  Data in 'buff' copied to the end of the outbound queue (inline for fixed
+*  frames, from the pool otherwise), to go out with ::Write() after
+*  everything queued before it
+****************************************************************/
+void FdState::QueueWrite(const char * buff, short size)
+{
+	if (size > 0)
+	{
+		writeQueue.emplace_back();
+		WriteSegment & segment = writeQueue.back();
+		segment.size = size;
+		char * bytes = segment.inlineBytes;
+		if (size > FD_STATE_INLINE_BUFFER)
 		{
-			writeBuf[i] = buff[i];
+			segment.pooled = BufferPool::Local().Get(size, segment.capacity);
+			bytes = segment.pooled;
 		}
+		memcpy(bytes, buff, size);
+		writeInProgress = true;
+	}
+}
+
+/***************************************************************
+* Add all of 'buff' to the end of what we want to write without copying it
+* 
+* Preconditions:
+*  buff not empty and shorter than 32K
+* Postcondition:
+*  buff (not a copy) queued to go out with ::Write() after everything queued
+*  before it, held on to until it has been written
+****************************************************************/
+void FdState::QueueWriteShared(const std::shared_ptr<const std::string> & buff)
+{
+	if (buff && !buff->empty())
+	{
+		writeQueue.emplace_back();
+		WriteSegment & segment = writeQueue.back();
+		segment.shared = buff;
+		segment.size = (unsigned short)buff->length();
+		writeInProgress = true;
+	}
+}
+
+/***************************************************************
+* Where a queued message's bytes are
+* 
+* Preconditions:
+*  segment one of our queued writes
+* Postcondition:
+*  Shared buffer's bytes returned if it came from QueueWriteShared(),
+*  otherwise its pool buffer or inline bytes
+****************************************************************/
+const char * FdState::SegmentData(const WriteSegment & segment)
+{
+	if (segment.shared)
+	{
+		return segment.shared->data();
+	}
+	if (segment.capacity > 0)
+	{
+		return segment.pooled;
+	}
+	return segment.inlineBytes;
+}
+
+/***************************************************************
+* Drop the first queued message
+* 
+* Preconditions:
+*  HasWrite()
+* Postcondition:
+*  its buffer given back, queue emptied (keeping its room) if that was the
+*  last one
+****************************************************************/
+void FdState::PopWrite()
+{
+	WriteSegment & segment = writeQueue[writeHead];
+	ReleaseBuffer(segment.pooled, segment.capacity);
+	segment.shared.reset();
+	++writeHead;
+	writePtr = 0;
+	if (writeHead == writeQueue.size())
+	{
+		writeQueue.clear();
+		writeHead = 0;
 	}
 }
 
@@ -363,11 +1089,7 @@ void FdState::SetRead(short size)
 	if (size > 0)
 	{
 		readSize = size;
-		if (readBuf != nullptr)
-		{
-			delete [] readBuf;
-		}
-		readBuf = new char[size];
+		ReserveBuffer(readBuf, readCapacity, readInline, size);
 		readPtr = 0;
 	}
 }
@@ -11,7 +11,30 @@
 
 // Store things like username
 #include <string>
+// Writes straight out of a buffer other connections share
+#include <memory>
+// Outbound queue
+#include <vector>
+extern "C"
+{
+	// struct iovec, for handing the queue to writev()
+	#include <sys/uio.h>
+	#include <stdint.h>
+}
+
+// Reads and writes up to this many bytes (every fixed size frame) use a
+// buffer inside the FdState, bigger ones borrow from the BufferPool
+#define FD_STATE_INLINE_BUFFER 8
+// Most queued messages handed to one writev()
+#define FD_STATE_MAX_IOV 16
+// Bytes asked of the socket per read(), so several pipelined frames come in
+// with one syscall and get parsed from the read-ahead buffer
+#define FD_STATE_READ_AHEAD 256
+// Most frames parsed for one connection before the others get a turn
+#define FD_STATE_READ_BUDGET 16
 
+// Slot in a reactor's connection slab that isn't holding a connection
+#define FD_STATE_FREE -1
 #define FD_STATE_ACCEPT_SOCK 0
 // Reads coming out of FD_STATE_ANON will be 32 bits
 // Connected, reading requested name length
@@ -49,10 +72,72 @@
 #define FD_STATE_GAME_INVITE 17
 // Waiting/reading response to game invitation
 #define FD_STATE_GAME_INVITE_RESP_WAIT 18
+// Reading the offset/limit and prefix of a players page request
+#define FD_STATE_PAGE_REQ_READ 19
+// Players page was requested from lobby state, writing it one chunk at a time
+#define FD_STATE_REQ_NAME_PAGE 20
+// Reading the fleet of a player that asked for a judged game and moves first
+// (the invitee). Goes to FD_STATE_GAME_WAIT_THISFD_MOVE after.
+#define FD_STATE_GAME_FLEET_READ_FIRST 21
+// Reading the fleet of a player that asked for a judged game and moves second
+// (the inviter). Goes to FD_STATE_GAME_WAIT_OFD_MOVE after.
+#define FD_STATE_GAME_FLEET_READ_SECOND 22
+// Writing the results the server worked out for this connection's shot
+#define FD_STATE_GAME_JUDGED_RESULTS 23
+// Writing the other player's shot, which the server already judged against
+// this connection's fleet. This connection's turn (or the lobby) is next.
+#define FD_STATE_GAME_JUDGED_SHOT 24
+
+// Where to find a connection that may live on another reactor thread. 'serial'
+// tells a reused fd apart from the connection that used to have it, so a
+// ConnRef kept after its connection closes just stops finding anything.
+typedef struct connRef
+{
+	int reactor;
+	int fd;
+	unsigned int serial;
+} ConnRef;
+
+// How far along sending a players page is, so it can be sent a chunk at a
+// time without building all of it first
+typedef struct listCursor
+{
+	// Only players whose names start with this
+	std::string prefix;
+	// Last name sent (or skipped), empty before the first
+	std::string after;
+	// Matching players still to skip before sending any
+	unsigned int skip;
+	// Players still to send, if limited
+	unsigned int left;
+	bool limited;
+	// Last chunk of the page has been written
+	bool done;
+} ListCursor;
+
+// Fleet the server judges shots against
+class JudgedFleet;
+// Computer player the server plays a game against
+class BotPlayer;
+
+// One message waiting in a connection's outbound queue
+typedef struct writeSegment
+{
+	// Pool buffer holding the bytes if they didn't fit inline, else nullptr
+	char * pooled;
+	// Size of the pool buffer, 0 if not using one
+	unsigned int capacity;
+	// Holds the bytes instead when queued with QueueWriteShared()
+	std::shared_ptr<const std::string> shared;
+	unsigned short size;
+	char inlineBytes[FD_STATE_INLINE_BUFFER];
+} WriteSegment;
 
 class FdState
 {
 public:
+	// Create an empty state tracker (a free slab slot)
+	FdState();
 	// Create a new state tracker for 'fd', starting in 'state'
 	FdState(int fd, short state);
 	// Clean up the state tracking class
@@ -61,8 +146,16 @@ public:
 	const FdState & operator=(const FdState & rhs);
 	// Copy contruct a state class
 	FdState(const FdState & s);
+	// Take over another state class's buffers instead of copying them
+	FdState(FdState && s);
+	// Set one state tracking class equal to another, taking its buffers
+	const FdState & operator=(FdState && rhs);
 	// Get the Fd that is wrapped in this state class
 	int GetFD() const;
+	// Get the number that is unique to this connection (even if the fd is reused)
+	unsigned int GetSerial() const;
+	// Set the number that is unique to this connection
+	void SetSerial(unsigned int serial);
 	// Get the state that this connection is in
 	short GetState() const;
 	// Set the state that this connection is in
@@ -71,19 +164,56 @@ public:
 	void SetName(const std::string& name);
 	// Get the username of the player that is connected
 	std::string GetName() const;
-	// Get a pointer to the other player in the game (only valid 
-	// while connection is participating in a game -- otherwise nullptr)
-	FdState * GetOtherPlayer() const;
-	// Set the pointer to the other player in the game (only valid 
-	// while connection is participating in a game -- otherwise should be reset
-	// to nullptr)
-	void SetOtherPlayer(FdState * other);
-	// Reads once and returns true if that's all we were trying to get
+	// Get a handle to the other player in the game (only valid 
+	// while connection is participating in a game -- look it up with
+	// Reactor::Find(), which gives nullptr if they are gone)
+	ConnRef GetOtherPlayer() const;
+	// Check if we are paired with another player
+	bool HasOtherPlayer() const;
+	// Set the handle to the other player in the game (only valid 
+	// while connection is participating in a game -- otherwise should be
+	// cleared)
+	void SetOtherPlayer(const ConnRef & other);
+	// Forget about the other player
+	void ClearOtherPlayer();
+	// Get where the player that invited us lives (only valid while answering
+	// an invitation or waiting for the inviter to join the game)
+	ConnRef GetInviter() const;
+	// Remember where the player that invited us lives
+	void SetInviter(const ConnRef & inviter);
+	// Get where the player we invited lives (only valid while waiting for
+	// their answer)
+	ConnRef GetInvitee() const;
+	// Remember where the player we invited lives
+	void SetInvitee(const ConnRef & invitee);
+	// Get how far along sending a players page is
+	ListCursor & GetListCursor();
+	// Reads once (from bytes read ahead if there are any) and returns true if
+	// that's all we were trying to get
 	int Read();
-	// Writes once and returns true if that's all we were trying to write
+	// Check if bytes were read ahead that no read has asked for yet
+	bool HasBufferedRead() const;
+	// Writes once (everything queued, as far as the socket takes it) and
+	// returns true if the queue is empty after
 	int Write();
-	// Set up what we want to write
-	void SetWrite(const char * buff, short size);
+	// Take bytes that were already received for us (io_uring backend), same
+	// return values as Read()
+	int ReadFrom(const char * data, int count);
+	// How many more bytes the current read wants
+	int ReadRemaining() const;
+	// Point 'iov' at the queued bytes that haven't gone out yet, returns how
+	// many entries were filled in
+	int GetWriteRemaining(struct iovec * iov, int max) const;
+	// Note that 'count' bytes were written for us (io_uring backend), same
+	// return values as Write()
+	int Wrote(int count);
+	// Check if anything is waiting to be written
+	bool HasWrite() const;
+	// Add a message to the end of what we want to write
+	void QueueWrite(const char * buff, short size);
+	// Add all of 'buff' to the end of what we want to write without copying
+	// it (other connections may be writing the same one)
+	void QueueWriteShared(const std::shared_ptr<const std::string> & buff);
 	// Set how much we want to read
 	void SetRead(short size);
 	// Get what was read and how long it is
@@ -94,18 +224,86 @@ public:
 	void SetLastMoveWin();
 	// See if the last move this FD did was a win
 	bool GetLastMoveWin();
+	// Set whether the player asked for the server to judge shots at their
+	// fleet in their next game
+	void SetJudged(bool judged);
+	// Check if the player asked for the server to judge shots at their fleet
+	bool GetJudged() const;
+	// Set the fleet shots at this player are judged against (nullptr for none)
+	void SetFleet(const std::shared_ptr<JudgedFleet> & fleet);
+	// Get the fleet shots at this player are judged against (nullptr if the
+	// other player's client judges them)
+	JudgedFleet * GetFleet() const;
+	// Set the rules (GAME_RULES_*) of the game this player asked for or was
+	// invited to
+	void SetRules(unsigned char rules);
+	// Get the rules of the game this player asked for or was invited to
+	unsigned char GetRules() const;
+	// Set the bot this player is playing against (nullptr for none)
+	void SetBot(const std::shared_ptr<BotPlayer> & bot);
+	// Get the bot this player is playing against (empty if they are playing
+	// another player, or not playing)
+	const std::shared_ptr<BotPlayer> & GetBot() const;
+	// Get how many bytes have been read from and written to the connection
+	uint64_t GetBytesRead() const;
+	uint64_t GetBytesWritten() const;
+	// Set when (metricsNow()) the frame queued for relaying to this player
+	// was read from the other one, 0 for no relay waiting
+	void SetRelayStart(uint64_t start);
+	// Get when the frame being relayed to this player was read (0 for none)
+	uint64_t GetRelayStart() const;
 private:
 	int fd;
+	unsigned int serial;
 	short state;
 	std::string name;
-	FdState * otherPlayer;
+	ConnRef otherPlayer;
+	ConnRef inviter;
+	ConnRef invitee;
+	ListCursor listCursor;
 	short readPtr;
+	// How much of the first queued message has gone out
 	short writePtr;
 	short readSize;
-	short writeSize;
+	// Points at the inline buffer, a pool buffer, or nullptr
 	char * readBuf;
-	char * writeBuf;
+	// Size of the pool buffer, 0 if not using one
+	unsigned int readCapacity;
+	char readInline[FD_STATE_INLINE_BUFFER];
+	// Bytes read from the socket but not asked for yet are aheadBuf[aheadStart]
+	// to aheadBuf[aheadEnd]. Pool buffer, taken on the first Read().
+	char * aheadBuf;
+	unsigned int aheadCapacity;
+	unsigned short aheadStart;
+	unsigned short aheadEnd;
+	// Messages waiting to go out, starting at writeHead. Emptied (keeping its
+	// room) whenever it drains, so a steady stream of writes doesn't allocate.
+	std::vector<WriteSegment> writeQueue;
+	unsigned int writeHead;
 	bool readInProgress;
 	bool writeInProgress;
 	bool lastMoveWin;
+	bool judged;
+	std::shared_ptr<JudgedFleet> fleet;
+	unsigned char rules;
+	std::shared_ptr<BotPlayer> bot;
+	uint64_t bytesRead;
+	uint64_t bytesWritten;
+	uint64_t relayStart;
+	// read() into the empty read-ahead buffer
+	int FillReadAhead();
+	// Where a queued message's bytes are
+	static const char * SegmentData(const WriteSegment & segment);
+	// Drop the first queued message
+	void PopWrite();
+	// Make 'buf' big enough for 'size' bytes (inline or from the pool)
+	static void ReserveBuffer(char *& buf, unsigned int & capacity, char * inlineBuf, short size);
+	// Give 'buf' back to the pool if it came from there
+	static void ReleaseBuffer(char *& buf, unsigned int & capacity);
+	// Copy s's buffer contents and queued writes into our own buffers
+	void CopyBuffers(const FdState & s);
+	// Take s's buffers (copying the inline ones) and queued writes
+	void TakeBuffers(FdState & s);
+	// Give back every queued write's buffer and empty the queue
+	void ClearWrites();
 };
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "FlightRecorder.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the per-reactor flight recorder ring, and turning what it
+ * copies out into a timeline.
+ ************************************/
+
+#include <algorithm>
+#include <unordered_map>
+#include "Metrics.h"
+
+extern "C"
+{
+	#include <inttypes.h>
+	#include <stdio.h>
+}
+
+/***************************************************************
+* Empty recorder for reactor number 'reactor'
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No events recorded
+****************************************************************/
+FlightRecorder::FlightRecorder(int Reactor): reactor(Reactor), head(0)
+{
+	for (int i = 0; i < FLIGHT_RECORDER_EVENTS; ++i)
+	{
+		slots[i].time = 0;
+		slots[i].who = 0;
+		slots[i].what = 0;
+	}
+}
+
+/***************************************************************
+* Note that something just happened to a connection
+*
+* Preconditions:
+*  Only called from the owning reactor's thread, kind one of the FLIGHT_*
+*  #defines
+* Postcondition:
+*  event written over the oldest one in the ring, with the time, conn's fd,
+*  serial and current state, and 'value'
+****************************************************************/
+void FlightRecorder::Record(short kind, const FdState & conn, int value)
+{
+	uint64_t at = head.load(std::memory_order_relaxed);
+	Slot & slot = slots[at & (FLIGHT_RECORDER_EVENTS - 1)];
+	slot.time.store(metricsNow(), std::memory_order_relaxed);
+	slot.who.store(((uint64_t)conn.GetSerial() << 32) | (uint32_t)conn.GetFD(), std::memory_order_relaxed);
+	slot.what.store(((uint64_t)(uint16_t)kind << 48) | ((uint64_t)(uint16_t)conn.GetState() << 32) | (uint32_t)value, std::memory_order_relaxed);
+	// Readers only look at slots before the head
+	head.store(at + 1, std::memory_order_release);
+}
+
+/***************************************************************
+* Copy the events still in the ring
+*
+* Preconditions:
+*  None, safe from any thread
+* Postcondition:
+*  No object changes. Events added to the end of 'events', oldest first,
+*  leaving out any the reactor wrote over while they were being copied.
+****************************************************************/
+void FlightRecorder::Copy(std::vector<FlightEvent> & events) const
+{
+	uint64_t end = head.load(std::memory_order_acquire);
+	uint64_t start = end > FLIGHT_RECORDER_EVENTS ? end - FLIGHT_RECORDER_EVENTS : 0;
+	size_t first = events.size();
+	for (uint64_t at = start; at < end; ++at)
+	{
+		const Slot & slot = slots[at & (FLIGHT_RECORDER_EVENTS - 1)];
+		FlightEvent event;
+		event.time = slot.time.load(std::memory_order_relaxed);
+		uint64_t who = slot.who.load(std::memory_order_relaxed);
+		uint64_t what = slot.what.load(std::memory_order_relaxed);
+		event.reactor = reactor;
+		event.fd = (int)(uint32_t)who;
+		event.serial = (unsigned int)(who >> 32);
+		event.kind = (short)(uint16_t)(what >> 48);
+		event.state = (short)(uint16_t)(what >> 32);
+		event.value = (int)(uint32_t)what;
+		events.push_back(event);
+	}
+	// Whatever the reactor recorded since we started may have gone over the
+	// oldest slots we copied (the one it is writing now included)
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t now = head.load(std::memory_order_relaxed);
+	uint64_t firstGood = now >= FLIGHT_RECORDER_EVENTS ? now - FLIGHT_RECORDER_EVENTS + 1 : 0;
+	if (firstGood > start)
+	{
+		size_t overwritten = std::min<uint64_t>(firstGood - start, end - start);
+		events.erase(events.begin() + first, events.begin() + first + overwritten);
+	}
+}
+
+// Where a connection's current state slice started
+typedef struct
+{
+	uint64_t start;
+	short state;
+	int reactor;
+} FlightSlice;
+
+/***************************************************************
+* Add one slice or marker to a trace
+*
+* Preconditions:
+*  out holds the start of the trace
+* Postcondition:
+*  Chrome trace event object added (with a comma before it if it isn't the
+*  first). 'duration' < 0 makes a marker, otherwise a slice. Times in
+*  nanoseconds, written out in microseconds.
+****************************************************************/
+static void addTraceEvent(std::string & out, bool & first, const char * name, uint64_t at, int64_t duration, int reactor, unsigned int serial, const char * args)
+{
+	char line[256];
+	if (duration < 0)
+	{
+		snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{%s}}",
+			first ? "" : ",", name, at / 1000.0, reactor, serial, args);
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{%s}}",
+			first ? "" : ",", name, at / 1000.0, duration / 1000.0, reactor, serial, args);
+	}
+	first = false;
+	out += line;
+}
+
+/***************************************************************
+* Turn copied events into Chrome trace event JSON
+*
+* Preconditions:
+*  events copied out of the recorders with Copy()
+* Postcondition:
+*  events sorted by time. JSON returned with a track per connection (pid
+*  the reactor, tid the serial): a "state N" slice for every stretch it
+*  spent in FD_STATE_* N, and a marker for each accept, read, write, abort and
+*  handover. Times are microseconds from the first event. Connections whose
+*  first events fell out of the ring start their first slice at their oldest
+*  event left.
+****************************************************************/
+std::string formatFlightTrace(std::vector<FlightEvent> & events)
+{
+	static const char * kindNames[] = {"", "accept", "state", "read", "write", "abort", "adopt"};
+	std::stable_sort(events.begin(), events.end(), [](const FlightEvent & a, const FlightEvent & b)
+	{
+		return a.time < b.time;
+	});
+	uint64_t base = events.empty() ? 0 : events.front().time;
+	std::unordered_map<unsigned int, FlightSlice> slices;
+	std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	char name[32];
+	char args[96];
+	for (const FlightEvent & event: events)
+	{
+		uint64_t at = event.time - base;
+		auto found = slices.find(event.serial);
+		if (slices.end() == found)
+		{
+			FlightSlice slice = {at, event.state, event.reactor};
+			found = slices.insert(std::make_pair(event.serial, slice)).first;
+		}
+		if (FLIGHT_STATE == event.kind || FLIGHT_ABORT == event.kind)
+		{
+			// That ends the slice for the state it was in
+			FlightSlice & slice = found->second;
+			snprintf(name, sizeof(name), "state %d", slice.state);
+			snprintf(args, sizeof(args), "\"fd\":%d", event.fd);
+			addTraceEvent(out, first, name, slice.start, at - slice.start, slice.reactor, event.serial, args);
+			slice.start = at;
+			slice.state = event.value;
+			slice.reactor = event.reactor;
+		}
+		if (FLIGHT_STATE != event.kind && event.kind > 0 && event.kind <= FLIGHT_ADOPT)
+		{
+			snprintf(args, sizeof(args), "\"fd\":%d,\"state\":%d,\"value\":%d", event.fd, event.state, event.value);
+			addTraceEvent(out, first, kindNames[event.kind], at, -1, event.reactor, event.serial, args);
+		}
+		if (FLIGHT_ABORT == event.kind)
+		{
+			slices.erase(found);
+		}
+	}
+	// Whatever state connections are still in lasts to the end of the trace
+	uint64_t last = events.empty() ? 0 : events.back().time - base;
+	for (auto& open: slices)
+	{
+		snprintf(name, sizeof(name), "state %d", open.second.state);
+		addTraceEvent(out, first, name, open.second.start, last - open.second.start, open.second.reactor, open.first, "\"open\":true");
+	}
+	out += "\n]}\n";
+	return out;
+}
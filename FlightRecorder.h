@@ -0,0 +1,96 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class FlightRecorder:
+ *  The last FLIGHT_RECORDER_EVENTS things that happened to one reactor's
+ *  connections (accepts, state changes, finished reads and writes, aborts),
+ *  with when they happened, so a stalled or slow game can be traced back
+ *  through the server's state machine after the fact.
+ *
+ *  Each reactor has its own, and only its thread records into it. Recording
+ *  writes one slot of a fixed ring (overwriting the oldest) and moves the
+ *  head, so it never allocates or locks. Every slot is a few atomic words, so
+ *  another thread can Copy() the ring out while the reactor keeps going; any
+ *  slot that might have been overwritten while it was being copied is left
+ *  out.
+ *
+ * formatFlightTrace()
+ *  Turns copied events into Chrome trace event JSON (chrome://tracing,
+ *  Perfetto): one track per connection, with a slice for each state it was in
+ *  and a marker for each event.
+ ***********************************/
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "FdState.h"
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// Events kept per reactor (a power of two)
+#define FLIGHT_RECORDER_EVENTS 4096
+
+// What a recorded event was. 'value' is described for each.
+// Accepted, starting in FD_STATE_ANON. value unused
+#define FLIGHT_ACCEPT 1
+// Changed state, from 'state' to 'value'
+#define FLIGHT_STATE 2
+// Finished a read in 'state', value the frame size
+#define FLIGHT_READ 3
+// Finished writing everything queued in 'state', value the bytes written
+// since the connection was accepted
+#define FLIGHT_WRITE 4
+// Aborted in 'state', value the METRICS_ABORT_* reason
+#define FLIGHT_ABORT 5
+// Handed over from another reactor in 'state', value that reactor's number
+#define FLIGHT_ADOPT 6
+
+// One event, copied out of a recorder
+typedef struct flightEvent
+{
+	// metricsNow() when it happened
+	uint64_t time;
+	int reactor;
+	int fd;
+	unsigned int serial;
+	short kind;
+	// Connection's state when it happened (before a FLIGHT_STATE)
+	short state;
+	int value;
+} FlightEvent;
+
+class FlightRecorder
+{
+public:
+	// Empty recorder for reactor number 'reactor'
+	FlightRecorder(int reactor);
+	// Note that 'kind' (a FLIGHT_* #define) just happened to 'conn'. Only
+	// from the owning reactor's thread.
+	void Record(short kind, const FdState & conn, int value);
+	// Add the events still in the ring to the end of 'events', oldest first.
+	// Safe from any thread.
+	void Copy(std::vector<FlightEvent> & events) const;
+private:
+	FlightRecorder(const FlightRecorder &) = delete;
+	FlightRecorder & operator=(const FlightRecorder &) = delete;
+	// An event packed into words that can be read while being written
+	typedef struct
+	{
+		std::atomic<uint64_t> time;
+		// serial << 32 | fd
+		std::atomic<uint64_t> who;
+		// kind << 48 | state << 32 | value
+		std::atomic<uint64_t> what;
+	} Slot;
+	int reactor;
+	// Events ever recorded, the next one goes in slots[head % size]
+	std::atomic<uint64_t> head;
+	Slot slots[FLIGHT_RECORDER_EVENTS];
+};
+
+// Chrome trace event JSON for 'events' (sorted by time first)
+std::string formatFlightTrace(std::vector<FlightEvent> & events);
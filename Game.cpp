@@ -199,25 +199,55 @@ void Game::PlaceShips()
 			}
 		}
 		// Get to 0 based numbering
-		newx -= 1;
-		newy -= 1;
-		fleet[i-1].Place(horiz, newx, newy);
-		if (horiz)
+		PlaceShip(i, horiz, newx-1, newy-1);
+		this->PrintBoard();
+	}
+}
+
+/***************************************************************
+* Places the 'size'-space ship without asking anyone
+* Preconditions:
+*  0 < size <= FLEETSIZE, that ship not already placed, x and y 0 based
+* Postcondition:
+*  Ship placed on the board and true returned, or false returned (and
+*  nothing changed) if it would hang off the board
+****************************************************************/
+bool Game::PlaceShip(short size, bool horizontal, short x, short y)
+{
+	if (size < 1 || size > FLEETSIZE || x < 0 || y < 0 ||
+		(horizontal && (x+size > MAP_SIDE_SIZE || y >= MAP_SIDE_SIZE)) ||
+		(!horizontal && (y+size > MAP_SIDE_SIZE || x >= MAP_SIDE_SIZE)))
+	{
+		return false;
+	}
+	fleet[size-1].Place(horizontal, x, y);
+	if (horizontal)
+	{
+		for (int j = x; j < size+x; ++j)
 		{
-			for (int j = newx; j < i+newx; ++j)
-			{
-				ocean[j][newy].first = &(fleet[i-1]);
-			}
+			ocean[j][y].first = &(fleet[size-1]);
 		}
-		else
+	}
+	else
+	{
+		for (int j = y; j < size+y; ++j)
 		{
-			for (int j = newy; j < i+newy; ++j)
-			{
-				ocean[newx][j].first = &(fleet[i-1]);
-			}
+			ocean[x][j].first = &(fleet[size-1]);
 		}
-		this->PrintBoard();
 	}
+	return true;
+}
+
+/***************************************************************
+* Gets ship number 'shipNum' (the one with shipNum+1 spaces)
+* Preconditions:
+*  0 <= shipNum < FLEETSIZE
+* Postcondition:
+*  No changes to object, the ship returned
+****************************************************************/
+const Ship & Game::GetShip(int shipNum) const
+{
+	return fleet[shipNum];
 }
 
 /*****************************************************************
@@ -21,6 +21,11 @@ public:
 	void PrintBoard() const;
 	// Interacts with the user through stdin to place the ships on their board
 	void PlaceShips();
+	// Places the 'size'-space ship without asking anyone (0 based x and y).
+	// False if it would hang off the board.
+	bool PlaceShip(short size, bool horizontal, short x, short y);
+	// Gets ship number 'shipNum' (the one with shipNum+1 spaces)
+	const Ship & GetShip(int shipNum) const;
 	// Records where we sucessfully hit another ship on the other player's board
 	void SetPlayHitCoord(short x, short y);
 	// Marks where the user targeted on the other player's map
@@ -0,0 +1,102 @@
+#include "GameRules.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Table of the sets of rules, each with its own BitGame.
+ ************************************/
+
+#include "Game.h"
+#include "SparseGame.h"
+
+/****************************************************************
+* Make an empty fleet of type G
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  fleet returned
+****************************************************************/
+template <class G>
+static std::shared_ptr<JudgedFleet> makeFleet()
+{
+	return std::make_shared<G>();
+}
+
+/****************************************************************
+* Make an empty fleet for GAME_RULES_GIANT
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  fleet returned
+****************************************************************/
+static std::shared_ptr<JudgedFleet> makeGiantFleet()
+{
+	std::vector<short> sizes;
+	for (short size = 5; size >= 2; --size)
+	{
+		sizes.insert(sizes.end(), 100, size);
+	}
+	return std::make_shared<SparseGame>(1000, 1000, sizes);
+}
+
+// Fleets for each set of rules
+typedef BitGame<MAP_SIDE_SIZE, MAP_SIDE_SIZE, FleetOf<1, 2, 3, 4, 5> > ClassicFleet;
+typedef BitGame<10, 10, FleetOf<5, 4, 3, 3, 2> > StandardFleet;
+typedef BitGame<8, 8, FleetOf<4, 3, 2> > SmallFleet;
+typedef BitGame<15, 15, FleetOf<5, 4, 4, 3, 3, 2, 2> > LargeFleet;
+
+// Indexed by the GAME_RULES_* numbers
+static const GameRules RulesTable[] =
+{
+	{ClassicFleet::width, ClassicFleet::height, ClassicFleet::shipCount, false, makeFleet<ClassicFleet>},
+	{StandardFleet::width, StandardFleet::height, StandardFleet::shipCount, false, makeFleet<StandardFleet>},
+	{SmallFleet::width, SmallFleet::height, SmallFleet::shipCount, false, makeFleet<SmallFleet>},
+	{LargeFleet::width, LargeFleet::height, LargeFleet::shipCount, false, makeFleet<LargeFleet>},
+	{1000, 1000, 400, true, makeGiantFleet},
+};
+
+/****************************************************************
+* Look up a set of rules by number
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  The rules numbered 'rules' returned, or nullptr if there are none
+****************************************************************/
+const GameRules * findRules(unsigned int rules)
+{
+	if (rules >= sizeof(RulesTable)/sizeof(RulesTable[0]))
+	{
+		return nullptr;
+	}
+	return &RulesTable[rules];
+}
+
+/****************************************************************
+* Get the size of a move (or move results) frame
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  bytes returned: one word, or two with wide coordinates
+****************************************************************/
+short moveFrameSize(const GameRules & rules)
+{
+	return rules.wide ? 2*sizeof(uint32_t) : sizeof(uint32_t);
+}
+
+/****************************************************************
+* Get the size of the ACTION_FLEET frame
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  bytes returned: the header, then one word per ship (two with wide
+*  coordinates)
+****************************************************************/
+short fleetFrameSize(const GameRules & rules)
+{
+	return sizeof(uint32_t) + rules.shipCount*moveFrameSize(rules);
+}
@@ -0,0 +1,51 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * The sets of rules (board size and fleet) a game can be played with, and
+ * picking the BitGame for them at runtime. The inviter picks the rules with
+ * the GAME_RULES bits of ACTION_PLAY_PLAYERNAME (see netDefines.h).
+ *
+ * const GameRules * findRules(unsigned int rules)
+ *  The rules numbered 'rules', or nullptr if there are none
+ * std::shared_ptr<JudgedFleet> GameRules::MakeFleet()
+ *  An empty fleet built for those rules (a BitGame, or a SparseGame for the
+ *  boards too big for one)
+ * short moveFrameSize(const GameRules & rules)
+ *  Bytes in a move (or move results) frame under those rules
+ * short fleetFrameSize(const GameRules & rules)
+ *  Bytes in the ACTION_FLEET frame under those rules
+ ***********************************/
+
+#include <memory>
+#include "BitGame.h"
+
+// 10x10, ships of 1 to 5 spaces (Game, and so the stock client)
+#define GAME_RULES_CLASSIC 0
+// 10x10, ships of 5, 4, 3, 3 and 2 spaces
+#define GAME_RULES_STANDARD 1
+// 8x8, ships of 4, 3 and 2 spaces
+#define GAME_RULES_SMALL 2
+// 15x15, ships of 5, 4, 4, 3, 3, 2 and 2 spaces
+#define GAME_RULES_LARGE 3
+// 1000x1000, 100 ships each of 5, 4, 3 and 2 spaces, with wide coordinates
+#define GAME_RULES_GIANT 4
+
+typedef struct gameRules
+{
+	short width;
+	short height;
+	int shipCount;
+	// Moves, results and the fleet use WIDE_COORDS_MASK coordinates
+	bool wide;
+	// Makes an empty fleet for these rules
+	std::shared_ptr<JudgedFleet> (*MakeFleet)();
+} GameRules;
+
+// The rules numbered 'rules', or nullptr if there are none
+const GameRules * findRules(unsigned int rules);
+// Bytes in a move (or move results) frame under 'rules'
+short moveFrameSize(const GameRules & rules);
+// Bytes in the ACTION_FLEET frame under 'rules'
+short fleetFrameSize(const GameRules & rules);
@@ -0,0 +1,415 @@
+#include "Heatmap.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the targeting heatmap.
+ ************************************/
+
+#include <algorithm>
+#include <thread>
+#include <functional>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Lanes to add to for each 4 bits of a mask (bit i set -> lane i all ones)
+alignas(16) static const uint32_t NibbleLanes[16][4] =
+{
+	{0, 0, 0, 0}, {~0u, 0, 0, 0}, {0, ~0u, 0, 0}, {~0u, ~0u, 0, 0},
+	{0, 0, ~0u, 0}, {~0u, 0, ~0u, 0}, {0, ~0u, ~0u, 0}, {~0u, ~0u, ~0u, 0},
+	{0, 0, 0, ~0u}, {~0u, 0, 0, ~0u}, {0, ~0u, 0, ~0u}, {~0u, ~0u, 0, ~0u},
+	{0, 0, ~0u, ~0u}, {~0u, 0, ~0u, ~0u}, {0, ~0u, ~0u, ~0u}, {~0u, ~0u, ~0u, ~0u},
+};
+
+/****************************************************************
+* Get 64 bits of a mask starting anywhere
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes. Bits 'bit' to 'bit'+63 of mask returned (low bit first), with
+*  0s for any of them before the start or past the end of it
+****************************************************************/
+static uint64_t bitsAt(const std::vector<uint64_t> & mask, long bit)
+{
+	long count = mask.size();
+	long word = bit >= 0 ? bit / 64 : -((63 - bit) / 64);
+	int shift = bit - word*64;
+	uint64_t low = (word >= 0 && word < count) ? mask[word] : 0;
+	if (0 == shift)
+	{
+		return low;
+	}
+	uint64_t high = (word+1 >= 0 && word+1 < count) ? mask[word+1] : 0;
+	return (low >> shift) | (high << (64 - shift));
+}
+
+/****************************************************************
+* Add to the count of each space set in one word of a mask
+*
+* Preconditions:
+*  counts has room for 64 spaces
+* Postcondition:
+*  'weight' added to counts[i] for each bit i set in 'bits'
+****************************************************************/
+static void addBits(unsigned int * counts, uint64_t bits, unsigned int weight)
+{
+#ifdef __SSE2__
+	__m128i weights = _mm_set1_epi32(weight);
+	for (int nibble = 0; bits; ++nibble, bits >>= 4)
+	{
+		if (bits & 15)
+		{
+			__m128i lanes = _mm_load_si128((const __m128i *)NibbleLanes[bits & 15]);
+			__m128i * at = (__m128i *)(counts + 4*nibble);
+			_mm_storeu_si128(at, _mm_add_epi32(_mm_loadu_si128(at), _mm_and_si128(lanes, weights)));
+		}
+	}
+#else
+	while (bits)
+	{
+		counts[__builtin_ctzll(bits)] += weight;
+		bits &= bits - 1;
+	}
+#endif
+}
+
+/****************************************************************
+* Start a heatmap with nothing fired at
+*
+* Preconditions:
+*  Every size 1 to HEATMAP_MAX_SHIP, threads >= 1
+* Postcondition:
+*  Every space unknown, every ship afloat, edge tables made
+****************************************************************/
+Heatmap::Heatmap(short Width, short Height, const std::vector<short> & sizes, int Threads): width(Width), height(Height), words((Width*Height + 63)/64), threads(Threads), board(words, 0), shot(words, 0), hits(words, 0), sunk(words, 0), acrossStarts(HEATMAP_MAX_SHIP + 1, Mask(words, 0)), downStarts(HEATMAP_MAX_SHIP + 1, Mask(words, 0)), afloat(sizes), density(words*64, 0)
+{
+	for (int space = 0; space < width*height; ++space)
+	{
+		board[space/64] |= ((uint64_t)1) << (space & 63);
+	}
+	for (short size = 1; size <= HEATMAP_MAX_SHIP; ++size)
+	{
+		for (int space = 0; space < width*height; ++space)
+		{
+			uint64_t bit = ((uint64_t)1) << (space & 63);
+			if (space % width + size <= width)
+			{
+				acrossStarts[size][space/64] |= bit;
+			}
+			if (space / width + size <= height)
+			{
+				downStarts[size][space/64] |= bit;
+			}
+		}
+	}
+}
+
+/****************************************************************
+* Get the board size
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes, width or height returned
+****************************************************************/
+short Heatmap::Width() const
+{
+	return width;
+}
+
+short Heatmap::Height() const
+{
+	return height;
+}
+
+/****************************************************************
+* Check if a space hasn't been fired at
+*
+* Preconditions:
+*  x < width and y < height
+* Postcondition:
+*  No changes, true returned if it hasn't
+****************************************************************/
+bool Heatmap::IsUnknown(short x, short y) const
+{
+	int space = y*width + x;
+	return 0 == (shot[space/64] & (((uint64_t)1) << (space & 63)));
+}
+
+/****************************************************************
+* Check if a space is a hit on a ship that hasn't sunk
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes, false returned for spaces off the board
+****************************************************************/
+bool Heatmap::IsLiveHit(short x, short y) const
+{
+	if (x < 0 || y < 0 || x >= width || y >= height)
+	{
+		return false;
+	}
+	int space = y*width + x;
+	uint64_t bit = ((uint64_t)1) << (space & 63);
+	return (hits[space/64] & bit) && !(sunk[space/64] & bit);
+}
+
+/****************************************************************
+* Mark a ship that was just sunk
+*
+* Preconditions:
+*  x, y the space that sank it (already recorded as a hit)
+* Postcondition:
+*  A run of 'size' unsunk hits through x, y (across first) marked sunk, just
+*  x, y if there isn't one, and one 'size' ship taken off the afloat list
+****************************************************************/
+void Heatmap::MarkSunk(short x, short y, short size)
+{
+	bool marked = false;
+	for (int across = 1; across >= 0 && !marked; --across)
+	{
+		for (int back = 0; back < size && !marked; ++back)
+		{
+			short startX = across ? x-back : x;
+			short startY = across ? y : y-back;
+			bool run = true;
+			for (int j = 0; j < size && run; ++j)
+			{
+				run = IsLiveHit(across ? startX+j : startX, across ? startY : startY+j);
+			}
+			if (!run)
+			{
+				continue;
+			}
+			for (int j = 0; j < size; ++j)
+			{
+				int space = (across ? startY : startY+j)*width + (across ? startX+j : startX);
+				sunk[space/64] |= ((uint64_t)1) << (space & 63);
+			}
+			marked = true;
+		}
+	}
+	if (!marked)
+	{
+		int space = y*width + x;
+		sunk[space/64] |= ((uint64_t)1) << (space & 63);
+	}
+	std::vector<short>::iterator ship = std::find(afloat.begin(), afloat.end(), size);
+	if (afloat.end() != ship)
+	{
+		afloat.erase(ship);
+	}
+}
+
+/****************************************************************
+* Learn the results of a shot
+*
+* Preconditions:
+*  x < width and y < height
+* Postcondition:
+*  space marked as fired at (and hit), and the ship marked sunk if it sank
+****************************************************************/
+void Heatmap::Record(short x, short y, bool hit, short shipSize, bool sink)
+{
+	int space = y*width + x;
+	uint64_t bit = ((uint64_t)1) << (space & 63);
+	shot[space/64] |= bit;
+	if (hit)
+	{
+		hits[space/64] |= bit;
+		if (sink)
+		{
+			MarkSunk(x, y, shipSize);
+		}
+	}
+}
+
+/****************************************************************
+* Add up where 'ships' ships of one size could lie in one direction, for the
+* spaces in words 'first' to 'last' of the board
+*
+* Preconditions:
+*  open the spaces ships can be on, live the unsunk hits, counts has room for
+*  words*64 spaces, 0 <= first <= last <= words
+* Postcondition:
+*  Each of those spaces' count raised by 'ships' for every placement covering
+*  it (times HEATMAP_TARGET_WEIGHT times the hits for placements covering
+*  hits). Nothing outside them is touched, so threads can each take a range.
+****************************************************************/
+void Heatmap::CountPlacements(short size, bool horizontal, unsigned int ships, const Mask & open, const Mask & live, unsigned int * counts, int first, int last) const
+{
+	long step = horizontal ? 1 : width;
+	const Mask & edges = horizontal ? acrossStarts[size] : downStarts[size];
+	// Placements covering our spaces can start this many words before them
+	int from = std::max(0L, first - ((size-1)*step)/64 - 1);
+	Mask starts(words, 0);
+	// Hits under each placement, one bit of the count per mask
+	Mask hitCount[3] = {Mask(words, 0), Mask(words, 0), Mask(words, 0)};
+	for (int i = from; i < last; ++i)
+	{
+		uint64_t fits = edges[i];
+		uint64_t count0 = 0, count1 = 0, count2 = 0;
+		for (int j = 0; j < size && fits; ++j)
+		{
+			long bit = 64L*i + j*step;
+			fits &= bitsAt(open, bit);
+			uint64_t carry = bitsAt(live, bit);
+			uint64_t next = count0 & carry;
+			count0 ^= carry;
+			carry = next;
+			next = count1 & carry;
+			count1 ^= carry;
+			count2 |= next;
+		}
+		starts[i] = fits;
+		hitCount[0][i] = count0;
+		hitCount[1][i] = count1;
+		hitCount[2][i] = count2;
+	}
+	Mask group(words, 0);
+	for (int hitsCovered = 0; hitsCovered <= size; ++hitsCovered)
+	{
+		bool any = false;
+		for (int i = from; i < last; ++i)
+		{
+			uint64_t match = starts[i];
+			match &= (hitsCovered & 1) ? hitCount[0][i] : ~hitCount[0][i];
+			match &= (hitsCovered & 2) ? hitCount[1][i] : ~hitCount[1][i];
+			match &= (hitsCovered & 4) ? hitCount[2][i] : ~hitCount[2][i];
+			group[i] = match;
+			any = any || match;
+		}
+		if (!any)
+		{
+			continue;
+		}
+		unsigned int weight = ships * (hitsCovered ? HEATMAP_TARGET_WEIGHT*hitsCovered : 1);
+		// Every space of every placement in the group
+		for (int j = 0; j < size; ++j)
+		{
+			for (int i = first; i < last; ++i)
+			{
+				uint64_t covered = bitsAt(group, 64L*i - j*step);
+				if (covered)
+				{
+					addBits(counts + 64*i, covered, weight);
+				}
+			}
+		}
+	}
+}
+
+/****************************************************************
+* Score every space
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Scores worked out for the ships still afloat and returned, 0 for spaces
+*  already fired at. Up to 'threads' threads (each doing a stretch of the
+*  board) used on boards with at least HEATMAP_THREAD_MIN_SPACES spaces.
+****************************************************************/
+const std::vector<unsigned int> & Heatmap::Calculate()
+{
+	Mask open(words), live(words);
+	for (int i = 0; i < words; ++i)
+	{
+		// Not a miss and not part of a sunk ship
+		open[i] = board[i] & ~((shot[i] & ~hits[i]) | sunk[i]);
+		live[i] = hits[i] & ~sunk[i];
+	}
+	// One job per ship size and direction, counting all the ships that size
+	unsigned int ships[HEATMAP_MAX_SHIP + 1] = {0};
+	for (short size : afloat)
+	{
+		++ships[size];
+	}
+	std::vector<short> jobs;
+	for (short size = 1; size <= HEATMAP_MAX_SHIP; ++size)
+	{
+		if (ships[size])
+		{
+			jobs.push_back(size);
+			// Both ways round are the same for 1 space ships
+			if (size > 1)
+			{
+				jobs.push_back(-size);
+			}
+		}
+	}
+	std::fill(density.begin(), density.end(), 0);
+	int workers = std::min(words, threads);
+	if (width*height < HEATMAP_THREAD_MIN_SPACES)
+	{
+		workers = 1;
+	}
+	// Each thread takes its own stretch of the board, through every job
+	std::vector<std::thread> running;
+	for (int worker = 0; worker < workers; ++worker)
+	{
+		int first = (long)words*worker/workers;
+		int last = (long)words*(worker+1)/workers;
+		std::function<void()> count = [&, first, last]()
+		{
+			for (short job : jobs)
+			{
+				short size = job < 0 ? -job : job;
+				CountPlacements(size, job > 0, ships[size], open, live, density.data(), first, last);
+			}
+		};
+		if (workers - 1 == worker)
+		{
+			// Last stretch on this thread
+			count();
+		}
+		else
+		{
+			running.push_back(std::thread(count));
+		}
+	}
+	for (std::thread & thread : running)
+	{
+		thread.join();
+	}
+	// Nothing left to find where we already fired
+	for (int space = 0; space < width*height; ++space)
+	{
+		if (shot[space/64] & (((uint64_t)1) << (space & 63)))
+		{
+			density[space] = 0;
+		}
+	}
+	return density;
+}
+
+/****************************************************************
+* Find the best space to fire at
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Scores calculated. True returned with x, y (0 based) set to the first
+*  unknown space with the highest score, or false if there are none.
+****************************************************************/
+bool Heatmap::Best(short & x, short & y)
+{
+	Calculate();
+	int best = -1;
+	for (int space = 0; space < width*height; ++space)
+	{
+		if ((-1 == best || density[space] > density[best]) && IsUnknown(space % width, space / width))
+		{
+			best = space;
+		}
+	}
+	if (-1 == best)
+	{
+		return false;
+	}
+	x = best % width;
+	y = best / width;
+	return true;
+}
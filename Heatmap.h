@@ -0,0 +1,95 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class Heatmap:
+ *  Works out where the other player's ships most likely are, from the
+ *  results of our shots so far (what decodeMoveResults() gives). Every way
+ *  each ship still afloat could lie is counted, leaving out the ones over a
+ *  miss or a sunk ship; a space's score is how many of them cover it.
+ *  Placements through hits that aren't sunk yet count HEATMAP_TARGET_WEIGHT
+ *  times as much per hit, so once something is hit the spaces around it win
+ *  (target) until it sinks, then it is back to the densest open water (hunt).
+ *
+ *  Boards are bitmasks (one bit per space, bit y*width+x), so the places a
+ *  ship fits are found for the whole board at once: AND together the open
+ *  spaces shifted by each of its spaces, and mask off the starts that would
+ *  hang off the edge (tables made once per board). How many hits each
+ *  placement covers is counted the same way with a 3 bit adder across the
+ *  masks. Each group of placements is then added into the per space counts
+ *  4 spaces at a time with SSE2 (where there is SSE2), using a table that
+ *  turns 4 bits into 4 lanes. Ships of the same size are only counted once.
+ *
+ *  Big boards can spread the work over threads, each doing every ship size
+ *  and direction for its own stretch of the board.
+ *
+ * Heatmap(short width, short height, const std::vector<short> & sizes, int threads)
+ *  Nothing fired at yet on a width by height board with ships of 'sizes'
+ * void Record(short x, short y, bool hit, short shipSize, bool sink)
+ *  Learn the results of a shot (0 based x and y)
+ * const std::vector<unsigned int> & Calculate()
+ *  Scores for every space (y*width+x)
+ * bool Best(short & x, short & y)
+ *  The space not fired at yet with the highest score
+ ***********************************/
+
+#include <vector>
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// How much more a placement counts for each unsunk hit it covers
+#define HEATMAP_TARGET_WEIGHT 20
+// Biggest ship there can be (3 bits of ship size on the wire)
+#define HEATMAP_MAX_SHIP 7
+// Boards with fewer spaces than this are always done on one thread
+#define HEATMAP_THREAD_MIN_SPACES 4096
+
+class Heatmap
+{
+public:
+	// Nothing fired at yet on a width by height board with ships of 'sizes'
+	// (each 1 to HEATMAP_MAX_SHIP). Calculate() uses up to 'threads' threads
+	// on big boards.
+	Heatmap(short width, short height, const std::vector<short> & sizes, int threads = 1);
+	short Width() const;
+	short Height() const;
+	// Learn the results of firing at x, y (0 based)
+	void Record(short x, short y, bool hit, short shipSize, bool sink);
+	// Check if x, y (0 based) hasn't been fired at
+	bool IsUnknown(short x, short y) const;
+	// Score every space (index y*width+x, padded past the end of the board
+	// with 0s). Spaces already fired at are 0.
+	const std::vector<unsigned int> & Calculate();
+	// Put the unknown space with the highest score in x, y (the first one of
+	// those tied). False if every space has been fired at.
+	bool Best(short & x, short & y);
+private:
+	typedef std::vector<uint64_t> Mask;
+	// Add the placements of one ship size and direction to the counts of
+	// the spaces in words 'first' to 'last'
+	void CountPlacements(short size, bool horizontal, unsigned int ships, const Mask & open, const Mask & live, unsigned int * counts, int first, int last) const;
+	// Mark the 'size' ship just sunk at x, y as sunk
+	void MarkSunk(short x, short y, short size);
+	// Check if x, y (0 based) is an unsunk hit
+	bool IsLiveHit(short x, short y) const;
+	short width;
+	short height;
+	int words;
+	int threads;
+	// Spaces on the board, fired at, hit, and part of a sunk ship
+	Mask board;
+	Mask shot;
+	Mask hits;
+	Mask sunk;
+	// Spaces a ship of each size can start at without hanging off the board,
+	// going across and down
+	std::vector<Mask> acrossStarts;
+	std::vector<Mask> downStarts;
+	// Sizes of the ships not sunk yet
+	std::vector<short> afloat;
+	// Scores, words*64 long so the SSE2 adds never go off the end
+	std::vector<unsigned int> density;
+};
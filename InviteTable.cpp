@@ -0,0 +1,164 @@
+#include "InviteTable.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the table of invitations waiting to be answered.
+ ************************************/
+
+/***************************************************************
+* Put an invitation at the back of its invitee's line
+*
+* Preconditions:
+*  inviter doesn't have another invitation in the table
+* Postcondition:
+*  invitation stored, after everything already waiting for the same invitee
+****************************************************************/
+void InviteTable::Add(const PendingInvite & invite)
+{
+	int index;
+	if (freeEntries.empty())
+	{
+		index = entries.size();
+		entries.push_back(Entry());
+	}
+	else
+	{
+		index = freeEntries.back();
+		freeEntries.pop_back();
+	}
+	Entry & entry = entries[index];
+	entry.invite = invite;
+	entry.next = -1;
+
+	Queue blank = {-1, -1, 0};
+	Queue & line = byInvitee.insert(std::make_pair(invite.invitee.serial, blank)).first->second;
+	entry.prev = line.tail;
+	if (-1 == line.tail)
+	{
+		line.head = index;
+	}
+	else
+	{
+		entries[line.tail].next = index;
+	}
+	line.tail = index;
+	++line.count;
+	byInviter[invite.inviter.serial] = index;
+}
+
+/***************************************************************
+* Take entry 'index' out of its line and free it
+*
+* Preconditions:
+*  index a used entry
+* Postcondition:
+*  entry unlinked from its invitee's line (line dropped if now empty),
+*  removed from the inviter lookup, and its spot freed
+****************************************************************/
+void InviteTable::Unlink(int index)
+{
+	Entry & entry = entries[index];
+	std::unordered_map<unsigned int, Queue>::iterator line = byInvitee.find(entry.invite.invitee.serial);
+	if (-1 == entry.prev)
+	{
+		line->second.head = entry.next;
+	}
+	else
+	{
+		entries[entry.prev].next = entry.next;
+	}
+	if (-1 == entry.next)
+	{
+		line->second.tail = entry.prev;
+	}
+	else
+	{
+		entries[entry.next].prev = entry.prev;
+	}
+	if (0 == --line->second.count)
+	{
+		byInvitee.erase(line);
+	}
+	byInviter.erase(entry.invite.inviter.serial);
+	entry.invite.name.clear();
+	freeEntries.push_back(index);
+}
+
+/***************************************************************
+* Take the oldest invitation waiting for an invitee
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  true returned with 'invite' set to the oldest invitation (which is taken
+*  out of the table), or false returned if nothing was waiting
+****************************************************************/
+bool InviteTable::PopNext(unsigned int inviteeSerial, PendingInvite & invite)
+{
+	std::unordered_map<unsigned int, Queue>::iterator line = byInvitee.find(inviteeSerial);
+	if (byInvitee.end() == line)
+	{
+		return false;
+	}
+	int index = line->second.head;
+	invite = entries[index].invite;
+	Unlink(index);
+	return true;
+}
+
+/***************************************************************
+* Drop the invitation sent by a player
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  inviter's invitation removed and true returned, or false if they didn't
+*  have one waiting
+****************************************************************/
+bool InviteTable::RemoveInviter(unsigned int inviterSerial)
+{
+	std::unordered_map<unsigned int, int>::iterator found = byInviter.find(inviterSerial);
+	if (byInviter.end() == found)
+	{
+		return false;
+	}
+	Unlink(found->second);
+	return true;
+}
+
+/***************************************************************
+* Drop every invitation waiting for an invitee
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  invitations for the invitee removed from the table and added to 'removed'
+*  (oldest first)
+****************************************************************/
+void InviteTable::RemoveInvitee(unsigned int inviteeSerial, std::vector<PendingInvite> & removed)
+{
+	PendingInvite invite;
+	while (PopNext(inviteeSerial, invite))
+	{
+		removed.push_back(invite);
+	}
+}
+
+/***************************************************************
+* Number of invitations waiting for an invitee
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, count returned
+****************************************************************/
+unsigned int InviteTable::CountFor(unsigned int inviteeSerial) const
+{
+	std::unordered_map<unsigned int, Queue>::const_iterator line = byInvitee.find(inviteeSerial);
+	if (byInvitee.end() == line)
+	{
+		return 0;
+	}
+	return line->second.count;
+}
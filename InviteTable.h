@@ -0,0 +1,79 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class InviteTable:
+ *  Invitations waiting for a player to answer them. A player can only look at
+ *  one invitation at a time, so any that arrive while they are answering one
+ *  wait here, oldest first. Each reactor has one for the players it owns.
+ *
+ *  Invitations are found by who they are for (to show the next one, or to
+ *  turn them all down) and by who sent them (when the sender gives up), both
+ *  without looking through the rest of the table.
+ *
+ * Add(const PendingInvite & invite)
+ *  Put an invitation at the back of its invitee's line
+ * PopNext(unsigned int inviteeSerial, PendingInvite & invite)
+ *  Take the oldest invitation waiting for an invitee
+ * RemoveInviter(unsigned int inviterSerial)
+ *  Drop the invitation sent by a player
+ * RemoveInvitee(unsigned int inviteeSerial, std::vector<PendingInvite> & removed)
+ *  Drop every invitation waiting for an invitee, handing them back so their
+ *  senders can be told no
+ ***********************************/
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "FdState.h"
+
+typedef struct pendingInvite
+{
+	// Who the invitation is for (one of this reactor's connections)
+	ConnRef invitee;
+	// Who sent it (may be on another reactor)
+	ConnRef inviter;
+	// Name of the player that sent it
+	std::string name;
+	// Rules they want to play by
+	unsigned char rules;
+} PendingInvite;
+
+class InviteTable
+{
+public:
+	// Put an invitation at the back of its invitee's line
+	void Add(const PendingInvite & invite);
+	// Take the oldest invitation waiting for an invitee. Returns false if none.
+	bool PopNext(unsigned int inviteeSerial, PendingInvite & invite);
+	// Drop the invitation sent by a player. Returns false if there wasn't one.
+	bool RemoveInviter(unsigned int inviterSerial);
+	// Drop every invitation waiting for an invitee, adding them to 'removed'
+	void RemoveInvitee(unsigned int inviteeSerial, std::vector<PendingInvite> & removed);
+	// Number of invitations waiting for an invitee
+	unsigned int CountFor(unsigned int inviteeSerial) const;
+private:
+	// An invitation, linked into its invitee's line
+	typedef struct inviteEntry
+	{
+		PendingInvite invite;
+		int prev;
+		int next;
+	} Entry;
+	// One invitee's line (positions in 'entries', -1 for none)
+	typedef struct inviteQueue
+	{
+		int head;
+		int tail;
+		unsigned int count;
+	} Queue;
+	// Take entry 'index' out of its line and free it
+	void Unlink(int index);
+	// Invitations, with freed spots reused
+	std::vector<Entry> entries;
+	std::vector<int> freeEntries;
+	// Lines by invitee serial, and invitation position by inviter serial
+	std::unordered_map<unsigned int, Queue> byInvitee;
+	std::unordered_map<unsigned int, int> byInviter;
+};
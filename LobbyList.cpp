@@ -0,0 +1,210 @@
+#include "LobbyList.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the cached list of players in the lobby.
+ ************************************/
+
+#include <utility>
+#include "netDefines.h"
+extern "C"
+{
+	#include <arpa/inet.h>
+	#include <stdint.h>
+}
+
+/***************************************************************
+* Create an empty list
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  List with nobody in it, and nothing built yet
+****************************************************************/
+LobbyList::LobbyList(): version(0), serializedVersion(0)
+{
+	
+}
+
+/***************************************************************
+* Put a player into the list
+*
+* Preconditions:
+*  ref a connection that isn't in the list already
+* Postcondition:
+*  player added, version bumped
+****************************************************************/
+void LobbyList::Add(const std::string & name, const ConnRef & ref)
+{
+	Entry entry;
+	entry.name = name;
+	entry.ref = ref;
+	positions[ref.serial] = entries.size();
+	sortedNames.insert(name);
+	entries.push_back(std::move(entry));
+	++version;
+}
+
+/***************************************************************
+* Take a player out of the list
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  player removed (the last player moved into their spot) and version bumped,
+*  true returned. false returned if they weren't in the list.
+****************************************************************/
+bool LobbyList::Remove(const ConnRef & ref)
+{
+	std::unordered_map<unsigned int, unsigned int>::iterator found = positions.find(ref.serial);
+	if (positions.end() == found)
+	{
+		return false;
+	}
+	unsigned int i = found->second;
+	positions.erase(found);
+	sortedNames.erase(entries[i].name);
+	if (i != entries.size() - 1)
+	{
+		entries[i] = std::move(entries.back());
+		positions[entries[i].ref.serial] = i;
+	}
+	entries.pop_back();
+	++version;
+	return true;
+}
+
+/***************************************************************
+* Build the list as it goes over the network
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes. 32 bit length (network order) followed by the text of
+*  the list returned. The list is sent empty if it is too long for the length
+*  field.
+****************************************************************/
+std::string LobbyList::Serialize() const
+{
+	std::string nameList("Available players:\n");
+	for (auto& entry: entries)
+	{
+		nameList += entry.name;
+		nameList += "\n";
+	}
+	uint32_t len = nameList.length();
+	if (len >= LONG_TRANSFER_SIZE_MASK)
+	{
+		nameList.clear();
+		len = 0;
+	}
+	len = htonl(len);
+	std::string returnString(((char *)&len), sizeof(uint32_t));
+	returnString += nameList;
+	return returnString;
+}
+
+/***************************************************************
+* Get the list as it goes over the network
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  list built again only if players were added or removed since the last
+*  call. Shared copy returned, it stays valid (and unchanged) for as long as
+*  the caller holds on to it.
+****************************************************************/
+std::shared_ptr<const std::string> LobbyList::GetSerialized()
+{
+	if (!serialized || serializedVersion != version)
+	{
+		serialized = std::make_shared<const std::string>(Serialize());
+		serializedVersion = version;
+	}
+	return serialized;
+}
+
+/***************************************************************
+* Add the next players of a page
+*
+* Preconditions:
+*  cursor set up with the page's prefix, skip and limit, 'after' empty for the
+*  first chunk
+* Postcondition:
+*  [1 byte length][name] entries appended to page (in name order) for players
+*  after cursor.after that start with the prefix, without going over maxBytes.
+*  cursor moved past them. Players joining or leaving in between chunks don't
+*  throw the order off, they just show up or not.
+*  LOBBY_PAGE_END returned if there are no more matching players,
+*  LOBBY_PAGE_FULL if the next one didn't fit, LOBBY_PAGE_LIMIT if the limit
+*  was reached with more players matching after it
+****************************************************************/
+int LobbyList::FillPage(ListCursor & cursor, std::string & page, unsigned int maxBytes) const
+{
+	std::set<std::string>::const_iterator it;
+	if (cursor.after.empty())
+	{
+		it = sortedNames.lower_bound(cursor.prefix);
+	}
+	else
+	{
+		it = sortedNames.upper_bound(cursor.after);
+	}
+	for (; it != sortedNames.end(); ++it)
+	{
+		if (0 != it->compare(0, cursor.prefix.length(), cursor.prefix))
+		{
+			// Sorted, so nothing after this starts with the prefix either
+			break;
+		}
+		if (cursor.skip > 0)
+		{
+			--cursor.skip;
+			cursor.after = *it;
+			continue;
+		}
+		if (cursor.limited && 0 == cursor.left)
+		{
+			return LOBBY_PAGE_LIMIT;
+		}
+		if (page.length() + 1 + it->length() > maxBytes)
+		{
+			return LOBBY_PAGE_FULL;
+		}
+		page += (char)it->length();
+		page += *it;
+		cursor.after = *it;
+		if (cursor.limited)
+		{
+			--cursor.left;
+		}
+	}
+	return LOBBY_PAGE_END;
+}
+
+/***************************************************************
+* Number that goes up every time someone is added or removed
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, version returned
+****************************************************************/
+unsigned int LobbyList::GetVersion() const
+{
+	return version;
+}
+
+/***************************************************************
+* Number of players in the list
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, count returned
+****************************************************************/
+unsigned int LobbyList::GetCount() const
+{
+	return entries.size();
+}
@@ -0,0 +1,77 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class LobbyList:
+ *  The players sitting in FD_STATE_LOBBY, kept ready to send to anyone who
+ *  asks for the players list. Players come and go far less often than the
+ *  list gets asked for, so the list is only built again after it changed,
+ *  and everyone asking for the same version shares one copy of it.
+ *
+ *  Not thread safe, the server keeps it behind a mutex.
+ *
+ * Add(const std::string & name, const ConnRef & ref)
+ *  Put a player into the list
+ * Remove(const ConnRef & ref)
+ *  Take a player back out of the list
+ * GetSerialized()
+ *  The list ready to be written to a connection (length first)
+ * FillPage(ListCursor & cursor, std::string & page, unsigned int maxBytes)
+ *  The next part of a players page, in name order, picking up where 'cursor'
+ *  left off
+ ***********************************/
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <set>
+#include "FdState.h"
+
+// FillPage() results
+// Every matching player has been sent
+#define LOBBY_PAGE_END 0
+// Out of room, more to send in the next chunk
+#define LOBBY_PAGE_FULL 1
+// Sent as many as the page was limited to, more players match after it
+#define LOBBY_PAGE_LIMIT 2
+
+class LobbyList
+{
+public:
+	// Create an empty list
+	LobbyList();
+	// Put a player into the list
+	void Add(const std::string & name, const ConnRef & ref);
+	// Take a player out of the list. Returns false if they weren't in it.
+	bool Remove(const ConnRef & ref);
+	// Get the list as it goes over the network, building it if it changed
+	std::shared_ptr<const std::string> GetSerialized();
+	// Add players after 'cursor' to 'page' as [length][name] entries while it
+	// stays within maxBytes. Returns one of the LOBBY_PAGE_* #defines.
+	int FillPage(ListCursor & cursor, std::string & page, unsigned int maxBytes) const;
+	// Number that goes up every time someone is added or removed
+	unsigned int GetVersion() const;
+	// Number of players in the list
+	unsigned int GetCount() const;
+private:
+	typedef struct lobbyEntry
+	{
+		std::string name;
+		ConnRef ref;
+	} Entry;
+	// Build the list as it goes over the network
+	std::string Serialize() const;
+	// Players, in no particular order (removing one moves the last one into
+	// its spot)
+	std::vector<Entry> entries;
+	// Where each player is in 'entries', by serial
+	std::unordered_map<unsigned int, unsigned int> positions;
+	// The same players' names in order, for pages and prefix searches
+	std::set<std::string> sortedNames;
+	unsigned int version;
+	// Last list built, and the version it was built from
+	std::shared_ptr<const std::string> serialized;
+	unsigned int serializedVersion;
+};
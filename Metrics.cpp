@@ -0,0 +1,528 @@
+#include "Metrics.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the per-reactor counters and histograms, and printing a
+ * snapshot of them for the stats socket.
+ ************************************/
+
+#include "FdState.h"
+
+extern "C"
+{
+	#include <time.h>
+	#include <inttypes.h>
+	#include <stdio.h>
+}
+
+/***************************************************************
+* Empty histogram
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  count, sum and every bucket 0
+****************************************************************/
+MetricsHistogram::MetricsHistogram(): count(0), sum(0)
+{
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		buckets[i] = 0;
+	}
+}
+
+/***************************************************************
+* Count a latency
+*
+* Preconditions:
+*  Only called from the thread that owns this histogram
+* Postcondition:
+*  'nanoseconds' (rounded down to microseconds) added to the sum and counted
+*  in its bucket
+****************************************************************/
+void MetricsHistogram::Record(uint64_t nanoseconds)
+{
+	uint64_t micros = nanoseconds / 1000;
+	// Bucket is how many bits the latency takes
+	int bucket = (0 == micros) ? 0 : 64 - __builtin_clzll(micros);
+	if (bucket >= METRICS_BUCKETS)
+	{
+		bucket = METRICS_BUCKETS - 1;
+	}
+	count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	sum.store(sum.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+	buckets[bucket].store(buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/***************************************************************
+* Add our counts to 'total'
+*
+* Preconditions:
+*  None, safe from any thread
+* Postcondition:
+*  No object changes, count, sum and buckets added to total's. They are read
+*  one at a time, so they can be a few latencies apart from each other.
+****************************************************************/
+void MetricsHistogram::AddTo(MetricsHistogramSnapshot & total) const
+{
+	total.count += count.load(std::memory_order_relaxed);
+	total.sum += sum.load(std::memory_order_relaxed);
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		total.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+	}
+}
+
+/***************************************************************
+* All zeros
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Every counter 0, histograms empty
+****************************************************************/
+Metrics::Metrics(): accepts(0), bytesIn(0), bytesOut(0), loopEnters(0), poolHeapAllocs(0), poolHeapFrees(0), poolReuses(0)
+{
+	for (int i = 0; i < METRICS_STATES; ++i)
+	{
+		states[i] = 0;
+	}
+	for (int i = 0; i < METRICS_ABORT_REASONS; ++i)
+	{
+		aborts[i] = 0;
+	}
+	for (int i = 0; i < METRICS_ACTIONS; ++i)
+	{
+		messages[i] = 0;
+	}
+}
+
+/***************************************************************
+* Add to a counter only this thread writes
+*
+* Preconditions:
+*  Only called from the thread that owns the counter
+* Postcondition:
+*  'by' added. A load and a store instead of fetch_add, since nothing else
+*  writes it, so there is no locked instruction.
+****************************************************************/
+void Metrics::Bump(std::atomic<uint64_t> & counter, uint64_t by)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+/***************************************************************
+* A connection was accepted
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  accepted counted, and one more connection in FD_STATE_ANON
+****************************************************************/
+void Metrics::Accepted()
+{
+	Bump(accepts, 1);
+	states[FD_STATE_ANON].store(states[FD_STATE_ANON].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/***************************************************************
+* A connection went from state 'from' to 'to'
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  One fewer connection in 'from' and one more in 'to' (states outside
+*  0 to METRICS_STATES-1 not tracked)
+****************************************************************/
+void Metrics::StateChanged(short from, short to)
+{
+	if (from >= 0 && from < METRICS_STATES)
+	{
+		states[from].store(states[from].load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	}
+	if (to >= 0 && to < METRICS_STATES)
+	{
+		states[to].store(states[to].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+/***************************************************************
+* A connection was aborted
+*
+* Preconditions:
+*  Only called from the owning reactor's thread, reason one of the
+*  METRICS_ABORT_* #defines
+* Postcondition:
+*  abort counted under 'reason', one fewer connection in 'state'
+****************************************************************/
+void Metrics::Aborted(short state, int reason)
+{
+	if (reason >= 0 && reason < METRICS_ABORT_REASONS)
+	{
+		Bump(aborts[reason], 1);
+	}
+	if (state >= 0 && state < METRICS_STATES)
+	{
+		states[state].store(states[state].load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+	}
+}
+
+/***************************************************************
+* A message was read
+*
+* Preconditions:
+*  Only called from the owning reactor's thread, header the message's first
+*  word in host order
+* Postcondition:
+*  message counted under its ACTION_* number
+****************************************************************/
+void Metrics::Message(uint32_t header)
+{
+	Bump(messages[header >> METRICS_ACTION_SHIFT], 1);
+}
+
+/***************************************************************
+* Bytes read from connections
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  count added to the bytes read
+****************************************************************/
+void Metrics::BytesIn(uint64_t count)
+{
+	Bump(bytesIn, count);
+}
+
+/***************************************************************
+* Bytes written to connections
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  count added to the bytes written
+****************************************************************/
+void Metrics::BytesOut(uint64_t count)
+{
+	Bump(bytesOut, count);
+}
+
+/***************************************************************
+* The event loop called epoll_wait() or io_uring_enter()
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  count added to the calls made, so the backends' syscalls per message can
+*  be compared
+****************************************************************/
+void Metrics::LoopEntered(uint64_t count)
+{
+	Bump(loopEnters, count);
+}
+
+/***************************************************************
+* The reactor thread's BufferPool went to the heap for a buffer
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  heap allocation counted
+****************************************************************/
+void Metrics::PoolHeapAllocated()
+{
+	Bump(poolHeapAllocs, 1);
+}
+
+/***************************************************************
+* The reactor thread's BufferPool gave a buffer back to the heap
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  heap free counted
+****************************************************************/
+void Metrics::PoolHeapFreed()
+{
+	Bump(poolHeapFrees, 1);
+}
+
+/***************************************************************
+* The reactor thread's BufferPool answered a Get() from a free list
+*
+* Preconditions:
+*  Only called from the owning reactor's thread
+* Postcondition:
+*  reuse counted
+****************************************************************/
+void Metrics::PoolReused()
+{
+	Bump(poolReuses, 1);
+}
+
+/***************************************************************
+* Get the players list build time histogram
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, histogram returned
+****************************************************************/
+MetricsHistogram & Metrics::ListBuild()
+{
+	return listBuild;
+}
+
+/***************************************************************
+* Get the players page chunk fill time histogram
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, histogram returned
+****************************************************************/
+MetricsHistogram & Metrics::PageFill()
+{
+	return pageFill;
+}
+
+/***************************************************************
+* Get the move relay latency histogram
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, histogram returned
+****************************************************************/
+MetricsHistogram & Metrics::Relay()
+{
+	return relay;
+}
+
+/***************************************************************
+* Add everything to 'total'
+*
+* Preconditions:
+*  None, safe from any thread
+* Postcondition:
+*  No object changes, every counter and histogram added to total's
+****************************************************************/
+void Metrics::AddTo(MetricsSnapshot & total) const
+{
+	for (int i = 0; i < METRICS_STATES; ++i)
+	{
+		total.states[i] += states[i].load(std::memory_order_relaxed);
+	}
+	total.accepts += accepts.load(std::memory_order_relaxed);
+	for (int i = 0; i < METRICS_ABORT_REASONS; ++i)
+	{
+		total.aborts[i] += aborts[i].load(std::memory_order_relaxed);
+	}
+	for (int i = 0; i < METRICS_ACTIONS; ++i)
+	{
+		total.messages[i] += messages[i].load(std::memory_order_relaxed);
+	}
+	total.bytesIn += bytesIn.load(std::memory_order_relaxed);
+	total.bytesOut += bytesOut.load(std::memory_order_relaxed);
+	total.loopEnters += loopEnters.load(std::memory_order_relaxed);
+	total.poolHeapAllocs += poolHeapAllocs.load(std::memory_order_relaxed);
+	total.poolHeapFrees += poolHeapFrees.load(std::memory_order_relaxed);
+	total.poolReuses += poolReuses.load(std::memory_order_relaxed);
+	listBuild.AddTo(total.listBuild);
+	pageFill.AddTo(total.pageFill);
+	relay.AddTo(total.relay);
+}
+
+/***************************************************************
+* Monotonic clock in nanoseconds
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  nanoseconds since some fixed point returned (never 0)
+****************************************************************/
+uint64_t metricsNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/***************************************************************
+* Zero a histogram snapshot
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  count, sum and buckets 0
+****************************************************************/
+static void clearHistogram(MetricsHistogramSnapshot & histogram)
+{
+	histogram.count = 0;
+	histogram.sum = 0;
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		histogram.buckets[i] = 0;
+	}
+}
+
+/***************************************************************
+* Zero a snapshot before adding reactors to it
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  every number in snapshot 0
+****************************************************************/
+void clearMetrics(MetricsSnapshot & snapshot)
+{
+	for (int i = 0; i < METRICS_STATES; ++i)
+	{
+		snapshot.states[i] = 0;
+	}
+	snapshot.accepts = 0;
+	for (int i = 0; i < METRICS_ABORT_REASONS; ++i)
+	{
+		snapshot.aborts[i] = 0;
+	}
+	for (int i = 0; i < METRICS_ACTIONS; ++i)
+	{
+		snapshot.messages[i] = 0;
+	}
+	snapshot.bytesIn = 0;
+	snapshot.bytesOut = 0;
+	snapshot.loopEnters = 0;
+	snapshot.poolHeapAllocs = 0;
+	snapshot.poolHeapFrees = 0;
+	snapshot.poolReuses = 0;
+	clearHistogram(snapshot.listBuild);
+	clearHistogram(snapshot.pageFill);
+	clearHistogram(snapshot.relay);
+}
+
+/***************************************************************
+* Find a percentile of a histogram
+*
+* Preconditions:
+*  0 < fraction <= 1
+* Postcondition:
+*  No changes. Upper bound in microseconds of the bucket holding that
+*  fraction of the latencies returned (0 if it is empty)
+****************************************************************/
+static uint64_t histogramPercentile(const MetricsHistogramSnapshot & histogram, double fraction)
+{
+	uint64_t seen = 0;
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		seen += histogram.buckets[i];
+		if (histogram.count > 0 && seen >= fraction*histogram.count)
+		{
+			return (uint64_t)1 << i;
+		}
+	}
+	return 0;
+}
+
+/***************************************************************
+* Add a "name value" line
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  line added to the end of out
+****************************************************************/
+static void addLine(std::string & out, const char * name, int64_t value)
+{
+	char line[96];
+	snprintf(line, sizeof(line), "%s %" PRId64 "\n", name, value);
+	out += line;
+}
+
+/***************************************************************
+* Add the lines for one histogram
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  name_count, name_sum_us, approximate name_p50_us, _p90_us and _p99_us, and
+*  name_bucket_us_<upper bound> for each bucket with anything in it added to
+*  out
+****************************************************************/
+static void addHistogram(std::string & out, const char * name, const MetricsHistogramSnapshot & histogram)
+{
+	char label[64];
+	snprintf(label, sizeof(label), "%s_count", name);
+	addLine(out, label, histogram.count);
+	snprintf(label, sizeof(label), "%s_sum_us", name);
+	addLine(out, label, histogram.sum);
+	snprintf(label, sizeof(label), "%s_p50_us", name);
+	addLine(out, label, histogramPercentile(histogram, 0.5));
+	snprintf(label, sizeof(label), "%s_p90_us", name);
+	addLine(out, label, histogramPercentile(histogram, 0.9));
+	snprintf(label, sizeof(label), "%s_p99_us", name);
+	addLine(out, label, histogramPercentile(histogram, 0.99));
+	for (int i = 0; i < METRICS_BUCKETS; ++i)
+	{
+		if (histogram.buckets[i])
+		{
+			snprintf(label, sizeof(label), "%s_bucket_us_%" PRIu64, name, (uint64_t)1 << i);
+			addLine(out, label, histogram.buckets[i]);
+		}
+	}
+}
+
+/***************************************************************
+* Print a snapshot
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  One "name value" line per total (BufferPool heap use included), per
+*  state, abort reason and ACTION_* number seen, and per histogram number
+*  returned. States and actions are named by number (FD_STATE_*, and
+*  ACTION_* >> METRICS_ACTION_SHIFT).
+****************************************************************/
+std::string formatMetrics(const MetricsSnapshot & snapshot)
+{
+	static const char * abortNames[METRICS_ABORT_REASONS] = {"aborts_read", "aborts_write", "aborts_hangup", "aborts_protocol", "aborts_partner", "aborts_timeout"};
+	std::string out;
+	char label[64];
+	int64_t connections = 0;
+	for (int i = 0; i < METRICS_STATES; ++i)
+	{
+		connections += snapshot.states[i];
+	}
+	addLine(out, "connections", connections);
+	for (int i = 0; i < METRICS_STATES; ++i)
+	{
+		if (snapshot.states[i])
+		{
+			snprintf(label, sizeof(label), "connections_state_%d", i);
+			addLine(out, label, snapshot.states[i]);
+		}
+	}
+	addLine(out, "accepts", snapshot.accepts);
+	for (int i = 0; i < METRICS_ABORT_REASONS; ++i)
+	{
+		addLine(out, abortNames[i], snapshot.aborts[i]);
+	}
+	for (int i = 0; i < METRICS_ACTIONS; ++i)
+	{
+		if (snapshot.messages[i])
+		{
+			snprintf(label, sizeof(label), "messages_action_%d", i);
+			addLine(out, label, snapshot.messages[i]);
+		}
+	}
+	addLine(out, "bytes_in", snapshot.bytesIn);
+	addLine(out, "bytes_out", snapshot.bytesOut);
+	addLine(out, "loop_enters", snapshot.loopEnters);
+	addLine(out, "pool_heap_allocs", snapshot.poolHeapAllocs);
+	addLine(out, "pool_heap_frees", snapshot.poolHeapFrees);
+	addLine(out, "pool_reuses", snapshot.poolReuses);
+	addHistogram(out, "list_build", snapshot.listBuild);
+	addHistogram(out, "page_fill", snapshot.pageFill);
+	addHistogram(out, "relay", snapshot.relay);
+	return out;
+}
@@ -0,0 +1,160 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class Metrics:
+ *  Counters and latency histograms for one reactor. Only the reactor's own
+ *  thread adds to them, so each one is a plain load and store (no locked
+ *  instructions), but they are atomics so the stats thread can read them
+ *  while the reactor runs. A snapshot adds up every reactor's.
+ *
+ *  Connections per state are counted as how many came into and went out of
+ *  each state on this reactor, so a connection handed to another reactor
+ *  still comes out right once they are added up.
+ *
+ * class MetricsHistogram:
+ *  Latencies in microseconds, bucketed by powers of two
+ *
+ * MetricsSnapshot
+ *  Plain copy of the numbers, what AddTo() adds into and formatMetrics()
+ *  prints
+ ***********************************/
+
+#include <atomic>
+#include <string>
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// FD_STATE_* numbers tracked (all of them are less than this)
+#define METRICS_STATES 32
+// ACTION_* numbers tracked, (header & ACTION_MASK) >> METRICS_ACTION_SHIFT
+#define METRICS_ACTIONS 64
+#define METRICS_ACTION_SHIFT 26
+// Histogram bucket i holds latencies under 2^i microseconds (and at least
+// 2^(i-1)), the last one everything longer
+#define METRICS_BUCKETS 32
+
+// Why a connection was aborted
+// read() failed or the client hung up while we were reading
+#define METRICS_ABORT_READ 0
+// write() failed
+#define METRICS_ABORT_WRITE 1
+// Hung up while we weren't reading from it
+#define METRICS_ABORT_HANGUP 2
+// Sent something the protocol doesn't allow
+#define METRICS_ABORT_PROTOCOL 3
+// The player it was playing (or about to) misbehaved or went away
+#define METRICS_ABORT_PARTNER 4
+// Sat in one state past its deadline
+#define METRICS_ABORT_TIMEOUT 5
+#define METRICS_ABORT_REASONS 6
+
+// Plain copy of one histogram
+typedef struct metricsHistogramSnapshot
+{
+	uint64_t count;
+	// Microseconds
+	uint64_t sum;
+	uint64_t buckets[METRICS_BUCKETS];
+} MetricsHistogramSnapshot;
+
+// Plain copy of the numbers, summed over however many reactors
+typedef struct metricsSnapshot
+{
+	int64_t states[METRICS_STATES];
+	uint64_t accepts;
+	uint64_t aborts[METRICS_ABORT_REASONS];
+	uint64_t messages[METRICS_ACTIONS];
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	// epoll_wait() or io_uring_enter() calls the event loops made
+	uint64_t loopEnters;
+	// BufferPool buffers that came from or went back to the heap, and Get()s
+	// answered from a free list
+	uint64_t poolHeapAllocs;
+	uint64_t poolHeapFrees;
+	uint64_t poolReuses;
+	// Building the whole players list (ACTION_REQ_PLAYERS_LIST)
+	MetricsHistogramSnapshot listBuild;
+	// Filling one chunk of a players page
+	MetricsHistogramSnapshot pageFill;
+	// Move (or its results) read from one player until written to the other
+	MetricsHistogramSnapshot relay;
+} MetricsSnapshot;
+
+class MetricsHistogram
+{
+public:
+	// Empty histogram
+	MetricsHistogram();
+	// Count a latency of 'nanoseconds' (only from the owning thread)
+	void Record(uint64_t nanoseconds);
+	// Add our counts to 'total'
+	void AddTo(MetricsHistogramSnapshot & total) const;
+private:
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> buckets[METRICS_BUCKETS];
+};
+
+class Metrics
+{
+public:
+	// All zeros
+	Metrics();
+	// A connection was accepted (it starts in FD_STATE_ANON)
+	void Accepted();
+	// A connection went from state 'from' to 'to'
+	void StateChanged(short from, short to);
+	// A connection in 'state' was aborted for 'reason' (METRICS_ABORT_*)
+	void Aborted(short state, int reason);
+	// A message starting with 'header' (host order) was read
+	void Message(uint32_t header);
+	// Bytes read from or written to connections
+	void BytesIn(uint64_t count);
+	void BytesOut(uint64_t count);
+	// The event loop called epoll_wait() or io_uring_enter() 'count' times
+	void LoopEntered(uint64_t count);
+	// The reactor thread's BufferPool went to the heap for a buffer, gave one
+	// back to it, or reused one
+	void PoolHeapAllocated();
+	void PoolHeapFreed();
+	void PoolReused();
+	// How long building the players list, filling a players page chunk or
+	// relaying a move took
+	MetricsHistogram & ListBuild();
+	MetricsHistogram & PageFill();
+	MetricsHistogram & Relay();
+	// Add everything to 'total' (safe from any thread)
+	void AddTo(MetricsSnapshot & total) const;
+private:
+	Metrics(const Metrics &) = delete;
+	Metrics & operator=(const Metrics &) = delete;
+	// Add to a counter only this thread writes
+	static void Bump(std::atomic<uint64_t> & counter, uint64_t by);
+	// Connections that came into (+) and went out of (-) each state here
+	std::atomic<int64_t> states[METRICS_STATES];
+	std::atomic<uint64_t> accepts;
+	std::atomic<uint64_t> aborts[METRICS_ABORT_REASONS];
+	std::atomic<uint64_t> messages[METRICS_ACTIONS];
+	std::atomic<uint64_t> bytesIn;
+	std::atomic<uint64_t> bytesOut;
+	std::atomic<uint64_t> loopEnters;
+	std::atomic<uint64_t> poolHeapAllocs;
+	std::atomic<uint64_t> poolHeapFrees;
+	std::atomic<uint64_t> poolReuses;
+	MetricsHistogram listBuild;
+	MetricsHistogram pageFill;
+	MetricsHistogram relay;
+};
+
+// Monotonic clock in nanoseconds, for timing things to Record()
+uint64_t metricsNow();
+// Zero a snapshot before adding reactors to it
+void clearMetrics(MetricsSnapshot & snapshot);
+// One "name value" line per number that isn't zero (plus the percentiles of
+// each histogram)
+std::string formatMetrics(const MetricsSnapshot & snapshot);
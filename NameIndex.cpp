@@ -0,0 +1,240 @@
+#include "NameIndex.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the player name hash table.
+ ************************************/
+
+#include <utility>
+
+// Values for Slot::use
+#define NAME_SLOT_EMPTY 0
+#define NAME_SLOT_USED 1
+#define NAME_SLOT_DEAD 2
+
+/***************************************************************
+* Create an empty index
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Index with no names in it
+****************************************************************/
+NameIndex::NameIndex(): count(0), usedOrDead(0)
+{
+	Slot blank;
+	blank.use = NAME_SLOT_EMPTY;
+	blank.invitable = false;
+	blank.hash = 0;
+	blank.ref = {-1, -1, 0};
+	slots.resize(NAME_INDEX_INITIAL_SLOTS, blank);
+}
+
+/***************************************************************
+* Hash a name (FNV-1a)
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  hash of name returned
+****************************************************************/
+unsigned int NameIndex::Hash(const std::string & name)
+{
+	unsigned int hash = 2166136261u;
+	for (unsigned char c: name)
+	{
+		hash ^= c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/***************************************************************
+* Find the slot holding 'name'
+*
+* Preconditions:
+*  hash is Hash(name)
+* Postcondition:
+*  No object changes, slot number returned, or -1 if the name isn't here
+****************************************************************/
+int NameIndex::Lookup(const std::string & name, unsigned int hash) const
+{
+	unsigned int mask = slots.size() - 1;
+	for (unsigned int i = hash & mask; ; i = (i + 1) & mask)
+	{
+		const Slot & slot = slots[i];
+		if (NAME_SLOT_EMPTY == slot.use)
+		{
+			return -1;
+		}
+		if (NAME_SLOT_USED == slot.use && slot.hash == hash && slot.name == name)
+		{
+			return i;
+		}
+	}
+}
+
+/***************************************************************
+* Move everything into a table of 'newSize' slots
+*
+* Preconditions:
+*  newSize a power of 2 bigger than the number of names
+* Postcondition:
+*  names moved over, tombstones dropped
+****************************************************************/
+void NameIndex::Rehash(unsigned int newSize)
+{
+	std::vector<Slot> old;
+	old.swap(slots);
+	Slot blank;
+	blank.use = NAME_SLOT_EMPTY;
+	blank.invitable = false;
+	blank.hash = 0;
+	blank.ref = {-1, -1, 0};
+	slots.resize(newSize, blank);
+	unsigned int mask = newSize - 1;
+	for (auto& slot: old)
+	{
+		if (NAME_SLOT_USED != slot.use)
+		{
+			continue;
+		}
+		unsigned int i = slot.hash & mask;
+		while (NAME_SLOT_EMPTY != slots[i].use)
+		{
+			i = (i + 1) & mask;
+		}
+		slots[i] = std::move(slot);
+	}
+	usedOrDead = count;
+}
+
+/***************************************************************
+* Give 'name' to 'ref' if no one has it
+*
+* Preconditions:
+*  ref a connection that doesn't have a name yet
+* Postcondition:
+*  true returned and name recorded (not invitable yet), or false returned
+*  if someone already has it
+****************************************************************/
+bool NameIndex::Claim(const std::string & name, const ConnRef & ref)
+{
+	unsigned int hash = Hash(name);
+	if (-1 != Lookup(name, hash))
+	{
+		return false;
+	}
+	// Keep at least half the slots empty so probes stay short. Grow if it is
+	// mostly names, otherwise just sweep the tombstones out.
+	if ((usedOrDead + 1) * 2 > slots.size())
+	{
+		Rehash((count + 1) * 4 > slots.size() ? slots.size() * 2 : slots.size());
+	}
+	unsigned int mask = slots.size() - 1;
+	unsigned int i = hash & mask;
+	while (NAME_SLOT_USED == slots[i].use)
+	{
+		i = (i + 1) & mask;
+	}
+	if (NAME_SLOT_EMPTY == slots[i].use)
+	{
+		++usedOrDead;
+	}
+	slots[i].use = NAME_SLOT_USED;
+	slots[i].invitable = false;
+	slots[i].hash = hash;
+	slots[i].ref = ref;
+	slots[i].name = name;
+	++count;
+	return true;
+}
+
+/***************************************************************
+* Free up 'name' if 'ref' is the connection that has it
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  name no longer taken (if it was ref's)
+****************************************************************/
+void NameIndex::Release(const std::string & name, const ConnRef & ref)
+{
+	int i = Lookup(name, Hash(name));
+	// Serials are never reused, so they alone say whose name it is (the
+	// reactor and fd change when a connection is handed to another thread)
+	if (-1 == i || slots[i].ref.serial != ref.serial)
+	{
+		return;
+	}
+	slots[i].use = NAME_SLOT_DEAD;
+	slots[i].invitable = false;
+	slots[i].name.clear();
+	--count;
+}
+
+/***************************************************************
+* Note the player with 'name' becoming invitable or not
+*
+* Preconditions:
+*  ref the connection that claimed name
+* Postcondition:
+*  name's invitable flag set, and its location updated to ref
+****************************************************************/
+void NameIndex::SetInvitable(const std::string & name, const ConnRef & ref, bool invitable)
+{
+	int i = Lookup(name, Hash(name));
+	if (-1 == i || slots[i].ref.serial != ref.serial)
+	{
+		return;
+	}
+	slots[i].invitable = invitable;
+	slots[i].ref = ref;
+}
+
+/***************************************************************
+* Check if anyone has 'name'
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if the name is taken
+****************************************************************/
+bool NameIndex::IsTaken(const std::string & name) const
+{
+	return -1 != Lookup(name, Hash(name));
+}
+
+/***************************************************************
+* Find the player with 'name' if they can be invited
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes. true returned with 'found' set to where the player's
+*  connection lives if they can be invited, false otherwise
+****************************************************************/
+bool NameIndex::FindInvitable(const std::string & name, ConnRef & found) const
+{
+	int i = Lookup(name, Hash(name));
+	if (-1 == i || !slots[i].invitable)
+	{
+		return false;
+	}
+	found = slots[i].ref;
+	return true;
+}
+
+/***************************************************************
+* Number of names given out
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, count returned
+****************************************************************/
+unsigned int NameIndex::GetCount() const
+{
+	return count;
+}
@@ -0,0 +1,72 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class NameIndex:
+ *  Hash table (open addressing, linear probing) from player name to where that
+ *  player's connection lives. A name is in the index from the time the server
+ *  gives it to a player until they disconnect, so it answers both "is this
+ *  name taken?" and "can this player be invited right now?" (they are in the
+ *  lobby, or answering another invitation) without looking at every
+ *  connection.
+ *
+ *  Not thread safe, the server keeps it behind a mutex.
+ *
+ * Claim(const std::string & name, const ConnRef & ref)
+ *  Give 'name' to the connection 'ref' unless someone already has it
+ * Release(const std::string & name, const ConnRef & ref)
+ *  The connection that had 'name' is gone, free the name up
+ * SetInvitable(const std::string & name, const ConnRef & ref, bool invitable)
+ *  Note the player with 'name' becoming invitable or not
+ * FindInvitable(const std::string & name, ConnRef & found)
+ *  Find a player that can be invited by name
+ ***********************************/
+
+#include <string>
+#include <vector>
+#include "FdState.h"
+
+// Start with room for this many names (must be a power of 2)
+#define NAME_INDEX_INITIAL_SLOTS 64
+
+class NameIndex
+{
+public:
+	// Create an empty index
+	NameIndex();
+	// Give 'name' to 'ref' if no one has it. Returns false if it is taken.
+	bool Claim(const std::string & name, const ConnRef & ref);
+	// Free up 'name' if 'ref' is the connection that has it
+	void Release(const std::string & name, const ConnRef & ref);
+	// Note the player with 'name' becoming invitable or not
+	void SetInvitable(const std::string & name, const ConnRef & ref, bool invitable);
+	// Check if anyone has 'name'
+	bool IsTaken(const std::string & name) const;
+	// Find the player with 'name' if they can be invited
+	bool FindInvitable(const std::string & name, ConnRef & found) const;
+	// Number of names given out
+	unsigned int GetCount() const;
+private:
+	typedef struct nameSlot
+	{
+		// Never used, used, or used and then freed (a tombstone, so probing
+		// keeps going past it)
+		char use;
+		bool invitable;
+		unsigned int hash;
+		ConnRef ref;
+		std::string name;
+	} Slot;
+	// Hash a name (FNV-1a)
+	static unsigned int Hash(const std::string & name);
+	// Find the slot holding 'name', or -1
+	int Lookup(const std::string & name, unsigned int hash) const;
+	// Make the table twice as big (or just clear tombstones out)
+	void Rehash(unsigned int newSize);
+	std::vector<Slot> slots;
+	// Slots holding a name
+	unsigned int count;
+	// Slots holding a name or a tombstone
+	unsigned int usedOrDead;
+};
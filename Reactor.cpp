@@ -0,0 +1,456 @@
+#include "Reactor.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements one event loop thread's worth of server state, plus the mailbox
+ * the reactor threads use to hand work to each other.
+ ************************************/
+
+#include <atomic>
+#include <utility>
+
+extern "C"
+{
+	#include <unistd.h>
+	#include <stdint.h>
+	#include <sys/eventfd.h>
+	// for perror
+	#include <stdio.h>
+}
+
+/***************************************************************
+* Create reactor number 'id' with an empty connection set
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  Reactor created with its wakeup eventfd already being watched by its loop
+*  (GetWakeFD() returns -1 if the eventfd couldn't be made). No listening
+*  socket yet. If !useEpoll the loop only records interest changes.
+****************************************************************/
+Reactor::Reactor(int Id, bool useEpoll): id(Id), loop(useEpoll), listenFd(-1), wakeFd(-1), recorder(Id), timers(metricsNow() / 1000000)
+{
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (-1 == wakeFd)
+	{
+		perror("Trouble creating the reactor wakeup eventfd");
+	}
+	else
+	{
+		loop.AddRead(wakeFd);
+	}
+}
+
+/***************************************************************
+* Close the wakeup fd and any connections still around
+*
+* Preconditions:
+*  Reactor's thread has stopped
+* Postcondition:
+*  fds owned by the reactor closed, handed over connections that were never
+*  picked up freed
+****************************************************************/
+Reactor::~Reactor()
+{
+	for (unsigned int chunk = 0; chunk < chunks.size(); ++chunk)
+	{
+		for (int i = 0; i < REACTOR_SLAB_CHUNK; ++i)
+		{
+			if (chunks[chunk][i].GetFD() == (int)(chunk * REACTOR_SLAB_CHUNK + i))
+			{
+				close(chunks[chunk][i].GetFD());
+			}
+		}
+		delete [] chunks[chunk];
+	}
+	for (auto& msg: mailbox)
+	{
+		delete msg.conn;
+	}
+	if (-1 != wakeFd)
+	{
+		close(wakeFd);
+	}
+}
+
+/***************************************************************
+* Get this reactor's number
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, reactor number returned
+****************************************************************/
+int Reactor::GetId() const
+{
+	return id;
+}
+
+/***************************************************************
+* Get this reactor's event loop
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  Reference to the loop returned
+****************************************************************/
+EventLoop & Reactor::GetLoop()
+{
+	return loop;
+}
+
+/***************************************************************
+* Get the fd that becomes readable when messages are waiting
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, eventfd returned
+****************************************************************/
+int Reactor::GetWakeFD() const
+{
+	return wakeFd;
+}
+
+/***************************************************************
+* Get this reactor's listening socket
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, listening fd returned (-1 if not set yet)
+****************************************************************/
+int Reactor::GetListenFD() const
+{
+	return listenFd;
+}
+
+/***************************************************************
+* Set this reactor's listening socket
+*
+* Preconditions:
+*  fd a listening socket already added to our connection set
+* Postcondition:
+*  listening fd saved
+****************************************************************/
+void Reactor::SetListenFD(int fd)
+{
+	listenFd = fd;
+}
+
+/***************************************************************
+* Hand out a serial number no other connection has
+*
+* Preconditions:
+*  None, safe from any thread
+* Postcondition:
+*  new nonzero serial returned
+****************************************************************/
+unsigned int Reactor::NextSerial()
+{
+	static std::atomic<unsigned int> lastSerial(0);
+	unsigned int serial = ++lastSerial;
+	if (0 == serial)
+	{
+		// Wrapped around, 0 means 'never set'
+		serial = ++lastSerial;
+	}
+	return serial;
+}
+
+/***************************************************************
+* Find one of our connections by its fd
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  nullptr returned if the fd isn't one of our connections, otherwise pointer
+*  to its slot (good until that connection is removed)
+****************************************************************/
+FdState * Reactor::FindByFd(int fd)
+{
+	if (fd < 0 || (unsigned int)(fd / REACTOR_SLAB_CHUNK) >= chunks.size())
+	{
+		return nullptr;
+	}
+	FdState * state = &chunks[fd / REACTOR_SLAB_CHUNK][fd % REACTOR_SLAB_CHUNK];
+	if (state->GetFD() != fd)
+	{
+		// Free slot
+		return nullptr;
+	}
+	return state;
+}
+
+/***************************************************************
+* Find one of our connections by a reference to it
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  nullptr returned if the connection has gone away (or the ref is for
+*  another reactor), otherwise pointer to its state
+****************************************************************/
+FdState * Reactor::Find(const ConnRef & ref)
+{
+	if (ref.reactor != id)
+	{
+		return nullptr;
+	}
+	FdState * state = FindByFd(ref.fd);
+	if (nullptr == state || state->GetSerial() != ref.serial)
+	{
+		return nullptr;
+	}
+	return state;
+}
+
+/***************************************************************
+* Get a reference other reactors can use to find 'state'
+*
+* Preconditions:
+*  state is one of our connections
+* Postcondition:
+*  No object changes, reference returned
+****************************************************************/
+ConnRef Reactor::RefTo(const FdState & state) const
+{
+	ConnRef ref;
+	ref.reactor = id;
+	ref.fd = state.GetFD();
+	ref.serial = state.GetSerial();
+	return ref;
+}
+
+/***************************************************************
+* Slot for 'fd' (free or not), making its chunk if needed
+*
+* Preconditions:
+*  fd >= 0
+* Postcondition:
+*  Reference to the slot returned. Chunks up to fd's are allocated, all free.
+****************************************************************/
+FdState & Reactor::Slot(int fd)
+{
+	while ((unsigned int)(fd / REACTOR_SLAB_CHUNK) >= chunks.size())
+	{
+		chunks.push_back(new FdState[REACTOR_SLAB_CHUNK]);
+	}
+	return chunks[fd / REACTOR_SLAB_CHUNK][fd % REACTOR_SLAB_CHUNK];
+}
+
+/***************************************************************
+* Start tracking 'fd' in 'state'
+*
+* Preconditions:
+*  fd isn't already one of our connections
+* Postcondition:
+*  fd's slot set up with no reads/writes in progress and returned
+****************************************************************/
+FdState * Reactor::AddFd(int fd, short state)
+{
+	FdState & slot = Slot(fd);
+	slot = FdState(fd, state);
+	return &slot;
+}
+
+/***************************************************************
+* Move a connection from another reactor into our slab
+*
+* Preconditions:
+*  state came from another reactor's DetachFd()
+* Postcondition:
+*  state moved (buffers and all) into its fd's slot, which is returned.
+*  'state' is left empty for the caller to delete.
+****************************************************************/
+FdState * Reactor::AdoptFd(FdState & state)
+{
+	FdState & slot = Slot(state.GetFD());
+	slot = std::move(state);
+	return &slot;
+}
+
+/***************************************************************
+* Move a connection out of our slab so it can be handed to another reactor
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  connection for fd moved to a new heap FdState (caller owns it) and its slot
+*  freed, or nullptr returned if the fd wasn't ours
+****************************************************************/
+FdState * Reactor::DetachFd(int fd)
+{
+	FdState * slot = FindByFd(fd);
+	if (nullptr == slot)
+	{
+		return nullptr;
+	}
+	FdState * state = new FdState(std::move(*slot));
+	*slot = FdState();
+	return state;
+}
+
+/***************************************************************
+* Stop tracking fd and free its slot (does not close the fd)
+*
+* Preconditions:
+*  No one is going to use the connection's FdState after this
+* Postcondition:
+*  slot for fd freed (along with its buffers). Returns 1 if the fd wasn't
+*  ours.
+****************************************************************/
+int Reactor::RemoveFd(int fd)
+{
+	FdState * slot = FindByFd(fd);
+	if (nullptr == slot)
+	{
+		return 1;
+	}
+	*slot = FdState();
+	return 0;
+}
+
+/***************************************************************
+* Invitations waiting for our players to answer them
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  Reference to the invitation table returned
+****************************************************************/
+InviteTable & Reactor::GetInvites()
+{
+	return invites;
+}
+
+/***************************************************************
+* Get this reactor's counters and histograms
+*
+* Preconditions:
+*  Only add to them from this reactor's thread
+* Postcondition:
+*  No object changes, metrics returned
+****************************************************************/
+Metrics & Reactor::GetMetrics()
+{
+	return metrics;
+}
+
+/***************************************************************
+* Get this reactor's flight recorder
+*
+* Preconditions:
+*  Only record into it from this reactor's thread
+* Postcondition:
+*  No object changes, recorder returned
+****************************************************************/
+FlightRecorder & Reactor::GetFlightRecorder()
+{
+	return recorder;
+}
+
+/***************************************************************
+* Get this reactor's connection deadlines
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  No object changes, timer wheel returned (its clock is metricsNow() in
+*  milliseconds)
+****************************************************************/
+TimerWheel & Reactor::GetTimers()
+{
+	return timers;
+}
+
+/***************************************************************
+* Remember that 'fd' has bytes read ahead that weren't parsed yet
+*
+* Preconditions:
+*  Only called from this reactor's thread, fd >= 0
+* Postcondition:
+*  fd will be in the next TakeBuffered() (once, however often it is noted)
+****************************************************************/
+void Reactor::NoteBuffered(int fd)
+{
+	if ((unsigned int)fd >= inBuffered.size())
+	{
+		inBuffered.resize(fd+1, false);
+	}
+	if (!inBuffered[fd])
+	{
+		inBuffered[fd] = true;
+		buffered.push_back(fd);
+	}
+}
+
+/***************************************************************
+* Get (and forget) the fds noted with NoteBuffered()
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  'fds' replaced with the noted fds (each listed once), list emptied. The
+*  connections may have closed or had their fd reused since.
+****************************************************************/
+void Reactor::TakeBuffered(std::vector<int> & fds)
+{
+	fds.clear();
+	fds.swap(buffered);
+	for (auto fd: fds)
+	{
+		inBuffered[fd] = false;
+	}
+}
+
+/***************************************************************
+* Queue a message for this reactor. Safe to call from any thread.
+*
+* Preconditions:
+*  msg.conn (if set) is heap allocated and not used by the caller afterwards
+* Postcondition:
+*  message queued, reactor's loop woken up if it wasn't already due to be
+****************************************************************/
+void Reactor::Post(const ReactorMessage & msg)
+{
+	bool wasEmpty;
+	{
+		std::lock_guard<std::mutex> lock(mailboxMutex);
+		wasEmpty = mailbox.empty();
+		mailbox.push_back(msg);
+	}
+	if (wasEmpty)
+	{
+		// Only the first message needs to wake the loop, the rest get picked up
+		// with it
+		uint64_t one = 1;
+		if (sizeof(one) != write(wakeFd, &one, sizeof(one)))
+		{
+			perror("Trouble waking up a reactor");
+		}
+	}
+}
+
+/***************************************************************
+* Take all waiting messages
+*
+* Preconditions:
+*  Only called from this reactor's thread
+* Postcondition:
+*  'messages' replaced with everything that was waiting, mailbox emptied and
+*  eventfd reset
+****************************************************************/
+void Reactor::TakeMessages(std::vector<ReactorMessage> & messages)
+{
+	uint64_t count;
+	// Clear the wakeup. Nothing to read just means we drained it already.
+	if (-1 == read(wakeFd, &count, sizeof(count)))
+	{
+		count = 0;
+	}
+	messages.clear();
+	std::lock_guard<std::mutex> lock(mailboxMutex);
+	messages.swap(mailbox);
+}
@@ -0,0 +1,154 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class Reactor:
+ *  One event loop thread of the server. Each reactor has its own listening
+ *  socket (all bound to the same port with SO_REUSEPORT, so the kernel spreads
+ *  new connections between them), its own epoll loop, and its own set of
+ *  connections that only its thread touches.
+ *
+ *  Connections live in a slab of FdState slots indexed by fd. Slots are
+ *  allocated a chunk at a time and never move, so adding, finding and removing
+ *  a connection is a couple of array lookups and a pointer to a connection
+ *  stays good until it is removed. Anything kept longer than that (like the
+ *  partner link between two players) is kept as a ConnRef, whose serial
+ *  doubles as the slot's generation: Find() gives nullptr once the
+ *  connection it was for is gone, even if the fd has been reused.
+ *
+ *  Reactors talk to each other by posting ReactorMessages to each other's
+ *  mailbox. Posting is the only Reactor call that is safe from another thread;
+ *  it wakes the receiving loop up through an eventfd.
+ ***********************************/
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include "EventLoop.h"
+#include "FdState.h"
+#include "InviteTable.h"
+#include "Metrics.h"
+#include "FlightRecorder.h"
+#include "TimerWheel.h"
+
+// Number of connection slots allocated at a time
+#define REACTOR_SLAB_CHUNK 256
+
+// Ask the reactor owning 'target' to send it an invitation from 'from'
+#define REACTOR_MSG_INVITE 1
+// Tell the reactor owning the inviter 'target' that 'from' answered ('yes')
+#define REACTOR_MSG_INVITE_REPLY 2
+// Hand 'conn' over to the reactor owning 'target' to start a game with it
+#define REACTOR_MSG_ADOPT 3
+// Tell the reactor owning 'target' that the player it was waiting to start a
+// game with has gone away
+#define REACTOR_MSG_PARTNER_GONE 4
+// Tell the reactor owning the invitee 'target' that inviter 'from' gave up, so
+// their invitation shouldn't be shown if it is still waiting
+#define REACTOR_MSG_INVITE_CANCEL 5
+// Tell the reactor owning 'target' where the bot it is playing fires next
+#define REACTOR_MSG_BOT_SHOT 6
+
+typedef struct reactorMessage
+{
+	short type;
+	// The connection the message is about, on the receiving reactor
+	ConnRef target;
+	// The connection on the sending side the message came from
+	ConnRef from;
+	// REACTOR_MSG_INVITE_REPLY: whether the invitation was accepted
+	bool yes;
+	// REACTOR_MSG_INVITE: name of the inviting player, and the rules they
+	// want to play by
+	std::string name;
+	unsigned char rules;
+	// REACTOR_MSG_BOT_SHOT: the space the bot fires at (0 based)
+	short x;
+	short y;
+	// REACTOR_MSG_ADOPT: connection being handed over (moved out of the
+	// sender's slab). Receiver moves it into its own slab and deletes this.
+	FdState * conn;
+} ReactorMessage;
+
+class Reactor
+{
+public:
+	// Create reactor number 'id' with an empty connection set. Without epoll
+	// the loop only tracks interest, for the io_uring backend.
+	Reactor(int id, bool useEpoll = true);
+	// Close the wakeup fd and any connections still around
+	~Reactor();
+	// Get this reactor's number
+	int GetId() const;
+	// Get this reactor's event loop
+	EventLoop & GetLoop();
+	// Get the fd that becomes readable when messages are waiting
+	int GetWakeFD() const;
+	// Get this reactor's listening socket
+	int GetListenFD() const;
+	// Set this reactor's listening socket
+	void SetListenFD(int fd);
+	// Hand out a serial number no other connection has
+	static unsigned int NextSerial();
+	// Find one of our connections by its fd (nullptr if it isn't ours)
+	FdState * FindByFd(int fd);
+	// Find one of our connections by a reference to it (nullptr if it is gone)
+	FdState * Find(const ConnRef & ref);
+	// Get a reference other reactors can use to find 'state'
+	ConnRef RefTo(const FdState & state) const;
+	// Start tracking 'fd' in 'state'. Returns its slot.
+	FdState * AddFd(int fd, short state);
+	// Move a connection from another reactor into our slab. Returns its slot.
+	FdState * AdoptFd(FdState & state);
+	// Stop tracking fd and free its slot (does not close the fd)
+	int RemoveFd(int fd);
+	// Move a connection out of our slab so it can be handed to another
+	// reactor. Caller owns (and deletes) what is returned.
+	FdState * DetachFd(int fd);
+	// Invitations waiting for our players to answer them
+	InviteTable & GetInvites();
+	// Counters and histograms for this reactor's connections (only this
+	// reactor's thread adds to them, any thread can read them)
+	Metrics & GetMetrics();
+	// What recently happened to this reactor's connections (only this
+	// reactor's thread records, any thread can copy it)
+	FlightRecorder & GetFlightRecorder();
+	// Deadlines for this reactor's connections (only this reactor's thread)
+	TimerWheel & GetTimers();
+	// Remember that 'fd' has bytes read ahead that weren't parsed yet
+	void NoteBuffered(int fd);
+	// Get (and forget) the fds noted with NoteBuffered()
+	void TakeBuffered(std::vector<int> & fds);
+	// Queue a message for this reactor. Safe to call from any thread.
+	void Post(const ReactorMessage & msg);
+	// Take all waiting messages (only call from this reactor's thread)
+	void TakeMessages(std::vector<ReactorMessage> & messages);
+private:
+	// Not copyable, it owns fds
+	Reactor(const Reactor & r);
+	const Reactor & operator=(const Reactor & rhs);
+	int id;
+	EventLoop loop;
+	int listenFd;
+	int wakeFd;
+	// Slot for 'fd' (free or not), making its chunk if needed
+	FdState & Slot(int fd);
+	// Connection slots. Slot for fd is chunks[fd / REACTOR_SLAB_CHUNK]
+	// [fd % REACTOR_SLAB_CHUNK], and holds a connection if its fd matches.
+	std::vector<FdState *> chunks;
+	// Invitations our players haven't gotten to yet
+	InviteTable invites;
+	Metrics metrics;
+	FlightRecorder recorder;
+	TimerWheel timers;
+	// Connections with read-ahead bytes to come back to (ran out of their
+	// read budget, or weren't reading when the bytes came in). Epoll won't
+	// tell us about them since the socket itself has nothing.
+	std::vector<int> buffered;
+	// Whether each fd is in 'buffered' already, indexed by fd
+	std::vector<bool> inBuffered;
+	// Messages from other reactors (or ourself), protected by mailboxMutex
+	std::mutex mailboxMutex;
+	std::vector<ReactorMessage> mailbox;
+};
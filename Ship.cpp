@@ -82,7 +82,8 @@ bool Ship::CoordIsOnShip(const coord & location) const
 	{
 		return true;
 	}
-	else if (location.y >= this->y &&
+	else if (!horizontal &&
+		location.y >= this->y &&
 		location.y < this->y+totalSpaces &&
 		location.x == this->x)
 	{
@@ -142,4 +143,43 @@ bool Ship::Sunk() const
 short Ship::GetSize() const
 {
 	return totalSpaces;
+}
+
+/****************************************************************
+* Checks if the ship was placed horizontally
+* 
+* Preconditions:
+*  Ship placed
+* Postcondition:
+*  No changes to object. True returned if horizontal, false if vertical
+****************************************************************/
+bool Ship::IsHorizontal() const
+{
+	return horizontal;
+}
+
+/****************************************************************
+* Retrieves the x coordinate of the ship's first space
+* 
+* Preconditions:
+*  Ship placed
+* Postcondition:
+*  No changes to object. 0 based x coordinate returned
+****************************************************************/
+short Ship::GetX() const
+{
+	return x;
+}
+
+/****************************************************************
+* Retrieves the y coordinate of the ship's first space
+* 
+* Preconditions:
+*  Ship placed
+* Postcondition:
+*  No changes to object. 0 based y coordinate returned
+****************************************************************/
+short Ship::GetY() const
+{
+	return y;
 }
\ No newline at end of file
@@ -27,6 +27,8 @@
  *  Checks if the coord is a space the ship occupies
  * void SetSize(short size)
  *  Sets the size of this ship
+ * bool IsHorizontal() const, short GetX() const, short GetY() const
+ *  Where the ship was placed
  ***********************************/
 
 #include "coord.h"
@@ -42,6 +44,9 @@ public:
 	bool Hit(short x, short y);
 	bool Sunk() const;
 	bool CoordIsOnShip(const coord & location) const;
+	bool IsHorizontal() const;
+	short GetX() const;
+	short GetY() const;
 protected:
 	short totalSpaces;
 	short hitSpaces;
@@ -0,0 +1,145 @@
+#include "ShipIndex.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the index of ships by row and column.
+ ************************************/
+
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/****************************************************************
+* Index a placed ship
+*
+* Preconditions:
+*  ship placed (see Ship::Place), not overlapping any ship already indexed
+* Postcondition:
+*  ship added to the list for its row (horizontal) or column (vertical) as
+*  number 'shipNum'
+****************************************************************/
+void ShipIndex::Add(const Ship & ship, int shipNum)
+{
+	Line & line = ship.IsHorizontal() ? rows[ship.GetY()] : columns[ship.GetX()];
+	short start = ship.IsHorizontal() ? ship.GetX() : ship.GetY();
+	int at = std::lower_bound(line.starts.begin(), line.starts.end(), start) - line.starts.begin();
+	line.starts.insert(line.starts.begin() + at, start);
+	line.ends.insert(line.ends.begin() + at, start + ship.GetSize() - 1);
+	line.ships.insert(line.ships.begin() + at, shipNum);
+}
+
+/****************************************************************
+* Find the ship covering a position in one row or column
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes. The ship number returned, or -1 if no ship in 'line' covers
+*  'pos'
+****************************************************************/
+int ShipIndex::FindInLine(const Line & line, short pos)
+{
+	int count = line.starts.size();
+	if (count > SHIP_INDEX_SCAN_MAX)
+	{
+		// Last ship starting at or before pos
+		int at = std::upper_bound(line.starts.begin(), line.starts.end(), pos) - line.starts.begin() - 1;
+		if (at >= 0 && pos <= line.ends[at])
+		{
+			return line.ships[at];
+		}
+		return -1;
+	}
+	int i = 0;
+#ifdef __SSE2__
+	__m128i wanted = _mm_set1_epi16(pos);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i starts = _mm_loadu_si128((const __m128i *)&line.starts[i]);
+		__m128i ends = _mm_loadu_si128((const __m128i *)&line.ends[i]);
+		// Ships that start after pos or end before it
+		__m128i outside = _mm_or_si128(_mm_cmpgt_epi16(starts, wanted), _mm_cmpgt_epi16(wanted, ends));
+		int inside = ~_mm_movemask_epi8(outside) & 0xFFFF;
+		if (inside)
+		{
+			// Two mask bits per 16 bit lane
+			return line.ships[i + (__builtin_ctz(inside) >> 1)];
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if (line.starts[i] <= pos && pos <= line.ends[i])
+		{
+			return line.ships[i];
+		}
+	}
+	return -1;
+}
+
+/****************************************************************
+* Find the ship on a space
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes. The ship number returned, or -1 if there isn't one there
+****************************************************************/
+int ShipIndex::Find(short x, short y) const
+{
+	std::unordered_map<short, Line>::const_iterator line = rows.find(y);
+	if (rows.end() != line)
+	{
+		int ship = FindInLine(line->second, x);
+		if (-1 != ship)
+		{
+			return ship;
+		}
+	}
+	line = columns.find(x);
+	if (columns.end() != line)
+	{
+		return FindInLine(line->second, y);
+	}
+	return -1;
+}
+
+/****************************************************************
+* Find the ships on a batch of spaces
+*
+* Preconditions:
+*  shots has 'count' spaces, shipNums room for 'count' numbers
+* Postcondition:
+*  No changes. shipNums[i] set to the number of the ship on shots[i], or -1.
+*  Runs of shots in the same row or column only look the lists up once.
+****************************************************************/
+void ShipIndex::FindAll(const coord * shots, int count, int * shipNums) const
+{
+	static const Line empty;
+	const Line * row = &empty;
+	const Line * column = &empty;
+	short rowY = -1;
+	short columnX = -1;
+	for (int i = 0; i < count; ++i)
+	{
+		if (shots[i].y != rowY || i == 0)
+		{
+			std::unordered_map<short, Line>::const_iterator found = rows.find(shots[i].y);
+			row = rows.end() != found ? &found->second : &empty;
+			rowY = shots[i].y;
+		}
+		if (shots[i].x != columnX || i == 0)
+		{
+			std::unordered_map<short, Line>::const_iterator found = columns.find(shots[i].x);
+			column = columns.end() != found ? &found->second : &empty;
+			columnX = shots[i].x;
+		}
+		shipNums[i] = FindInLine(*row, shots[i].x);
+		if (-1 == shipNums[i])
+		{
+			shipNums[i] = FindInLine(*column, shots[i].y);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class ShipIndex:
+ *  Finds which ship (if any) is on a space without testing every ship. Each
+ *  ship is one interval: horizontal ships in the list for their row,
+ *  vertical ones in the list for their column. Lists are kept sorted by
+ *  where the ships start, as separate start/end/ship arrays, so a short list
+ *  is scanned 8 ships at a time with SSE2 (where there is SSE2) and a long
+ *  one is binary searched. Only rows and columns with ships take memory.
+ *
+ * void Add(const Ship & ship, int shipNum)
+ *  Index a placed ship as number 'shipNum'
+ * int Find(short x, short y) const
+ *  The number of the ship on x, y, or -1
+ * void FindAll(const coord * shots, int count, int * shipNums) const
+ *  Find() for a batch of spaces at once
+ ***********************************/
+
+#include <vector>
+#include <unordered_map>
+#include "Ship.h"
+#include "coord.h"
+
+// Lists with up to this many ships are scanned instead of binary searched
+#define SHIP_INDEX_SCAN_MAX 32
+
+class ShipIndex
+{
+public:
+	// Index a placed ship as number 'shipNum'
+	void Add(const Ship & ship, int shipNum);
+	// The number of the ship on x, y, or -1 if there isn't one
+	int Find(short x, short y) const;
+	// For each of the 'count' spaces in 'shots', the number of the ship on it
+	// (or -1) put in 'shipNums'
+	void FindAll(const coord * shots, int count, int * shipNums) const;
+private:
+	// Ships in one row or column, by where they start
+	typedef struct shipLine
+	{
+		std::vector<short> starts;
+		std::vector<short> ends;
+		std::vector<int> ships;
+	} Line;
+	// The ship covering 'pos' in 'line', or -1
+	static int FindInLine(const Line & line, short pos);
+	// Horizontal ships by y (positions are x), vertical ships by x
+	// (positions are y)
+	std::unordered_map<short, Line> rows;
+	std::unordered_map<short, Line> columns;
+};
@@ -0,0 +1,184 @@
+#include "SparseGame.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the sparse board for very big games.
+ ************************************/
+
+/****************************************************************
+* Create a new game object
+* Preconditions:
+*  width and height > 0, every size > 0
+* Postcondition:
+*  Board empty. Ships not placed.
+****************************************************************/
+SparseGame::SparseGame(short Width, short Height, const std::vector<short> & Sizes): width(Width), height(Height), sizes(Sizes), placed(Sizes.size(), false), afloat(Sizes), unplaced(Sizes.size()), unsunk(Sizes.size()), index(), shotChunks()
+{
+	
+}
+
+/****************************************************************
+* Board size
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes to object, width returned
+****************************************************************/
+short SparseGame::Width() const
+{
+	return width;
+}
+
+/****************************************************************
+* Board size
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes to object, height returned
+****************************************************************/
+short SparseGame::Height() const
+{
+	return height;
+}
+
+/****************************************************************
+* Number of ships in a full fleet
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes to object, ship count returned
+****************************************************************/
+int SparseGame::ShipCount() const
+{
+	return sizes.size();
+}
+
+/****************************************************************
+* Size of ship 'shipNum'
+* Preconditions:
+*  0 <= shipNum < ShipCount()
+* Postcondition:
+*  No changes to object, ship size returned
+****************************************************************/
+short SparseGame::ShipSize(int shipNum) const
+{
+	return sizes[shipNum];
+}
+
+/****************************************************************
+* Number of shot bitmap chunks allocated so far
+* Preconditions:
+*  None
+* Postcondition:
+*  No changes to object, chunk count returned
+****************************************************************/
+unsigned int SparseGame::ChunkCount() const
+{
+	return shotChunks.size();
+}
+
+/***************************************************************
+* Places the first unplaced 'size'-space ship
+* Preconditions:
+*  x and y 0 based
+* Postcondition:
+*  Ship placed on the board and true returned, or false returned (and
+*  nothing changed) if it would hang off the board, it would overlap another
+*  ship, or every ship that size was placed already
+****************************************************************/
+bool SparseGame::PlaceShip(short size, bool horizontal, short x, short y)
+{
+	if (x < 0 || y < 0 ||
+		(horizontal && (x+size > width || y >= height)) ||
+		(!horizontal && (y+size > height || x >= width)))
+	{
+		return false;
+	}
+	unsigned int shipNum = 0;
+	while (shipNum < sizes.size() && (sizes[shipNum] != size || placed[shipNum]))
+	{
+		++shipNum;
+	}
+	if (sizes.size() == shipNum)
+	{
+		return false;
+	}
+	// The ship's spaces are one run along a row or column, so look them up as
+	// a batch
+	std::vector<coord> spaces(size);
+	std::vector<int> found(size);
+	for (int j = 0; j < size; ++j)
+	{
+		spaces[j].x = horizontal ? x+j : x;
+		spaces[j].y = horizontal ? y : y+j;
+	}
+	index.FindAll(spaces.data(), size, found.data());
+	for (int j = 0; j < size; ++j)
+	{
+		if (-1 != found[j])
+		{
+			return false;
+		}
+	}
+	Ship ship(size);
+	ship.Place(horizontal, x, y);
+	index.Add(ship, shipNum);
+	placed[shipNum] = true;
+	--unplaced;
+	return true;
+}
+
+/****************************************************************
+* Record a shot at a space
+* Preconditions:
+*  space < width*height
+* Postcondition:
+*  space marked fired at (allocating its chunk if it is the first shot
+*  there). true returned if it was fired at before.
+****************************************************************/
+bool SparseGame::Shoot(uint32_t space)
+{
+	std::unique_ptr<uint64_t[]> & chunk = shotChunks[space / SPARSE_CHUNK_SPACES];
+	if (!chunk)
+	{
+		chunk.reset(new uint64_t[SPARSE_CHUNK_SPACES/64]());
+	}
+	uint32_t offset = space % SPARSE_CHUNK_SPACES;
+	uint64_t bit = ((uint64_t)1) << (offset & 63);
+	bool before = 0 != (chunk[offset >> 6] & bit);
+	chunk[offset >> 6] |= bit;
+	return before;
+}
+
+/*****************************************************************
+* Calulates the results of the other player's move at x,y
+*
+* Preconditions:
+*  x < width and y < height, all ships placed
+* Postcondition:
+*  Space marked as fired at. Results set the same way as
+*  Game::CalculateMoveResults: hit only for a ship space not hit before,
+*  shipSize 0 and sink and win false otherwise
+****************************************************************/
+void SparseGame::CalculateMoveResults(short x, short y, bool & hit, short & shipSize, bool & sink, bool & win)
+{
+	uint32_t space = (uint32_t)y*width + x;
+	bool firedBefore = Shoot(space);
+	int ship = index.Find(x, y);
+	hit = !firedBefore && -1 != ship;
+	shipSize = 0;
+	sink = false;
+	win = false;
+	if (!hit)
+	{
+		return;
+	}
+	shipSize = sizes[ship];
+	sink = (0 == --afloat[ship]);
+	if (sink)
+	{
+		--unsunk;
+	}
+	win = (0 == unsunk && 0 == unplaced);
+}
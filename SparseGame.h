@@ -0,0 +1,57 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class SparseGame:
+ *  A fleet on a board too big for BitGame (like 1000x1000 with hundreds of
+ *  ships). Memory goes with the ships and shots, not the board area: ships
+ *  are kept in a ShipIndex (one interval each), and the spaces fired at in a
+ *  bitmap whose chunks are only allocated once a shot lands in them.
+ *
+ * SparseGame(short width, short height, const std::vector<short> & sizes)
+ *  Empty width by height board, for ships of 'sizes' spaces
+ * The rest is the JudgedFleet interface (see BitGame.h)
+ ***********************************/
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "BitGame.h"
+#include "ShipIndex.h"
+
+// Spaces per chunk of the shot bitmap
+#define SPARSE_CHUNK_SPACES 4096
+
+class SparseGame : public JudgedFleet
+{
+public:
+	// Create a new game object
+	SparseGame(short width, short height, const std::vector<short> & sizes);
+	short Width() const;
+	short Height() const;
+	int ShipCount() const;
+	short ShipSize(int shipNum) const;
+	bool PlaceShip(short size, bool horizontal, short x, short y);
+	void CalculateMoveResults(short x, short y, bool & hit, short & shipSize,
+	bool & sink, bool & win);
+	// Number of shot bitmap chunks allocated so far
+	unsigned int ChunkCount() const;
+private:
+	// Record a shot at 'space'. Returns true if it was fired at before.
+	bool Shoot(uint32_t space);
+	short width;
+	short height;
+	// Size of each ship, whether it is placed, and how many of its spaces are
+	// left unhit
+	std::vector<short> sizes;
+	std::vector<bool> placed;
+	std::vector<short> afloat;
+	// Ships not placed yet, and ships not sunk yet
+	int unplaced;
+	int unsunk;
+	// Where each placed ship is
+	ShipIndex index;
+	// Spaces fired at, by chunk
+	std::unordered_map<uint32_t, std::unique_ptr<uint64_t[]> > shotChunks;
+};
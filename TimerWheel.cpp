@@ -0,0 +1,249 @@
+#include "TimerWheel.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the hierarchical timer wheel the reactors reap stalled
+ * connections with.
+ ************************************/
+
+/***************************************************************
+* Empty wheel whose time starts at 'nowMs'
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No deadlines set, tick 0 is nowMs
+****************************************************************/
+TimerWheel::TimerWheel(uint64_t nowMs): startMs(nowMs), now(0), count(0)
+{
+	for (int i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; ++i)
+	{
+		heads[i] = -1;
+	}
+}
+
+/***************************************************************
+* Expire 'fd' 'delayMs' after 'nowMs'
+*
+* Preconditions:
+*  fd >= 0, nowMs from the same clock as the one the wheel was made with
+* Postcondition:
+*  fd's deadline (replacing any it had) set for the first tick at least
+*  delayMs after nowMs (and after the last Advance()), or as far away as the
+*  wheel goes if that is further. Timed from nowMs rather than the last
+*  Advance(), since the event loop can sleep a long time between those.
+****************************************************************/
+void TimerWheel::Set(int fd, unsigned int serial, unsigned int delayMs, uint64_t nowMs)
+{
+	if ((unsigned int)fd >= entries.size())
+	{
+		Entry blank = {0, 0, -1, -1, -1};
+		entries.resize(fd + 1, blank);
+	}
+	if (-1 != entries[fd].slot)
+	{
+		Unlink(fd);
+	}
+	else
+	{
+		++count;
+	}
+	uint64_t dueMs = (nowMs > startMs ? nowMs - startMs : 0) + delayMs;
+	uint64_t due = (dueMs + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+	entries[fd].expires = due > now ? due : now + 1;
+	entries[fd].serial = serial;
+	Insert(fd);
+}
+
+/***************************************************************
+* Forget any deadline 'fd' has
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  fd won't come up in Advance() until it is Set() again
+****************************************************************/
+void TimerWheel::Cancel(int fd)
+{
+	if (fd < 0 || (unsigned int)fd >= entries.size() || -1 == entries[fd].slot)
+	{
+		return;
+	}
+	Unlink(fd);
+	--count;
+}
+
+/***************************************************************
+* Link fd's entry into the slot its deadline belongs in
+*
+* Preconditions:
+*  fd's entry not in any slot, expires >= now
+* Postcondition:
+*  entry at the front of the slot on the lowest level that can tell its tick
+*  apart from now. Deadlines past the top level are moved in to its end.
+****************************************************************/
+void TimerWheel::Insert(int fd)
+{
+	Entry & entry = entries[fd];
+	uint64_t delta = entry.expires - now;
+	int level = 0;
+	uint64_t span = TIMER_WHEEL_SLOTS;
+	while (delta >= span && level < TIMER_WHEEL_LEVELS - 1)
+	{
+		++level;
+		span <<= TIMER_WHEEL_SHIFT;
+	}
+	if (delta >= span)
+	{
+		entry.expires = now + span - 1;
+	}
+	int slot = level * TIMER_WHEEL_SLOTS + ((entry.expires >> (TIMER_WHEEL_SHIFT * level)) & (TIMER_WHEEL_SLOTS - 1));
+	entry.slot = slot;
+	entry.prev = -1;
+	entry.next = heads[slot];
+	if (-1 != entry.next)
+	{
+		entries[entry.next].prev = fd;
+	}
+	heads[slot] = fd;
+}
+
+/***************************************************************
+* Unlink fd's entry from its slot
+*
+* Preconditions:
+*  fd's entry in a slot
+* Postcondition:
+*  entry in no slot (slot -1), the rest of its list still linked
+****************************************************************/
+void TimerWheel::Unlink(int fd)
+{
+	Entry & entry = entries[fd];
+	if (-1 == entry.prev)
+	{
+		heads[entry.slot] = entry.next;
+	}
+	else
+	{
+		entries[entry.prev].next = entry.next;
+	}
+	if (-1 != entry.next)
+	{
+		entries[entry.next].prev = entry.prev;
+	}
+	entry.slot = -1;
+}
+
+/***************************************************************
+* Spread one slot of 'level' down to the levels below it
+*
+* Preconditions:
+*  now just reached the start of the stretch of time that slot of 'level'
+*  covers
+* Postcondition:
+*  every entry that was in it re-inserted on a lower level
+****************************************************************/
+void TimerWheel::Cascade(int level)
+{
+	int slot = level * TIMER_WHEEL_SLOTS + ((now >> (TIMER_WHEEL_SHIFT * level)) & (TIMER_WHEEL_SLOTS - 1));
+	int fd = heads[slot];
+	heads[slot] = -1;
+	while (-1 != fd)
+	{
+		int next = entries[fd].next;
+		Insert(fd);
+		fd = next;
+	}
+}
+
+/***************************************************************
+* Move time up to 'nowMs'
+*
+* Preconditions:
+*  nowMs from the same clock as the one the wheel was made with
+* Postcondition:
+*  One tick done for each whole TIMER_WHEEL_TICK_MS since the wheel started
+*  that wasn't done yet. Every deadline on those ticks cancelled and added
+*  to 'expired' (which isn't cleared first).
+****************************************************************/
+void TimerWheel::Advance(uint64_t nowMs, std::vector<TimerExpiry> & expired)
+{
+	uint64_t target = nowMs > startMs ? (nowMs - startMs) / TIMER_WHEEL_TICK_MS : 0;
+	if (0 == count && target > now)
+	{
+		// Nothing to find on the way
+		now = target;
+		return;
+	}
+	while (now < target)
+	{
+		++now;
+		// Each level comes around when the one below wraps back to slot 0
+		for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+		{
+			if (now & (((uint64_t)1 << (TIMER_WHEEL_SHIFT * level)) - 1))
+			{
+				break;
+			}
+			Cascade(level);
+		}
+		int slot = now & (TIMER_WHEEL_SLOTS - 1);
+		int fd = heads[slot];
+		heads[slot] = -1;
+		while (-1 != fd)
+		{
+			Entry & entry = entries[fd];
+			TimerExpiry expiry = {fd, entry.serial};
+			expired.push_back(expiry);
+			entry.slot = -1;
+			--count;
+			fd = entry.next;
+		}
+	}
+}
+
+/***************************************************************
+* How long an event loop can sleep before the next Advance() is due
+*
+* Preconditions:
+*  nowMs from the same clock as the one the wheel was made with
+* Postcondition:
+*  No object changes. Milliseconds until the first tick a deadline can go off
+*  on returned (0 if it is already due), or -1 if no deadlines are set so
+*  there is no need to wake up. That is the earliest set slot on the first
+*  level, or the start of the earliest set slot on a higher one (its
+*  deadlines are somewhere in that slot's stretch), whichever comes first.
+****************************************************************/
+int TimerWheel::NextTimeout(uint64_t nowMs) const
+{
+	if (0 == count)
+	{
+		return -1;
+	}
+	uint64_t first = UINT64_MAX;
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+	{
+		int shift = TIMER_WHEEL_SHIFT * level;
+		uint64_t current = now >> shift;
+		// Slots come up in order after the current one. Higher levels can
+		// have the current slot's index a whole lap away, the first level
+		// can't.
+		int last = (0 == level) ? TIMER_WHEEL_SLOTS - 1 : TIMER_WHEEL_SLOTS;
+		for (int ahead = 1; ahead <= last; ++ahead)
+		{
+			uint64_t start = (current + ahead) << shift;
+			if (start >= first)
+			{
+				break;
+			}
+			if (-1 != heads[level * TIMER_WHEEL_SLOTS + ((current + ahead) & (TIMER_WHEEL_SLOTS - 1))])
+			{
+				first = start;
+				break;
+			}
+		}
+	}
+	uint64_t due = startMs + first * TIMER_WHEEL_TICK_MS;
+	return due > nowMs ? (int)(due - nowMs) : 0;
+}
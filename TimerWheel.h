@@ -0,0 +1,93 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class TimerWheel:
+ *  Deadlines for one reactor's connections, at most one per fd. Time moves in
+ *  ticks of TIMER_WHEEL_TICK_MS. The wheel has TIMER_WHEEL_LEVELS levels of
+ *  TIMER_WHEEL_SLOTS slots each. The first level holds what is due in the
+ *  next TIMER_WHEEL_SLOTS ticks, one slot per tick. Each level after that
+ *  covers TIMER_WHEEL_SLOTS times as long per slot. When the first level comes
+ *  back around, the next level's slot for the coming stretch is spread back
+ *  down, so every timer is only ever moved a level at a time.
+ *
+ *  Setting, moving and cancelling a deadline are a couple of list link
+ *  changes (entries are indexed by fd and linked through each other, so no
+ *  allocation once the fd has been seen). Advancing costs a slot per tick
+ *  plus what expires.
+ *
+ * Set(int fd, unsigned int serial, unsigned int delayMs, uint64_t nowMs)
+ *  Expire fd 'delayMs' after 'nowMs' (replaces any deadline fd already had)
+ * Cancel(int fd)
+ *  Forget fd's deadline
+ * Advance(uint64_t nowMs, std::vector<TimerExpiry> & expired)
+ *  Move up to 'nowMs', collecting what came due
+ * NextTimeout(uint64_t nowMs)
+ *  How long an event loop can sleep before the next Advance() is due (until
+ *  the earliest slot holding a deadline comes up, not just the next tick)
+ ***********************************/
+
+#include <vector>
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// Length of a tick, so how late a deadline can go off
+#define TIMER_WHEEL_TICK_MS 100
+// Slots per level (a power of two) and bits to shift a tick by per level
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_SHIFT 6
+// 64^3 ticks of 100ms, so deadlines up to about 7 hours out (longer ones go
+// off then)
+#define TIMER_WHEEL_LEVELS 3
+
+// A deadline that came due
+typedef struct timerExpiry
+{
+	int fd;
+	// Connection the deadline was set for (fds get reused)
+	unsigned int serial;
+} TimerExpiry;
+
+class TimerWheel
+{
+public:
+	// Empty wheel whose time starts at 'nowMs'
+	TimerWheel(uint64_t nowMs);
+	// Expire 'fd' 'delayMs' after 'nowMs'
+	void Set(int fd, unsigned int serial, unsigned int delayMs, uint64_t nowMs);
+	// Forget any deadline 'fd' has
+	void Cancel(int fd);
+	// Move time up to 'nowMs', adding every deadline passed to 'expired'
+	void Advance(uint64_t nowMs, std::vector<TimerExpiry> & expired);
+	// Milliseconds until a deadline can next go off, -1 if none are set
+	int NextTimeout(uint64_t nowMs) const;
+private:
+	// One fd's deadline, linked into its slot's list
+	typedef struct
+	{
+		uint64_t expires;
+		unsigned int serial;
+		// Slot (level * TIMER_WHEEL_SLOTS + index) it is in, -1 if not set
+		int slot;
+		int prev;
+		int next;
+	} Entry;
+	// Link fd's entry into the slot its deadline belongs in
+	void Insert(int fd);
+	// Unlink fd's entry from its slot
+	void Unlink(int fd);
+	// Spread one slot of 'level' down to the levels below it
+	void Cascade(int level);
+	// Time the wheel starts at, ticks are counted from here
+	uint64_t startMs;
+	// Ticks done so far
+	uint64_t now;
+	unsigned int count;
+	// First fd in each slot's list, -1 for empty
+	int heads[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+	// Indexed by fd
+	std::vector<Entry> entries;
+};
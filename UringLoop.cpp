@@ -0,0 +1,498 @@
+#include "UringLoop.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the io_uring wrapper used by the server's completion based
+ * backend. Talks to the kernel with the raw io_uring syscalls.
+ ************************************/
+
+#include <cstring>
+
+extern "C"
+{
+	#include <unistd.h>
+	#include <errno.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/socket.h>
+	#include <sys/uio.h>
+	// for perror
+	#include <stdio.h>
+}
+
+// Buffer group the recv buffers are registered as
+#define URING_RECV_GROUP 0
+
+// user_data layout: op in the top byte, fd (or send slot) in the next three,
+// caller's tag in the bottom four
+#define URING_PACK(op, index, tag) (((uint64_t)(op) << 56) | ((uint64_t)((index) & 0xFFFFFF) << 32) | (uint64_t)(tag))
+#define URING_UNPACK_OP(data) ((short)((data) >> 56))
+#define URING_UNPACK_INDEX(data) ((int)(((data) >> 32) & 0xFFFFFF))
+#define URING_UNPACK_TAG(data) ((unsigned int)((data) & 0xFFFFFFFF))
+
+/***************************************************************
+* Set up the rings and register the buffers
+*
+* Preconditions:
+*  recvBuffers a power of 2 no bigger than 32768. Called on the thread that
+*  will use the loop.
+* Postcondition:
+*  Ring created and mapped, recv buffers handed to the kernel, send slots
+*  registered. IsOpen() returns false if any of that failed.
+****************************************************************/
+UringLoop::UringLoop(unsigned int entries, unsigned int recvBuffers, unsigned int sendSlots, unsigned int BufferSize): ringFd(-1), enterCount(0), sqRingPtr(MAP_FAILED), sqRingSize(0), sqes((struct io_uring_sqe *)MAP_FAILED), sqesSize(0), toSubmit(0), bufRing((struct io_uring_buf_ring *)MAP_FAILED), bufRingEntries(recvBuffers), bufTail(0), recvArea(nullptr), recvBufferCount(recvBuffers), sendArea(nullptr), sendSlotCount(sendSlots), bufferSize(BufferSize)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	// Only this thread submits, and we don't need to be interrupted to run
+	// completion work, we'll be in io_uring_enter() soon enough
+	params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+	ringFd = syscall(__NR_io_uring_setup, entries, &params);
+	if (-1 == ringFd && EINVAL == errno)
+	{
+		// Older kernel, do without the hints
+		memset(&params, 0, sizeof(params));
+		ringFd = syscall(__NR_io_uring_setup, entries, &params);
+	}
+	if (-1 == ringFd)
+	{
+		perror("Trouble creating the io_uring");
+		return;
+	}
+
+	// The submission and completion rings share one mapping on anything
+	// recent enough to have provided buffer rings
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (cqRingSize > sqRingSize)
+	{
+		sqRingSize = cqRingSize;
+	}
+	sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = (struct io_uring_sqe *)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (MAP_FAILED == sqRingPtr || MAP_FAILED == (void *)sqes || !(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		perror("Trouble mapping the io_uring");
+		close(ringFd);
+		ringFd = -1;
+		return;
+	}
+	char * ring = (char *)sqRingPtr;
+	sqHead = (unsigned int *)(ring + params.sq_off.head);
+	sqTail = (unsigned int *)(ring + params.sq_off.tail);
+	sqMask = (unsigned int *)(ring + params.sq_off.ring_mask);
+	sqArray = (unsigned int *)(ring + params.sq_off.array);
+	sqEntries = params.sq_entries;
+	cqHead = (unsigned int *)(ring + params.cq_off.head);
+	cqTail = (unsigned int *)(ring + params.cq_off.tail);
+	cqMask = (unsigned int *)(ring + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+	// Submission entries always go in order, so the index array never changes
+	for (unsigned int i = 0; i < sqEntries; ++i)
+	{
+		sqArray[i] = i;
+	}
+
+	// Recv buffers: a ring of buffer descriptors we share with the kernel
+	bufRing = (struct io_uring_buf_ring *)mmap(nullptr, bufRingEntries * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	recvArea = new char[recvBufferCount * bufferSize];
+	if (MAP_FAILED == (void *)bufRing)
+	{
+		perror("Trouble allocating the recv buffer ring");
+		close(ringFd);
+		ringFd = -1;
+		return;
+	}
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)bufRing;
+	reg.ring_entries = bufRingEntries;
+	reg.bgid = URING_RECV_GROUP;
+	if (-1 == syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1))
+	{
+		perror("Trouble registering the recv buffer ring");
+		close(ringFd);
+		ringFd = -1;
+		return;
+	}
+	for (unsigned int i = 0; i < recvBufferCount; ++i)
+	{
+		ReleaseRecv(i);
+	}
+
+	// Send slots: one big registered area, split up into bufferSize pieces
+	sendArea = new char[sendSlotCount * bufferSize];
+	struct iovec area;
+	area.iov_base = sendArea;
+	area.iov_len = sendSlotCount * bufferSize;
+	if (-1 == syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &area, 1))
+	{
+		perror("Trouble registering the send buffers");
+		close(ringFd);
+		ringFd = -1;
+		return;
+	}
+	sendSlotFd.resize(sendSlotCount, -1);
+	for (unsigned int i = sendSlotCount; i > 0; --i)
+	{
+		freeSendSlots.push_back(i-1);
+	}
+}
+
+/***************************************************************
+* Tear down the rings and free the buffers
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  ring closed (the kernel cancels anything still in flight), memory freed
+****************************************************************/
+UringLoop::~UringLoop()
+{
+	if (-1 != ringFd)
+	{
+		close(ringFd);
+	}
+	if (MAP_FAILED != sqRingPtr)
+	{
+		munmap(sqRingPtr, sqRingSize);
+	}
+	if (MAP_FAILED != (void *)sqes)
+	{
+		munmap(sqes, sqesSize);
+	}
+	if (MAP_FAILED != (void *)bufRing)
+	{
+		munmap(bufRing, bufRingEntries * sizeof(struct io_uring_buf));
+	}
+	delete[] recvArea;
+	delete[] sendArea;
+}
+
+/***************************************************************
+* Check if setting everything up worked
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, true returned if the loop can be used
+****************************************************************/
+bool UringLoop::IsOpen() const
+{
+	return -1 != ringFd;
+}
+
+/***************************************************************
+* Get a blank submission entry, flushing the queue to the kernel if full
+*
+* Preconditions:
+*  IsOpen()
+* Postcondition:
+*  zeroed entry returned, already counted as queued. nullptr returned if the
+*  queue is full and the kernel wouldn't take any of it.
+****************************************************************/
+struct io_uring_sqe * UringLoop::GetSqe()
+{
+	unsigned int tail = *sqTail;
+	if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+	{
+		Enter(0);
+		if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+		{
+			return nullptr;
+		}
+	}
+	struct io_uring_sqe * sqe = &sqes[tail & *sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	// The kernel only looks at the queue during io_uring_enter(), so it's fine
+	// to publish the entry before the caller fills it in
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	++toSubmit;
+	return sqe;
+}
+
+/***************************************************************
+* Tell the kernel about queued entries and optionally wait for completions
+*
+* Preconditions:
+*  IsOpen()
+* Postcondition:
+*  Returns 0, or -1 on errors other than being interrupted
+****************************************************************/
+int UringLoop::Enter(unsigned int waitFor)
+{
+	++enterCount;
+	int submitted = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+	if (-1 == submitted)
+	{
+		// Interrupted, or too many completions waiting to take more work.
+		// Either way harvesting completions sorts it out
+		if (EINTR == errno || EBUSY == errno || EAGAIN == errno)
+		{
+			return 0;
+		}
+		perror("Trouble entering the io_uring");
+		return -1;
+	}
+	toSubmit -= submitted;
+	return 0;
+}
+
+/***************************************************************
+* Receive up to 'len' bytes on 'fd' into a provided buffer
+*
+* Preconditions:
+*  IsOpen(), fd a connected socket, len > 0
+* Postcondition:
+*  recv queued (returns true), or false if the queue is full
+****************************************************************/
+bool UringLoop::QueueRecv(int fd, unsigned int len, unsigned int tag)
+{
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->len = len < bufferSize ? len : bufferSize;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_RECV_GROUP;
+	sqe->user_data = URING_PACK(URING_OP_RECV, fd, tag);
+	return true;
+}
+
+/***************************************************************
+* Write the bytes 'iov' points at to 'fd' through a registered send slot
+*
+* Preconditions:
+*  IsOpen(), fd a connected socket, iov has 'count' entries
+* Postcondition:
+*  as many of the bytes as fit in a slot copied into one (in order, so
+*  several small messages go out as one write) and the write queued (returns
+*  true), or false if there isn't a free slot or queue entry (try again after
+*  some sends complete)
+****************************************************************/
+bool UringLoop::QueueSend(int fd, const struct iovec * iov, int count, unsigned int tag)
+{
+	if (freeSendSlots.empty() || count <= 0)
+	{
+		return false;
+	}
+	unsigned int slot = freeSendSlots.back();
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	freeSendSlots.pop_back();
+	char * buffer = sendArea + slot * bufferSize;
+	unsigned int len = 0;
+	for (int i = 0; i < count && len < bufferSize; ++i)
+	{
+		unsigned int part = iov[i].iov_len;
+		if (part > bufferSize - len)
+		{
+			// Rest of it goes in the next send
+			part = bufferSize - len;
+		}
+		memcpy(buffer + len, iov[i].iov_base, part);
+		len += part;
+	}
+	sendSlotFd[slot] = fd;
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)buffer;
+	sqe->len = len;
+	sqe->buf_index = 0;
+	sqe->user_data = URING_PACK(URING_OP_SEND, slot, tag);
+	return true;
+}
+
+/***************************************************************
+* Accept connections on listening socket 'fd' until told to stop
+*
+* Preconditions:
+*  IsOpen(), fd a listening socket
+* Postcondition:
+*  multishot accept queued (returns true), or false if the queue is full. The
+*  new fds come back non-blocking and close-on-exec.
+****************************************************************/
+bool UringLoop::QueueAccept(int fd)
+{
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = URING_PACK(URING_OP_ACCEPT, fd, 0);
+	return true;
+}
+
+/***************************************************************
+* Read 8 bytes from 'fd' into 'target'
+*
+* Preconditions:
+*  IsOpen(), target stays valid until the read completes
+* Postcondition:
+*  read queued (returns true), or false if the queue is full
+****************************************************************/
+bool UringLoop::QueueRead(int fd, uint64_t * target)
+{
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)target;
+	sqe->len = sizeof(*target);
+	sqe->user_data = URING_PACK(URING_OP_READ, fd, 0);
+	return true;
+}
+
+/***************************************************************
+* Complete once 'after' has passed
+*
+* Preconditions:
+*  IsOpen(), after stays valid until the next SubmitAndWait() submits it
+* Postcondition:
+*  timeout queued (returns true), or false if the queue is full. It
+*  completes with -ETIME once the time is up.
+****************************************************************/
+bool UringLoop::QueueTimeout(struct __kernel_timespec * after)
+{
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)after;
+	sqe->len = 1;
+	// Only time can finish it, not other completions
+	sqe->off = 0;
+	sqe->user_data = URING_PACK(URING_OP_TIMEOUT, 0, 0);
+	return true;
+}
+
+/***************************************************************
+* Cancel every operation in flight on 'fd'
+*
+* Preconditions:
+*  IsOpen()
+* Postcondition:
+*  cancel queued (returns true), or false if the queue is full. The cancelled
+*  operations complete with -ECANCELED.
+****************************************************************/
+bool UringLoop::CancelFd(int fd)
+{
+	struct io_uring_sqe * sqe = GetSqe();
+	if (nullptr == sqe)
+	{
+		return false;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = fd;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = URING_PACK(URING_OP_CANCEL, fd, 0);
+	return true;
+}
+
+/***************************************************************
+* Submit what is queued, wait for and collect completions
+*
+* Preconditions:
+*  IsOpen()
+* Postcondition:
+*  'completions' replaced with everything that finished, send slots of
+*  finished sends freed. Returns how many were collected, or -1 on error.
+****************************************************************/
+int UringLoop::SubmitAndWait(std::vector<UringCompletion> & completions)
+{
+	completions.clear();
+	unsigned int head = *cqHead;
+	if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+	{
+		// Nothing finished yet, submit and sleep in the same syscall
+		if (Enter(1))
+		{
+			return -1;
+		}
+	}
+	else if (toSubmit > 0 && Enter(0))
+	{
+		return -1;
+	}
+	unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		struct io_uring_cqe * cqe = &cqes[head & *cqMask];
+		UringCompletion completion;
+		completion.op = URING_UNPACK_OP(cqe->user_data);
+		completion.fd = URING_UNPACK_INDEX(cqe->user_data);
+		completion.tag = URING_UNPACK_TAG(cqe->user_data);
+		completion.result = cqe->res;
+		completion.data = nullptr;
+		completion.bufferId = 0;
+		completion.hasBuffer = cqe->flags & IORING_CQE_F_BUFFER;
+		completion.more = cqe->flags & IORING_CQE_F_MORE;
+		if (completion.hasBuffer)
+		{
+			completion.bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			completion.data = recvArea + completion.bufferId * bufferSize;
+		}
+		if (URING_OP_SEND == completion.op)
+		{
+			unsigned int slot = completion.fd;
+			completion.fd = sendSlotFd[slot];
+			freeSendSlots.push_back(slot);
+		}
+		completions.push_back(completion);
+	}
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	return completions.size();
+}
+
+/***************************************************************
+* Give a recv buffer back to the kernel
+*
+* Preconditions:
+*  bufferId came from a recv completion and hasn't been given back yet
+* Postcondition:
+*  buffer can be picked for another recv
+****************************************************************/
+void UringLoop::ReleaseRecv(unsigned short bufferId)
+{
+	// The header's flexible 'bufs' member isn't at offset 0 when compiled as
+	// C++, so index the descriptors ourself. The ring tail lives in the first
+	// descriptor's resv field.
+	struct io_uring_buf * bufs = (struct io_uring_buf *)bufRing;
+	struct io_uring_buf * buf = &bufs[bufTail & (bufRingEntries - 1)];
+	buf->addr = (uint64_t)(recvArea + bufferId * bufferSize);
+	buf->len = bufferSize;
+	buf->bid = bufferId;
+	++bufTail;
+	__atomic_store_n(&bufs[0].resv, bufTail, __ATOMIC_RELEASE);
+}
+
+/***************************************************************
+* Number of io_uring_enter() calls made so far
+*
+* Preconditions:
+*  None
+* Postcondition:
+*  No object changes, count returned
+****************************************************************/
+unsigned long UringLoop::GetEnterCount() const
+{
+	return enterCount;
+}
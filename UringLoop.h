@@ -0,0 +1,151 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class UringLoop:
+ *  A small io_uring wrapper (straight syscalls, no liburing) used by the
+ *  server's optional completion based I/O backend. Instead of being told an fd
+ *  is ready and then calling read()/write() on it, the server queues up recvs
+ *  and sends for every connection that wants them and hands them all to the
+ *  kernel in one io_uring_enter(), which also hands back everything that
+ *  finished since last time.
+ *
+ *  Recvs use a ring of buffers registered with the kernel (a provided buffer
+ *  group), so idle connections don't tie up any memory: a buffer is only
+ *  picked when data actually arrives. Sends are copied into slots of a
+ *  registered buffer area and written with IORING_OP_WRITE_FIXED. Neither kind
+ *  of buffer belongs to a connection, so a connection can be freed while it
+ *  still has something in flight.
+ *
+ * QueueRecv(int fd, unsigned int len, unsigned int tag)
+ *  Receive up to len bytes on fd. 'tag' comes back with the completion.
+ * QueueSend(int fd, const struct iovec * iov, int count, unsigned int tag)
+ *  Gather what iov points at into a send slot (as much as fits) and write it
+ *  to fd
+ * QueueAccept(int fd)
+ *  Multishot accept: one completion per new connection on listening socket fd
+ * QueueRead(int fd, uint64_t * target)
+ *  Plain 8 byte read (used for the reactor's wakeup eventfd)
+ * QueueTimeout(struct __kernel_timespec * after)
+ *  Complete once 'after' has passed (so a wait can't sleep past a deadline)
+ * CancelFd(int fd)
+ *  Cancel anything still in flight on fd (for connections moving to another
+ *  reactor, whose ring will take over their I/O)
+ * SubmitAndWait(std::vector<UringCompletion> & completions)
+ *  Submit everything queued, wait for at least one completion, and collect all
+ *  of the completions that are ready
+ * ReleaseRecv(unsigned short bufferId)
+ *  Give a recv buffer back to the kernel once its data has been copied out
+ ***********************************/
+
+#include <vector>
+
+extern "C"
+{
+	#include <stdint.h>
+	#include <stddef.h>
+	#include <linux/io_uring.h>
+	#include <sys/uio.h>
+}
+
+// What an operation was, so its completion can be told apart
+#define URING_OP_RECV 1
+#define URING_OP_SEND 2
+#define URING_OP_ACCEPT 3
+#define URING_OP_READ 4
+#define URING_OP_CANCEL 5
+#define URING_OP_TIMEOUT 6
+
+// Default sizes used by the server
+#define URING_QUEUE_DEPTH 4096
+#define URING_RECV_BUFFERS 1024
+#define URING_SEND_SLOTS 1024
+// Big enough for the largest message we send (a full players list)
+#define URING_BUFFER_SIZE 2048
+
+typedef struct uringCompletion
+{
+	// One of the URING_OP_* #defines
+	short op;
+	int fd;
+	// Whatever was passed as 'tag' when the operation was queued
+	unsigned int tag;
+	// Byte count or new fd on success, -errno on failure
+	int result;
+	// URING_OP_RECV: where the received bytes are (until ReleaseRecv)
+	const char * data;
+	// URING_OP_RECV: which buffer to give back, if hasBuffer
+	unsigned short bufferId;
+	bool hasBuffer;
+	// Multishot operation is still armed and will complete again
+	bool more;
+} UringCompletion;
+
+class UringLoop
+{
+public:
+	// Set up the rings and register the buffers
+	UringLoop(unsigned int entries, unsigned int recvBuffers, unsigned int sendSlots, unsigned int bufferSize);
+	// Tear down the rings and free the buffers
+	~UringLoop();
+	// Check if setting everything up worked
+	bool IsOpen() const;
+	// Receive up to 'len' bytes on 'fd' into a provided buffer
+	bool QueueRecv(int fd, unsigned int len, unsigned int tag);
+	// Write the bytes 'iov' points at to 'fd' through a registered send slot
+	bool QueueSend(int fd, const struct iovec * iov, int count, unsigned int tag);
+	// Accept connections on listening socket 'fd' until told to stop
+	bool QueueAccept(int fd);
+	// Read 8 bytes from 'fd' into 'target'
+	bool QueueRead(int fd, uint64_t * target);
+	// Complete once 'after' has passed
+	bool QueueTimeout(struct __kernel_timespec * after);
+	// Cancel every operation in flight on 'fd'
+	bool CancelFd(int fd);
+	// Submit what is queued, wait for and collect completions. Returns how
+	// many were collected, or -1 on error
+	int SubmitAndWait(std::vector<UringCompletion> & completions);
+	// Give a recv buffer back to the kernel
+	void ReleaseRecv(unsigned short bufferId);
+	// Number of io_uring_enter() calls made so far
+	unsigned long GetEnterCount() const;
+private:
+	// Not copyable, it owns the ring
+	UringLoop(const UringLoop & loop);
+	const UringLoop & operator=(const UringLoop & rhs);
+	// Get a blank submission entry, flushing the queue to the kernel if full
+	struct io_uring_sqe * GetSqe();
+	// Tell the kernel about queued entries and optionally wait for one
+	int Enter(unsigned int waitFor);
+	int ringFd;
+	unsigned long enterCount;
+	// Submission queue
+	void * sqRingPtr;
+	size_t sqRingSize;
+	struct io_uring_sqe * sqes;
+	size_t sqesSize;
+	unsigned int * sqHead;
+	unsigned int * sqTail;
+	unsigned int * sqMask;
+	unsigned int * sqArray;
+	unsigned int sqEntries;
+	unsigned int toSubmit;
+	// Completion queue (shares the mapping with the submission queue)
+	unsigned int * cqHead;
+	unsigned int * cqTail;
+	unsigned int * cqMask;
+	struct io_uring_cqe * cqes;
+	// Provided recv buffers
+	struct io_uring_buf_ring * bufRing;
+	unsigned int bufRingEntries;
+	unsigned short bufTail;
+	char * recvArea;
+	unsigned int recvBufferCount;
+	// Registered send slots, and which are free
+	char * sendArea;
+	unsigned int sendSlotCount;
+	std::vector<unsigned int> freeSendSlots;
+	std::vector<int> sendSlotFd;
+	unsigned int bufferSize;
+};
@@ -0,0 +1,262 @@
+#include "WireCodec.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the game message codecs shared by the client and server.
+ ************************************/
+
+#include "netDefines.h"
+
+extern "C"
+{
+	// htonl/ntohl
+	#include <arpa/inet.h>
+}
+
+/****************************************************************
+ * Encode the cordinates of a move
+ * 
+ * Preconditions:
+ *  x and y <= MAP_SIDE_SIZE
+ * Postcondition:
+ *  encoded move returned
+ ****************************************************************/
+uint32_t encodeMove(short x, short y)
+{
+	uint32_t ourMove = ACTION_MOVE;
+	ourMove = ourMove | (MOVE_X_COORD_MASK_UNSHIFTED&(x<<MOVE_X_COORD_SHIFT));
+	ourMove = ourMove | (MOVE_Y_COORD_MASK_UNSHIFTED&(y<<MOVE_Y_COORD_SHIFT));
+	ourMove = htonl(ourMove);
+	return ourMove;
+}
+
+/****************************************************************
+ * Decode a move's coordinates
+ * 
+ * Preconditions:
+ *  move a valid move message in network order
+ * Postcondition:
+ *  x and y updated with parsed coordinates
+ ****************************************************************/
+void decodeMove(uint32_t move, short & x, short & y)
+{
+	move = ntohl(move);
+	x = (move & MOVE_X_COORD_MASK_UNSHIFTED)>>MOVE_X_COORD_SHIFT;
+	y = (move & MOVE_Y_COORD_MASK_UNSHIFTED)>>MOVE_Y_COORD_SHIFT;
+}
+
+/****************************************************************
+ * Encode the results of a move
+ * 
+ * Preconditions:
+ *  x and y <= MAP_SIDE_SIZE, shipSize <=5, if win == true; hit == true
+ * Postcondition:
+ *  encoded result of move returned, already converted to network order
+ ****************************************************************/
+uint32_t encodeMoveResults(short x, short y, bool hit, short shipSize, bool sink, bool win)
+{
+	uint32_t response = ACTION_MOVE_RESULTS;
+	
+	response = response | ((x<<MOVE_X_COORD_SHIFT) & MOVE_X_COORD_MASK_UNSHIFTED);
+	response = response | ((y<<MOVE_Y_COORD_SHIFT) & MOVE_Y_COORD_MASK_UNSHIFTED);
+	if (hit)
+	{
+		response = response | MOVE_HIT_SHIP_MASK;
+		response = response | ((shipSize<<MOVE_SIZE_OF_HIT_SHIP_SHIFT)&MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED);
+	}
+	if (sink)
+	{
+		response = response | MOVE_SINK_SHIP_MASK;
+	}
+	if (win)
+	{
+		response = response | WIN_BIT_MASK;
+	}
+	
+	response = htonl(response);
+	return response;
+}
+
+/****************************************************************
+ * Decode the results of a move
+ * 
+ * Preconditions:
+ *  response a valid network order encoded move results message
+ * Postcondition:
+ *  hit, shipSize, sink, and win all updated from the encoded values in response
+ ****************************************************************/
+void decodeMoveResults(uint32_t response, bool & hit, short & shipSize, bool & sink, bool & win)
+{
+	response = ntohl(response);
+	if (response & WIN_YES)
+	{
+		win = true;
+	}
+	else
+	{
+		win = false;
+	}
+	if (response & MOVE_SINK_SHIP_MASK)
+	{
+		sink = true;
+	}
+	else
+	{
+		sink = false;
+	}
+	if (response & MOVE_HIT_SHIP_MASK)
+	{
+		// Set ship size
+		hit = true;
+		shipSize = ((response & MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED)>>MOVE_SIZE_OF_HIT_SHIP_SHIFT);
+	}
+	else
+	{
+		hit = false;
+	}
+}
+
+/****************************************************************
+ * Encode where a placed ship is
+ * 
+ * Preconditions:
+ *  ship placed on the board
+ * Postcondition:
+ *  encoded ship returned (1 based coordinates), already converted to network
+ *  order
+ ****************************************************************/
+uint32_t encodeShip(const Ship & ship)
+{
+	uint32_t word = ((ship.GetSize()<<MOVE_SIZE_OF_HIT_SHIP_SHIFT)&MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED);
+	word = word | (((ship.GetX()+1)<<MOVE_X_COORD_SHIFT) & MOVE_X_COORD_MASK_UNSHIFTED);
+	word = word | (((ship.GetY()+1)<<MOVE_Y_COORD_SHIFT) & MOVE_Y_COORD_MASK_UNSHIFTED);
+	if (ship.IsHorizontal())
+	{
+		word = word | FLEET_HORIZONTAL_MASK;
+	}
+	return htonl(word);
+}
+
+/****************************************************************
+ * Decode where a ship is
+ * 
+ * Preconditions:
+ *  word one of the ship words of an ACTION_FLEET, in network order
+ * Postcondition:
+ *  size, horizontal, and the 1 based x and y updated from it
+ ****************************************************************/
+void decodeShip(uint32_t word, short & size, bool & horizontal, short & x, short & y)
+{
+	word = ntohl(word);
+	size = (word & MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED)>>MOVE_SIZE_OF_HIT_SHIP_SHIFT;
+	horizontal = (0 != (word & FLEET_HORIZONTAL_MASK));
+	x = (word & MOVE_X_COORD_MASK_UNSHIFTED)>>MOVE_X_COORD_SHIFT;
+	y = (word & MOVE_Y_COORD_MASK_UNSHIFTED)>>MOVE_Y_COORD_SHIFT;
+}
+
+/****************************************************************
+ * Pack 1 based x and y into a wide coordinates word
+ * 
+ * Preconditions:
+ *  0 <= x, y < 65536
+ * Postcondition:
+ *  word returned in network order
+ ****************************************************************/
+static uint32_t encodeWideCoords(short x, short y)
+{
+	return htonl((((uint32_t)(unsigned short)x) << WIDE_X_SHIFT) | (unsigned short)y);
+}
+
+/****************************************************************
+ * Unpack a wide coordinates word
+ * 
+ * Preconditions:
+ *  word in network order
+ * Postcondition:
+ *  x and y set (1 based)
+ ****************************************************************/
+static void decodeWideCoords(uint32_t word, short & x, short & y)
+{
+	word = ntohl(word);
+	x = word >> WIDE_X_SHIFT;
+	y = word & WIDE_Y_MASK;
+}
+
+/****************************************************************
+ * Encode a move with wide coordinates
+ * 
+ * Preconditions:
+ *  x and y 1 based
+ * Postcondition:
+ *  frame set to the ACTION_MOVE word and the coordinates word, both in
+ *  network order
+ ****************************************************************/
+void encodeWideMove(short x, short y, uint32_t frame[2])
+{
+	frame[0] = htonl(ACTION_MOVE | WIDE_COORDS_MASK);
+	frame[1] = encodeWideCoords(x, y);
+}
+
+/****************************************************************
+ * Decode a move's wide coordinates
+ * 
+ * Preconditions:
+ *  frame a wide move, in network order
+ * Postcondition:
+ *  x and y set (1 based)
+ ****************************************************************/
+void decodeWideMove(const uint32_t frame[2], short & x, short & y)
+{
+	decodeWideCoords(frame[1], x, y);
+}
+
+/****************************************************************
+ * Encode the results of a move with wide coordinates
+ * 
+ * Preconditions:
+ *  x and y 1 based
+ * Postcondition:
+ *  frame set to the ACTION_MOVE_RESULTS word (read it with
+ *  decodeMoveResults()) and the coordinates word, both in network order
+ ****************************************************************/
+void encodeWideMoveResults(short x, short y, bool hit, short shipSize, bool sink, bool win, uint32_t frame[2])
+{
+	frame[0] = htonl(ntohl(encodeMoveResults(0, 0, hit, shipSize, sink, win)) | WIDE_COORDS_MASK);
+	frame[1] = encodeWideCoords(x, y);
+}
+
+/****************************************************************
+ * Encode where a ship is with wide coordinates
+ * 
+ * Preconditions:
+ *  x and y 1 based, 0 < size <= 7
+ * Postcondition:
+ *  frame set to the ship word and the coordinates word, both in network
+ *  order
+ ****************************************************************/
+void encodeWideShip(short size, bool horizontal, short x, short y, uint32_t frame[2])
+{
+	uint32_t word = ((size<<MOVE_SIZE_OF_HIT_SHIP_SHIFT)&MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED) | WIDE_COORDS_MASK;
+	if (horizontal)
+	{
+		word = word | FLEET_HORIZONTAL_MASK;
+	}
+	frame[0] = htonl(word);
+	frame[1] = encodeWideCoords(x, y);
+}
+
+/****************************************************************
+ * Decode where a ship is from wide coordinates
+ * 
+ * Preconditions:
+ *  frame a wide ship, in network order
+ * Postcondition:
+ *  size, horizontal, x and y (1 based) set
+ ****************************************************************/
+void decodeWideShip(const uint32_t frame[2], short & size, bool & horizontal, short & x, short & y)
+{
+	short unusedX, unusedY;
+	decodeShip(frame[0], size, horizontal, unusedX, unusedY);
+	decodeWideCoords(frame[1], x, y);
+}
\ No newline at end of file
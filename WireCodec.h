@@ -0,0 +1,49 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Packing and unpacking of the fixed size game messages (moves, move
+ * results and fleet placements), shared by the client and the server. Every
+ * word goes over the wire in network order; these take and give it that way.
+ *
+ * encodeMove(short x, short y)/decodeMove(uint32_t move, short & x, short & y)
+ *  A shot at 1 based x, y
+ * encodeMoveResults(...)/decodeMoveResults(...)
+ *  What a shot hit, and whether it sank a ship or won the game
+ * encodeShip(const Ship & ship)/decodeShip(uint32_t word, ...)
+ *  Where one ship of a fleet is, for ACTION_FLEET
+ * encodeWide...(..., uint32_t frame[2])/decodeWide...(const uint32_t frame[2], ...)
+ *  The same, with WIDE_COORDS_MASK coordinates (two words each)
+ ***********************************/
+
+#include "Ship.h"
+
+extern "C"
+{
+	#include <stdint.h>
+}
+
+// Encode the cordinates of a move
+uint32_t encodeMove(short x, short y);
+// Decode a move's coordinates
+void decodeMove(uint32_t move, short & x, short & y);
+// Encode the results of a move
+uint32_t encodeMoveResults(short x, short y, bool hit, short shipSize, bool sink, bool win);
+// Decode the results of a move
+void decodeMoveResults(uint32_t response, bool & hit, short & shipSize, bool & sink, bool & win);
+// Encode where a placed ship is
+uint32_t encodeShip(const Ship & ship);
+// Decode where a ship is (1 based x and y)
+void decodeShip(uint32_t word, short & size, bool & horizontal, short & x, short & y);
+// Encode a move with wide coordinates
+void encodeWideMove(short x, short y, uint32_t frame[2]);
+// Decode a move's wide coordinates
+void decodeWideMove(const uint32_t frame[2], short & x, short & y);
+// Encode the results of a move with wide coordinates (decodeMoveResults()
+// reads the first word)
+void encodeWideMoveResults(short x, short y, bool hit, short shipSize, bool sink, bool win, uint32_t frame[2]);
+// Encode where a ship is with wide coordinates (1 based x and y)
+void encodeWideShip(short size, bool horizontal, short x, short y, uint32_t frame[2]);
+// Decode where a ship is from wide coordinates (1 based x and y)
+void decodeWideShip(const uint32_t frame[2], short & size, bool & horizontal, short & x, short & y);
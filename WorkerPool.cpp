@@ -0,0 +1,88 @@
+#include "WorkerPool.h"
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * Implements the pool of worker threads.
+ ************************************/
+
+/****************************************************************
+* Start the worker threads
+*
+* Preconditions:
+*  threads > 0
+* Postcondition:
+*  'threads' threads waiting for jobs
+****************************************************************/
+WorkerPool::WorkerPool(int threads): workers(), jobsMutex(), jobsReady(), jobs(), stopping(false)
+{
+	for (int i = 0; i < threads; ++i)
+	{
+		workers.push_back(std::thread(&WorkerPool::Work, this));
+	}
+}
+
+/****************************************************************
+* Stop the worker threads
+*
+* Preconditions:
+*  No one submits any more jobs
+* Postcondition:
+*  Jobs already submitted run, and the threads joined
+****************************************************************/
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+	}
+	jobsReady.notify_all();
+	for (std::thread & worker : workers)
+	{
+		worker.join();
+	}
+}
+
+/****************************************************************
+* Run a job on a worker thread
+*
+* Preconditions:
+*  None (safe from any thread)
+* Postcondition:
+*  job queued, and a waiting worker woken up for it
+****************************************************************/
+void WorkerPool::Submit(const std::function<void()> & job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs.push_back(job);
+	}
+	jobsReady.notify_one();
+}
+
+/****************************************************************
+* Run jobs until the pool is stopped
+*
+* Preconditions:
+*  Called on a worker thread
+* Postcondition:
+*  Returns once the pool is stopping and there are no jobs left
+****************************************************************/
+void WorkerPool::Work()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsReady.wait(lock, [this]{ return stopping || !jobs.empty(); });
+			if (jobs.empty())
+			{
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ * class WorkerPool:
+ *  Threads for work that shouldn't hold up an event loop (like working out a
+ *  bot's next shot). Jobs are run in the order they were submitted, by
+ *  whichever thread is free; a job that needs to tell a reactor something
+ *  posts it a ReactorMessage.
+ *
+ * WorkerPool(int threads)
+ *  Start 'threads' worker threads
+ * ~WorkerPool()
+ *  Finish the jobs already submitted, then stop the threads
+ * void Submit(const std::function<void()> & job)
+ *  Run 'job' on a worker thread. Safe from any thread.
+ ***********************************/
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class WorkerPool
+{
+public:
+	// Start 'threads' worker threads
+	WorkerPool(int threads);
+	// Finish the jobs already submitted, then stop the threads
+	~WorkerPool();
+	// Run 'job' on a worker thread
+	void Submit(const std::function<void()> & job);
+private:
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool & operator=(const WorkerPool &) = delete;
+	// What each worker thread runs
+	void Work();
+	std::vector<std::thread> workers;
+	std::mutex jobsMutex;
+	std::condition_variable jobsReady;
+	std::deque<std::function<void()> > jobs;
+	bool stopping;
+};
@@ -0,0 +1,725 @@
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ *
+ * Microbenchmarks for the code every move and lobby request goes through:
+ * Game::CalculateMoveResults (miss, hit, sink and win), Ship::Hit and
+ * CoordIsOnShip, ShipIndex lookups one at a time and in batches on a big
+ * fleet, the wire codecs, FdState's read and write buffers, and building and
+ * paging the lobby list with 10, 1k and 100k players.
+ *
+ * Each benchmark is warmed up until it has run for BENCH_WARMUP_MS, which
+ * also works out how many operations make a repetition of about -t ms. It
+ * then runs -r repetitions and reports the median's nanoseconds, TSC cycles
+ * and allocations (operator new calls) per operation, and the fastest
+ * repetition's nanoseconds.
+ *  -f only runs the benchmarks with that in their name
+ *  -r sets the number of repetitions (default 7)
+ *  -t sets the milliseconds per repetition (default 100)
+ * Build with optimization to get numbers that mean anything:
+ *  make clean; make OPT=-O2 bench
+ ************************************/
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include "Game.h"
+#include "Ship.h"
+#include "ShipIndex.h"
+#include "WireCodec.h"
+#include "netDefines.h"
+#include "FdState.h"
+#include "LobbyList.h"
+
+extern "C"
+{
+	#include <getopt.h>
+	#include <stdlib.h>
+	#include <stdio.h>
+	#include <string.h>
+	#include <arpa/inet.h>
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+// How long each benchmark runs before it is timed
+#define BENCH_WARMUP_MS 20
+// Players in the lobby list benchmarks
+#define BENCH_LOBBY_SMALL 10
+#define BENCH_LOBBY_MEDIUM 1000
+#define BENCH_LOBBY_LARGE 100000
+// Players asked for in a page
+#define BENCH_PAGE_LIMIT 20
+// Ships in the ShipIndex benchmarks (half across rows, half down columns of
+// a BENCH_INDEX_BOARD square board), and shots per batch
+#define BENCH_INDEX_SHIPS 1000
+#define BENCH_INDEX_BOARD 1000
+#define BENCH_INDEX_BATCH 64
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Contains an easy to use representation of the command line args
+typedef struct
+{
+	std::string filter;
+	int reps;
+	int repMs;
+} bench_options;
+
+// One repetition of a benchmark, per operation
+typedef struct
+{
+	double ns;
+	double cycles;
+	double allocs;
+} BenchRep;
+
+static bench_options Options;
+// operator new calls so far
+static unsigned long Allocations = 0;
+
+// Count every allocation, so the benchmarks can report allocations per op
+void * operator new(size_t size)
+{
+	++Allocations;
+	void * memory = malloc(size ? size : 1);
+	if (nullptr == memory)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void * memory) noexcept
+{
+	free(memory);
+}
+
+/****************************************************************
+ * Keep the compiler from throwing away a result nothing reads
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  value treated as used
+ ****************************************************************/
+template <typename T>
+inline void keep(const T & value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/****************************************************************
+ * Read the CPU's time stamp counter
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  TSC returned, 0 where there isn't one
+ ****************************************************************/
+inline unsigned long long readCycles()
+{
+#if BENCH_HAVE_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/****************************************************************
+ * Set up our struct
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  options intialized to defaults
+ ****************************************************************/
+void Init_bench_options(bench_options & options)
+{
+	options.filter = "";
+	options.reps = 7;
+	options.repMs = 100;
+}
+
+/****************************************************************
+ * Parse the command line args
+ *
+ * Preconditions:
+ *  options initialized
+ * Postcondition:
+ *  options populated with settings from command line. Returns 0 on success,
+ *  nonzero if the options were not usable
+ ****************************************************************/
+int parseOptions(int argc, char ** argv, bench_options & options)
+{
+	int arg;
+	while (-1 != (arg = getopt(argc, argv, "f:r:t:")))
+	{
+		if ('f' == arg)
+		{
+			options.filter = optarg;
+		}
+		else if ('r' == arg)
+		{
+			options.reps = atoi(optarg);
+			if (options.reps < 1 || options.reps > 1000)
+			{
+				std::cerr << "Repetitions (-r) must be between 1 and 1000.\n";
+				return 1;
+			}
+		}
+		else if ('t' == arg)
+		{
+			options.repMs = atoi(optarg);
+			if (options.repMs < 1)
+			{
+				std::cerr << "Milliseconds per repetition (-t) must be at least 1.\n";
+				return 2;
+			}
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Time 'ops' operations of a benchmark
+ *
+ * Preconditions:
+ *  body(ops) does 'ops' operations
+ * Postcondition:
+ *  nanoseconds, cycles and allocations per operation returned
+ ****************************************************************/
+template <typename Body>
+BenchRep timeOps(Body & body, long ops)
+{
+	unsigned long allocStart = Allocations;
+	BenchClock::time_point start = BenchClock::now();
+	unsigned long long cycleStart = readCycles();
+	body(ops);
+	unsigned long long cycles = readCycles() - cycleStart;
+	double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+	BenchRep rep;
+	rep.ns = ns / ops;
+	rep.cycles = (double)cycles / ops;
+	rep.allocs = (double)(Allocations - allocStart) / ops;
+	return rep;
+}
+
+/****************************************************************
+ * Run one benchmark and print how it did
+ *
+ * Preconditions:
+ *  body(ops) does 'ops' operations of what is being measured
+ * Postcondition:
+ *  Skipped if its name doesn't match -f. Otherwise warmed up, timed and one
+ *  line written to stdout.
+ ****************************************************************/
+template <typename Body>
+void bench(const std::string & name, Body body)
+{
+	if (std::string::npos == name.find(Options.filter))
+	{
+		return;
+	}
+	// Warm up, doubling until it takes long enough to size the repetitions by
+	long ops = 1;
+	double warmupNs = 0;
+	BenchClock::time_point warmupStart = BenchClock::now();
+	while (BenchClock::now() - warmupStart < std::chrono::milliseconds(BENCH_WARMUP_MS))
+	{
+		warmupNs = timeOps(body, ops).ns;
+		ops *= 2;
+	}
+	ops = std::max(1L, (long)(Options.repMs * 1e6 / std::max(warmupNs, 0.001)));
+	std::vector<BenchRep> reps;
+	for (int i = 0; i < Options.reps; ++i)
+	{
+		reps.push_back(timeOps(body, ops));
+	}
+	std::sort(reps.begin(), reps.end(), [](const BenchRep & a, const BenchRep & b) { return a.ns < b.ns; });
+	const BenchRep & median = reps[reps.size() / 2];
+	printf("%-36s %12.1f %12.1f %12.1f %10.2f\n", name.c_str(), median.ns, reps[0].ns, median.cycles, median.allocs);
+	fflush(stdout);
+}
+
+// Game with the ships at known spots, that can take back a shot so the same
+// one can be timed over and over
+class BenchGame : public Game
+{
+public:
+	// Ship n (n+1 spaces) across row n from x 0
+	BenchGame()
+	{
+		for (short size = 1; size <= FLEETSIZE; ++size)
+		{
+			PlaceShip(size, true, 0, size-1);
+		}
+		Snapshot();
+	}
+	// Remember where the ships are now, for Undo()
+	void Snapshot()
+	{
+		for (int i = 0; i < FLEETSIZE; ++i)
+		{
+			saved[i] = fleet[i];
+		}
+	}
+	// Take back the shot at x, y (0 based) that hit ship 'shipNum'
+	void Undo(short x, short y, int shipNum)
+	{
+		ocean[x][y].second = false;
+		fleet[shipNum] = saved[shipNum];
+	}
+private:
+	Ship saved[FLEETSIZE];
+};
+
+/****************************************************************
+ * Benchmark Game::CalculateMoveResults
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  Miss, hit, sink and win paths run. The hit, sink and win ones include
+ *  taking the shot back (two stores and a Ship copy).
+ ****************************************************************/
+void benchGame()
+{
+	BenchGame game;
+	bench("game.CalculateMoveResults.miss", [&](long ops)
+	{
+		bool hit, sink, win;
+		short shipSize;
+		for (long i = 0; i < ops; ++i)
+		{
+			game.CalculateMoveResults(9, 9, hit, shipSize, sink, win);
+			keep(hit);
+		}
+	});
+	bench("game.CalculateMoveResults.hit", [&](long ops)
+	{
+		bool hit, sink, win;
+		short shipSize;
+		for (long i = 0; i < ops; ++i)
+		{
+			// Front of the 5 space ship
+			game.CalculateMoveResults(0, 4, hit, shipSize, sink, win);
+			keep(sink);
+			game.Undo(0, 4, 4);
+		}
+	});
+	bench("game.CalculateMoveResults.sink", [&](long ops)
+	{
+		bool hit, sink, win;
+		short shipSize;
+		for (long i = 0; i < ops; ++i)
+		{
+			// The 1 space ship, with the rest still afloat
+			game.CalculateMoveResults(0, 0, hit, shipSize, sink, win);
+			keep(win);
+			game.Undo(0, 0, 0);
+		}
+	});
+	// Sink everything but the 1 space ship
+	BenchGame last;
+	for (short row = 1; row < FLEETSIZE; ++row)
+	{
+		for (short x = 0; x <= row; ++x)
+		{
+			bool hit, sink, win;
+			short shipSize;
+			last.CalculateMoveResults(x, row, hit, shipSize, sink, win);
+		}
+	}
+	last.Snapshot();
+	bench("game.CalculateMoveResults.win", [&](long ops)
+	{
+		bool hit, sink, win;
+		short shipSize;
+		for (long i = 0; i < ops; ++i)
+		{
+			last.CalculateMoveResults(0, 0, hit, shipSize, sink, win);
+			keep(win);
+			last.Undo(0, 0, 0);
+		}
+	});
+}
+
+/****************************************************************
+ * Benchmark Ship::Hit and Ship::CoordIsOnShip
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  On and off the ship run for each. Hit on the ship includes copying the
+ *  ship back so the hit count stays put.
+ ****************************************************************/
+void benchShip()
+{
+	Ship placed(5);
+	placed.Place(true, 2, 3);
+	Ship ship = placed;
+	bench("ship.Hit.on", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			ship = placed;
+			bool hit = ship.Hit(2 + (i & 3), 3);
+			keep(hit);
+		}
+	});
+	bench("ship.Hit.off", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			bool hit = ship.Hit(2 + (i & 3), 4);
+			keep(hit);
+		}
+	});
+	bench("ship.CoordIsOnShip.on", [&](long ops)
+	{
+		coord location;
+		location.y = 3;
+		for (long i = 0; i < ops; ++i)
+		{
+			location.x = 2 + (i & 3);
+			bool on = placed.CoordIsOnShip(location);
+			keep(on);
+		}
+	});
+	bench("ship.CoordIsOnShip.off", [&](long ops)
+	{
+		coord location;
+		location.y = 4;
+		for (long i = 0; i < ops; ++i)
+		{
+			location.x = 2 + (i & 3);
+			bool on = placed.CoordIsOnShip(location);
+			keep(on);
+		}
+	});
+}
+
+/****************************************************************
+ * Benchmark ShipIndex::Find against ShipIndex::FindAll
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  A batch of BENCH_INDEX_BATCH shots looked up one Find() at a time and with
+ *  one FindAll(), for a sweep along a row (the run FindAll() only looks up
+ *  once) and for shots scattered over the board. Times are per batch.
+ ****************************************************************/
+void benchShipIndex()
+{
+	ShipIndex index;
+	for (int i = 0; i < BENCH_INDEX_SHIPS / 2; ++i)
+	{
+		short size = 2 + i % 9;
+		Ship across(size);
+		across.Place(true, (i * 37) % (BENCH_INDEX_BOARD - size), 2*i);
+		index.Add(across, 2*i);
+		Ship down(size);
+		down.Place(false, 2*i + 1, (i * 53) % (BENCH_INDEX_BOARD - size));
+		index.Add(down, 2*i + 1);
+	}
+	std::vector<coord> sweep(BENCH_INDEX_BATCH);
+	std::vector<coord> scattered(BENCH_INDEX_BATCH);
+	for (int i = 0; i < BENCH_INDEX_BATCH; ++i)
+	{
+		sweep[i].x = i;
+		sweep[i].y = 0;
+		scattered[i].x = (i * 131) % BENCH_INDEX_BOARD;
+		scattered[i].y = (i * 211) % BENCH_INDEX_BOARD;
+	}
+	std::vector<int> found(BENCH_INDEX_BATCH);
+	bench("shipIndex.Find.sweep64", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			for (int j = 0; j < BENCH_INDEX_BATCH; ++j)
+			{
+				found[j] = index.Find(sweep[j].x, sweep[j].y);
+			}
+			keep(found[0]);
+		}
+	});
+	bench("shipIndex.FindAll.sweep64", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			index.FindAll(sweep.data(), BENCH_INDEX_BATCH, found.data());
+			keep(found[0]);
+		}
+	});
+	bench("shipIndex.Find.scattered64", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			for (int j = 0; j < BENCH_INDEX_BATCH; ++j)
+			{
+				found[j] = index.Find(scattered[j].x, scattered[j].y);
+			}
+			keep(found[0]);
+		}
+	});
+	bench("shipIndex.FindAll.scattered64", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			index.FindAll(scattered.data(), BENCH_INDEX_BATCH, found.data());
+			keep(found[0]);
+		}
+	});
+}
+
+/****************************************************************
+ * Benchmark the wire codecs
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  encode and decode of moves, move results and ships run, plain and wide
+ ****************************************************************/
+void benchCodecs()
+{
+	bench("codec.encodeMove", [](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			uint32_t move = encodeMove(1 + (i & 7), 1 + ((i >> 3) & 7));
+			keep(move);
+		}
+	});
+	uint32_t moves[64];
+	for (int i = 0; i < 64; ++i)
+	{
+		moves[i] = encodeMove(1 + (i & 7), 1 + (i >> 3));
+	}
+	bench("codec.decodeMove", [&](long ops)
+	{
+		short x, y;
+		for (long i = 0; i < ops; ++i)
+		{
+			decodeMove(moves[i & 63], x, y);
+			keep(x);
+			keep(y);
+		}
+	});
+	bench("codec.encodeMoveResults", [](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			uint32_t results = encodeMoveResults(1 + (i & 7), 1 + ((i >> 3) & 7), i & 1, 1 + (i & 3), i & 2, i & 4);
+			keep(results);
+		}
+	});
+	uint32_t results[64];
+	for (int i = 0; i < 64; ++i)
+	{
+		results[i] = encodeMoveResults(1 + (i & 7), 1 + (i >> 3), i & 1, 1 + (i & 3), i & 2, i & 4);
+	}
+	bench("codec.decodeMoveResults", [&](long ops)
+	{
+		bool hit, sink, win;
+		short shipSize = 0;
+		for (long i = 0; i < ops; ++i)
+		{
+			decodeMoveResults(results[i & 63], hit, shipSize, sink, win);
+			keep(hit);
+			keep(shipSize);
+		}
+	});
+	Ship ship(4);
+	ship.Place(false, 3, 5);
+	bench("codec.encodeShip", [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			uint32_t word = encodeShip(ship);
+			keep(word);
+		}
+	});
+	uint32_t shipWord = encodeShip(ship);
+	bench("codec.decodeShip", [&](long ops)
+	{
+		short size, x, y;
+		bool horizontal;
+		for (long i = 0; i < ops; ++i)
+		{
+			decodeShip(shipWord, size, horizontal, x, y);
+			keep(x);
+		}
+	});
+	bench("codec.encodeWideMove", [](long ops)
+	{
+		uint32_t frame[2];
+		for (long i = 0; i < ops; ++i)
+		{
+			encodeWideMove(1 + (i & 511), 1 + ((i >> 9) & 511), frame);
+			keep(frame);
+		}
+	});
+	uint32_t wide[2];
+	encodeWideMove(500, 700, wide);
+	bench("codec.decodeWideMove", [&](long ops)
+	{
+		short x, y;
+		for (long i = 0; i < ops; ++i)
+		{
+			decodeWideMove(wide, x, y);
+			keep(x);
+		}
+	});
+}
+
+/****************************************************************
+ * Benchmark FdState's read and write buffers
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  Setting up a read, taking the bytes and getting them back run for a frame
+ *  that fits inline and one that comes from the BufferPool, and the same for
+ *  queueing a write and noting it written
+ ****************************************************************/
+void benchFdState()
+{
+	FdState state(3, FD_STATE_LOBBY);
+	char data[MAX_NAME_LEN];
+	memset(data, 'x', sizeof(data));
+	short sizes[2] = {sizeof(uint32_t), MAX_NAME_LEN};
+	for (short size : sizes)
+	{
+		std::string suffix = "." + std::to_string(size) + "B";
+		bench("fdstate.SetRead+ReadFrom" + suffix, [&](long ops)
+		{
+			short readSize;
+			for (long i = 0; i < ops; ++i)
+			{
+				state.SetRead(size);
+				state.ReadFrom(data, size);
+				char * read = state.GetRead(readSize);
+				keep(read);
+			}
+		});
+		bench("fdstate.QueueWrite+Wrote" + suffix, [&](long ops)
+		{
+			for (long i = 0; i < ops; ++i)
+			{
+				state.QueueWrite(data, size);
+				int done = state.Wrote(size);
+				keep(done);
+			}
+		});
+	}
+}
+
+/****************************************************************
+ * Benchmark the lobby list at one size
+ *
+ * Preconditions:
+ *  players > 0
+ * Postcondition:
+ *  Rebuilding the whole list after a change, getting it unchanged, and
+ *  filling the first page and first full chunk run
+ ****************************************************************/
+void benchLobby(unsigned int players)
+{
+	LobbyList lobby;
+	std::vector<std::string> names;
+	for (unsigned int i = 0; i < players; ++i)
+	{
+		names.push_back("player" + std::to_string(i));
+		ConnRef ref = {0, (int)i, i};
+		lobby.Add(names.back(), ref);
+	}
+	std::string suffix = "." + std::to_string(players);
+	bench("lobby.GetSerialized.changed" + suffix, [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			// Someone leaves and comes back, so it has to be built again
+			unsigned int who = i % names.size();
+			ConnRef ref = {0, (int)who, who};
+			lobby.Remove(ref);
+			lobby.Add(names[who], ref);
+			std::shared_ptr<const std::string> list = lobby.GetSerialized();
+			keep(list);
+		}
+	});
+	bench("lobby.GetSerialized.same" + suffix, [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			std::shared_ptr<const std::string> list = lobby.GetSerialized();
+			keep(list);
+		}
+	});
+	ListCursor cursor;
+	std::string page;
+	unsigned int maxBytes = sizeof(uint32_t) + LONG_TRANSFER_SIZE_MASK;
+	bench("lobby.FillPage.first20" + suffix, [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			cursor = {"", "", 0, BENCH_PAGE_LIMIT, true, false};
+			page.assign(sizeof(uint32_t), '\0');
+			int result = lobby.FillPage(cursor, page, maxBytes);
+			keep(result);
+		}
+	});
+	bench("lobby.FillPage.chunk" + suffix, [&](long ops)
+	{
+		for (long i = 0; i < ops; ++i)
+		{
+			cursor = {"", "", 0, 0, false, false};
+			page.assign(sizeof(uint32_t), '\0');
+			int result = lobby.FillPage(cursor, page, maxBytes);
+			keep(result);
+		}
+	});
+}
+
+int main(int argc, char ** argv)
+{
+	Init_bench_options(Options);
+	if (parseOptions(argc, argv, Options))
+	{
+		return 1;
+	}
+#ifndef __OPTIMIZE__
+	std::cerr << "Built without optimization, these numbers are for -O0 (make clean; make OPT=-O2 bench).\n";
+#endif
+#if !BENCH_HAVE_TSC
+	std::cerr << "No time stamp counter on this CPU, cycles/op will be 0.\n";
+#endif
+	printf("%-36s %12s %12s %12s %10s\n", "benchmark", "ns/op", "min ns/op", "cycles/op", "allocs/op");
+	benchGame();
+	benchShip();
+	benchShipIndex();
+	benchCodecs();
+	benchFdState();
+	benchLobby(BENCH_LOBBY_SMALL);
+	benchLobby(BENCH_LOBBY_MEDIUM);
+	benchLobby(BENCH_LOBBY_LARGE);
+	return 0;
+}
@@ -10,6 +10,9 @@
 #include <iostream>
 #include "Game.h"
 #include "netDefines.h"
+#include "WireCodec.h"
+#include "GameRules.h"
+#include "Heatmap.h"
 
 extern "C"
 {
@@ -29,6 +32,8 @@ typedef struct
 {
 	char * port;
 	char * address;
+	// Have the server judge shots at our fleet (-j)
+	bool judged;
 } program_options;
 
 /****************************************************************
@@ -47,6 +52,7 @@ void Init_program_options(program_options * options)
 {
 	options->port = NULL;
 	options->address = NULL;
+	options->judged = false;
 }
 
 /****************************************************************
@@ -63,7 +69,7 @@ void parseOptions(int argc, char ** argv, program_options & options)
 {
 	int portNum = 0;
 	int arg;
-	while (-1 != (arg = getopt(argc, argv, "s:i:p:")))
+	while (-1 != (arg = getopt(argc, argv, "s:i:p:j")))
 	{
 		if ('p' == arg)
 		{
@@ -80,6 +86,10 @@ void parseOptions(int argc, char ** argv, program_options & options)
 		{
 			options.address = optarg;
 		}
+		else if ('j' == arg)
+		{
+			options.judged = true;
+		}
 	}
 	if (NULL == (options.address))
 	{
@@ -212,42 +222,101 @@ bool signEQunsign(int sign, unsigned int usign)
 	return ((unsigned int)sign) == usign;
 }
 
+/****************************************************************
+ * Turn the entries of a players page ([1 byte length][name] each) into one
+ *  name per line
+ * 
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  names appended to 'list', each followed by a newline. Returns false if the
+ *  entries were cut off
+ ****************************************************************/
+bool decodePageEntries(const std::string & entries, std::string & list)
+{
+	unsigned int pos = 0;
+	while (pos < entries.length())
+	{
+		unsigned int nameLen = (unsigned char)entries[pos];
+		++pos;
+		if (pos + nameLen > entries.length())
+		{
+			return false;
+		}
+		list.append(entries, pos, nameLen);
+		list += "\n";
+		pos += nameLen;
+	}
+	return true;
+}
+
 /****************************************************************
  * Reads a length and then string from a connection, and returns the resulting
- *  string. Handles strings up to LONG_TRANSFER_SIZE_MASK bytes
+ *  string. Handles strings up to LONG_TRANSFER_SIZE_MASK bytes, and players
+ *  pages (ACTION_PLAYERS_PAGE) of any length, which come in chunks of up to
+ *  that many bytes
  * 
  * Preconditions:
  *  fd is open and readable
  * Postcondition:
- *  string that was read returned
+ *  string that was read returned (a players page as one name per line)
  ****************************************************************/
 std::string readLongString(int fd)
 {
-	int ReadCount = -1;
-	uint32_t len;
-	ReadCount = readBytes(fd, ((char *)&len), sizeof(uint32_t));
-	if (ReadCount != sizeof(uint32_t))
-	{
-		return std::string("");
-	}
-	len = ntohl(len);
-	len = len & LONG_TRANSFER_SIZE_MASK;
-	if (len < 1)
-	{
-		return std::string("");
-	}
-	char * data = new char[len];
-	if (!data)
-	{
-		return std::string("");
+	std::string returnVal;
+	std::string entries;
+	bool page = false;
+	bool moreChunks = true;
+	while (moreChunks)
+	{
+		int ReadCount = -1;
+		uint32_t len;
+		ReadCount = readBytes(fd, ((char *)&len), sizeof(uint32_t));
+		if (ReadCount != sizeof(uint32_t))
+		{
+			return std::string("");
+		}
+		len = ntohl(len);
+		page = (ACTION_PLAYERS_PAGE == (len & ACTION_MASK));
+		moreChunks = page && (len & PAGE_MORE_CHUNKS_MASK);
+		bool morePlayers = page && (len & PAGE_MORE_PLAYERS_MASK);
+		len = len & LONG_TRANSFER_SIZE_MASK;
+		if (len > 0)
+		{
+			char * data = new char[len];
+			ReadCount = readBytes(fd, data, len);
+			if (!signEQunsign(ReadCount, len))
+			{
+				delete [] data;
+				return std::string("");
+			}
+			std::string chunk(data, len);
+			delete [] data;
+			if (!page)
+			{
+				return chunk;
+			}
+			entries += chunk;
+		}
+		if (page)
+		{
+			// Chunks end on entry boundaries, so decode as we go instead of
+			// holding on to all of them
+			if (!decodePageEntries(entries, returnVal))
+			{
+				return std::string("");
+			}
+			entries.clear();
+			if (morePlayers)
+			{
+				returnVal += "...\n";
+			}
+		}
 	}
-	ReadCount = readBytes(fd, data, len);
-	if (!signEQunsign(ReadCount, len))
+	if (page)
 	{
-		return std::string("");
+		returnVal = "Available players:\n" + returnVal;
 	}
-	std::string returnVal(data, len);
-	delete [] data;
 	return returnVal;
 }
 
@@ -341,130 +410,81 @@ int writeString(int fd, const std::string & str, uint32_t action)
 }
 
 /****************************************************************
- * Request the x and y coordinates to fire at from the user
+ * Ask for a page of the players list
  * 
  * Preconditions:
- *  Game being played and it's the players turn
+ *  fd open and writable. prefix shorter than MAX_NAME_LEN
  * Postcondition:
- *  x and y coordinates stored in 'x' and  'y'
+ *  ACTION_REQ_PLAYERS_PAGE request written (read the answer with
+ *  readLongString()), or a negative number returned for an error
  ****************************************************************/
-void getPlayCoord(short &x, short &y)
+int writePageRequest(int fd, unsigned short offset, unsigned short limit, const std::string & prefix)
 {
-	x = 0;
-	y = 0;
-	while (x < 1 || x > MAP_SIDE_SIZE)
+	uint32_t request[2];
+	request[0] = htonl(ACTION_REQ_PLAYERS_PAGE | (prefix.length() & TRANSFER_SIZE_MASK));
+	request[1] = htonl(((uint32_t)offset << PAGE_OFFSET_SHIFT) | limit);
+	if (sizeof(request) != writeData(fd, (char *)request, sizeof(request)))
 	{
-		std::cout << "Please enter the x coordinate you want to fire at: ";
-		std::cin >> x;
+		return -1;
 	}
-	
-	while (y < 1 || y > MAP_SIDE_SIZE)
+	if (!signEQunsign(writeData(fd, prefix.c_str(), prefix.length()), prefix.length()))
 	{
-		std::cout << "Please enter the y coordinate you want to fire at: ";
-		std::cin >> y;
+		return -2;
 	}
+	return sizeof(request) + prefix.length();
 }
 
 /****************************************************************
- * Encode the cordinates of a move
- * 
- * Preconditions:
- *  x and y <= MAP_SIDE_SIZE
- * Postcondition:
- *  encoded move returned
- ****************************************************************/
-uint32_t encodeMove(short x, short y)
-{
-	uint32_t ourMove = ACTION_MOVE;
-	ourMove = ourMove | (MOVE_X_COORD_MASK_UNSHIFTED&(x<<MOVE_X_COORD_SHIFT));
-	ourMove = ourMove | (MOVE_Y_COORD_MASK_UNSHIFTED&(y<<MOVE_Y_COORD_SHIFT));
-	ourMove = htonl(ourMove);
-	return ourMove;
-}
-
-/****************************************************************
- * Decode a move's coordinates
+ * Send our fleet to the server, for a game where it judges shots at us
  * 
  * Preconditions:
- *  response a valid move message in network order
+ *  fd open and writable. game's ships placed
  * Postcondition:
- *  x and y updated with parsed coordinates
+ *  ACTION_FLEET header and one word per ship written, or a negative number
+ *  returned for an error
  ****************************************************************/
-void decodeMove(uint32_t response, short & x, short & y)
+int writeFleet(int fd, const Game & game)
 {
-	response = ntohl(response);
-	x = (response & MOVE_X_COORD_MASK_UNSHIFTED)>>MOVE_X_COORD_SHIFT;
-	y = (response & MOVE_Y_COORD_MASK_UNSHIFTED)>>MOVE_Y_COORD_SHIFT;
-}
-
-/****************************************************************
- * Encode the results of a move
- * 
- * Preconditions:
- *  x and y <= MAP_SIDE_SIZE, shipSize <=5, if win == true; hit == true
- * Postcondition:
- *  encoded result of move returned, already converted to network order
- ****************************************************************/
-uint32_t encodeMoveResults(short x, short y, bool hit, short shipSize, bool sink, bool win)
-{
-	uint32_t response = ACTION_MOVE_RESULTS;
-	
-	response = response | ((x<<MOVE_X_COORD_SHIFT) & MOVE_X_COORD_MASK_UNSHIFTED);
-	response = response | ((y<<MOVE_Y_COORD_SHIFT) & MOVE_Y_COORD_MASK_UNSHIFTED);
-	if (hit)
-	{
-		response = response | MOVE_HIT_SHIP_MASK;
-		response = response | ((shipSize<<MOVE_SIZE_OF_HIT_SHIP_SHIFT)&MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED);
-	}
-	if (sink)
+	uint32_t fleet[FLEETSIZE+1];
+	fleet[0] = htonl(ACTION_FLEET | FLEETSIZE);
+	for (int i = 0; i < FLEETSIZE; ++i)
 	{
-		response = response | MOVE_SINK_SHIP_MASK;
+		fleet[i+1] = encodeShip(game.GetShip(i));
 	}
-	if (win)
+	if (sizeof(fleet) != writeData(fd, (char *)fleet, sizeof(fleet)))
 	{
-		response = response | WIN_BIT_MASK;
+		return -1;
 	}
-	
-	response = htonl(response);
-	return response;
+	return sizeof(fleet);
 }
 
 /****************************************************************
- * Decode the results of a move
+ * Request the x and y coordinates to fire at from the user
  * 
  * Preconditions:
- *  response a valid network order encoded move results message
+ *  Game being played and it's the players turn, hints has the results of
+ *  our moves so far
  * Postcondition:
- *  hit, shipSize, sink, and win all updated from the encoded values in response
+ *  Best odds from hints shown, x and y coordinates stored in 'x' and  'y'
  ****************************************************************/
-void decodeMoveResults(uint32_t response, bool & hit, short & shipSize, bool & sink, bool & win)
+void getPlayCoord(short &x, short &y, Heatmap & hints)
 {
-	response = ntohl(response);
-	if (response & WIN_YES)
+	if (hints.Best(x, y))
 	{
-		win = true;
+		std::cout << "Hint: the best odds are at x " << x+1 << ", y " << y+1 << ".\n";
 	}
-	else
-	{
-		win = false;
-	}
-	if (response & MOVE_SINK_SHIP_MASK)
-	{
-		sink = true;
-	}
-	else
-	{
-		sink = false;
-	}
-	if (response & MOVE_HIT_SHIP_MASK)
+	x = 0;
+	y = 0;
+	while (x < 1 || x > MAP_SIDE_SIZE)
 	{
-		// Set ship size
-		hit = true;
-		shipSize = ((response & MOVE_SIZE_OF_HIT_SHIP_MASK_UNSHIFTED)>>MOVE_SIZE_OF_HIT_SHIP_SHIFT);
+		std::cout << "Please enter the x coordinate you want to fire at: ";
+		std::cin >> x;
 	}
-	else
+	
+	while (y < 1 || y > MAP_SIDE_SIZE)
 	{
-		hit = false;
+		std::cout << "Please enter the y coordinate you want to fire at: ";
+		std::cin >> y;
 	}
 }
 
@@ -558,10 +578,8 @@ int main(int argc, char ** argv)
 	bool quit = false;
 	while (!quit)
 	{
-		// Need to get list of other players
-		uint32_t listReq = ACTION_REQ_PLAYERS_LIST;
-		listReq = htonl(listReq);
-		if (sizeof(uint32_t) != writeData(connection, (char *)&listReq, sizeof(uint32_t)))
+		// Need to get list of other players (all of them, however many that is)
+		if (0 > writePageRequest(connection, 0, 0, std::string("")))
 		{
 			quit = true;
 			break;
@@ -638,6 +656,10 @@ int main(int argc, char ** argv)
 				--otherUserPtr;
 			}
 			uint32_t ourRequest = ACTION_PLAY_PLAYERNAME | (otherUserPtr & TRANSFER_SIZE_MASK);
+			if (options.judged)
+			{
+				ourRequest = ourRequest | GAME_JUDGED_MASK;
+			}
 			ourRequest = htonl(ourRequest);
 			// write request type, and embed string length
 			if (sizeof(uint32_t) != writeData(connection, (char *)&ourRequest, sizeof(uint32_t)))
@@ -695,6 +717,12 @@ int main(int argc, char ** argv)
 			delete [] otherPlayerName;
 			// Ask if the user wants to accept
 			char userAnswer = 'u';
+			if (GAME_RULES_CLASSIC != ((serverRequest & GAME_RULES_MASK_UNSHIFTED) >> GAME_RULES_SHIFT))
+			{
+				// We only have the classic board
+				std::cout << "\n\n" << otherPlayer << " invited you to a game with rules we can't play. Declining.\n";
+				userAnswer = 'n';
+			}
 			while (userAnswer != 'Y' && userAnswer !='y' && userAnswer != 'n' && userAnswer != 'N')
 			{
 				std::cout << "\n\n" << otherPlayer << " has invited you to a game. Do you want to play? [y/n]\n";
@@ -705,6 +733,10 @@ int main(int argc, char ** argv)
 			{
 				// respond with an accept
 				uint32_t response = ACTION_INVITE_RESPONSE | INVITE_RESPONSE_YES;
+				if (options.judged)
+				{
+					response = response | GAME_JUDGED_MASK;
+				}
 				response = htonl(response);
 				if (sizeof(uint32_t) != writeData(connection, (char *)&response, sizeof(uint32_t)))
 				{
@@ -738,13 +770,25 @@ int main(int argc, char ** argv)
 		bool win = false;
 		// Place ships
 		game.PlaceShips();
+		// Where their ships probably are (they have the same fleet as us)
+		std::vector<short> sizes;
+		for (int shipNum = 0; shipNum < FLEETSIZE; ++shipNum)
+		{
+			sizes.push_back(game.GetShip(shipNum).GetSize());
+		}
+		Heatmap hints(MAP_SIDE_SIZE, MAP_SIDE_SIZE, sizes);
 		game.PrintBoard();
+		if (options.judged && writeFleet(connection, game) < 0)
+		{
+			quit = true;
+			break;
+		}
 		
 		if (continueRead == 3)
 		{
 			// Do our first turn
 			std::cout << "Because you were invited to a game, you get the first move. \n";
-			getPlayCoord(x, y);
+			getPlayCoord(x, y, hints);
 			game.SetPlayCoord(x-1, y-1);
 			// Send our move
 			// Encodes move, including net byte order
@@ -763,6 +807,7 @@ int main(int argc, char ** argv)
 			}
 			// Decodes from net order
 			decodeMoveResults(moveResults, hit, hitShipSize, sink, win);
+			hints.Record(x-1, y-1, hit, hitShipSize, sink);
 			if (hit)
 			{
 				game.SetPlayHitCoord(x-1, y-1);
@@ -795,12 +840,16 @@ int main(int argc, char ** argv)
 			outputMoveResults(false, hit, hitShipSize, sink, win);
 			game.PrintBoard();
 			
-			uint32_t theirMoveResults = encodeMoveResults(x, y, hit, hitShipSize, sink, win);
-			
-			if (sizeof(uint32_t) != writeData(connection, (char *)&theirMoveResults, sizeof(uint32_t)))
+			// The server already told them if it judges our fleet
+			if (!options.judged)
 			{
-				quit = true;
-				break;
+				uint32_t theirMoveResults = encodeMoveResults(x, y, hit, hitShipSize, sink, win);
+				
+				if (sizeof(uint32_t) != writeData(connection, (char *)&theirMoveResults, sizeof(uint32_t)))
+				{
+					quit = true;
+					break;
+				}
 			}
 			if (win) // other player won
 			{
@@ -811,7 +860,7 @@ int main(int argc, char ** argv)
 			win = false;
 			
 			std::cout << "Our turn.\n";
-			getPlayCoord(x, y);
+			getPlayCoord(x, y, hints);
 			game.SetPlayCoord(x-1, y-1);
 			// Send our move
 			// Encodes move, including net byte order
@@ -830,6 +879,7 @@ int main(int argc, char ** argv)
 			}
 			// Decodes from net order
 			decodeMoveResults(moveResults, hit, hitShipSize, sink, win);
+			hints.Record(x-1, y-1, hit, hitShipSize, sink);
 			if (hit)
 			{
 				game.SetPlayHitCoord(x-1, y-1);
@@ -0,0 +1,954 @@
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ *
+ * Load generator for the battleship server. Opens lots of non-blocking
+ * connections from one thread and has them do what players do, with the same
+ * messages the client sends: ask for a name, look at a page of the players
+ * list, invite and accept, and play whole games, answering shots from an in
+ * memory fleet. Clients are paired up: the even one of each pair looks at the
+ * list and invites the odd one, which accepts and moves first. After a game
+ * the inviter does it again.
+ *  -s sets the server and -p the port to connect to
+ *  -c sets the number of clients (default 1000), opened at -r per second
+ *   (default 200)
+ *  -d sets how many seconds to keep going once they are all open (default 10)
+ *  -g sets the rules (GAME_RULES_* number, not a wide one; default classic)
+ *  -a sets how clients pick shots (heatmap, hunt or random; default hunt)
+ *  -j has the server judge every shot
+ *  -l sets how many players a list page asks for (default 20)
+ * Prints what it did each second, then the totals and how long the server
+ * took to answer each kind of message.
+ ************************************/
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "EventLoop.h"
+#include "netDefines.h"
+#include "WireCodec.h"
+#include "GameRules.h"
+#include "Bot.h"
+
+extern "C"
+{
+	#include <getopt.h>
+	#include <netdb.h>
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/resource.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <arpa/inet.h>
+	#include <errno.h>
+	#include <string.h>
+	#include <stdlib.h>
+	#include <stdio.h>
+	#include <unistd.h>
+	#include <signal.h>
+}
+
+// Where a simulated client is
+// Connecting
+#define LOAD_CONNECTING 0
+// Asked for a name, waiting for the answer
+#define LOAD_NAME_WAIT 1
+// In the lobby with nothing going on
+#define LOAD_LOBBY 2
+// Asked for a page of the players list, waiting for the last chunk
+#define LOAD_PAGE_WAIT 3
+// Invited the other half of its pair, waiting for the answer
+#define LOAD_INVITE_WAIT 4
+// Fired, waiting for the results
+#define LOAD_RESULTS_WAIT 5
+// Waiting for the other player to fire
+#define LOAD_THEIR_MOVE 6
+// Connection gone
+#define LOAD_CLOSED 7
+
+// Kinds of message the time to an answer is kept for
+// ACTION_NAME_REQUEST to ACTION_NAME_IS_YOURS
+#define LATENCY_LOGIN 0
+// ACTION_REQ_PLAYERS_PAGE to the last ACTION_PLAYERS_PAGE chunk
+#define LATENCY_PAGE 1
+// ACTION_PLAY_PLAYERNAME to ACTION_INVITE_RESPONSE
+#define LATENCY_INVITE 2
+// ACTION_MOVE to the other player getting it
+#define LATENCY_RELAY 3
+// ACTION_MOVE to its ACTION_MOVE_RESULTS
+#define LATENCY_MOVE 4
+#define LATENCY_KINDS 5
+
+// How long an inviter waits to ask again after a no (ms)
+#define LOAD_RETRY_MS 20
+
+typedef std::chrono::steady_clock LoadClock;
+
+// Contains an easy to use representation of the command line args
+typedef struct
+{
+	char * port;
+	char * address;
+	int clients;
+	int rate;
+	int duration;
+	unsigned char rules;
+	std::string strategy;
+	bool judged;
+	unsigned short pageLimit;
+} load_options;
+
+// One simulated player
+typedef struct
+{
+	int fd;
+	int state;
+	std::string name;
+	// Bytes read that aren't a whole frame yet
+	std::string in;
+	// Bytes still to write
+	std::string out;
+	// This game: where our ships are, and how we pick shots at theirs
+	std::shared_ptr<JudgedFleet> fleet;
+	std::shared_ptr<ShotStrategy> strategy;
+	// Our last shot (0 based)
+	short x;
+	short y;
+	// When the message we are waiting on an answer to went out
+	LoadClock::time_point sent;
+} LoadClient;
+
+// What happened, in all and since the last report
+typedef struct
+{
+	long logins;
+	long pages;
+	long invites;
+	long declined;
+	long moves;
+	long games;
+	long errors;
+} LoadCounts;
+
+static const char * LatencyNames[LATENCY_KINDS] = {"login", "page", "invite", "relay", "move"};
+
+static load_options Options;
+static std::vector<LoadClient> Clients;
+// Client index for each fd, -1 for none
+static std::vector<int> FdClients;
+static EventLoop * Loop = nullptr;
+static LoadCounts Totals;
+// Microseconds each answer took, by LATENCY_* kind
+static std::vector<uint32_t> Latencies[LATENCY_KINDS];
+// Inviters to send their next invitation, and when (soonest first)
+typedef std::pair<LoadClock::time_point, int> LoadRetry;
+static std::priority_queue<LoadRetry, std::vector<LoadRetry>, std::greater<LoadRetry> > Retries;
+static std::mt19937 Random;
+
+/****************************************************************
+ * Set up our struct -- note that I expect this to point to argv memory,
+ * so no destructor needed
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  options intialized to defaults
+ ****************************************************************/
+void Init_load_options(load_options & options)
+{
+	options.port = NULL;
+	options.address = NULL;
+	options.clients = 1000;
+	options.rate = 200;
+	options.duration = 10;
+	options.rules = GAME_RULES_CLASSIC;
+	options.strategy = "hunt";
+	options.judged = false;
+	options.pageLimit = 20;
+}
+
+/****************************************************************
+ * Parse the command line args
+ *
+ * Preconditions:
+ *  options initialized
+ * Postcondition:
+ *  options populated with settings from command line. Returns 0 on success,
+ *  nonzero if the options were not usable
+ ****************************************************************/
+int parseOptions(int argc, char ** argv, load_options & options)
+{
+	int arg;
+	while (-1 != (arg = getopt(argc, argv, "s:i:p:c:r:d:g:a:jl:")))
+	{
+		if ('p' == arg)
+		{
+			options.port = optarg;
+		}
+		// Treat -s and -i the same since getaddrinfo can handle them both
+		else if ('s' == arg || 'i' == arg)
+		{
+			options.address = optarg;
+		}
+		else if ('c' == arg)
+		{
+			options.clients = atoi(optarg);
+			if (options.clients < 2 || options.clients > 1000000)
+			{
+				std::cerr << "Number of clients (-c) must be between 2 and 1000000.\n";
+				return 3;
+			}
+		}
+		else if ('r' == arg)
+		{
+			options.rate = atoi(optarg);
+			if (options.rate < 1)
+			{
+				std::cerr << "Connections per second (-r) must be at least 1.\n";
+				return 4;
+			}
+		}
+		else if ('d' == arg)
+		{
+			options.duration = atoi(optarg);
+			if (options.duration < 0)
+			{
+				std::cerr << "Seconds to run (-d) can't be negative.\n";
+				return 5;
+			}
+		}
+		else if ('g' == arg)
+		{
+			options.rules = atoi(optarg);
+			const GameRules * rules = findRules(options.rules);
+			if (nullptr == rules || rules->wide)
+			{
+				std::cerr << "Rules (-g) must be a set of rules without wide coordinates.\n";
+				return 6;
+			}
+		}
+		else if ('a' == arg)
+		{
+			options.strategy = optarg;
+		}
+		else if ('j' == arg)
+		{
+			options.judged = true;
+		}
+		else if ('l' == arg)
+		{
+			options.pageLimit = atoi(optarg);
+		}
+	}
+	std::vector<short> none;
+	if (!makeStrategy(options.strategy, *findRules(options.rules), none, 0))
+	{
+		std::cerr << "Strategy (-a) must be heatmap, hunt or random.\n";
+		return 7;
+	}
+	if (NULL == options.address)
+	{
+		std::cerr << "You must set either a hostname or address with -s or -i.\n";
+		return 1;
+	}
+	if (NULL == options.port)
+	{
+		std::cerr << "You must set a port number with the -p option.\n";
+		return 2;
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Record how long the server took to answer a message
+ *
+ * Preconditions:
+ *  kind a LATENCY_* number
+ * Postcondition:
+ *  microseconds since 'sent' added to the samples for 'kind'
+ ****************************************************************/
+void recordLatency(int kind, LoadClock::time_point sent)
+{
+	long micros = std::chrono::duration_cast<std::chrono::microseconds>(LoadClock::now() - sent).count();
+	Latencies[kind].push_back(micros);
+}
+
+/****************************************************************
+ * Write as much of a client's queued bytes as the socket takes
+ *
+ * Preconditions:
+ *  client connected
+ * Postcondition:
+ *  Written bytes taken off the queue, and the fd watched for writes only
+ *  while some are left. False if the connection broke.
+ ****************************************************************/
+bool flush(LoadClient & client)
+{
+	while (!client.out.empty())
+	{
+		int written = write(client.fd, client.out.data(), client.out.length());
+		if (written < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+		{
+			Loop->AddWrite(client.fd);
+			return true;
+		}
+		if (written <= 0)
+		{
+			return false;
+		}
+		client.out.erase(0, written);
+	}
+	Loop->RemoveWrite(client.fd);
+	return true;
+}
+
+/****************************************************************
+ * Queue bytes to go to the server
+ *
+ * Preconditions:
+ *  client connected
+ * Postcondition:
+ *  bytes added to the queue, for the next flush() to write
+ ****************************************************************/
+void queueBytes(LoadClient & client, const void * data, size_t bytes)
+{
+	client.out.append((const char *)data, bytes);
+}
+
+/****************************************************************
+ * Queue one word (host order) to go to the server
+ *
+ * Preconditions:
+ *  client connected
+ * Postcondition:
+ *  word queued in network order
+ ****************************************************************/
+void queueWord(LoadClient & client, uint32_t word)
+{
+	word = htonl(word);
+	queueBytes(client, &word, sizeof(uint32_t));
+}
+
+/****************************************************************
+ * Drop a client
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  connection closed and counted as an error, unless it was already
+ ****************************************************************/
+void closeClient(LoadClient & client)
+{
+	if (LOAD_CLOSED == client.state)
+	{
+		return;
+	}
+	Loop->Remove(client.fd);
+	close(client.fd);
+	FdClients[client.fd] = -1;
+	client.state = LOAD_CLOSED;
+	client.out.clear();
+	client.in.clear();
+	++Totals.errors;
+}
+
+/****************************************************************
+ * Look at a page of the players list, before inviting
+ *
+ * Preconditions:
+ *  client an inviter in LOAD_LOBBY
+ * Postcondition:
+ *  ACTION_REQ_PLAYERS_PAGE queued for the first page of everyone
+ ****************************************************************/
+void requestPage(LoadClient & client)
+{
+	uint32_t request[2];
+	request[0] = htonl(ACTION_REQ_PLAYERS_PAGE);
+	request[1] = htonl(Options.pageLimit);
+	queueBytes(client, request, sizeof(request));
+	client.state = LOAD_PAGE_WAIT;
+	client.sent = LoadClock::now();
+}
+
+/****************************************************************
+ * Invite the other half of a client's pair
+ *
+ * Preconditions:
+ *  index an inviter (even) client that just got its players page
+ * Postcondition:
+ *  ACTION_PLAY_PLAYERNAME with the rules (and judging if -j) queued
+ ****************************************************************/
+void invite(int index)
+{
+	LoadClient & client = Clients[index];
+	const std::string & other = Clients[index+1].name;
+	uint32_t request = ACTION_PLAY_PLAYERNAME | other.length() | (Options.rules << GAME_RULES_SHIFT);
+	if (Options.judged)
+	{
+		request = request | GAME_JUDGED_MASK;
+	}
+	queueWord(client, request);
+	queueBytes(client, other.data(), other.length());
+	client.state = LOAD_INVITE_WAIT;
+	client.sent = LoadClock::now();
+}
+
+/****************************************************************
+ * Set up a client's side of a new game
+ *
+ * Preconditions:
+ *  client just accepted, or was accepted
+ * Postcondition:
+ *  fleet placed at random and a new strategy made. The fleet is queued as an
+ *  ACTION_FLEET if the server judges our shots.
+ ****************************************************************/
+void startGame(LoadClient & client)
+{
+	const GameRules & rules = *findRules(Options.rules);
+	std::vector<Ship> ships;
+	client.fleet = rules.MakeFleet();
+	placeFleet(*client.fleet, BOT_PLACE_RANDOM, Random, &ships);
+	std::vector<short> sizes;
+	for (const Ship & ship : ships)
+	{
+		sizes.push_back(ship.GetSize());
+	}
+	client.strategy = makeStrategy(Options.strategy, rules, sizes, Random());
+	if (Options.judged)
+	{
+		queueWord(client, ACTION_FLEET | ships.size());
+		for (const Ship & ship : ships)
+		{
+			uint32_t word = encodeShip(ship);
+			queueBytes(client, &word, sizeof(uint32_t));
+		}
+	}
+}
+
+/****************************************************************
+ * Fire at the other player
+ *
+ * Preconditions:
+ *  client's turn in a game
+ * Postcondition:
+ *  ACTION_MOVE queued, waiting for the results
+ ****************************************************************/
+void fire(LoadClient & client)
+{
+	client.strategy->NextShot(client.x, client.y);
+	uint32_t move = encodeMove(client.x+1, client.y+1);
+	queueBytes(client, &move, sizeof(uint32_t));
+	client.state = LOAD_RESULTS_WAIT;
+	client.sent = LoadClock::now();
+}
+
+/****************************************************************
+ * Back to the lobby after a game
+ *
+ * Preconditions:
+ *  game just ended
+ * Postcondition:
+ *  client in LOAD_LOBBY, and an inviter queued to invite again
+ ****************************************************************/
+void endGame(int index)
+{
+	LoadClient & client = Clients[index];
+	client.state = LOAD_LOBBY;
+	client.fleet = nullptr;
+	client.strategy = nullptr;
+	if (0 == index % 2)
+	{
+		++Totals.games;
+		Retries.push(std::make_pair(LoadClock::now(), index));
+	}
+}
+
+/****************************************************************
+ * Get the size of the frame starting with a header
+ *
+ * Preconditions:
+ *  header in host order
+ * Postcondition:
+ *  bytes in the whole frame returned, header included
+ ****************************************************************/
+size_t frameSize(uint32_t header)
+{
+	uint32_t action = header & ACTION_MASK;
+	if (ACTION_PLAYERS_PAGE == action)
+	{
+		return sizeof(uint32_t) + (header & LONG_TRANSFER_SIZE_MASK);
+	}
+	if (ACTION_INVITE_REQ == action)
+	{
+		return sizeof(uint32_t) + (header & TRANSFER_SIZE_MASK);
+	}
+	return sizeof(uint32_t);
+}
+
+/****************************************************************
+ * Act on one frame from the server
+ *
+ * Preconditions:
+ *  frame a whole frame (header in network order) for Clients[index]
+ * Postcondition:
+ *  client moved on to its next state with any answer queued. False if the
+ *  frame didn't belong in the state the client is in.
+ ****************************************************************/
+bool handleFrame(int index, const char * frame)
+{
+	LoadClient & client = Clients[index];
+	uint32_t word;
+	memcpy(&word, frame, sizeof(uint32_t));
+	uint32_t header = ntohl(word);
+	uint32_t action = header & ACTION_MASK;
+	if (LOAD_NAME_WAIT == client.state)
+	{
+		if (ACTION_NAME_IS_YOURS != action)
+		{
+			return false;
+		}
+		recordLatency(LATENCY_LOGIN, client.sent);
+		++Totals.logins;
+		client.state = LOAD_LOBBY;
+		// Pairs start once both halves are in
+		int inviter = index - index % 2;
+		if (LOAD_LOBBY == Clients[inviter].state && LOAD_LOBBY == Clients[inviter+1].state)
+		{
+			Retries.push(std::make_pair(LoadClock::now(), inviter));
+		}
+		return true;
+	}
+	if (LOAD_PAGE_WAIT == client.state && ACTION_PLAYERS_PAGE == action)
+	{
+		if (0 == (header & PAGE_MORE_CHUNKS_MASK))
+		{
+			recordLatency(LATENCY_PAGE, client.sent);
+			++Totals.pages;
+			invite(index);
+		}
+		return true;
+	}
+	if (LOAD_INVITE_WAIT == client.state && ACTION_INVITE_RESPONSE == action)
+	{
+		recordLatency(LATENCY_INVITE, client.sent);
+		if (0 == (header & INVITE_RESPONSE_YES))
+		{
+			// The other one isn't back in the lobby yet
+			++Totals.declined;
+			client.state = LOAD_LOBBY;
+			Retries.push(std::make_pair(LoadClock::now() + std::chrono::milliseconds(LOAD_RETRY_MS), index));
+			return true;
+		}
+		++Totals.invites;
+		startGame(client);
+		// The one invited moves first
+		client.state = LOAD_THEIR_MOVE;
+		return true;
+	}
+	if (LOAD_LOBBY == client.state && ACTION_INVITE_REQ == action)
+	{
+		uint32_t response = ACTION_INVITE_RESPONSE | INVITE_RESPONSE_YES;
+		if (Options.judged)
+		{
+			response = response | GAME_JUDGED_MASK;
+		}
+		queueWord(client, response);
+		startGame(client);
+		fire(client);
+		return true;
+	}
+	if (LOAD_RESULTS_WAIT == client.state && ACTION_MOVE_RESULTS == action)
+	{
+		recordLatency(LATENCY_MOVE, client.sent);
+		++Totals.moves;
+		bool hit, sink, win;
+		short shipSize = 0;
+		decodeMoveResults(word, hit, shipSize, sink, win);
+		client.strategy->Record(client.x, client.y, hit, shipSize, sink);
+		if (win)
+		{
+			endGame(index);
+		}
+		else
+		{
+			client.state = LOAD_THEIR_MOVE;
+		}
+		return true;
+	}
+	if (LOAD_THEIR_MOVE == client.state && ACTION_MOVE == action)
+	{
+		// The other half of the pair sent it
+		recordLatency(LATENCY_RELAY, Clients[index ^ 1].sent);
+		short x, y, shipSize = 0;
+		bool hit, sink, win = false;
+		decodeMove(word, x, y);
+		client.fleet->CalculateMoveResults(x-1, y-1, hit, shipSize, sink, win);
+		if (!Options.judged)
+		{
+			uint32_t results = encodeMoveResults(x, y, hit, shipSize, sink, win);
+			queueBytes(client, &results, sizeof(uint32_t));
+		}
+		if (win)
+		{
+			endGame(index);
+		}
+		else
+		{
+			fire(client);
+		}
+		return true;
+	}
+	return false;
+}
+
+/****************************************************************
+ * Read what the server sent a client, and act on every whole frame
+ *
+ * Preconditions:
+ *  client's fd readable
+ * Postcondition:
+ *  frames handled and answers flushed. Client closed if the connection
+ *  broke or the server sent something it shouldn't have.
+ ****************************************************************/
+void readClient(int index)
+{
+	LoadClient & client = Clients[index];
+	char buffer[4096];
+	int readCount = read(client.fd, buffer, sizeof(buffer));
+	if (readCount < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+	{
+		return;
+	}
+	if (readCount <= 0)
+	{
+		closeClient(client);
+		return;
+	}
+	client.in.append(buffer, readCount);
+	size_t pos = 0;
+	while (client.in.length() - pos >= sizeof(uint32_t))
+	{
+		uint32_t header;
+		memcpy(&header, client.in.data() + pos, sizeof(uint32_t));
+		size_t size = frameSize(ntohl(header));
+		if (client.in.length() - pos < size)
+		{
+			break;
+		}
+		if (!handleFrame(index, client.in.data() + pos))
+		{
+			closeClient(client);
+			return;
+		}
+		pos += size;
+	}
+	client.in.erase(0, pos);
+	if (!flush(client))
+	{
+		closeClient(client);
+	}
+}
+
+/****************************************************************
+ * Open the next client's connection
+ *
+ * Preconditions:
+ *  Loop set up, address one of getaddrinfo()'s results for the server
+ * Postcondition:
+ *  non-blocking connect started and the fd watched for it finishing, or the
+ *  client closed if that failed
+ ****************************************************************/
+void openClient(int index, const struct addrinfo * address)
+{
+	LoadClient & client = Clients[index];
+	client.fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK, address->ai_protocol);
+	if (-1 == client.fd)
+	{
+		perror("Trouble getting a socket");
+		client.state = LOAD_CLOSED;
+		++Totals.errors;
+		return;
+	}
+	// Every message is small and answered, don't let Nagle hold them back
+	int yes = 1;
+	setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	if ((unsigned int)client.fd >= FdClients.size())
+	{
+		FdClients.resize(client.fd+1, -1);
+	}
+	FdClients[client.fd] = index;
+	client.state = LOAD_CONNECTING;
+	if (-1 == connect(client.fd, address->ai_addr, address->ai_addrlen) && EINPROGRESS != errno)
+	{
+		perror("Trouble connecting");
+		closeClient(client);
+		return;
+	}
+	Loop->AddWrite(client.fd);
+}
+
+/****************************************************************
+ * Ask for a client's name, once it is connected
+ *
+ * Preconditions:
+ *  client in LOAD_CONNECTING and its fd writable
+ * Postcondition:
+ *  ACTION_NAME_REQUEST written and the fd watched for reads, or the client
+ *  closed if connecting failed
+ ****************************************************************/
+void connected(LoadClient & client)
+{
+	int error = 0;
+	socklen_t errorSize = sizeof(error);
+	if (-1 == getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) || 0 != error)
+	{
+		closeClient(client);
+		return;
+	}
+	Loop->AddRead(client.fd);
+	queueWord(client, ACTION_NAME_REQUEST | client.name.length());
+	queueBytes(client, client.name.data(), client.name.length());
+	client.state = LOAD_NAME_WAIT;
+	client.sent = LoadClock::now();
+	if (!flush(client))
+	{
+		closeClient(client);
+	}
+}
+
+/****************************************************************
+ * Send the invitations that are due
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  Every inviter due by now, still in the lobby and with its other half in
+ *  the lobby too, has asked for a players page (it invites once that comes)
+ ****************************************************************/
+void sendDueInvites()
+{
+	LoadClock::time_point now = LoadClock::now();
+	while (!Retries.empty() && Retries.top().first <= now)
+	{
+		int index = Retries.top().second;
+		Retries.pop();
+		LoadClient & client = Clients[index];
+		if (LOAD_LOBBY != client.state || LOAD_CLOSED == Clients[index+1].state)
+		{
+			continue;
+		}
+		requestPage(client);
+		if (!flush(client))
+		{
+			closeClient(client);
+		}
+	}
+}
+
+/****************************************************************
+ * Count the clients in each state
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  No changes. Number of clients connected (logged in or not) returned, and
+ *  the ones in a game put in 'playing'
+ ****************************************************************/
+int countConnected(int opened, int & playing)
+{
+	int connected = 0;
+	playing = 0;
+	for (int i = 0; i < opened; ++i)
+	{
+		if (LOAD_CLOSED != Clients[i].state)
+		{
+			++connected;
+		}
+		if (LOAD_RESULTS_WAIT == Clients[i].state || LOAD_THEIR_MOVE == Clients[i].state)
+		{
+			++playing;
+		}
+	}
+	return connected;
+}
+
+/****************************************************************
+ * Print what happened since the last report
+ *
+ * Preconditions:
+ *  last the totals at the last report, 'seconds' ago
+ * Postcondition:
+ *  one line of rates written to stdout, last set to the totals
+ ****************************************************************/
+void report(double elapsed, double seconds, int opened, LoadCounts & last)
+{
+	int playing;
+	int connected = countConnected(opened, playing);
+	printf("%6.1fs connected %d playing %d logins/s %.0f pages/s %.0f games/s %.0f moves/s %.0f declined %ld errors %ld\n",
+		elapsed, connected, playing, (Totals.logins - last.logins) / seconds,
+		(Totals.pages - last.pages) / seconds, (Totals.games - last.games) / seconds,
+		(Totals.moves - last.moves) / seconds, Totals.declined - last.declined,
+		Totals.errors - last.errors);
+	fflush(stdout);
+	last = Totals;
+}
+
+/****************************************************************
+ * Print the percentiles of each kind of answer
+ *
+ * Preconditions:
+ *  Run over
+ * Postcondition:
+ *  Latencies sorted, and one line per kind written to stdout
+ ****************************************************************/
+void printLatencies()
+{
+	printf("Latency (us)   count      p50      p90      p99    p99.9      max\n");
+	for (int kind = 0; kind < LATENCY_KINDS; ++kind)
+	{
+		std::vector<uint32_t> & samples = Latencies[kind];
+		if (samples.empty())
+		{
+			continue;
+		}
+		std::sort(samples.begin(), samples.end());
+		size_t last = samples.size() - 1;
+		printf("%-8s %11zu %8u %8u %8u %8u %8u\n", LatencyNames[kind], samples.size(),
+			samples[last * 50 / 100], samples[last * 90 / 100], samples[last * 99 / 100],
+			samples[last * 999 / 1000], samples[last]);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	Init_load_options(Options);
+	if (parseOptions(argc, argv, Options))
+	{
+		return 1;
+	}
+	// A write to a connection the server dropped shouldn't kill us
+	signal(SIGPIPE, SIG_IGN);
+	// One fd per client
+	struct rlimit files;
+	if (0 == getrlimit(RLIMIT_NOFILE, &files) && files.rlim_cur < files.rlim_max)
+	{
+		files.rlim_cur = files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+
+	struct addrinfo hints;
+	struct addrinfo * address;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	int returnStatus = getaddrinfo(Options.address, Options.port, &hints, &address);
+	if (0 != returnStatus)
+	{
+		fprintf(stderr, "Couldn't get address lookup info: %s\n", gai_strerror(returnStatus));
+		return 2;
+	}
+
+	EventLoop loop;
+	Loop = &loop;
+	if (-1 == loop.GetFD())
+	{
+		return 3;
+	}
+	Random.seed(getpid());
+	Clients.resize(Options.clients);
+	// Clients come in pairs, so leave the odd one out
+	Options.clients -= Options.clients % 2;
+	char prefix[32];
+	snprintf(prefix, sizeof(prefix), "load%d_", (int)getpid());
+	for (int i = 0; i < Options.clients; ++i)
+	{
+		Clients[i].fd = -1;
+		Clients[i].state = LOAD_CLOSED;
+		Clients[i].name = prefix + std::to_string(i);
+	}
+	memset(&Totals, 0, sizeof(Totals));
+	LoadCounts last = Totals;
+
+	LoadClock::time_point start = LoadClock::now();
+	LoadClock::time_point lastReport = start;
+	LoadClock::time_point rampDone = start;
+	int opened = 0;
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	for (;;)
+	{
+		LoadClock::time_point now = LoadClock::now();
+		double elapsed = std::chrono::duration<double>(now - start).count();
+		// Open however many the ramp says should be by now
+		int due = std::min((long)Options.clients, (long)(elapsed * Options.rate) + 1);
+		while (opened < due)
+		{
+			openClient(opened, address);
+			++opened;
+			if (opened == Options.clients)
+			{
+				rampDone = now;
+			}
+		}
+		if (opened == Options.clients && now - rampDone >= std::chrono::seconds(Options.duration))
+		{
+			break;
+		}
+		double sinceReport = std::chrono::duration<double>(now - lastReport).count();
+		if (sinceReport >= 1.0)
+		{
+			report(elapsed, sinceReport, opened, last);
+			lastReport = now;
+		}
+		sendDueInvites();
+
+		// Come back in time for the ramp and retries
+		int timeout = (opened < Options.clients || !Retries.empty()) ? 1 : 100;
+		int ready = loop.Wait(events, EVENT_LOOP_MAX_EVENTS, timeout);
+		for (int i = 0; i < ready; ++i)
+		{
+			int fd = events[i].data.fd;
+			if ((unsigned int)fd >= FdClients.size() || -1 == FdClients[fd])
+			{
+				continue;
+			}
+			int index = FdClients[fd];
+			LoadClient & client = Clients[index];
+			if (LOAD_CONNECTING == client.state)
+			{
+				connected(client);
+				continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			{
+				readClient(index);
+			}
+			if (LOAD_CLOSED != client.state && (events[i].events & EPOLLOUT) && !flush(client))
+			{
+				closeClient(client);
+			}
+		}
+	}
+	double seconds = std::chrono::duration<double>(LoadClock::now() - start).count();
+	double steady = std::chrono::duration<double>(LoadClock::now() - rampDone).count();
+	freeaddrinfo(address);
+
+	printLatencies();
+	int playing;
+	int connected = countConnected(opened, playing);
+	// One line to track capacity by (rates over the whole run)
+	printf("clients=%d connected=%d seconds=%.1f steady_seconds=%.1f logins_per_sec=%.0f moves_per_sec=%.0f games_per_sec=%.0f declined=%ld errors=%ld\n",
+		Options.clients, connected, seconds, steady, Totals.logins / seconds,
+		Totals.moves / seconds, Totals.games / seconds, Totals.declined, Totals.errors);
+	for (int i = 0; i < opened; ++i)
+	{
+		if (LOAD_CLOSED != Clients[i].state)
+		{
+			close(Clients[i].fd);
+		}
+	}
+	return 0;
+}
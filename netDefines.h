@@ -17,6 +17,9 @@
 #define ACTION_INVITE_REQ 0x1c000000
 #define ACTION_MOVE 0x20000000
 #define ACTION_MOVE_RESULTS 0x24000000
+#define ACTION_REQ_PLAYERS_PAGE 0x28000000
+#define ACTION_PLAYERS_PAGE 0x2c000000
+#define ACTION_FLEET 0x30000000
 
 // For transferring coordinates of moves and their results
 #define MOVE_X_COORD_SHIFT 16
@@ -40,6 +43,22 @@
 #define WIN_YES WIN_BIT_MASK
 #define WIN_NO ~WIN_YES
 
+// Players page request: ACTION_REQ_PLAYERS_PAGE with the prefix length in the
+// TRANSFER_SIZE_MASK bits, then a 32 bit word with how many matching players to
+// skip (offset) and how many to send (limit, 0 for all of them), then the
+// prefix itself (players whose names start with it, empty for everyone)
+#define PAGE_OFFSET_SHIFT 16
+#define PAGE_OFFSET_MASK_UNSHIFTED 0x0000FFFF<<PAGE_OFFSET_SHIFT
+#define PAGE_LIMIT_MASK 0x0000FFFF
+
+// Players page response: one or more chunks, each ACTION_PLAYERS_PAGE with the
+// chunk length in the LONG_TRANSFER_SIZE_MASK bits, followed by that many bytes
+// of entries (1 byte name length, then the name). Names are sorted.
+// Another chunk of this page follows
+#define PAGE_MORE_CHUNKS_MASK 1<<25
+// More players match after this page (ask again with a bigger offset)
+#define PAGE_MORE_PLAYERS_MASK 1<<24
+
 // Up to 255 chars/bytes
 #define TRANSFER_SIZE_MASK 0x000000FF
 
@@ -47,5 +66,34 @@
 #define INVITE_RESPONSE_NO 0
 #define INVITE_RESPONSE_YES 1
 
+// Set on ACTION_PLAY_PLAYERNAME (inviting) or on a yes ACTION_INVITE_RESPONSE
+// (accepting) to have the server judge shots at your fleet. You then send an
+// ACTION_FLEET right after the game starts, and the other player's shots come
+// to you as ACTION_MOVE with nothing to answer: the server already sent them
+// the results.
+#define GAME_JUDGED_MASK 1<<25
+
+// Set of rules (GAME_RULES_* in GameRules.h) the game is played by, picked on
+// ACTION_PLAY_PLAYERNAME and passed on in the other player's ACTION_INVITE_REQ.
+// Moves are judged against that board size, and an ACTION_FLEET has to have
+// that fleet.
+#define GAME_RULES_SHIFT 8
+#define GAME_RULES_MASK_UNSHIFTED 0x0000000F<<GAME_RULES_SHIFT
+
+// Fleet upload: ACTION_FLEET with the number of ships in the
+// TRANSFER_SIZE_MASK bits, then one 32 bit word per ship with its size in the
+// MOVE_SIZE_OF_HIT_SHIP bits, the 1 based coordinates of its first space in
+// the move coordinate bits, and FLEET_HORIZONTAL_MASK if it is horizontal
+#define FLEET_HORIZONTAL_MASK 1<<25
+
+// Wide coordinates, for boards bigger than the 4 bit fields hold. Set on
+// ACTION_MOVE, ACTION_MOVE_RESULTS, ACTION_FLEET and fleet ship words, which
+// then leave the 4 bit coordinate fields 0 and are followed by one more word
+// with the 1 based x in the high 16 bits and y in the low 16 bits. A wide
+// ACTION_FLEET has its ship count in the LONG_TRANSFER_SIZE_MASK bits.
+#define WIDE_COORDS_MASK 1<<11
+#define WIDE_X_SHIFT 16
+#define WIDE_Y_MASK 0x0000FFFF
+
 // Max length of a username
 #define MAX_NAME_LEN 64
\ No newline at end of file
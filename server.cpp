@@ -1,6 +1,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <atomic>
 
 extern "C"
 {
@@ -15,72 +19,470 @@ extern "C"
 	// for perror
 	#include <stdio.h>
 	#include <sys/socket.h>
+	#include <sys/un.h>
 	// For memset
 	#include <string.h>
 	#include <signal.h>
+	#include <fcntl.h>
+	#include <time.h>
 }
 
+#include "EventLoop.h"
+#include "UringLoop.h"
 #include "FdState.h"
+#include "Reactor.h"
+#include "Metrics.h"
+#include "BufferPool.h"
+#include "FlightRecorder.h"
+#include "TimerWheel.h"
+#include "NameIndex.h"
+#include "LobbyList.h"
+#include "GameRules.h"
+#include "WireCodec.h"
+#include "Bot.h"
+#include "WorkerPool.h"
 #include "netDefines.h"
 
-static std::vector<FdState> Fds;
-static int maxFd = 3;
+// Dumps the flight recorders to the -f file
+#define FLIGHT_DUMP_SIGNAL SIGUSR1
+// How long the stats socket waits for a command before sending the metrics
+#define STATS_COMMAND_TIMEOUT_MS 200
+
+// How long a connection may stay in one state before it is dropped (and its
+// game partner with it). See stateTimeout() for which states get which.
+// Connected but not named yet
+#define TIMEOUT_HANDSHAKE_MS 10000
+// Invited but hasn't answered
+#define TIMEOUT_INVITE_MS 30000
+// In a game (a turn, or waiting on the other player's)
+#define TIMEOUT_GAME_MS 120000
+// In the lobby without asking for anything
+#define TIMEOUT_LOBBY_MS 600000
+
+// Contains an easy to use representation of the command line args
+typedef struct
+{
+	char * port;
+	int reactors;
+	// Use io_uring instead of epoll for connection I/O
+	bool uring;
+	// Computer players to put in the lobby, and threads to run them on
+	int bots;
+	int workers;
+	// Unix domain socket to serve metrics snapshots on (NULL for none)
+	char * statsPath;
+	// File the flight recorders are dumped to on FLIGHT_DUMP_SIGNAL
+	char * flightPath;
+} server_options;
+
+// Bytes received for a connection that it hasn't asked for yet, and what is
+// in flight for it. Used by the io_uring backend only, indexed by fd.
+typedef struct
+{
+	// Connection this belongs to (fds get reused)
+	unsigned int serial;
+	std::string bytes;
+	// Connection hung up (or errored) after sending 'bytes'
+	bool closed;
+	bool recvInFlight;
+	bool sendInFlight;
+} UringConn;
+
+// All of the event loop threads. Filled in before any of them start and never
+// changed after, so any thread can read it.
+static std::vector<Reactor *> Reactors;
+// Who is in the lobby, and every name given out, across all of the reactors.
+// Only touched with LobbyMutex held.
+static std::mutex LobbyMutex;
+static LobbyList Lobby;
+static NameIndex Names;
+// Threads that work out bot shots (nullptr when there are no bots)
+static WorkerPool * BotWorkers = nullptr;
+// Seeds each bot game differently
+static std::atomic<unsigned int> BotSeed(0);
+
+/****************************************************************
+ * Set up our struct -- note that I expect this to point to argv memory,
+ * so no destructor needed
+ * 
+ * Preconditions:
+ *  options is a pointer to a block of memory at least
+ *   sizeof(server_options) in size
+ * Postcondition:
+ *  options intialized to defaults
+ ****************************************************************/
+void Init_server_options(server_options * options)
+{
+	options->port = NULL;
+	options->reactors = 1;
+	options->uring = false;
+	options->bots = 0;
+	options->workers = 1;
+	options->statsPath = NULL;
+	options->flightPath = (char *)"battleship-flight.json";
+}
 
 /****************************************************************
- * Parse the port from the command line args
+ * Parse the port, number of event loop threads, I/O backend, number of bots,
+ * bot worker threads, stats socket and flight recorder dump file from the
+ * command line args
  * 
  * Preconditions:
  *  User properly specified port in the argc and argv given
  * Postcondition:
- *  returns the port or service name string, or an empty string on error
+ *  options populated with settings from command line. Returns 0 on success,
+ *  nonzero if the options were not usable
  ****************************************************************/
-std::string getPortString(int argc, char ** argv)
+int parseOptions(int argc, char ** argv, server_options & options)
 {
 	int arg;
-	char * portString = NULL;
-	while (-1 != (arg = getopt(argc, argv, "p:")))
+	while (-1 != (arg = getopt(argc, argv, "p:t:b:a:w:m:f:")))
 	{
 		if ('p' == arg)
 		{
-			portString = optarg;
+			options.port = optarg;
+		}
+		else if ('t' == arg)
+		{
+			options.reactors = atoi(optarg);
+			if (options.reactors < 1 || options.reactors > 1024)
+			{
+				std::cerr << "Number of event loop threads (-t) must be between 1 and 1024.\n";
+				return 2;
+			}
+		}
+		else if ('b' == arg)
+		{
+			if (0 == strcmp("epoll", optarg))
+			{
+				options.uring = false;
+			}
+			else if (0 == strcmp("uring", optarg))
+			{
+				options.uring = true;
+			}
+			else
+			{
+				std::cerr << "I/O backend (-b) must be epoll or uring.\n";
+				return 3;
+			}
+		}
+		else if ('a' == arg)
+		{
+			options.bots = atoi(optarg);
+			if (options.bots < 0 || options.bots > 1000)
+			{
+				std::cerr << "Number of bots (-a) must be between 0 and 1000.\n";
+				return 4;
+			}
+		}
+		else if ('w' == arg)
+		{
+			options.workers = atoi(optarg);
+			if (options.workers < 1 || options.workers > 1024)
+			{
+				std::cerr << "Number of bot worker threads (-w) must be between 1 and 1024.\n";
+				return 5;
+			}
+		}
+		else if ('m' == arg)
+		{
+			options.statsPath = optarg;
+			if (strlen(optarg) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+			{
+				std::cerr << "Stats socket path (-m) is too long.\n";
+				return 6;
+			}
+		}
+		else if ('f' == arg)
+		{
+			options.flightPath = optarg;
 		}
 	}
-	if (NULL == portString)
+	if (NULL == options.port)
 	{
 		std::cerr << "No port number or service name set. Please specify it with -p <port_number>.\n";
-		return std::string("");
+		return 1;
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Build a message for another reactor (or ourself) about 'target'
+ * 
+ * Preconditions:
+ *  type one of the REACTOR_MSG_* #defines
+ * Postcondition:
+ *  message returned with everything but type, target and from blanked out
+ ****************************************************************/
+ReactorMessage makeMessage(short type, const ConnRef & target, const ConnRef & from)
+{
+	ReactorMessage msg;
+	msg.type = type;
+	msg.target = target;
+	msg.from = from;
+	msg.yes = false;
+	msg.rules = GAME_RULES_CLASSIC;
+	msg.x = 0;
+	msg.y = 0;
+	msg.conn = nullptr;
+	return msg;
+}
+
+/****************************************************************
+ * Add a player to the lobby directory
+ * 
+ * Preconditions:
+ *  state is one of reactor's connections, with a name, entering FD_STATE_LOBBY
+ * Postcondition:
+ *  player shows up in the players list
+ ****************************************************************/
+void lobbyAdd(Reactor & reactor, const FdState & state)
+{
+	ConnRef ref = reactor.RefTo(state);
+	std::lock_guard<std::mutex> lock(LobbyMutex);
+	Lobby.Add(state.GetName(), ref);
+}
+
+/****************************************************************
+ * Take a player out of the lobby directory
+ * 
+ * Preconditions:
+ *  state is one of reactor's connections
+ * Postcondition:
+ *  player no longer in the directory (if they were)
+ ****************************************************************/
+void lobbyRemove(Reactor & reactor, const FdState & state)
+{
+	ConnRef ref = reactor.RefTo(state);
+	std::lock_guard<std::mutex> lock(LobbyMutex);
+	Lobby.Remove(ref);
+}
+
+/****************************************************************
+ * Put the computer players in the lobby
+ * 
+ * Preconditions:
+ *  No reactor threads running yet
+ * Postcondition:
+ *  'count' bots (BOT_NAME_PREFIX1 and up) listed and invitable, their names
+ *  taken
+ ****************************************************************/
+void addBots(int count)
+{
+	std::lock_guard<std::mutex> lock(LobbyMutex);
+	for (int i = 1; i <= count; ++i)
+	{
+		std::string name = BOT_NAME_PREFIX + std::to_string(i);
+		ConnRef ref = {BOT_REACTOR, i, 0};
+		Names.Claim(name, ref);
+		Names.SetInvitable(name, ref, true);
+		Lobby.Add(name, ref);
+	}
+}
+
+/****************************************************************
+ * Give a name to a player, unless someone connected already has it
+ * 
+ * Preconditions:
+ *  state is one of reactor's connections, without a name yet
+ * Postcondition:
+ *  true returned and name set on state if it was free, false otherwise
+ ****************************************************************/
+bool nameClaim(Reactor & reactor, FdState & state, const std::string & name)
+{
+	{
+		std::lock_guard<std::mutex> lock(LobbyMutex);
+		if (!Names.Claim(name, reactor.RefTo(state)))
+		{
+			return false;
+		}
+	}
+	state.SetName(name);
+	return true;
+}
+
+/****************************************************************
+ * Free up a disconnecting player's name
+ * 
+ * Preconditions:
+ *  state is one of reactor's connections
+ * Postcondition:
+ *  state's name (if it had one) can be claimed by someone else
+ ****************************************************************/
+void nameRelease(Reactor & reactor, const FdState & state)
+{
+	if (state.GetName().empty())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(LobbyMutex);
+	Names.Release(state.GetName(), reactor.RefTo(state));
+}
+
+/****************************************************************
+ * Check if a player in 'state' can be sent an invitation
+ * 
+ * Preconditions:
+ *  state one of the #defined states in FdState.h
+ * Postcondition:
+ *  true returned for the lobby and for fetching the players list (the
+ *  invitation is queued behind the list), and for answering another
+ *  invitation (the new one waits its turn in the reactor's InviteTable)
+ ****************************************************************/
+bool isInvitable(short state)
+{
+	return FD_STATE_LOBBY == state || FD_STATE_REQ_NAME_LIST == state ||
+		FD_STATE_GAME_INVITE == state || FD_STATE_GAME_INVITE_RESP_WAIT == state;
+}
+
+/****************************************************************
+ * Check if a player in 'state' shows up in the players list
+ * 
+ * Preconditions:
+ *  state one of the #defined states in FdState.h
+ * Postcondition:
+ *  true returned for the lobby, and for fetching the players list or a page of
+ *  it from there (so polling the list doesn't change it and throw away the
+ *  cached copy)
+ ****************************************************************/
+bool isListed(short state)
+{
+	return FD_STATE_LOBBY == state || FD_STATE_REQ_NAME_LIST == state ||
+		FD_STATE_PAGE_REQ_READ == state || FD_STATE_REQ_NAME_PAGE == state;
+}
+
+/****************************************************************
+ * Check if what a connection in 'state' reads starts a new message
+ * 
+ * Preconditions:
+ *  state one of the #defined states in FdState.h
+ * Postcondition:
+ *  true returned for the states whose reads start with an ACTION_* word,
+ *  false for the ones reading the rest of a message (like a name)
+ ****************************************************************/
+bool startsMessage(short state)
+{
+	return FD_STATE_ANON == state || FD_STATE_LOBBY == state ||
+		FD_STATE_GAME_WAIT_THISFD_MOVE == state || FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS == state ||
+		FD_STATE_GAME_INVITE_RESP_WAIT == state || FD_STATE_GAME_FLEET_READ_FIRST == state ||
+		FD_STATE_GAME_FLEET_READ_SECOND == state;
+}
+
+/****************************************************************
+ * Find how long a connection may stay in 'state'
+ * 
+ * Preconditions:
+ *  state one of the #defined states in FdState.h
+ * Postcondition:
+ *  One of the TIMEOUT_*_MS #defines returned, or 0 if it may stay forever
+ ****************************************************************/
+unsigned int stateTimeout(short state)
+{
+	switch (state)
+	{
+		case FD_STATE_ANON:
+		case FD_STATE_ANON_NAME_SIZE:
+		case FD_STATE_NAME_REJECT:
+		case FD_STATE_NAME_ACCEPT:
+			return TIMEOUT_HANDSHAKE_MS;
+		case FD_STATE_GAME_INVITE:
+		case FD_STATE_GAME_INVITE_RESP_WAIT:
+			return TIMEOUT_INVITE_MS;
+		case FD_STATE_GAME_WAIT_THISFD_MOVE:
+		case FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS:
+		case FD_STATE_GAME_WAIT_OFD_MOVE:
+		case FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS:
+		case FD_STATE_GAME_REQ_ACCEPT:
+		case FD_STATE_GAME_FLEET_READ_FIRST:
+		case FD_STATE_GAME_FLEET_READ_SECOND:
+		case FD_STATE_GAME_JUDGED_RESULTS:
+		case FD_STATE_GAME_JUDGED_SHOT:
+			return TIMEOUT_GAME_MS;
+		case FD_STATE_LOBBY:
+		case FD_STATE_REQD_GAME:
+		case FD_STATE_REQ_NAME_LIST:
+		case FD_STATE_OPLYR_NAME_READ:
+		case FD_STATE_GAME_REQ_REJECT:
+		case FD_STATE_PAGE_REQ_READ:
+		case FD_STATE_REQ_NAME_PAGE:
+			return TIMEOUT_LOBBY_MS;
+		default:
+			return 0;
+	}
+}
+
+/****************************************************************
+ * Start the clock on how long a connection has been in its state
+ * 
+ * Preconditions:
+ *  state is one of reactor's connections, just put in its current state
+ * Postcondition:
+ *  connection's deadline set to its state's timeout from now (replacing the
+ *  one for its last state), or cleared if the state has none
+ ****************************************************************/
+void armTimeout(Reactor & reactor, const FdState & state)
+{
+	unsigned int timeout = stateTimeout(state.GetState());
+	if (0 == timeout)
+	{
+		reactor.GetTimers().Cancel(state.GetFD());
+	}
+	else
+	{
+		reactor.GetTimers().Set(state.GetFD(), state.GetSerial(), timeout, metricsNow() / 1000000);
 	}
-	return std::string(portString);
 }
 
 /****************************************************************
- * Add a FD to a set, and update the maxFd count if needed
+ * Change the state of a connection, keeping the lobby directory in sync
  * 
  * Preconditions:
- *  fd a valid fd, 'set' a valid fd_set pointer
+ *  state is one of reactor's connections, newState one of the #defined states
+ *  in FdState.h
  * Postcondition:
- *  fd added to the set, maxFd updated if this is the highest FD seen so far
+ *  connection in newState, added to or removed from the lobby directory if it
+ *  entered or left the lobby, marked invitable or not in the name index,
+ *  counted in the new state instead of the old one, and given the new
+ *  state's deadline
  ****************************************************************/
-void fdAddSet(int newFd, fd_set * set)
+void changeState(Reactor & reactor, FdState & state, short newState)
 {
-	if (newFd > maxFd)
+	bool wasInLobby = isListed(state.GetState());
+	bool nowInLobby = isListed(newState);
+	bool wasInvitable = isInvitable(state.GetState());
+	bool nowInvitable = isInvitable(newState);
+	reactor.GetMetrics().StateChanged(state.GetState(), newState);
+	reactor.GetFlightRecorder().Record(FLIGHT_STATE, state, newState);
+	state.SetState(newState);
+	armTimeout(reactor, state);
+	if (wasInLobby && !nowInLobby)
+	{
+		lobbyRemove(reactor, state);
+	}
+	else if (!wasInLobby && nowInLobby)
 	{
-		maxFd = newFd;
+		lobbyAdd(reactor, state);
+	}
+	if (wasInvitable != nowInvitable)
+	{
+		std::lock_guard<std::mutex> lock(LobbyMutex);
+		Names.SetInvitable(state.GetName(), reactor.RefTo(state), nowInvitable);
 	}
-	FD_SET(newFd, set);
 }
 
 /****************************************************************
  * Start listening on the specified port 
  * 
  * Preconditions:
- *  No one already listening on the same port, portstring a valid service 
- *  or port number
+ *  No one already listening on the same port (unless 'sharePort' is set and
+ *  they set it too), portstring a valid service or port number
  * Postcondition:
- *  sockfd updated with the new filedescriptor
+ *  reactor's listening socket set up and added to its connection set
  ****************************************************************/
-int SetUpListing(std::string portString, fd_set & readList, int & sockfd)
+int SetUpListing(std::string portString, Reactor & reactor, bool sharePort)
 {
+	int sockfd = -1;
 	// Gives getaddrinfo hints about the critera for the addresses it returns
 	struct addrinfo hints;
 	// Points to list of results from getaddrinfo
@@ -133,6 +535,17 @@ int SetUpListing(std::string portString, fd_set & readList, int & sockfd)
 		std::cerr <<  "Couldn't set option to re-use addresses. The server will still try to start, but if the address & port has been in use recently (think last minute range), binding may fail.\n";
 	}
 	
+	// Every reactor gets its own listening socket on the same port, and the
+	// kernel spreads incoming connections between them
+	if (sharePort && 0 >
+		setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (void *)&yes, sizeof(yes)))
+	{
+		std::cerr << "Couldn't set option to share the port between event loop threads.\n";
+		close(sockfd);
+		freeaddrinfo(serverinfo);
+		return 4;
+	}
+	
 	// Ok, so now we have a socket. Lets try to bind to it
 	if (-1 == bind(sockfd, current->ai_addr, current->ai_addrlen))
 	{
@@ -148,35 +561,78 @@ int SetUpListing(std::string portString, fd_set & readList, int & sockfd)
 	freeaddrinfo(serverinfo);
 	serverinfo = NULL;
 	
-	if (-1 == listen(sockfd, 10))
+	// Accepted connections get checked with accept4() until it runs dry, so
+	// the listen socket must not block
+	int flags = fcntl(sockfd, F_GETFL, 0);
+	if (-1 == flags || -1 == fcntl(sockfd, F_SETFL, flags | O_NONBLOCK))
+	{
+		std::cerr << "Couldn't make the listening socket non-blocking.\n";
+		return 64;
+	}
+	
+	// Let a burst of connecting players queue up instead of being refused
+	if (-1 == listen(sockfd, SOMAXCONN))
 	{
 		// Couldn't listen
 		std::cerr << "Call to listen failed.\n";
 		return 32;
 	}
 	
-	// Been modifying reference to the accept var through sockfd reference all along
-	
 	// Add new FD to list with correct state
-	Fds.push_back(FdState(sockfd, FD_STATE_ACCEPT_SOCK));
-	fdAddSet(sockfd, &readList);
+	reactor.AddFd(sockfd, FD_STATE_ACCEPT_SOCK);
+	reactor.SetListenFD(sockfd);
+	reactor.GetLoop().AddRead(sockfd);
 	
 	return 0;
 }
 
+/****************************************************************
+ * Start tracking a newly accepted connection
+ * 
+ * Preconditions:
+ *  acceptfd a new, non-blocking connection
+ * Postcondition:
+ *  connection added to reactor's connections, waiting for its first message
+ *  (with TIMEOUT_HANDSHAKE_MS to get named), and counted. Nagle is off on
+ *  it, so small replies and relayed moves go out as soon as they are written
+ *  instead of waiting on the client's delayed ACK.
+ ****************************************************************/
+void addConnection(int acceptfd, Reactor & reactor)
+{
+	int yes = 1;
+	if (0 > setsockopt(acceptfd, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes)))
+	{
+		perror("Trouble turning off Nagle on a connection");
+	}
+	FdState * newConnection = reactor.AddFd(acceptfd, FD_STATE_ANON);
+	newConnection->SetSerial(Reactor::NextSerial());
+	newConnection->SetRead(sizeof(uint32_t));
+	reactor.GetLoop().AddRead(acceptfd);
+	reactor.GetMetrics().Accepted();
+	reactor.GetFlightRecorder().Record(FLIGHT_ACCEPT, *newConnection, 0);
+	armTimeout(reactor, *newConnection);
+}
+
 /****************************************************************
  * Accept a new connection
  * 
  * Preconditions:
- *  sockfd ready for a read by accept()
+ *  sockfd is the non-blocking listening socket
  * Postcondition:
- *  new file descriptor state added to the Fds list
+ *  new file descriptor state added to reactor's connections. Returns 0 if a connection
+ *  was accepted (there may be more waiting), 1 if there was nothing left to
+ *  accept or accepting failed
  ****************************************************************/
-int acceptConnection(int sockfd, fd_set & readSet)
+int acceptConnection(int sockfd, Reactor & reactor)
 {
 	int acceptfd = -1;
-	if (-1 == (acceptfd = accept(sockfd, NULL, NULL)))
+	if (-1 == (acceptfd = accept4(sockfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)))
 	{
+		if (EAGAIN == errno || EWOULDBLOCK == errno)
+		{
+			// Drained the backlog
+			return 1;
+		}
 		perror("Trouble accept()ing a connection");
 		// Things the man page says we should check for and try again after
 		if (!(EAGAIN == errno || ENETDOWN == errno || EPROTO == errno || \
@@ -184,67 +640,97 @@ int acceptConnection(int sockfd, fd_set & readSet)
 			|| EHOSTUNREACH == errno || EOPNOTSUPP == errno || ENETUNREACH))
 		{
 			// Something the man page didn't list went wrong, let's give up
+			reactor.GetLoop().Remove(sockfd);
 			close(sockfd);
-			FD_CLR(sockfd, &readSet);
 		}
+		return 1;
 	}
 	else
 	{
-		FdState newConnection(acceptfd, FD_STATE_ANON);
-		newConnection.SetRead(sizeof(uint32_t));
-		Fds.push_back(newConnection);
-		fdAddSet(newConnection.GetFD(), &readSet);
+		addConnection(acceptfd, reactor);
 	}
 	return 0;
 }
 
 
 /****************************************************************
- * Remove a Fd from the 'container' list
+ * Tell an inviter's reactor that the answer to their invitation is no
+ * 
+ * Preconditions:
+ *  invitee one of our connections (or where one used to be)
+ * Postcondition:
+ *  inviter's reactor will write them the rejection
+ ****************************************************************/
+void declineInvite(const ConnRef & inviter, const ConnRef & invitee)
+{
+	ReactorMessage reply = makeMessage(REACTOR_MSG_INVITE_REPLY, inviter, invitee);
+	reply.yes = false;
+	Reactors[inviter.reactor]->Post(reply);
+}
+
+/****************************************************************
+ * Turn down every invitation still waiting for one of our players
  * 
  * Preconditions:
- *  fd actually in one of the FdState wrappers in container
+ *  state one of our connections
  * Postcondition:
- *  FdState wrapper for fd removed from the container
+ *  waiting invitations removed and their senders told no
  ****************************************************************/
-int removeFd(std::vector<FdState> & container, int fd)
+void declineWaitingInvites(Reactor & reactor, const FdState & state)
 {
-	int returnVal = 1;
-	for (std::vector<FdState>::iterator it = container.begin(); it!=container.end(); ++it)
+	std::vector<PendingInvite> waiting;
+	reactor.GetInvites().RemoveInvitee(state.GetSerial(), waiting);
+	for (auto& invite: waiting)
 	{
-		if (fd == it->GetFD())
-		{
-			container.erase(it);
-			returnVal = 0;
-			break;
-		}
+		declineInvite(invite.inviter, invite.invitee);
 	}
-	return returnVal;
 }
 
 /****************************************************************
  * Do our best to clean up from a connection
  * 
  * Preconditions:
- *  Hopefully none, cleanup function
+ *  Hopefully none, cleanup function. reason one of the METRICS_ABORT_*
+ *  #defines
  * Postcondition:
- *  fd removed from read and write sets, other players pointing to it set to
- *  nullptr, connection shut and closed, FdState removed from Fds
+ *  fd removed from the event loop and timer wheel, invitations to or from it
+ *  turned down or withdrawn, connection shut and closed, FdState removed from
+ *  the reactor, lobby directory and name index, abort counted under 'reason'.
+ *  A partner it was playing (or about to) is aborted too, as
+ *  METRICS_ABORT_PARTNER, so it isn't left waiting on moves that won't come.
  ****************************************************************/
-int abortConnection(FdState & state, fd_set & readSet, fd_set & writeSet)
+int abortConnection(FdState & state, Reactor & reactor, int reason)
 {
 	int returnVal = 0;
-	// Remove from read set
-	FD_CLR(state.GetFD(), &readSet);
-	// Remove it from the write set
-	FD_CLR(state.GetFD(), &writeSet);
-	// Remove any partner pointers to this one
-	for (auto& ostate: Fds)
+	reactor.GetMetrics().Aborted(state.GetState(), reason);
+	reactor.GetFlightRecorder().Record(FLIGHT_ABORT, state, reason);
+	// Stop watching it for reads or writes, or the time it takes
+	reactor.GetLoop().Remove(state.GetFD());
+	reactor.GetTimers().Cancel(state.GetFD());
+	if (isListed(state.GetState()))
 	{
-		if (ostate.GetOtherPlayer() == &state)
-		{
-			ostate.SetOtherPlayer(nullptr);
-		}
+		lobbyRemove(reactor, state);
+	}
+	nameRelease(reactor, state);
+	// Nobody is left to answer invitations to us
+	if (FD_STATE_GAME_INVITE == state.GetState() || FD_STATE_GAME_INVITE_RESP_WAIT == state.GetState())
+	{
+		declineInvite(state.GetInviter(), reactor.RefTo(state));
+	}
+	declineWaitingInvites(reactor, state);
+	if (FD_STATE_REQD_GAME == state.GetState())
+	{
+		// Our invitation might still be waiting in line somewhere
+		ReactorMessage cancel = makeMessage(REACTOR_MSG_INVITE_CANCEL, state.GetInvitee(), reactor.RefTo(state));
+		Reactors[state.GetInvitee().reactor]->Post(cancel);
+	}
+	// Only our partner (if we still have one) links to us. Links only last
+	// for a game, so it has no game left to play.
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	if (nullptr != other)
+	{
+		other->ClearOtherPlayer();
+		state.ClearOtherPlayer();
 	}
 	// Shut the connection
 	if (shutdown(state.GetFD(), SHUT_RDWR))
@@ -256,10 +742,14 @@ int abortConnection(FdState & state, fd_set & readSet, fd_set & writeSet)
 	{
 		returnVal = 2;
 	}
-	if (removeFd(Fds, state.GetFD()))
+	if (reactor.RemoveFd(state.GetFD()))
 	{
 		returnVal = 3;
 	}
+	if (nullptr != other)
+	{
+		abortConnection(*other, reactor, METRICS_ABORT_PARTNER);
+	}
 	return returnVal;
 }
 
@@ -271,7 +761,7 @@ int abortConnection(FdState & state, fd_set & readSet, fd_set & writeSet)
  * Postcondition:
  *  command read from the connection, and state changed
  ****************************************************************/
-void anonRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void anonRead(FdState & state, Reactor & reactor)
 {
 	uint32_t request;
 	short readSize;
@@ -280,7 +770,7 @@ void anonRead(FdState & state, fd_set & readSet, fd_set & writeSet)
 	if (readSize != sizeof(uint32_t))
 	{
 		// Read amount was not the expected size
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		return;
 	}
 	request = *((uint32_t *)result);
@@ -293,62 +783,59 @@ void anonRead(FdState & state, fd_set & readSet, fd_set & writeSet)
 		if (nameSize > 0 && nameSize < MAX_NAME_LEN)
 		{
 			// Set up for a transfer of nameSize
-			state.SetState(FD_STATE_ANON_NAME_SIZE);
+			changeState(reactor, state, FD_STATE_ANON_NAME_SIZE);
 			state.SetRead(nameSize);
 		}
 		else
 		{
 			// Invalid name size, abort connection.
-			abortConnection(state, readSet, writeSet);
+			abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		}
 	}
 	else
 	{
 		// All other requests are invalid state transitions
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 	}
 }
 
 /****************************************************************
- * Find a FdState in Fds by it's username
+ * Find a player that can be invited by their username
  * 
  * Preconditions:
- *  Searched for FdState is in FD_STATE_LOBBY
+ *  Searched for player is in the lobby or answering an invitation (on any
+ *  reactor)
  * Postcondition:
- *  nullptr returned if not found, otherwise pointer to search result
+ *  false returned if not found (or they can't be invited), otherwise true
+ *  with 'found' set to where the player's connection lives
  ****************************************************************/
-FdState * findByName(const std::string & name)
+bool findByName(const std::string & name, ConnRef & found)
 {
-	for (auto& state: Fds)
-	{
-		if (state.GetName() == name && state.GetState() == FD_STATE_LOBBY)
-		{
-			return &state;
-		}
-	}
-	return nullptr;
+	std::lock_guard<std::mutex> lock(LobbyMutex);
+	return Names.FindInvitable(name, found);
 }
 
 /****************************************************************
- * Generate a list of players currently in the lobby
+ * Get the list of players currently in the lobby, ready to write
  * 
  * Preconditions:
- *  None?
+ *  Called from reactor's thread
  * Postcondition:
- *  String listing the players in the lobby returned
+ *  Serialized list returned, shared with everyone else who asked for it
+ *  since the lobby last changed (no need to write a length before it, that is
+ *  already embedded in it). How long that took (waiting for the lobby lock
+ *  included) recorded in reactor's metrics.
  ****************************************************************/
-std::string getNameList()
+std::shared_ptr<const std::string> getNameList(Reactor & reactor)
 {
-	std::string returnVal("Available players:\n");
-	for (auto& state: Fds)
+	uint64_t start = metricsNow();
+	std::shared_ptr<const std::string> list;
 	{
-		if (state.GetState() == FD_STATE_LOBBY)
-		{
-			returnVal += state.GetName();
-			returnVal += "\n";
-		}
+		std::lock_guard<std::mutex> lock(LobbyMutex);
+		list = Lobby.GetSerialized();
 	}
-	return returnVal;
+	reactor.GetMetrics().ListBuild().Record(metricsNow() - start);
+	return list;
 }
 
 /****************************************************************
@@ -359,7 +846,7 @@ std::string getNameList()
  * Postcondition:
  *  username read from the connection, and state changed
  ****************************************************************/
-void nameRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void nameRead(FdState & state, Reactor & reactor)
 {
 	short readLen;
 	char * nameResult = state.GetRead(readLen);
@@ -367,30 +854,30 @@ void nameRead(FdState & state, fd_set & readSet, fd_set & writeSet)
 	{
 		std::string reqName = std::string(nameResult, readLen);
 		uint32_t response = 0;
-		if (findByName(reqName))
+		if (!nameClaim(reactor, state, reqName))
 		{
-			// Send error that the name is already taken
+			// Send error that the name is already taken (by someone in the
+			// lobby or in a game)
 			response = ACTION_NAME_TAKEN;
-			state.SetState(FD_STATE_NAME_REJECT);
+			changeState(reactor, state, FD_STATE_NAME_REJECT);
 		}
 		else
 		{
-			// Give them the name
-			state.SetName(reqName);
+			// Name is theirs now
 			// Tell them they are in the lobby
 			response = ACTION_NAME_IS_YOURS;
-			state.SetState(FD_STATE_NAME_ACCEPT);
+			changeState(reactor, state, FD_STATE_NAME_ACCEPT);
 		}
 		response = htonl(response);
-		state.SetWrite((char *)(&response), sizeof(uint32_t));
+		state.QueueWrite((char *)(&response), sizeof(uint32_t));
 		// Not reading again until the write finishes
-		FD_CLR(state.GetFD(), &readSet);
-		fdAddSet(state.GetFD(), &writeSet);
+		reactor.GetLoop().RemoveRead(state.GetFD());
+		reactor.GetLoop().AddWrite(state.GetFD());
 	}
 	else
 	{
 		// Name that was read was too big
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 	}
 }
 
@@ -404,13 +891,13 @@ void nameRead(FdState & state, fd_set & readSet, fd_set & writeSet)
  * Postcondition:
  *  connection in FD_STATE_ANON and ready to read another command
  ****************************************************************/
-void nameRejectAfterWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void nameRejectAfterWrite(FdState & state, Reactor & reactor)
 {
 	// Switch to read
-	FD_CLR(state.GetFD(), &writeSet);
-	fdAddSet(state.GetFD(), &readSet);
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	reactor.GetLoop().AddRead(state.GetFD());
 	// State: anon
-	state.SetState(FD_STATE_ANON);
+	changeState(reactor, state, FD_STATE_ANON);
 	// Read size:
 	state.SetRead(sizeof(uint32_t));
 }
@@ -425,13 +912,13 @@ void nameRejectAfterWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
  * Postcondition:
  *  connection in FD_STATE_LOBBY and ready to read another command
  ****************************************************************/
-void nameAcceptAfterWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void nameAcceptAfterWrite(FdState & state, Reactor & reactor)
 {
 	// Switch to read to listen for name listing command
-	FD_CLR(state.GetFD(), &writeSet);
-	fdAddSet(state.GetFD(), &readSet);
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	reactor.GetLoop().AddRead(state.GetFD());
 	// State: lobby
-	state.SetState(FD_STATE_LOBBY);
+	changeState(reactor, state, FD_STATE_LOBBY);
 	// Read size:
 	state.SetRead(sizeof(uint32_t));
 }
@@ -446,49 +933,23 @@ void nameAcceptAfterWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
  * Postcondition:
  *  connection set to read 32 bits, and state updated
  ****************************************************************/
-void nameResponseWriteFinish(FdState & state, fd_set & readSet, fd_set & writeSet)
+void nameResponseWriteFinish(FdState & state, Reactor & reactor)
 {
 	if (state.GetState() == FD_STATE_NAME_ACCEPT)
 	{
 		// In Lobby now
-		state.SetState(FD_STATE_LOBBY);
+		changeState(reactor, state, FD_STATE_LOBBY);
 	}
 	else if (state.GetState() == FD_STATE_NAME_REJECT)
 	{
 		// Anonymous again
-		state.SetState(FD_STATE_ANON);
+		changeState(reactor, state, FD_STATE_ANON);
 	}
 	// Waiting for the client to send us another name or a command to list players
 	// Either way, the size to read happens to be the same
 	state.SetRead(sizeof(uint32_t));
-	FD_CLR(state.GetFD(), &writeSet);
-	fdAddSet(state.GetFD(), &readSet);
-}
-
-/****************************************************************
- * Create and serialize a list of players in the lobby
- * 
- * Preconditions:
- *
- * Postcondition:
- *  returns the string that can be written to the connection to be deserialized
- *  on the other end (no need to write a length before the string, that is
- *  already embedded in the returned string)
- ****************************************************************/
-std::string GenerateNetNameList()
-{
-	std::string nameList = getNameList();
-	uint32_t len = nameList.length();
-	if (len >= LONG_TRANSFER_SIZE_MASK)
-	{
-		nameList = std::string("");
-		len = 0;
-	}
-	len = htonl(len);
-	// Pack bytes of length into first 4 chars of string
-	std::string returnString(((char *)&len), sizeof(uint32_t));
-	returnString += nameList;
-	return returnString;
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	reactor.GetLoop().AddRead(state.GetFD());
 }
 
 /****************************************************************
@@ -498,10 +959,11 @@ std::string GenerateNetNameList()
  * In state FD_STATE_LOBBY, after successfully reading
  *
  * Postcondition:
- *  connection set to either read the name of a player to play or handle a
- *  request for a list of players in the lobby.
+ *  connection set to either read the name of a player to play, handle a
+ *  request for a list of players in the lobby, or read the rest of a request
+ *  for a page of that list.
  ****************************************************************/
-void lobbyRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void lobbyRead(FdState & state, Reactor & reactor)
 {
 	// FD can request to play other player
 	// FD can request player list
@@ -510,7 +972,7 @@ void lobbyRead(FdState & state, fd_set & readSet, fd_set & writeSet)
 	if (sizeof(uint32_t) != readSize)
 	{
 		// Read command that was too large
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		return;
 	}
 	
@@ -518,33 +980,86 @@ void lobbyRead(FdState & state, fd_set & readSet, fd_set & writeSet)
 	request = ntohl(request);
 	if (ACTION_REQ_PLAYERS_LIST == (request & ACTION_MASK))
 	{
-		std::string list = GenerateNetNameList();
-		state.SetWrite(list.c_str(), (short)(list.length()));
+		state.QueueWriteShared(getNameList(reactor));
 		// Switch to write
-		fdAddSet(state.GetFD(), &writeSet);
-		FD_CLR(state.GetFD(), &readSet);
-		state.SetState(FD_STATE_REQ_NAME_LIST);
+		reactor.GetLoop().AddWrite(state.GetFD());
+		reactor.GetLoop().RemoveRead(state.GetFD());
+		changeState(reactor, state, FD_STATE_REQ_NAME_LIST);
+	}
+	else if (ACTION_REQ_PLAYERS_PAGE == (request & ACTION_MASK))
+	{
+		uint32_t prefixLen = request & TRANSFER_SIZE_MASK;
+		if (prefixLen < MAX_NAME_LEN)
+		{
+			// Offset and limit, then the prefix
+			state.SetRead(sizeof(uint32_t) + prefixLen);
+			changeState(reactor, state, FD_STATE_PAGE_REQ_READ);
+		}
+		else
+		{
+			// prefix too long
+			abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		}
 	}
 	else if (ACTION_PLAY_PLAYERNAME == (request & ACTION_MASK))
 	{
 		uint32_t nameLen = request & TRANSFER_SIZE_MASK;
-		if (nameLen < MAX_NAME_LEN)
+		uint32_t rules = (request & GAME_RULES_MASK_UNSHIFTED) >> GAME_RULES_SHIFT;
+		if (nameLen < MAX_NAME_LEN && nullptr != findRules(rules))
 		{
+			// Whether they want us judging shots at them if the game happens
+			state.SetJudged(0 != (request & GAME_JUDGED_MASK));
+			state.SetRules(rules);
 			// Switch to name reading state
 			state.SetRead(nameLen);
-			state.SetState(FD_STATE_OPLYR_NAME_READ);
+			changeState(reactor, state, FD_STATE_OPLYR_NAME_READ);
 		}
 		else
 		{
-			// name too long
-			abortConnection(state, readSet, writeSet);
+			// name too long, or rules we don't have
+			abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		}
 	}
 	else
 	{
 		// Invalid state transition: wrong command
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+	}
+}
+
+/****************************************************************
+ * Answer an invitation to one of the bots, which say yes to any game they can
+ * play
+ * 
+ * Preconditions:
+ *  state just invited a bot from FD_STATE_OPLYR_NAME_READ, rules set
+ * Postcondition:
+ *  yes written to state with a new bot to play against (their fleet or first
+ *  move is read once the yes is out, see afterWriteAccept), or no if the
+ *  board is too big for bots
+ ****************************************************************/
+void startBotGame(FdState & state, Reactor & reactor)
+{
+	const GameRules & rules = *findRules(state.GetRules());
+	uint32_t response = ACTION_INVITE_RESPONSE;
+	if (botCanPlay(rules))
+	{
+		response = response | INVITE_RESPONSE_YES;
+		changeState(reactor, state, FD_STATE_GAME_REQ_ACCEPT);
+		state.SetBot(std::make_shared<BotPlayer>(rules, BotSeed++));
+		// A fleet from an earlier game doesn't count
+		state.SetFleet(nullptr);
+	}
+	else
+	{
+		response = response | INVITE_RESPONSE_NO;
+		changeState(reactor, state, FD_STATE_GAME_REQ_REJECT);
 	}
+	// Switch to write
+	reactor.GetLoop().AddWrite(state.GetFD());
+	reactor.GetLoop().RemoveRead(state.GetFD());
+	response = htonl(response);
+	state.QueueWrite((char *)&response, sizeof(uint32_t));
 }
 
 /****************************************************************
@@ -555,107 +1070,169 @@ void lobbyRead(FdState & state, fd_set & readSet, fd_set & writeSet)
  *  name has finished
  *
  * Postcondition:
- *  other player invited to game if they exist and are in the right state,
- *  otherwise a no answer written to connection
+ *  other player invited to game if they exist and are in the right state (or
+ *  a bot's answer written), otherwise a no answer written to connection
  ****************************************************************/
-void otherPlayerNameRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void otherPlayerNameRead(FdState & state, Reactor & reactor)
 {
 	short nameLen;
 	char * readData = state.GetRead(nameLen);
 	if (nameLen <= 0 || nameLen >= MAX_NAME_LEN)
 	{
 		// Name was the wrong size
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		return;
 	}
 	
 	std::string otherPlayer(readData, nameLen);
-	FdState * otherFd = findByName(otherPlayer);
-	if (nullptr == otherFd || state.GetName() == otherPlayer)
+	ConnRef otherRef;
+	if (!findByName(otherPlayer, otherRef) || state.GetName() == otherPlayer)
 	{
 		// No such player, or they tried to play themselves
 		uint32_t response = ACTION_INVITE_RESPONSE;
 		response = response | INVITE_RESPONSE_NO;
-		state.SetState(FD_STATE_GAME_REQ_REJECT);
+		changeState(reactor, state, FD_STATE_GAME_REQ_REJECT);
 		// Switch to write
-		fdAddSet(state.GetFD(), &writeSet);
-		FD_CLR(state.GetFD(), &readSet);
+		reactor.GetLoop().AddWrite(state.GetFD());
+		reactor.GetLoop().RemoveRead(state.GetFD());
 		response = htonl(response);
-		state.SetWrite((char *)&response, sizeof(uint32_t));
+		state.QueueWrite((char *)&response, sizeof(uint32_t));
+	}
+	else if (BOT_REACTOR == otherRef.reactor)
+	{
+		startBotGame(state, reactor);
 	}
 	else
 	{
-		// Ask other player if they want to play
-		// Switch to write with other player
-		fdAddSet(otherFd->GetFD(), &writeSet);
-		FD_CLR(otherFd->GetFD(), &readSet);
-		otherFd->SetState(FD_STATE_GAME_INVITE);
-		uint32_t invitation = ACTION_INVITE_REQ;
-		uint32_t ourNameLen = state.GetName().length();
-		invitation = invitation | ourNameLen;
-		invitation = htonl(invitation);
-		std::string inviteandname((char *)&invitation, sizeof(uint32_t));
-		inviteandname += state.GetName();
-		otherFd->SetWrite(inviteandname.c_str(), (short)inviteandname.length());
-		
-		// remember who we asked to play (so they can find us for the response)
-		state.SetOtherPlayer(otherFd);
+		// Ask other player if they want to play. They might belong to another
+		// reactor, so have whoever owns them send the invitation (see
+		// handleInviteMessage). They send the answer back with our ref.
+		ReactorMessage invite = makeMessage(REACTOR_MSG_INVITE, otherRef, reactor.RefTo(state));
+		invite.name = state.GetName();
+		invite.rules = state.GetRules();
+		// Remember who, in case we leave before they answer
+		state.SetInvitee(otherRef);
 		// Not reading or writing anymore, waiting on other player
-		state.SetState(FD_STATE_REQD_GAME);
-		FD_CLR(state.GetFD(), &readSet);
+		changeState(reactor, state, FD_STATE_REQD_GAME);
+		reactor.GetLoop().RemoveRead(state.GetFD());
+		Reactors[otherRef.reactor]->Post(invite);
 	}
 }
 
 /****************************************************************
- * Find the Fd that invited the one pointed to by "invitee"
+ * Write an invitation to a player in the lobby
  * 
  * Preconditions:
- *  invitee a valid FdState pointer that previously invited us
+ *  otherFd one of our connections in FD_STATE_LOBBY or FD_STATE_REQ_NAME_LIST
  * Postcondition:
- *  nullptr returned if no such thing found, otherwise pointer to the result
+ *  invitation queued to be written to otherFd (after the players list, if
+ *  that is still going out), and otherFd remembers who sent it and the rules
+ *  they want to play by
  ****************************************************************/
-FdState * findFdByPastInvitation(FdState * invitee)
+void showInvite(Reactor & reactor, FdState & otherFd, const ConnRef & inviter, const std::string & inviterName, unsigned char rules)
 {
-	FdState * returnVal = nullptr;
-	for (auto& state: Fds)
+	if (FD_STATE_REQ_NAME_LIST == otherFd.GetState())
 	{
-		if (state.GetState() == FD_STATE_REQD_GAME && state.GetOtherPlayer() == invitee)
-		{
-			returnVal = &state;
-		}
+		// afterNameListWrite() won't get to set up the next read
+		otherFd.SetRead(sizeof(uint32_t));
 	}
-	return returnVal;
+	// Switch to write with other player
+	reactor.GetLoop().AddWrite(otherFd.GetFD());
+	reactor.GetLoop().RemoveRead(otherFd.GetFD());
+	changeState(reactor, otherFd, FD_STATE_GAME_INVITE);
+	uint32_t invitation = ACTION_INVITE_REQ;
+	uint32_t ourNameLen = inviterName.length();
+	invitation = invitation | ourNameLen;
+	invitation = invitation | (rules << GAME_RULES_SHIFT);
+	invitation = htonl(invitation);
+	// Header and name go out together from the queue
+	otherFd.QueueWrite((char *)&invitation, sizeof(uint32_t));
+	otherFd.QueueWrite(inviterName.c_str(), (short)inviterName.length());
+	// remember who asked us to play (so we can send them the response), and
+	// what they want to play
+	otherFd.SetInviter(inviter);
+	otherFd.SetRules(rules);
 }
 
 /****************************************************************
- * Switches state of the invited player to reading their response after we have
- * sent them the invatiation. 
+ * Send an invitation to one of our connections on behalf of a player that
+ * may be on another reactor
  * 
  * Preconditions:
- *  called when the invited player connection finishes a write in
- *  FD_STATE_GAME_WRITE
+ *  msg a REACTOR_MSG_INVITE posted to this reactor
  * Postcondition:
- *  connection switched to reading, and state set to
- *  FD_STATE_GAME_INVITE_RESP_WAIT
+ *  invitee set up to write the invitation if they are in the lobby or
+ *  fetching the players list, or the invitation queued if they are answering
+ *  another one. Otherwise the inviter's reactor told the answer is no.
  ****************************************************************/
-void writeGameInvite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void handleInviteMessage(Reactor & reactor, const ReactorMessage & msg)
 {
-	// Switch to reading now
-	FD_CLR(state.GetFD(), &writeSet);
-	fdAddSet(state.GetFD(), &readSet);
-	// Switch to the state that means we are waiting for a response
-	state.SetState(FD_STATE_GAME_INVITE_RESP_WAIT);
+	FdState * otherFd = reactor.Find(msg.target);
+	if (nullptr == otherFd || !isInvitable(otherFd->GetState()))
+	{
+		// They left the lobby (or the server) before the invitation got here,
+		// so answer for them
+		declineInvite(msg.from, msg.target);
+		return;
+	}
+	if (FD_STATE_LOBBY != otherFd->GetState() && FD_STATE_REQ_NAME_LIST != otherFd->GetState())
+	{
+		// Busy with someone else's invitation, wait in line
+		PendingInvite invite;
+		invite.invitee = msg.target;
+		invite.inviter = msg.from;
+		invite.name = msg.name;
+		invite.rules = msg.rules;
+		reactor.GetInvites().Add(invite);
+		return;
+	}
+	showInvite(reactor, *otherFd, msg.from, msg.name, msg.rules);
 }
 
 /****************************************************************
- * Reads the response after a connection has been invited to a game
+ * Drop an invitation whose sender gave up before it was shown
  * 
  * Preconditions:
- *  called after successful read in state FD_STATE_GAME_INVITE_RESP_WAIT
+ *  msg a REACTOR_MSG_INVITE_CANCEL posted to this reactor
  * Postcondition:
- *  connection set to read 32 bits, and state updated
+ *  inviter's invitation no longer waiting (if it was)
+ ****************************************************************/
+void handleInviteCancelMessage(Reactor & reactor, const ReactorMessage & msg)
+{
+	reactor.GetInvites().RemoveInviter(msg.from.serial);
+}
+
+/****************************************************************
+ * Switches state of the invited player to reading their response after we have
+ * sent them the invatiation. 
+ * 
+ * Preconditions:
+ *  called when the invited player connection finishes a write in
+ *  FD_STATE_GAME_WRITE
+ * Postcondition:
+ *  connection switched to reading, and state set to
+ *  FD_STATE_GAME_INVITE_RESP_WAIT
+ ****************************************************************/
+void writeGameInvite(FdState & state, Reactor & reactor)
+{
+	// Switch to reading now
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	reactor.GetLoop().AddRead(state.GetFD());
+	// Switch to the state that means we are waiting for a response
+	changeState(reactor, state, FD_STATE_GAME_INVITE_RESP_WAIT);
+}
+
+/****************************************************************
+ * Reads the response after a connection has been invited to a game
+ * 
+ * Preconditions:
+ *  called after successful read in state FD_STATE_GAME_INVITE_RESP_WAIT
+ * Postcondition:
+ *  connection set to read 32 bits, and state updated. Inviter's reactor told
+ *  what the answer was. On yes, other waiting invitations are turned down; on
+ *  no, the next one is shown.
  ****************************************************************/
-void readStateGameInvite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void readStateGameInvite(FdState & state, Reactor & reactor)
 {
 	// Need to find out if they said yes or no
 	short readSize;
@@ -663,7 +1240,7 @@ void readStateGameInvite(FdState & state, fd_set & readSet, fd_set & writeSet)
 	if (readSize != sizeof(uint32_t))
 	{
 		// Response read was not the right size
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		return;
 	}
 	
@@ -671,381 +1248,1338 @@ void readStateGameInvite(FdState & state, fd_set & readSet, fd_set & writeSet)
 	if ((response & ACTION_MASK) != ACTION_INVITE_RESPONSE)
 	{
 		// Invalid state transition: not a response to the request
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
 		return;
 	}
 	
 	// Find matching other connection
-	FdState * inviter = findFdByPastInvitation(&state);
-	if (nullptr == inviter)
+	ConnRef inviter = state.GetInviter();
+	if (inviter.reactor < 0)
 	{
-		abortConnection(state, readSet, writeSet);
+		abortConnection(state, reactor, METRICS_ABORT_PARTNER);
 		return;
 	}
 	
+	ReactorMessage reply = makeMessage(REACTOR_MSG_INVITE_REPLY, inviter, reactor.RefTo(state));
 	if (response & INVITE_RESPONSE_YES)
 	{
 		// Answered yes
-		// other connection goes into FD_STATE_GAME_REQ_ACCEPT, which will be followed by FD_STATE_GAME_OFD_MOVE when the write finishes
-		inviter->SetState(FD_STATE_GAME_REQ_ACCEPT);
-		uint32_t inviterResponse = ACTION_INVITE_RESPONSE;
-		inviterResponse = inviterResponse | INVITE_RESPONSE_YES;
-		inviterResponse = htonl(inviterResponse);
-		inviter->SetWrite(((char *)&inviterResponse), sizeof(uint32_t));
-		fdAddSet(inviter->GetFD(), &writeSet);
-		
-		// This connection goes into FD_STATE_GAME_THISFD_MOVE
-		state.SetState(FD_STATE_GAME_WAIT_THISFD_MOVE);
+		// This connection goes into FD_STATE_GAME_THISFD_MOVE, but doesn't
+		// read the move until the inviter has joined us (see startGame)
+		changeState(reactor, state, FD_STATE_GAME_WAIT_THISFD_MOVE);
+		state.SetJudged(0 != (response & GAME_JUDGED_MASK));
 		state.SetRead(sizeof(uint32_t));
-		// The other connection already has our address, but we need to set the reverse
-		state.SetOtherPlayer(inviter);
-		// This connection should already be in the read list
+		reactor.GetLoop().RemoveRead(state.GetFD());
+		reply.yes = true;
+		Reactors[inviter.reactor]->Post(reply);
+		// Anyone else waiting on us is out of luck
+		declineWaitingInvites(reactor, state);
 	}
 	else
 	{
 		// Answered no
 		// this connection goes into FD_STATE_LOBBY, and tries to read again
-		state.SetState(FD_STATE_LOBBY);
+		changeState(reactor, state, FD_STATE_LOBBY);
 		state.SetRead(sizeof(uint32_t));
 		// (This connection should already be in the read list)
-		
-		// Other fd parter variable cleared
-		inviter->SetOtherPlayer(nullptr);
-		// Other FD goes into FD_STATE_GAME_REQ_REJECT
-		inviter->SetState(FD_STATE_GAME_REQ_REJECT);
+		ConnRef none = {-1, -1, 0};
+		state.SetInviter(none);
+		reply.yes = false;
+		Reactors[inviter.reactor]->Post(reply);
+		// Next invitation in line, if there is one
+		PendingInvite next;
+		if (reactor.GetInvites().PopNext(state.GetSerial(), next))
+		{
+			showInvite(reactor, state, next.inviter, next.name, next.rules);
+		}
+	}
+}
+
+/****************************************************************
+ * Pair up an inviter and the invitee that accepted, once they are both on
+ * this reactor
+ * 
+ * Preconditions:
+ *  inviter one of our connections in FD_STATE_REQD_GAME, invitee one of our
+ *  connections or nullptr if it went away
+ * Postcondition:
+ *  game started (inviter writing the accept, invitee reading their fleet if
+ *  they want shots judged, otherwise waiting to read their first move), or the
+ *  inviter told no if the invitee isn't waiting for them anymore
+ ****************************************************************/
+void startGame(Reactor & reactor, FdState & inviter, FdState * invitee)
+{
+	if (nullptr == invitee || FD_STATE_GAME_WAIT_THISFD_MOVE != invitee->GetState() ||
+		invitee->HasOtherPlayer() || invitee->GetInviter().serial != inviter.GetSerial())
+	{
+		// Invitee gave up while we were getting here
+		changeState(reactor, inviter, FD_STATE_GAME_REQ_REJECT);
 		uint32_t inviterResponse = ACTION_INVITE_RESPONSE;
 		inviterResponse = inviterResponse | INVITE_RESPONSE_NO;
 		inviterResponse = htonl(inviterResponse);
-		inviter->SetWrite(((char *)&inviterResponse), sizeof(uint32_t));
-		fdAddSet(inviter->GetFD(), &writeSet);
+		inviter.QueueWrite(((char *)&inviterResponse), sizeof(uint32_t));
+		reactor.GetLoop().AddWrite(inviter.GetFD());
+		return;
 	}
+	// other connection goes into FD_STATE_GAME_REQ_ACCEPT, which will be followed by FD_STATE_GAME_OFD_MOVE when the write finishes
+	changeState(reactor, inviter, FD_STATE_GAME_REQ_ACCEPT);
+	uint32_t inviterResponse = ACTION_INVITE_RESPONSE;
+	inviterResponse = inviterResponse | INVITE_RESPONSE_YES;
+	inviterResponse = htonl(inviterResponse);
+	inviter.QueueWrite(((char *)&inviterResponse), sizeof(uint32_t));
+	reactor.GetLoop().AddWrite(inviter.GetFD());
+	
+	// Partner links both ways
+	inviter.SetOtherPlayer(reactor.RefTo(*invitee));
+	invitee->SetOtherPlayer(reactor.RefTo(inviter));
+	ConnRef none = {-1, -1, 0};
+	invitee->SetInviter(none);
+	// Fleets from an earlier game don't count
+	inviter.SetFleet(nullptr);
+	invitee->SetFleet(nullptr);
+	if (invitee->GetJudged())
+	{
+		// Header and one word per ship
+		changeState(reactor, *invitee, FD_STATE_GAME_FLEET_READ_FIRST);
+		invitee->SetRead(fleetFrameSize(*findRules(invitee->GetRules())));
+		reactor.GetLoop().AddRead(invitee->GetFD());
+	}
+	// Otherwise the invitee reads their first move once the accept is out (see
+	// afterWriteAccept), so the move can't get relayed ahead of it
 }
 
 /****************************************************************
- * Handle state change after we have successfully notified client of rejected
- * game invitation
+ * Handle the answer to an invitation one of our connections sent
  * 
  * Preconditions:
- *  called after successfull write in FD_STATE_GAME_REQ_REJECT
+ *  msg a REACTOR_MSG_INVITE_REPLY posted to this reactor
  * Postcondition:
- *  connection switched to reading, state set to FD_STATE_LOBBY
+ *  inviter told no, or the game started, or the inviter handed over to the
+ *  invitee's reactor so the whole game runs on one thread
  ****************************************************************/
-void afterWriteReject(FdState & state, fd_set & readSet, fd_set & writeSet)
+void handleInviteReplyMessage(Reactor & reactor, const ReactorMessage & msg)
 {
-	// Switch to reading
-	FD_CLR(state.GetFD(), &writeSet);
-	// Set up for a read from the lobby
-	fdAddSet(state.GetFD(), &readSet);
-	state.SetRead(sizeof(uint32_t));
-	state.SetState(FD_STATE_LOBBY);
+	FdState * inviter = reactor.Find(msg.target);
+	if (nullptr == inviter || FD_STATE_REQD_GAME != inviter->GetState())
+	{
+		if (msg.yes)
+		{
+			// They said yes to someone who isn't around anymore
+			ReactorMessage gone = makeMessage(REACTOR_MSG_PARTNER_GONE, msg.from, msg.target);
+			Reactors[msg.from.reactor]->Post(gone);
+		}
+		return;
+	}
+	
+	if (!msg.yes)
+	{
+		// Inviter goes into FD_STATE_GAME_REQ_REJECT
+		changeState(reactor, *inviter, FD_STATE_GAME_REQ_REJECT);
+		uint32_t inviterResponse = ACTION_INVITE_RESPONSE;
+		inviterResponse = inviterResponse | INVITE_RESPONSE_NO;
+		inviterResponse = htonl(inviterResponse);
+		inviter->QueueWrite(((char *)&inviterResponse), sizeof(uint32_t));
+		reactor.GetLoop().AddWrite(inviter->GetFD());
+		return;
+	}
+	
+	if (msg.from.reactor == reactor.GetId())
+	{
+		startGame(reactor, *inviter, reactor.Find(msg.from));
+	}
+	else
+	{
+		// Move the inviter over to the invitee's reactor. It isn't reading or
+		// writing while in FD_STATE_REQD_GAME, so nothing is in flight.
+		ReactorMessage adopt = makeMessage(REACTOR_MSG_ADOPT, msg.from, msg.target);
+		reactor.GetLoop().Remove(inviter->GetFD());
+		reactor.GetTimers().Cancel(inviter->GetFD());
+		adopt.conn = reactor.DetachFd(inviter->GetFD());
+		Reactors[msg.from.reactor]->Post(adopt);
+	}
 }
 
 /****************************************************************
- * Handle state change after we have successfully notified client of accepted
- * game invitation
+ * Take over an inviter's connection from another reactor and start its game
  * 
  * Preconditions:
- *  Should be called after successfull write in FD_STATE_GAME_REQ_ACCEPT
+ *  msg a REACTOR_MSG_ADOPT posted to this reactor
  * Postcondition:
- *  connection switched to waiting for other connection in the game
+ *  connection added to this reactor, game started (or inviter told no)
  ****************************************************************/
-void afterWriteAccept(FdState & state, fd_set & readSet, fd_set & writeSet)
+void handleAdoptMessage(Reactor & reactor, const ReactorMessage & msg)
 {
-	// switch to state FD_STATE_GAME_OFD_MOVE (which is waiting for other person to move state)
-	// Take this FD out of the write list, and don't at it to the read or write, because we are waiting on the other connection in the game
-	FD_CLR(state.GetFD(), &writeSet);
-	state.SetState(FD_STATE_GAME_WAIT_OFD_MOVE);
+	FdState * inviter = reactor.AdoptFd(*(msg.conn));
+	delete msg.conn;
+	reactor.GetFlightRecorder().Record(FLIGHT_ADOPT, *inviter, msg.from.reactor);
+	startGame(reactor, *inviter, reactor.Find(msg.target));
 }
 
 /****************************************************************
- * Handle state change after a read of a move from this FD
+ * Handle the inviter going away after we accepted their invitation
  * 
  * Preconditions:
- *  called after a read in state FD_STATE_GAME_THISFD_MOVE
+ *  msg a REACTOR_MSG_PARTNER_GONE posted to this reactor
  * Postcondition:
- *  Other player's connection set up to write the move we just recieved
+ *  invitee connection aborted, same as if the inviter couldn't be found
  ****************************************************************/
-void thisFdMoveRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void handlePartnerGoneMessage(Reactor & reactor, const ReactorMessage & msg)
 {
-	// Clear this FD from read list so it is in no lists
-	FD_CLR(state.GetFD(), &readSet);
-	FD_CLR(state.GetFD(), &writeSet);
-	// Put this FD in state FD_STATE_GAME_THISFD_MOVE_RESULTS
-	state.SetState(FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
-	
-	// Get the move
-	short readSize;
-	char * readData = state.GetRead(readSize);
-	if (readSize != sizeof(uint32_t))
+	FdState * invitee = reactor.Find(msg.target);
+	if (nullptr != invitee && FD_STATE_GAME_WAIT_THISFD_MOVE == invitee->GetState() &&
+		!invitee->HasOtherPlayer())
 	{
-		if (state.GetOtherPlayer())
-		{
-			abortConnection(*(state.GetOtherPlayer()), readSet, writeSet);
-		}
-		abortConnection(state, readSet, writeSet);
-		return;
+		abortConnection(*invitee, reactor, METRICS_ABORT_PARTNER);
 	}
-	
-	if (state.GetOtherPlayer())
+}
+
+// Writing a bot's shot can finish it right away, whose handler is further down
+void relayNow(FdState & other, Reactor & reactor);
+
+/****************************************************************
+ * Have a worker thread work out where a bot fires next, so the reactor
+ * doesn't wait on it
+ * 
+ * Preconditions:
+ *  state one of reactor's connections playing a bot, in
+ *  FD_STATE_GAME_WAIT_OFD_MOVE
+ * Postcondition:
+ *  job submitted that posts the shot back to reactor as a
+ *  REACTOR_MSG_BOT_SHOT (see handleBotShotMessage)
+ ****************************************************************/
+void askBot(Reactor & reactor, FdState & state)
+{
+	// The job keeps the bot around even if the player leaves meanwhile
+	std::shared_ptr<BotPlayer> bot = state.GetBot();
+	ConnRef player = reactor.RefTo(state);
+	Reactor * owner = &reactor;
+	BotWorkers->Submit([bot, player, owner]()
 	{
-		// Set up other FD (whose state should be FD_STATE_GAME_OFD_MOVE) to write move
-		state.GetOtherPlayer()->SetWrite(readData, readSize);
-		
-		// Put other FD in write mode
-		fdAddSet(state.GetOtherPlayer()->GetFD(), &writeSet);
-		// Other FD should already be in the state FD_STATE_GAME_OFD_MOVE
+		ReactorMessage shot = makeMessage(REACTOR_MSG_BOT_SHOT, player, player);
+		bot->GetBrain().NextShot(shot.x, shot.y);
+		owner->Post(shot);
+	});
+}
+
+/****************************************************************
+ * Send a bot's shot to the player it is playing
+ * 
+ * Preconditions:
+ *  msg a REACTOR_MSG_BOT_SHOT posted to this reactor
+ * Postcondition:
+ *  If the player is still waiting on it, the move is written to them. If the
+ *  server judges shots at them, the bot learns the results right away and
+ *  they move next (or go to the lobby if the bot won). Otherwise their client
+ *  sends the results (see oFdMoveResultsRead).
+ ****************************************************************/
+void handleBotShotMessage(Reactor & reactor, const ReactorMessage & msg)
+{
+	FdState * state = reactor.Find(msg.target);
+	if (nullptr == state || !state->GetBot() || FD_STATE_GAME_WAIT_OFD_MOVE != state->GetState())
+	{
+		// They left
+		return;
 	}
-	else
+	uint32_t move = encodeMove(msg.x+1, msg.y+1);
+	if (nullptr != state->GetFleet())
 	{
-		abortConnection(state, readSet, writeSet);
+		bool hit, sink, win = false;
+		short shipSize = 0;
+		state->GetFleet()->CalculateMoveResults(msg.x, msg.y, hit, shipSize, sink, win);
+		state->GetBot()->GetBrain().Record(msg.x, msg.y, hit, shipSize, sink);
+		changeState(reactor, *state, FD_STATE_GAME_JUDGED_SHOT);
+		if (win)
+		{
+			// judgedShotWrite() sends them to the lobby
+			state->SetBot(nullptr);
+		}
 	}
+	state->QueueWrite((char *)&move, sizeof(uint32_t));
+	reactor.GetLoop().AddWrite(state->GetFD());
+	relayNow(*state, reactor);
 }
 
 /****************************************************************
- * Handle state change after writing results of this connections move to this
- * connection
+ * Handle everything other reactors (or we) posted to this reactor
  * 
  * Preconditions:
- *  called after write in state FD_STATE_GAME_THISFD_MOVE_RESULTS
+ *  reactor's wakeup fd was readable
  * Postcondition:
- *  connection moved to lobby if they won, otherwise switch the other Fd to
- *  reading move from client 
+ *  mailbox drained and each message acted on
  ****************************************************************/
-void thisFdMoveResultsWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void handleMessages(Reactor & reactor, std::vector<ReactorMessage> & messages)
 {
-	// If the game was won, set up a lobby read and go to state FD_STATE_LOBBY
-	if (state.GetLastMoveWin())
-	{
-		state.SetState(FD_STATE_LOBBY);
-		state.SetRead(sizeof(uint32_t));
-		fdAddSet(state.GetFD(), &readSet);
-		FD_CLR(state.GetFD(), &writeSet);
-		state.ClearLastMoveWin();
-	}
-	else
-	// Otherwise:
+	reactor.TakeMessages(messages);
+	for (auto& msg: messages)
 	{
-		// Set this connection state to FD_STATE_GAME_OFD_MOVE
-		state.SetState(FD_STATE_GAME_WAIT_OFD_MOVE);
-		// Remove this connection from all lists
-		FD_CLR(state.GetFD(), &readSet);
-		FD_CLR(state.GetFD(), &writeSet);
-		if (state.GetOtherPlayer())
+		if (REACTOR_MSG_INVITE == msg.type)
 		{
-			// Set pair connection to state FD_STATE_GAME_THISFD_MOVE
-			state.GetOtherPlayer()->SetState(FD_STATE_GAME_WAIT_THISFD_MOVE);
-			// Put the other connection in the read list
-			fdAddSet(state.GetOtherPlayer()->GetFD(), &readSet);
-			state.GetOtherPlayer()->SetRead(sizeof(uint32_t));
+			handleInviteMessage(reactor, msg);
 		}
-		else
+		else if (REACTOR_MSG_INVITE_REPLY == msg.type)
+		{
+			handleInviteReplyMessage(reactor, msg);
+		}
+		else if (REACTOR_MSG_ADOPT == msg.type)
 		{
-			abortConnection(state, readSet, writeSet);
+			handleAdoptMessage(reactor, msg);
+		}
+		else if (REACTOR_MSG_PARTNER_GONE == msg.type)
+		{
+			handlePartnerGoneMessage(reactor, msg);
+		}
+		else if (REACTOR_MSG_INVITE_CANCEL == msg.type)
+		{
+			handleInviteCancelMessage(reactor, msg);
+		}
+		else if (REACTOR_MSG_BOT_SHOT == msg.type)
+		{
+			handleBotShotMessage(reactor, msg);
 		}
 	}
+	messages.clear();
 }
 
 /****************************************************************
- * Handle state change after the other connection's move has been written to
- * this connection
+ * Get the size of the move (and move results) frames in a player's game
  * 
  * Preconditions:
- *  called after write in state FD_STATE_GAME_WAIT_OFD_MOVE
+ *  state's rules set
  * Postcondition:
- *  this connection set to read 32 bits and state set to
- *  FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS 
+ *  bytes returned (bigger for rules with wide coordinates)
  ****************************************************************/
-// 
-void oFdMoveWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
+short moveSize(const FdState & state)
 {
-	// Put this connection in read list and make sure it's not in the write list anymore
-	fdAddSet(state.GetFD(), &readSet);
-	FD_CLR(state.GetFD(), &writeSet);
-	// set this connection's state to FD_STATE_GAME_OFD_MOVE_RESULTS
-	state.SetRead(sizeof(uint32_t));
-	state.SetState(FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS);
+	return moveFrameSize(*findRules(state.GetRules()));
 }
 
 /****************************************************************
- * handle state change after a read from this connection of the results of the
- * other FD's move
+ * Start reading a player's move, once both sides of the game are ready for it
  * 
  * Preconditions:
- *  called after read from state FD_STATE_GAME_OFD_MOVE_RESULTS
+ *  mover one of reactor's connections
  * Postcondition:
- *  if a win happened, then this connection moved to the lobby, other
- *  connection set to write result to client
- *  otherwise, other connection set to write result to client
+ *  If mover is in FD_STATE_GAME_WAIT_THISFD_MOVE and their partner is waiting
+ *  on them in FD_STATE_GAME_WAIT_OFD_MOVE with nothing left to write (or they
+ *  are playing a bot), mover set to read their move. Otherwise nothing changes; whichever side gets
+ *  ready last calls this again.
  ****************************************************************/
-void oFdMoveResultsRead(FdState & state, fd_set & readSet, fd_set & writeSet)
+void beginTurn(Reactor & reactor, FdState & mover)
 {
-	short readLen;
-	uint32_t result;
-	char * readData = state.GetRead(readLen);
-	if (readLen != sizeof(uint32_t))
+	if (FD_STATE_GAME_WAIT_THISFD_MOVE != mover.GetState() ||
+		reactor.GetLoop().WantsRead(mover.GetFD()))
 	{
-		if (state.GetOtherPlayer())
-		{
-			abortConnection(*(state.GetOtherPlayer()), readSet, writeSet);
-		}
-		abortConnection(state, readSet, writeSet);
 		return;
 	}
-	
-	result = ntohl(*((uint32_t *)readData));
-	
-	if (state.GetOtherPlayer())
+	if (mover.GetBot())
 	{
-		// Check if that was a winning move. If so, set a flag on the other connection & remove the pair pointers, set this connection up for a lobby read
-		if (result & WIN_YES)
+		// Bots are always ready
+		mover.SetRead(moveSize(mover));
+		reactor.GetLoop().AddRead(mover.GetFD());
+		return;
+	}
+	FdState * other = reactor.Find(mover.GetOtherPlayer());
+	if (nullptr == other || FD_STATE_GAME_WAIT_OFD_MOVE != other->GetState() ||
+		other->HasWrite())
+	{
+		return;
+	}
+	mover.SetRead(moveSize(mover));
+	reactor.GetLoop().AddRead(mover.GetFD());
+}
+
+/****************************************************************
+ * Handle a player's fleet, for a game where the server judges shots at them
+ * 
+ * Preconditions:
+ *  called after the read in FD_STATE_GAME_FLEET_READ_FIRST or
+ *  FD_STATE_GAME_FLEET_READ_SECOND
+ * Postcondition:
+ *  If it is an ACTION_FLEET with the fleet of the game's rules, on the board
+ *  and not overlapping, the fleet is kept on the connection and the player goes on to
+ *  their first move (or to waiting for the other player's). Otherwise both
+ *  players are aborted.
+ ****************************************************************/
+void fleetRead(FdState & state, Reactor & reactor)
+{
+	short readSize;
+	char * readData = state.GetRead(readSize);
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	uint32_t * words = (uint32_t *)readData;
+	const GameRules * rules = findRules(state.GetRules());
+	bool valid = (fleetFrameSize(*rules) == readSize) && (nullptr != other || state.GetBot());
+	if (valid)
+	{
+		uint32_t header = ntohl(words[0]);
+		uint32_t countMask = rules->wide ? LONG_TRANSFER_SIZE_MASK : TRANSFER_SIZE_MASK;
+		valid = (ACTION_FLEET == (header & ACTION_MASK)) &&
+			(rules->shipCount == (int)(header & countMask));
+	}
+	std::shared_ptr<JudgedFleet> fleet = rules->MakeFleet();
+	for (int i = 0; valid && i < rules->shipCount; ++i)
+	{
+		short size, x, y;
+		bool horizontal;
+		if (rules->wide)
 		{
-			state.GetOtherPlayer()->SetLastMoveWin();
-			state.GetOtherPlayer()->SetWrite(readData, readLen);
-			// Set other connection to state FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS
-			state.GetOtherPlayer()->SetState(FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
-			fdAddSet(state.GetOtherPlayer()->GetFD(), &writeSet);
-			
-			state.SetRead(sizeof(uint32_t));
-			state.SetState(FD_STATE_LOBBY);
-			state.GetOtherPlayer()->SetOtherPlayer(nullptr);
-			state.SetOtherPlayer(nullptr);
+			decodeWideShip(words + 1 + 2*i, size, horizontal, x, y);
 		}
 		else
 		{
-			// Set other connection to state FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS
-			state.GetOtherPlayer()->SetState(FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
-			// Put other connection in write list and set it up with the results we just read
-			fdAddSet(state.GetOtherPlayer()->GetFD(), &writeSet);
-			state.GetOtherPlayer()->SetWrite(readData, readLen);
-			
-			// Remove this connection from the read list
-			FD_CLR(state.GetFD(), &readSet);
+			decodeShip(words[1+i], size, horizontal, x, y);
 		}
+		// Each ship once, on the board and not on top of another one
+		valid = fleet->PlaceShip(size, horizontal, x-1, y-1);
+	}
+	if (!valid)
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	state.SetFleet(fleet);
+	reactor.GetLoop().RemoveRead(state.GetFD());
+	if (FD_STATE_GAME_FLEET_READ_FIRST == state.GetState())
+	{
+		// Invitee moves first
+		changeState(reactor, state, FD_STATE_GAME_WAIT_THISFD_MOVE);
+		beginTurn(reactor, state);
+	}
+	else if (state.GetBot())
+	{
+		// Bots move first too
+		changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE);
+		askBot(reactor, state);
 	}
 	else
 	{
-		abortConnection(state, readSet, writeSet);
+		changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE);
+		beginTurn(reactor, *other);
 	}
 }
 
 /****************************************************************
- * Handle state change after writing the lobby name list to the connection 
+ * Handle state change after we have successfully notified client of rejected
+ * game invitation
  * 
  * Preconditions:
- *  called after write finishes in FD_STATE_REQ_NAME_LIST state
+ *  called after successfull write in FD_STATE_GAME_REQ_REJECT
  * Postcondition:
- *  connection set to lobby state and prepared for a read of 32 bits
+ *  connection switched to reading, state set to FD_STATE_LOBBY
  ****************************************************************/
-void afterNameListWrite(FdState & state, fd_set & readSet, fd_set & writeSet)
+void afterWriteReject(FdState & state, Reactor & reactor)
 {
-	// Take ourself out of the write list
-	FD_CLR(state.GetFD(), &writeSet);
-	// Set up for a lobby read
-	fdAddSet(state.GetFD(), &readSet);
-	state.SetState(FD_STATE_LOBBY);
+	// Switch to reading
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	// Set up for a read from the lobby
+	reactor.GetLoop().AddRead(state.GetFD());
 	state.SetRead(sizeof(uint32_t));
+	changeState(reactor, state, FD_STATE_LOBBY);
 }
 
-int main(int argc, char ** argv)
+/****************************************************************
+ * Handle state change after we have successfully notified client of accepted
+ * game invitation
+ * 
+ * Preconditions:
+ *  Should be called after successfull write in FD_STATE_GAME_REQ_ACCEPT
+ * Postcondition:
+ *  connection switched to waiting for other connection in the game
+ ****************************************************************/
+void afterWriteAccept(FdState & state, Reactor & reactor)
 {
-	int sockfd = -1;
-	std::string port = getPortString(argc, argv);
-	
-	if (port == "")
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	if (state.GetJudged())
 	{
-		return 1;
+		// Their fleet comes first
+		changeState(reactor, state, FD_STATE_GAME_FLEET_READ_SECOND);
+		state.SetRead(fleetFrameSize(*findRules(state.GetRules())));
+		reactor.GetLoop().AddRead(state.GetFD());
+		return;
 	}
-	
-	std::cout << "Battleship server starting, version " << GIT_VERSION << ".\n";
-	
-	// Block SIGTERM.
-	sigset_t sigset, oldset;
-	sigemptyset(&sigset);
-	sigprocmask(SIG_BLOCK, &sigset, &oldset);
-	
-	// Enter the pselect() loop, using the original mask as argument.
-	fd_set readSet;
-	FD_ZERO(&readSet);
-	fd_set writeSet;
-	FD_ZERO(&writeSet);
-	
-	if (SetUpListing(port, readSet, sockfd))
+	// switch to state FD_STATE_GAME_OFD_MOVE (which is waiting for other person to move state)
+	// Take this FD out of the write list, and don't at it to the read or write, because we are waiting on the other connection in the game
+	changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE);
+	if (state.GetBot())
 	{
-		return -1;
+		// The bot they invited moves first
+		askBot(reactor, state);
+		return;
 	}
-	
-	fd_set readSetSelectResults = readSet;
-	fd_set writeSetSelectResults = writeSet;
-	
-	while (pselect(maxFd+1, &readSetSelectResults, &writeSetSelectResults, NULL, NULL, NULL) >= 0)
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	if (nullptr != other)
 	{
-		// Do some processing. Note that the process will not be
-		// interrupted while inside this loop.
-		for (auto& it: Fds)
-		{
-			int thisFD = it.GetFD();
-			short state = it.GetState();
-			if (FD_ISSET(thisFD, &readSetSelectResults))
-			{
-				int readResult;
-				if (thisFD != sockfd)
-				{
-					readResult = it.Read();
-				}
-				else
-				{
-					// Treat the accept FD as a special case and act like it's ready without trying to read it
-					readResult = 1;
-				}
-				if (readResult == 0)
-				{
-					// Need to read again, do nothing
-				}
-				else if (readResult < 0)
-				{
-					// End of connection or error reading
-					abortConnection(it, readSet, writeSet);
-				}
-				else if (readResult == 1)
-				{
-					// We're done reading a chunk, handle the result
-					if (FD_STATE_ACCEPT_SOCK == state)
-					{
-						acceptConnection(thisFD, readSet);
-					}
-					else if (FD_STATE_ANON == state)
-					{
-						anonRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_ANON_NAME_SIZE == state)
-					{
-						nameRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_LOBBY == state)
-					{
-						lobbyRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_WAIT_THISFD_MOVE == state)
-					{
-						thisFdMoveRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS == state)
-					{
-						oFdMoveResultsRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_OPLYR_NAME_READ == state)
-					{
-						otherPlayerNameRead(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_INVITE_RESP_WAIT == state)
+		beginTurn(reactor, *other);
+	}
+}
+
+// Relaying a move can finish the partner's write, whose handler is below
+void writeDone(FdState & state, Reactor & reactor);
+
+/****************************************************************
+ * Try to write a relayed frame to a player right away, instead of waiting for
+ * epoll to say their socket is writable
+ * 
+ * Preconditions:
+ *  other one of reactor's connections with a write queued, wanting to write,
+ *  and the handler that queued it done changing its own connection
+ * Postcondition:
+ *  With epoll, one Write() tried: the after-write handler run if it all went
+ *  out, the connection aborted on an error, otherwise left for epoll. The
+ *  io_uring backend already sends it before its next wait, so nothing is done
+ *  there.
+ ****************************************************************/
+void relayNow(FdState & other, Reactor & reactor)
+{
+	if (!reactor.GetLoop().UsesEpoll())
+	{
+		return;
+	}
+	uint64_t before = other.GetBytesWritten();
+	int writeResult = other.Write();
+	reactor.GetMetrics().BytesOut(other.GetBytesWritten() - before);
+	if (writeResult < 0)
+	{
+		// End of connection or error writing
+		abortConnection(other, reactor, METRICS_ABORT_WRITE);
+	}
+	else if (writeResult == 1)
+	{
+		writeDone(other, reactor);
+	}
+}
+
+/****************************************************************
+ * Work out a move against the other player's (or a bot's) fleet here, instead
+ * of asking their client
+ * 
+ * Preconditions:
+ *  state just read its move ('move', moveSize() bytes in network order) in
+ *  FD_STATE_GAME_WAIT_THISFD_MOVE. other its partner, and fleet theirs; or
+ *  other nullptr and fleet the bot's state is playing.
+ * Postcondition:
+ *  Results written (or queued) to state, the move to other so they can see
+ *  it. If it won, the partner links (or bot) are cleared and both go back to
+ *  the lobby once their writes finish. A move off the board aborts both.
+ ****************************************************************/
+void judgeMove(FdState & state, FdState * other, JudgedFleet & fleet, const char * move, Reactor & reactor)
+{
+	short x, y;
+	short frameSize = moveSize(state);
+	uint32_t results[2];
+	bool wide = findRules(state.GetRules())->wide;
+	if (wide)
+	{
+		decodeWideMove((const uint32_t *)move, x, y);
+	}
+	else
+	{
+		decodeMove(*((const uint32_t *)move), x, y);
+	}
+	if (x < 1 || x > fleet.Width() || y < 1 || y > fleet.Height())
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	bool hit, sink, win = false;
+	short shipSize = 0;
+	fleet.CalculateMoveResults(x-1, y-1, hit, shipSize, sink, win);
+	if (wide)
+	{
+		encodeWideMoveResults(x, y, hit, shipSize, sink, win, results);
+	}
+	else
+	{
+		results[0] = encodeMoveResults(x, y, hit, shipSize, sink, win);
+	}
+	
+	changeState(reactor, state, FD_STATE_GAME_JUDGED_RESULTS);
+	state.QueueWrite((char *)results, frameSize);
+	reactor.GetLoop().AddWrite(state.GetFD());
+	if (other)
+	{
+		changeState(reactor, *other, FD_STATE_GAME_JUDGED_SHOT);
+		other->QueueWrite(move, frameSize);
+		other->SetRelayStart(metricsNow());
+		reactor.GetLoop().AddWrite(other->GetFD());
+	}
+	if (win)
+	{
+		state.SetLastMoveWin();
+		state.ClearOtherPlayer();
+		state.SetBot(nullptr);
+		if (other)
+		{
+			other->ClearOtherPlayer();
+		}
+	}
+	// Last, since either one finishing can start the next turn. The partner
+	// failing to write aborts us too, so look ourselves up again after.
+	ConnRef self = reactor.RefTo(state);
+	if (other)
+	{
+		relayNow(*other, reactor);
+	}
+	FdState * still = reactor.Find(self);
+	if (nullptr != still)
+	{
+		relayNow(*still, reactor);
+	}
+}
+
+/****************************************************************
+ * Handle the write of a judged move's results to the player that made it
+ * 
+ * Preconditions:
+ *  called after write in state FD_STATE_GAME_JUDGED_RESULTS
+ * Postcondition:
+ *  connection moved to the lobby if they won, otherwise waiting for the other
+ *  player's move (which is read once they are ready too) or the bot's
+ ****************************************************************/
+void judgedResultsWrite(FdState & state, Reactor & reactor)
+{
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	if (state.GetLastMoveWin())
+	{
+		changeState(reactor, state, FD_STATE_LOBBY);
+		state.SetRead(sizeof(uint32_t));
+		reactor.GetLoop().AddRead(state.GetFD());
+		state.ClearLastMoveWin();
+		return;
+	}
+	changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE);
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	if (state.GetBot())
+	{
+		askBot(reactor, state);
+	}
+	else if (nullptr != other)
+	{
+		beginTurn(reactor, *other);
+	}
+	else
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PARTNER);
+	}
+}
+
+/****************************************************************
+ * Handle the write of the other player's (already judged) move to this
+ * connection
+ * 
+ * Preconditions:
+ *  called after write in state FD_STATE_GAME_JUDGED_SHOT
+ * Postcondition:
+ *  connection moved to the lobby if that move lost them the game, otherwise
+ *  it's their turn (read once the other player is ready)
+ ****************************************************************/
+void judgedShotWrite(FdState & state, Reactor & reactor)
+{
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	if (!state.HasOtherPlayer() && !state.GetBot())
+	{
+		// Game over
+		changeState(reactor, state, FD_STATE_LOBBY);
+		state.SetRead(sizeof(uint32_t));
+		reactor.GetLoop().AddRead(state.GetFD());
+		return;
+	}
+	changeState(reactor, state, FD_STATE_GAME_WAIT_THISFD_MOVE);
+	beginTurn(reactor, state);
+}
+
+/****************************************************************
+ * Handle state change after a read of a move from this FD
+ * 
+ * Preconditions:
+ *  called after a read in state FD_STATE_GAME_THISFD_MOVE
+ * Postcondition:
+ *  Move we just recieved written (or queued) to the other player's connection,
+ *  or judged here if the server has their (or the bot's) fleet
+ ****************************************************************/
+void thisFdMoveRead(FdState & state, Reactor & reactor)
+{
+	// Clear this FD from read list so it is in no lists
+	reactor.GetLoop().RemoveRead(state.GetFD());
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	// Put this FD in state FD_STATE_GAME_THISFD_MOVE_RESULTS
+	changeState(reactor, state, FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
+	
+	// Get the move
+	short readSize;
+	char * readData = state.GetRead(readSize);
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	if (readSize != moveSize(state))
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	
+	if (other && nullptr != other->GetFleet())
+	{
+		judgeMove(state, other, *(other->GetFleet()), readData, reactor);
+	}
+	else if (state.GetBot())
+	{
+		judgeMove(state, nullptr, state.GetBot()->GetFleet(), readData, reactor);
+	}
+	else if (other)
+	{
+		// Set up other FD (whose state should be FD_STATE_GAME_OFD_MOVE) to write
+		// move. A frame this small goes in the queue's inline slot, no
+		// allocation.
+		other->QueueWrite(readData, readSize);
+		other->SetRelayStart(metricsNow());
+		
+		// Put other FD in write mode
+		reactor.GetLoop().AddWrite(other->GetFD());
+		// Other FD should already be in the state FD_STATE_GAME_OFD_MOVE
+		relayNow(*other, reactor);
+	}
+	else
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PARTNER);
+	}
+}
+
+/****************************************************************
+ * Handle state change after writing results of this connections move to this
+ * connection
+ * 
+ * Preconditions:
+ *  called after write in state FD_STATE_GAME_THISFD_MOVE_RESULTS
+ * Postcondition:
+ *  connection moved to lobby if they won, otherwise switch the other Fd to
+ *  reading move from client 
+ ****************************************************************/
+void thisFdMoveResultsWrite(FdState & state, Reactor & reactor)
+{
+	// If the game was won, set up a lobby read and go to state FD_STATE_LOBBY
+	if (state.GetLastMoveWin())
+	{
+		changeState(reactor, state, FD_STATE_LOBBY);
+		state.SetRead(sizeof(uint32_t));
+		reactor.GetLoop().AddRead(state.GetFD());
+		reactor.GetLoop().RemoveWrite(state.GetFD());
+		state.ClearLastMoveWin();
+	}
+	else
+	// Otherwise:
+	{
+		// Set this connection state to FD_STATE_GAME_OFD_MOVE
+		changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE);
+		// Remove this connection from all lists
+		reactor.GetLoop().RemoveRead(state.GetFD());
+		reactor.GetLoop().RemoveWrite(state.GetFD());
+		FdState * other = reactor.Find(state.GetOtherPlayer());
+		if (other)
+		{
+			// Set pair connection to state FD_STATE_GAME_THISFD_MOVE
+			changeState(reactor, *other, FD_STATE_GAME_WAIT_THISFD_MOVE);
+			// Put the other connection in the read list
+			reactor.GetLoop().AddRead(other->GetFD());
+			other->SetRead(moveSize(*other));
+		}
+		else
+		{
+			abortConnection(state, reactor, METRICS_ABORT_PARTNER);
+		}
+	}
+}
+
+/****************************************************************
+ * Handle state change after the other connection's move has been written to
+ * this connection
+ * 
+ * Preconditions:
+ *  called after write in state FD_STATE_GAME_WAIT_OFD_MOVE
+ * Postcondition:
+ *  this connection set to read 32 bits and state set to
+ *  FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS 
+ ****************************************************************/
+// 
+void oFdMoveWrite(FdState & state, Reactor & reactor)
+{
+	// Put this connection in read list and make sure it's not in the write list anymore
+	reactor.GetLoop().AddRead(state.GetFD());
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	// set this connection's state to FD_STATE_GAME_OFD_MOVE_RESULTS
+	state.SetRead(moveSize(state));
+	changeState(reactor, state, FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS);
+}
+
+/****************************************************************
+ * Let a bot know how its shot went, from the results the player's client sent
+ * 
+ * Preconditions:
+ *  state playing a bot, just read the results ('readData', network order)
+ *  in FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS
+ * Postcondition:
+ *  bot told, and state moved to the lobby if it won, otherwise set to read
+ *  the player's move. Results for a space off the board abort the connection.
+ ****************************************************************/
+void botMoveResultsRead(FdState & state, const char * readData, Reactor & reactor)
+{
+	BotPlayer & bot = *state.GetBot();
+	short x, y, shipSize;
+	bool hit, sink, win;
+	// Same coordinate bits as the move
+	decodeMove(*((const uint32_t *)readData), x, y);
+	decodeMoveResults(*((const uint32_t *)readData), hit, shipSize, sink, win);
+	if (x < 1 || x > bot.GetRules().width || y < 1 || y > bot.GetRules().height)
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	bot.GetBrain().Record(x-1, y-1, hit, shipSize, sink);
+	// Still in the read list either way
+	if (win)
+	{
+		state.SetBot(nullptr);
+		state.SetRead(sizeof(uint32_t));
+		changeState(reactor, state, FD_STATE_LOBBY);
+	}
+	else
+	{
+		state.SetRead(moveSize(state));
+		changeState(reactor, state, FD_STATE_GAME_WAIT_THISFD_MOVE);
+	}
+}
+
+/****************************************************************
+ * handle state change after a read from this connection of the results of the
+ * other FD's move
+ * 
+ * Preconditions:
+ *  called after read from state FD_STATE_GAME_OFD_MOVE_RESULTS
+ * Postcondition:
+ *  if a win happened, then this connection moved to the lobby, other
+ *  connection set to write result to client
+ *  otherwise, other connection set to write result to client
+ *  Either way the result is written right away if the socket takes it. In a
+ *  game against a bot, the bot is told instead (see botMoveResultsRead).
+ ****************************************************************/
+void oFdMoveResultsRead(FdState & state, Reactor & reactor)
+{
+	short readLen;
+	uint32_t result;
+	char * readData = state.GetRead(readLen);
+	FdState * other = reactor.Find(state.GetOtherPlayer());
+	if (readLen != moveSize(state))
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	
+	result = ntohl(*((uint32_t *)readData));
+	
+	if (state.GetBot())
+	{
+		botMoveResultsRead(state, readData, reactor);
+	}
+	else if (other)
+	{
+		// Check if that was a winning move. If so, set a flag on the other connection & remove the pair links, set this connection up for a lobby read
+		if (result & WIN_YES)
+		{
+			other->SetLastMoveWin();
+			other->QueueWrite(readData, readLen);
+			other->SetRelayStart(metricsNow());
+			// Set other connection to state FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS
+			changeState(reactor, *other, FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
+			reactor.GetLoop().AddWrite(other->GetFD());
+			
+			state.SetRead(sizeof(uint32_t));
+			changeState(reactor, state, FD_STATE_LOBBY);
+			other->ClearOtherPlayer();
+			state.ClearOtherPlayer();
+			relayNow(*other, reactor);
+		}
+		else
+		{
+			// Set other connection to state FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS
+			changeState(reactor, *other, FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS);
+			// Put other connection in write list and set it up with the results we just read
+			reactor.GetLoop().AddWrite(other->GetFD());
+			other->QueueWrite(readData, readLen);
+			other->SetRelayStart(metricsNow());
+			
+			// Remove this connection from the read list
+			reactor.GetLoop().RemoveRead(state.GetFD());
+			// Last, since finishing the write starts us reading again
+			relayNow(*other, reactor);
+		}
+	}
+	else
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PARTNER);
+	}
+}
+
+/****************************************************************
+ * Set up the next chunk of a players page to be written
+ * 
+ * Preconditions:
+ *  state one of reactor's connections, its list cursor set up by
+ *  pageRequestRead() (and not done)
+ * Postcondition:
+ *  connection set to write one chunk header and up to LONG_TRANSFER_SIZE_MASK
+ *  bytes of entries, cursor moved past them and marked done if that was the
+ *  last chunk. How long filling it took recorded in reactor's metrics.
+ ****************************************************************/
+void setNamePageChunk(FdState & state, Reactor & reactor)
+{
+	ListCursor & cursor = state.GetListCursor();
+	// Room for the header, filled in once we know the length
+	std::string chunk(sizeof(uint32_t), '\0');
+	int result;
+	uint64_t start = metricsNow();
+	{
+		std::lock_guard<std::mutex> lock(LobbyMutex);
+		result = Lobby.FillPage(cursor, chunk, sizeof(uint32_t) + LONG_TRANSFER_SIZE_MASK);
+	}
+	reactor.GetMetrics().PageFill().Record(metricsNow() - start);
+	uint32_t header = ACTION_PLAYERS_PAGE | ((chunk.length() - sizeof(uint32_t)) & LONG_TRANSFER_SIZE_MASK);
+	if (LOBBY_PAGE_FULL == result)
+	{
+		header = header | PAGE_MORE_CHUNKS_MASK;
+	}
+	else if (LOBBY_PAGE_LIMIT == result)
+	{
+		header = header | PAGE_MORE_PLAYERS_MASK;
+	}
+	cursor.done = (LOBBY_PAGE_FULL != result);
+	header = htonl(header);
+	chunk.replace(0, sizeof(uint32_t), (char *)&header, sizeof(uint32_t));
+	state.QueueWrite(chunk.c_str(), (short)chunk.length());
+}
+
+/****************************************************************
+ * Start sending a players page once its request has been read
+ * 
+ * Preconditions:
+ *  called after the read finishes in FD_STATE_PAGE_REQ_READ
+ * Postcondition:
+ *  first chunk of the page set to be written, connection in
+ *  FD_STATE_REQ_NAME_PAGE
+ ****************************************************************/
+void pageRequestRead(FdState & state, Reactor & reactor)
+{
+	short readSize;
+	char * readData = state.GetRead(readSize);
+	if (readSize < (short)sizeof(uint32_t))
+	{
+		abortConnection(state, reactor, METRICS_ABORT_PROTOCOL);
+		return;
+	}
+	uint32_t range = *((uint32_t *)readData);
+	range = ntohl(range);
+	ListCursor & cursor = state.GetListCursor();
+	cursor.prefix = std::string(readData + sizeof(uint32_t), readSize - sizeof(uint32_t));
+	cursor.after.clear();
+	cursor.skip = range >> PAGE_OFFSET_SHIFT;
+	cursor.left = range & PAGE_LIMIT_MASK;
+	cursor.limited = (0 != cursor.left);
+	cursor.done = false;
+	setNamePageChunk(state, reactor);
+	// Switch to write
+	reactor.GetLoop().AddWrite(state.GetFD());
+	reactor.GetLoop().RemoveRead(state.GetFD());
+	changeState(reactor, state, FD_STATE_REQ_NAME_PAGE);
+}
+
+/****************************************************************
+ * Handle a chunk of a players page being written
+ * 
+ * Preconditions:
+ *  called after write finishes in FD_STATE_REQ_NAME_PAGE state
+ * Postcondition:
+ *  next chunk set to be written, or if that was the last one, connection set
+ *  to lobby state and prepared for a read of 32 bits
+ ****************************************************************/
+void afterNamePageWrite(FdState & state, Reactor & reactor)
+{
+	ListCursor & cursor = state.GetListCursor();
+	if (!cursor.done)
+	{
+		setNamePageChunk(state, reactor);
+		return;
+	}
+	cursor.prefix.clear();
+	cursor.after.clear();
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	reactor.GetLoop().AddRead(state.GetFD());
+	changeState(reactor, state, FD_STATE_LOBBY);
+	state.SetRead(sizeof(uint32_t));
+}
+
+/****************************************************************
+ * Handle state change after writing the lobby name list to the connection 
+ * 
+ * Preconditions:
+ *  called after write finishes in FD_STATE_REQ_NAME_LIST state
+ * Postcondition:
+ *  connection set to lobby state and prepared for a read of 32 bits
+ ****************************************************************/
+void afterNameListWrite(FdState & state, Reactor & reactor)
+{
+	// Take ourself out of the write list
+	reactor.GetLoop().RemoveWrite(state.GetFD());
+	// Set up for a lobby read
+	reactor.GetLoop().AddRead(state.GetFD());
+	changeState(reactor, state, FD_STATE_LOBBY);
+	state.SetRead(sizeof(uint32_t));
+}
+
+/****************************************************************
+ * Handle a connection finishing a read, based on what state it is in
+ * 
+ * Preconditions:
+ *  state's read just completed
+ * Postcondition:
+ *  read recorded, message counted by its ACTION_* if the read started one,
+ *  and the read handler for the connection's state run
+ ****************************************************************/
+void readDone(FdState & state, Reactor & reactor)
+{
+	short current = state.GetState();
+	short readSize;
+	char * readData = state.GetRead(readSize);
+	reactor.GetFlightRecorder().Record(FLIGHT_READ, state, readSize);
+	if (startsMessage(current) && readSize >= (short)sizeof(uint32_t))
+	{
+		reactor.GetMetrics().Message(ntohl(*((uint32_t *)readData)));
+	}
+	if (FD_STATE_ANON == current)
+	{
+		anonRead(state, reactor);
+	}
+	else if (FD_STATE_ANON_NAME_SIZE == current)
+	{
+		nameRead(state, reactor);
+	}
+	else if (FD_STATE_LOBBY == current)
+	{
+		lobbyRead(state, reactor);
+	}
+	else if (FD_STATE_GAME_WAIT_THISFD_MOVE == current)
+	{
+		thisFdMoveRead(state, reactor);
+	}
+	else if (FD_STATE_GAME_WAIT_OFD_MOVE_RESULTS == current)
+	{
+		oFdMoveResultsRead(state, reactor);
+	}
+	else if (FD_STATE_OPLYR_NAME_READ == current)
+	{
+		otherPlayerNameRead(state, reactor);
+	}
+	else if (FD_STATE_GAME_INVITE_RESP_WAIT == current)
+	{
+		readStateGameInvite(state, reactor);
+	}
+	else if (FD_STATE_PAGE_REQ_READ == current)
+	{
+		pageRequestRead(state, reactor);
+	}
+	else if (FD_STATE_GAME_FLEET_READ_FIRST == current || FD_STATE_GAME_FLEET_READ_SECOND == current)
+	{
+		fleetRead(state, reactor);
+	}
+}
+
+/****************************************************************
+ * Handle a connection finishing a write, based on what state it is in
+ * 
+ * Preconditions:
+ *  state's write just completed
+ * Postcondition:
+ *  write recorded, relay latency recorded if that write was relaying the
+ *  other player's frame, and the after-write handler for the connection's
+ *  state run
+ ****************************************************************/
+void writeDone(FdState & state, Reactor & reactor)
+{
+	reactor.GetFlightRecorder().Record(FLIGHT_WRITE, state, (int)state.GetBytesWritten());
+	if (state.GetRelayStart())
+	{
+		reactor.GetMetrics().Relay().Record(metricsNow() - state.GetRelayStart());
+		state.SetRelayStart(0);
+	}
+	short current = state.GetState();
+	if (FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS == current)
+	{
+		thisFdMoveResultsWrite(state, reactor);
+	}
+	else if (FD_STATE_GAME_WAIT_OFD_MOVE == current)
+	{
+		oFdMoveWrite(state, reactor);
+	}
+	else if (FD_STATE_NAME_REJECT == current)
+	{
+		nameRejectAfterWrite(state, reactor);
+	}
+	else if (FD_STATE_NAME_ACCEPT == current)
+	{
+		nameAcceptAfterWrite(state, reactor);
+	}
+	else if (FD_STATE_GAME_INVITE == current)
+	{
+		writeGameInvite(state, reactor);
+	}
+	else if (FD_STATE_GAME_REQ_ACCEPT == current)
+	{
+		afterWriteAccept(state, reactor);
+	}
+	else if (FD_STATE_GAME_REQ_REJECT == current)
+	{
+		afterWriteReject(state, reactor);
+	}
+	else if (FD_STATE_REQ_NAME_LIST == current)
+	{
+		afterNameListWrite(state, reactor);
+	}
+	else if (FD_STATE_REQ_NAME_PAGE == current)
+	{
+		afterNamePageWrite(state, reactor);
+	}
+	else if (FD_STATE_GAME_JUDGED_RESULTS == current)
+	{
+		judgedResultsWrite(state, reactor);
+	}
+	else if (FD_STATE_GAME_JUDGED_SHOT == current)
+	{
+		judgedShotWrite(state, reactor);
+	}
+}
+
+/****************************************************************
+ * Read from a connection and handle every complete frame it has buffered, up
+ * to its read budget
+ * 
+ * Preconditions:
+ *  state one of reactor's connections that wants to read
+ * Postcondition:
+ *  At most one read() made (none if bytes were already read ahead), then the
+ *  read handlers run for up to FD_STATE_READ_BUDGET frames while the
+ *  connection keeps wanting to read. Connection aborted if reading failed.
+ *  If it is still around with bytes left over, it is noted with
+ *  NoteBuffered() to come back to.
+ ****************************************************************/
+void readFrames(FdState * state, Reactor & reactor)
+{
+	int fd = state->GetFD();
+	unsigned int serial = state->GetSerial();
+	for (int frames = 0; frames < FD_STATE_READ_BUDGET; ++frames)
+	{
+		uint64_t before = state->GetBytesRead();
+		int readResult = state->Read();
+		reactor.GetMetrics().BytesIn(state->GetBytesRead() - before);
+		if (readResult < 0)
+		{
+			// End of connection or error reading
+			abortConnection(*state, reactor, METRICS_ABORT_READ);
+			return;
+		}
+		if (0 == readResult)
+		{
+			// Rest of the frame isn't here yet
+			break;
+		}
+		// We're done reading a chunk, handle the result
+		readDone(*state, reactor);
+		// Handlers can drop or hand off the connection
+		state = reactor.FindByFd(fd);
+		if (nullptr == state || state->GetSerial() != serial)
+		{
+			return;
+		}
+		if (!reactor.GetLoop().WantsRead(fd) || !state->HasBufferedRead())
+		{
+			break;
+		}
+	}
+	if (state->HasBufferedRead())
+	{
+		reactor.NoteBuffered(fd);
+	}
+}
+
+/****************************************************************
+ * Come back to connections that have frames read ahead (epoll backend)
+ * 
+ * Preconditions:
+ *  backlog scratch space
+ * Postcondition:
+ *  frames handled for the noted connections that want to read, the rest
+ *  noted again. Returns 0 if some connection still has frames it can go on
+ *  with (so the next wait shouldn't block), -1 otherwise.
+ ****************************************************************/
+int readBuffered(Reactor & reactor, std::vector<int> & backlog)
+{
+	EventLoop & loop = reactor.GetLoop();
+	reactor.TakeBuffered(backlog);
+	for (auto fd: backlog)
+	{
+		FdState * state = reactor.FindByFd(fd);
+		if (nullptr == state || !state->HasBufferedRead())
+		{
+			continue;
+		}
+		if (loop.WantsRead(fd))
+		{
+			readFrames(state, reactor);
+		}
+		else
+		{
+			// Not reading yet (waiting on the other player, say)
+			reactor.NoteBuffered(fd);
+		}
+	}
+	// Handlers above can start others reading, so check what is left after
+	int timeout = -1;
+	reactor.TakeBuffered(backlog);
+	for (auto fd: backlog)
+	{
+		FdState * state = reactor.FindByFd(fd);
+		if (nullptr == state || !state->HasBufferedRead())
+		{
+			continue;
+		}
+		reactor.NoteBuffered(fd);
+		if (loop.WantsRead(fd))
+		{
+			timeout = 0;
+		}
+	}
+	return timeout;
+}
+
+/****************************************************************
+ * Drop the connections that stayed in one state past its deadline
+ * 
+ * Preconditions:
+ *  expired scratch space
+ * Postcondition:
+ *  reactor's timer wheel moved up to now. Each connection whose deadline
+ *  passed aborted, along with the player it was in a game with (who can't
+ *  go on without it). Invitations to or from it are turned down by
+ *  abortConnection(), same as when a client hangs up.
+ ****************************************************************/
+void reapExpired(Reactor & reactor, std::vector<TimerExpiry> & expired)
+{
+	expired.clear();
+	reactor.GetTimers().Advance(metricsNow() / 1000000, expired);
+	for (auto& expiry: expired)
+	{
+		FdState * state = reactor.FindByFd(expiry.fd);
+		if (nullptr == state || state->GetSerial() != expiry.serial)
+		{
+			// Gone already (its partner timed out earlier in this batch)
+			continue;
+		}
+		// Takes its game partner with it
+		abortConnection(*state, reactor, METRICS_ABORT_TIMEOUT);
+	}
+}
+
+/****************************************************************
+ * Find how long an event loop can sleep
+ * 
+ * Preconditions:
+ *  timeout in milliseconds, -1 for no limit
+ * Postcondition:
+ *  timeout returned, cut down to when the reactor's timer wheel next needs
+ *  advancing if that is sooner
+ ****************************************************************/
+int untilNextDeadline(Reactor & reactor, int timeout)
+{
+	int timers = reactor.GetTimers().NextTimeout(metricsNow() / 1000000);
+	if (-1 == timeout || (timers >= 0 && timers < timeout))
+	{
+		return timers;
+	}
+	return timeout;
+}
+
+/****************************************************************
+ * Run one reactor's event loop (one per thread)
+ * 
+ * Preconditions:
+ *  reactor has its listening socket set up, and is only run by one thread
+ * Postcondition:
+ *  only returns if waiting for events fails
+ ****************************************************************/
+void runReactor(Reactor * reactorPtr)
+{
+	Reactor & reactor = *reactorPtr;
+	EventLoop & loop = reactor.GetLoop();
+	int sockfd = reactor.GetListenFD();
+	int wakeFd = reactor.GetWakeFD();
+	std::vector<ReactorMessage> messages;
+	std::vector<int> backlog;
+	std::vector<TimerExpiry> expired;
+	// This thread's buffers are this reactor's to count
+	BufferPool::Local().CountInto(&reactor.GetMetrics());
+	
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	int readyCount;
+	// Don't sleep while connections have whole frames read ahead, or past the
+	// next connection deadline
+	while ((readyCount = loop.Wait(events, EVENT_LOOP_MAX_EVENTS, untilNextDeadline(reactor, readBuffered(reactor, backlog)))) >= 0)
+	{
+		reactor.GetMetrics().LoopEntered(1);
+		// Only the connections that are actually ready get looked at. Note that
+		// the process will not be interrupted while inside this loop.
+		for (int i = 0; i < readyCount; ++i)
+		{
+			int thisFD = events[i].data.fd;
+			unsigned int ready = events[i].events;
+			if (thisFD == wakeFd)
+			{
+				// Other reactors (or us) sent messages
+				handleMessages(reactor, messages);
+				continue;
+			}
+			FdState * it = reactor.FindByFd(thisFD);
+			if (nullptr == it)
+			{
+				// Closed by an earlier event in this same batch
+				continue;
+			}
+			if ((ready & (EPOLLHUP | EPOLLERR)) && !loop.WantsRead(thisFD))
+			{
+				// Hung up while we weren't waiting to read from it. epoll
+				// reports this whether we asked or not, so deal with it now or
+				// it will keep waking us up. (If we are reading, the read will
+				// fail and clean it up below.)
+				abortConnection(*it, reactor, METRICS_ABORT_HANGUP);
+				continue;
+			}
+			if ((ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) && loop.WantsRead(thisFD))
+			{
+				if (thisFD == sockfd)
+				{
+					// Treat the accept FD as a special case and take everything
+					// that is waiting
+					while (0 == acceptConnection(thisFD, reactor))
 					{
-						readStateGameInvite(it, readSet, writeSet);
 					}
+					continue;
+				}
+				readFrames(it, reactor);
+				// The read handlers can add or drop connections, so look this
+				// one up again before using it for the write
+				it = reactor.FindByFd(thisFD);
+				if (nullptr == it)
+				{
+					continue;
 				}
 			}
-			if (FD_ISSET(thisFD, &writeSetSelectResults))
+			if ((ready & EPOLLOUT) && loop.WantsWrite(thisFD))
 			{
-				int writeResult = it.Write();
+				uint64_t before = it->GetBytesWritten();
+				int writeResult = it->Write();
+				reactor.GetMetrics().BytesOut(it->GetBytesWritten() - before);
 				if (writeResult == 0)
 				{
 					// Need to write again, do nothing
@@ -1053,49 +2587,544 @@ int main(int argc, char ** argv)
 				else if (writeResult < 0)
 				{
 					// End of connection or error reading
-					abortConnection(it, readSet, writeSet);
+					abortConnection(*it, reactor, METRICS_ABORT_WRITE);
 				}
 				else if (writeResult == 1)
 				{
 					// Fd ready for write
-					if (FD_STATE_GAME_WAIT_THISFD_MOVE_RESULTS == state)
-					{
-						thisFdMoveResultsWrite(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_WAIT_OFD_MOVE == state)
-					{
-						oFdMoveWrite(it, readSet, writeSet);
-					}
-					else if (FD_STATE_NAME_REJECT == state)
-					{
-						nameRejectAfterWrite(it, readSet, writeSet);
-					}
-					else if (FD_STATE_NAME_ACCEPT == state)
-					{
-						nameAcceptAfterWrite(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_INVITE == state)
-					{
-						writeGameInvite(it, readSet, writeSet);
-					}
-					else if (FD_STATE_GAME_REQ_ACCEPT == state)
+					writeDone(*it, reactor);
+				}
+			}
+		}
+		// After the batch, so none of its events land on a reused fd
+		reapExpired(reactor, expired);
+	}
+}
+
+/****************************************************************
+ * Get the io_uring bookkeeping for a connection
+ * 
+ * Preconditions:
+ *  state is one of this reactor's connections
+ * Postcondition:
+ *  entry for state's fd returned, reset first if it was left over from an
+ *  earlier connection on the same fd
+ ****************************************************************/
+UringConn & uringConnFor(std::vector<UringConn> & conns, const FdState & state)
+{
+	unsigned int fd = state.GetFD();
+	if (fd >= conns.size())
+	{
+		UringConn blank = {0, "", false, false, false};
+		conns.resize(fd+1, blank);
+	}
+	UringConn & conn = conns[fd];
+	if (conn.serial != state.GetSerial())
+	{
+		// Whatever the old connection had in flight was on its own socket, and
+		// its completions get dropped when their serial doesn't match
+		conn.serial = state.GetSerial();
+		conn.bytes.clear();
+		conn.closed = false;
+		conn.recvInFlight = false;
+		conn.sendInFlight = false;
+	}
+	return conn;
+}
+
+/****************************************************************
+ * Bring a connection's I/O up to date with what it wants (io_uring backend)
+ * 
+ * Preconditions:
+ *  fd had its interest change, or something complete for it
+ * Postcondition:
+ *  Bytes already received handed over while the connection wants to read
+ *  (running the read handlers as reads finish), then a recv queued if it
+ *  wants more and a send queued if it has something to write. fd added to
+ *  'retry' if the send couldn't be queued yet, or to 'again' (and nothing
+ *  else done) if it used up its FD_STATE_READ_BUDGET frames.
+ ****************************************************************/
+void uringService(Reactor & reactor, UringLoop & ring, std::vector<UringConn> & conns, int fd, std::vector<int> & retry, std::vector<int> & again)
+{
+	EventLoop & loop = reactor.GetLoop();
+	if (fd == reactor.GetListenFD() || fd == reactor.GetWakeFD())
+	{
+		// Have their own operations
+		return;
+	}
+	FdState * state = reactor.FindByFd(fd);
+	if (nullptr == state)
+	{
+		if ((unsigned int)fd < conns.size() && conns[fd].recvInFlight)
+		{
+			// Went to another reactor with a recv still waiting here. The
+			// client doesn't send anything while being handed over, so
+			// cancelling loses nothing.
+			ring.CancelFd(fd);
+			conns[fd].recvInFlight = false;
+		}
+		return;
+	}
+	unsigned int serial = state->GetSerial();
+	UringConn * conn = &uringConnFor(conns, *state);
+	// Hand over what was received while it wasn't reading, same as the
+	// kernel's socket buffer would for epoll
+	int frames = 0;
+	while (loop.WantsRead(fd) && !conn->bytes.empty() && state->ReadRemaining() > 0)
+	{
+		if (frames >= FD_STATE_READ_BUDGET)
+		{
+			// Let the other connections have a turn first
+			again.push_back(fd);
+			return;
+		}
+		int count = std::min<int>(state->ReadRemaining(), conn->bytes.size());
+		int readResult = state->ReadFrom(conn->bytes.data(), count);
+		conn->bytes.erase(0, count);
+		if (1 == readResult)
+		{
+			++frames;
+			readDone(*state, reactor);
+			// Handlers can drop or hand off the connection
+			state = reactor.FindByFd(fd);
+			if (nullptr == state || state->GetSerial() != serial)
+			{
+				return;
+			}
+			conn = &uringConnFor(conns, *state);
+		}
+	}
+	if (loop.WantsRead(fd) && conn->bytes.empty())
+	{
+		if (conn->closed)
+		{
+			// End of connection or error reading
+			abortConnection(*state, reactor, METRICS_ABORT_READ);
+			return;
+		}
+		if (!conn->recvInFlight && state->ReadRemaining() > 0)
+		{
+			// Ask for more than this frame so pipelined ones come in together
+			conn->recvInFlight = ring.QueueRecv(fd, FD_STATE_READ_AHEAD, serial);
+		}
+	}
+	if (loop.WantsWrite(fd) && !conn->sendInFlight)
+	{
+		struct iovec iov[FD_STATE_MAX_IOV];
+		int iovCount = state->GetWriteRemaining(iov, FD_STATE_MAX_IOV);
+		if (iovCount > 0)
+		{
+			// Everything queued goes out together
+			conn->sendInFlight = ring.QueueSend(fd, iov, iovCount, serial);
+			if (!conn->sendInFlight)
+			{
+				// Out of send slots, try again once some sends finish
+				retry.push_back(fd);
+			}
+		}
+	}
+}
+
+/****************************************************************
+ * Run one reactor's event loop with io_uring instead of epoll (one per thread)
+ * 
+ * Preconditions:
+ *  reactor made without epoll, has its listening socket set up, and is only
+ *  run by one thread
+ * Postcondition:
+ *  only returns if io_uring can't be set up or waiting on it fails
+ ****************************************************************/
+void runReactorUring(Reactor * reactorPtr)
+{
+	Reactor & reactor = *reactorPtr;
+	EventLoop & loop = reactor.GetLoop();
+	int sockfd = reactor.GetListenFD();
+	int wakeFd = reactor.GetWakeFD();
+	std::vector<ReactorMessage> messages;
+	// Made here so the ring belongs to this thread
+	UringLoop ring(URING_QUEUE_DEPTH, URING_RECV_BUFFERS, URING_SEND_SLOTS, URING_BUFFER_SIZE);
+	if (!ring.IsOpen())
+	{
+		std::cerr << "io_uring backend not available on reactor " << reactor.GetId() << ".\n";
+		return;
+	}
+	// This thread's buffers are this reactor's to count
+	BufferPool::Local().CountInto(&reactor.GetMetrics());
+	std::vector<UringConn> conns;
+	std::vector<UringCompletion> completions;
+	std::vector<int> changed;
+	// Connections that had something complete, or need to try a send again
+	std::vector<int> touched;
+	std::vector<int> retry;
+	// Connections that ran out of read budget with frames still buffered
+	std::vector<int> again;
+	std::vector<TimerExpiry> expired;
+	// When to wake up for the next connection deadline (the kernel reads it
+	// when it is submitted)
+	struct __kernel_timespec deadline;
+	bool timeoutInFlight = false;
+	// io_uring_enter() calls already counted in the metrics
+	unsigned long entersCounted = 0;
+	uint64_t wakeCount;
+	ring.QueueAccept(sockfd);
+	ring.QueueRead(wakeFd, &wakeCount);
+	
+	while (true)
+	{
+		// Queue up I/O for everything that changed. Handling data that was
+		// already here can change more, so go until it settles.
+		touched.insert(touched.end(), retry.begin(), retry.end());
+		retry.clear();
+		loop.TakeChanged(changed);
+		changed.insert(changed.end(), touched.begin(), touched.end());
+		touched.clear();
+		while (!changed.empty())
+		{
+			for (auto fd: changed)
+			{
+				uringService(reactor, ring, conns, fd, retry, again);
+			}
+			loop.TakeChanged(changed);
+			// Round robin until everyone's buffered frames are handled
+			changed.insert(changed.end(), again.begin(), again.end());
+			again.clear();
+		}
+		
+		int timeout = untilNextDeadline(reactor, -1);
+		if (!timeoutInFlight && timeout >= 0)
+		{
+			deadline.tv_sec = timeout / 1000;
+			deadline.tv_nsec = (timeout % 1000) * 1000000ll;
+			timeoutInFlight = ring.QueueTimeout(&deadline);
+		}
+		
+		// One syscall submits all of that and collects what finished
+		if (ring.SubmitAndWait(completions) < 0)
+		{
+			break;
+		}
+		// Queueing can flush a full submission queue too, so count every
+		// io_uring_enter() since last time, not just this one
+		reactor.GetMetrics().LoopEntered(ring.GetEnterCount() - entersCounted);
+		entersCounted = ring.GetEnterCount();
+		for (auto& done: completions)
+		{
+			if (URING_OP_ACCEPT == done.op)
+			{
+				if (done.result >= 0)
+				{
+					addConnection(done.result, reactor);
+				}
+				else if (-EAGAIN != done.result && -EINTR != done.result && -ECONNABORTED != done.result)
+				{
+					errno = -done.result;
+					perror("Trouble accept()ing a connection");
+				}
+				if (!done.more)
+				{
+					// Kernel stopped the multishot accept, start it again
+					ring.QueueAccept(sockfd);
+				}
+				continue;
+			}
+			if (URING_OP_READ == done.op)
+			{
+				// Other reactors (or us) sent messages
+				handleMessages(reactor, messages);
+				ring.QueueRead(wakeFd, &wakeCount);
+				continue;
+			}
+			if (URING_OP_CANCEL == done.op)
+			{
+				continue;
+			}
+			if (URING_OP_TIMEOUT == done.op)
+			{
+				timeoutInFlight = false;
+				continue;
+			}
+			FdState * it = reactor.FindByFd(done.fd);
+			bool current = nullptr != it && it->GetSerial() == done.tag;
+			if (URING_OP_RECV == done.op)
+			{
+				if (current)
+				{
+					UringConn & conn = uringConnFor(conns, *it);
+					conn.recvInFlight = false;
+					if (done.result > 0)
 					{
-						afterWriteAccept(it, readSet, writeSet);
+						conn.bytes.append(done.data, done.result);
+						reactor.GetMetrics().BytesIn(done.result);
 					}
-					else if (FD_STATE_GAME_REQ_REJECT == state)
+					else if (0 == done.result || (-ENOBUFS != done.result && -EAGAIN != done.result && -EINTR != done.result))
 					{
-						afterWriteReject(it, readSet, writeSet);
+						conn.closed = true;
 					}
-					else if (FD_STATE_REQ_NAME_LIST == state)
+					touched.push_back(done.fd);
+				}
+				if (done.hasBuffer)
+				{
+					ring.ReleaseRecv(done.bufferId);
+				}
+			}
+			else if (URING_OP_SEND == done.op && current)
+			{
+				uringConnFor(conns, *it).sendInFlight = false;
+				if (done.result > 0)
+				{
+					reactor.GetMetrics().BytesOut(done.result);
+					if (1 == it->Wrote(done.result))
 					{
-						afterNameListWrite(it, readSet, writeSet);
+						writeDone(*it, reactor);
 					}
 				}
+				else if (-EAGAIN != done.result && -EINTR != done.result)
+				{
+					// End of connection or error writing
+					abortConnection(*it, reactor, METRICS_ABORT_WRITE);
+					continue;
+				}
+				touched.push_back(done.fd);
 			}
 		}
-		// Retore the lists of things we want to check since pselect overwrites
-		// the list to tell us what is ready to read/write
-		readSetSelectResults = readSet;
-		writeSetSelectResults = writeSet;
+		reapExpired(reactor, expired);
+	}
+}
+
+/****************************************************************
+ * Start listening for metrics scrapers on a unix domain socket
+ * 
+ * Preconditions:
+ *  path fits in a sockaddr_un
+ * Postcondition:
+ *  anything already at path removed, listening (blocking) socket returned,
+ *  -1 if it couldn't be set up
+ ****************************************************************/
+int setUpStatsSocket(const char * path)
+{
+	int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (-1 == sockfd)
+	{
+		perror("Trouble opening the stats socket");
+		return -1;
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+	// Left over from the last run
+	unlink(path);
+	if (-1 == bind(sockfd, (struct sockaddr *)&address, sizeof(address)) || -1 == listen(sockfd, SOMAXCONN))
+	{
+		perror("Trouble listening on the stats socket");
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+/****************************************************************
+ * Get every reactor's metrics added up
+ * 
+ * Preconditions:
+ *  Reactors filled in
+ * Postcondition:
+ *  "name value" lines returned. The reactors never wait on this, it only
+ *  reads their counters.
+ ****************************************************************/
+std::string metricsText()
+{
+	MetricsSnapshot snapshot;
+	clearMetrics(snapshot);
+	for (auto& reactor: Reactors)
+	{
+		reactor->GetMetrics().AddTo(snapshot);
+	}
+	return formatMetrics(snapshot);
+}
+
+/****************************************************************
+ * Get what every reactor's flight recorder holds
+ * 
+ * Preconditions:
+ *  Reactors filled in
+ * Postcondition:
+ *  Chrome trace event JSON returned. The reactors never wait on this, it
+ *  only copies their rings.
+ ****************************************************************/
+std::string flightTrace()
+{
+	std::vector<FlightEvent> events;
+	for (auto& reactor: Reactors)
+	{
+		reactor->GetFlightRecorder().Copy(events);
+	}
+	return formatFlightTrace(events);
+}
+
+/****************************************************************
+ * Answer metrics scrapers (runs on its own thread)
+ * 
+ * Preconditions:
+ *  sockfd from setUpStatsSocket(), Reactors filled in
+ * Postcondition:
+ *  Each connection that sends "flight" gets the flight recorder trace, any
+ *  other (including one that sends nothing for STATS_COMMAND_TIMEOUT_MS, or
+ *  shuts its side) gets the metrics, then is closed. Only returns if
+ *  accepting fails.
+ ****************************************************************/
+void serveStats(int sockfd)
+{
+	int clientfd;
+	while (-1 != (clientfd = accept4(sockfd, NULL, NULL, SOCK_CLOEXEC)) || EINTR == errno)
+	{
+		if (-1 == clientfd)
+		{
+			continue;
+		}
+		struct timeval timeout = {0, STATS_COMMAND_TIMEOUT_MS * 1000};
+		setsockopt(clientfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		char command[16];
+		ssize_t commandLen = read(clientfd, command, sizeof(command) - 1);
+		command[std::max<ssize_t>(commandLen, 0)] = '\0';
+		std::string text = (0 == strncmp(command, "flight", 6)) ? flightTrace() : metricsText();
+		size_t sent = 0;
+		ssize_t count;
+		while (sent < text.length() && (count = write(clientfd, text.data() + sent, text.length() - sent)) > 0)
+		{
+			sent += count;
+		}
+		close(clientfd);
+	}
+	perror("Trouble accept()ing on the stats socket");
+	close(sockfd);
+}
+
+/****************************************************************
+ * Write the flight recorders to a file whenever FLIGHT_DUMP_SIGNAL comes in
+ * (runs on its own thread)
+ * 
+ * Preconditions:
+ *  FLIGHT_DUMP_SIGNAL blocked in every thread, Reactors filled in
+ * Postcondition:
+ *  Never returns. Each signal replaces the file at 'path' with the trace.
+ ****************************************************************/
+void dumpFlightOnSignal(const char * path)
+{
+	sigset_t dumpSignal;
+	sigemptyset(&dumpSignal);
+	sigaddset(&dumpSignal, FLIGHT_DUMP_SIGNAL);
+	int caught;
+	while (true)
+	{
+		if (0 != sigwait(&dumpSignal, &caught))
+		{
+			continue;
+		}
+		std::string trace = flightTrace();
+		FILE * file = fopen(path, "w");
+		if (NULL == file)
+		{
+			perror("Trouble opening the flight recorder dump");
+			continue;
+		}
+		if (trace.length() != fwrite(trace.data(), 1, trace.length(), file))
+		{
+			perror("Trouble writing the flight recorder dump");
+		}
+		fclose(file);
+		std::cout << "Flight recorders written to " << path << ".\n";
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	server_options options;
+	Init_server_options(&options);
+	if (parseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+	
+	if (options.uring)
+	{
+		// Make sure the kernel will let us before committing to it
+		UringLoop probe(8, 1, 1, URING_BUFFER_SIZE);
+		if (!probe.IsOpen())
+		{
+			std::cerr << "io_uring not available, using epoll instead.\n";
+			options.uring = false;
+		}
+	}
+	
+	std::cout << "Battleship server starting, version " << GIT_VERSION << ", with " << options.reactors << " event loop thread(s) using " << (options.uring ? "io_uring" : "epoll") << ".\n";
+	// Only the dump thread takes the flight recorder signal, so block it before
+	// any other thread starts (they all inherit this)
+	sigset_t dumpSignal;
+	sigemptyset(&dumpSignal);
+	sigaddset(&dumpSignal, FLIGHT_DUMP_SIGNAL);
+	pthread_sigmask(SIG_BLOCK, &dumpSignal, NULL);
+	
+	if (options.bots > 0)
+	{
+		std::cout << options.bots << " bot(s) playing on " << options.workers << " worker thread(s).\n";
+		BotWorkers = new WorkerPool(options.workers);
+		BotSeed = (unsigned int)time(NULL);
+		addBots(options.bots);
+	}
+	
+	// Block SIGTERM.
+	sigset_t sigset, oldset;
+	sigemptyset(&sigset);
+	sigprocmask(SIG_BLOCK, &sigset, &oldset);
+	// A client hanging up on us shows up as a write error, it shouldn't kill
+	// the server (io_uring writes can't ask for MSG_NOSIGNAL)
+	signal(SIGPIPE, SIG_IGN);
+	
+	void (*run)(Reactor *) = options.uring ? runReactorUring : runReactor;
+	for (int i = 0; i < options.reactors; ++i)
+	{
+		Reactor * reactor = new Reactor(i, !options.uring);
+		Reactors.push_back(reactor);
+		if ((!options.uring && -1 == reactor->GetLoop().GetFD()) || -1 == reactor->GetWakeFD())
+		{
+			return -1;
+		}
+		if (SetUpListing(options.port, *reactor, options.reactors > 1))
+		{
+			return -1;
+		}
+	}
+	
+	if (NULL != options.statsPath)
+	{
+		int statsFd = setUpStatsSocket(options.statsPath);
+		if (-1 == statsFd)
+		{
+			return -1;
+		}
+		// Runs until the server exits, nothing waits for it
+		std::thread(serveStats, statsFd).detach();
+		std::cout << "Serving metrics on " << options.statsPath << ".\n";
+	}
+	std::thread(dumpFlightOnSignal, options.flightPath).detach();
+	
+	// Reactor 0 runs on this thread, the rest get their own
+	std::vector<std::thread> threads;
+	for (int i = 1; i < options.reactors; ++i)
+	{
+		threads.push_back(std::thread(run, Reactors[i]));
+	}
+	run(Reactors[0]);
+	for (auto& thread: threads)
+	{
+		thread.join();
 	}
-}
\ No newline at end of file
+	// Workers post to the reactors, so they go first
+	delete BotWorkers;
+	for (auto& reactor: Reactors)
+	{
+		delete reactor;
+	}
+	return 0;
+}
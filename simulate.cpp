@@ -0,0 +1,337 @@
+/************************************
+ * Author: Erik Andersen
+ * Lab: CST340 Final Lab
+ *
+ *
+ * Plays games between computer players in memory, as fast as it can, to see
+ * how strategies and ways of placing a fleet do against each other.
+ *  -r sets the rules (GAME_RULES_* number, default classic)
+ *  -a and -b set the strategies of the side moving first and second
+ *   (heatmap, hunt or random; default heatmap)
+ *  -A and -B set how each side places its fleet (random or edges)
+ *  -n sets the number of games, -t the number of threads (default one per
+ *  core), -s the seed.
+ * Each game's seed comes from -s and its number, so the results don't
+ * depend on the number of threads.
+ ************************************/
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "Bot.h"
+#include "GameRules.h"
+
+extern "C"
+{
+	#include <getopt.h>
+	#include <stdlib.h>
+	#include <stdio.h>
+}
+
+// Games a thread takes at a time
+#define SIM_BATCH 64
+
+// Contains an easy to use representation of the command line args
+typedef struct
+{
+	unsigned char rules;
+	MatchSide sides[2];
+	long games;
+	int threads;
+	unsigned int seed;
+} sim_options;
+
+// What all of the threads found, added to without locks
+typedef struct
+{
+	// Next game number to hand out
+	std::atomic<long> next;
+	std::atomic<long> wins[2];
+	// Games nobody won
+	std::atomic<long> unfinished;
+	std::atomic<long> shots;
+	// Games each side won in exactly i shots
+	std::vector<std::atomic<long> > shotsToWin[2];
+} sim_results;
+
+/****************************************************************
+ * Set up our struct
+ *
+ * Preconditions:
+ *  None
+ * Postcondition:
+ *  options intialized to defaults
+ ****************************************************************/
+void Init_sim_options(sim_options & options)
+{
+	options.rules = GAME_RULES_CLASSIC;
+	for (int side = 0; side < 2; ++side)
+	{
+		options.sides[side].strategy = "heatmap";
+		options.sides[side].placement = BOT_PLACE_RANDOM;
+	}
+	options.games = 100000;
+	options.threads = std::max(1u, std::thread::hardware_concurrency());
+	options.seed = 1;
+}
+
+/****************************************************************
+ * Parse the command line args
+ *
+ * Preconditions:
+ *  options initialized
+ * Postcondition:
+ *  options populated with settings from command line. Returns 0 on success,
+ *  nonzero if the options were not usable
+ ****************************************************************/
+int parseOptions(int argc, char ** argv, sim_options & options)
+{
+	int arg;
+	while (-1 != (arg = getopt(argc, argv, "r:a:b:A:B:n:t:s:")))
+	{
+		if ('r' == arg)
+		{
+			options.rules = atoi(optarg);
+			if (nullptr == findRules(options.rules))
+			{
+				std::cerr << "Unknown rules (-r).\n";
+				return 1;
+			}
+		}
+		else if ('a' == arg || 'b' == arg)
+		{
+			options.sides['a' == arg ? 0 : 1].strategy = optarg;
+		}
+		else if ('A' == arg || 'B' == arg)
+		{
+			int placement = findPlacement(optarg);
+			if (-1 == placement)
+			{
+				std::cerr << "Fleet placement (-A, -B) must be random or edges.\n";
+				return 2;
+			}
+			options.sides['A' == arg ? 0 : 1].placement = placement;
+		}
+		else if ('n' == arg)
+		{
+			options.games = atol(optarg);
+			if (options.games < 1)
+			{
+				std::cerr << "Number of games (-n) must be at least 1.\n";
+				return 3;
+			}
+		}
+		else if ('t' == arg)
+		{
+			options.threads = atoi(optarg);
+			if (options.threads < 1 || options.threads > 1024)
+			{
+				std::cerr << "Number of threads (-t) must be between 1 and 1024.\n";
+				return 4;
+			}
+		}
+		else if ('s' == arg)
+		{
+			options.seed = strtoul(optarg, NULL, 10);
+		}
+	}
+	std::vector<short> none;
+	for (int side = 0; side < 2; ++side)
+	{
+		if (!makeStrategy(options.sides[side].strategy, *findRules(options.rules), none, 0))
+		{
+			std::cerr << "Strategy (-a, -b) must be heatmap, hunt or random.\n";
+			return 5;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Play games until there are none left to hand out
+ *
+ * Preconditions:
+ *  results' histograms sized for the rules' board
+ * Postcondition:
+ *  Games played, and what happened added to results
+ ****************************************************************/
+void simulate(const sim_options & options, sim_results & results)
+{
+	const GameRules & rules = *findRules(options.rules);
+	long wins[2] = {0, 0};
+	long unfinished = 0;
+	long shots = 0;
+	// Kept here and added to results once, so threads don't fight over them
+	std::vector<long> shotsToWin[2] = {std::vector<long>(results.shotsToWin[0].size(), 0), std::vector<long>(results.shotsToWin[1].size(), 0)};
+	for (;;)
+	{
+		long first = results.next.fetch_add(SIM_BATCH);
+		if (first >= options.games)
+		{
+			break;
+		}
+		long last = std::min(first + SIM_BATCH, options.games);
+		for (long game = first; game < last; ++game)
+		{
+			int sideShots[2];
+			int winner = playMatch(rules, options.sides, options.seed*2654435761u + game, sideShots);
+			shots += sideShots[0] + sideShots[1];
+			if (-1 == winner)
+			{
+				++unfinished;
+				continue;
+			}
+			++wins[winner];
+			++shotsToWin[winner][sideShots[winner]];
+		}
+	}
+	for (int side = 0; side < 2; ++side)
+	{
+		results.wins[side] += wins[side];
+		for (size_t i = 0; i < shotsToWin[side].size(); ++i)
+		{
+			if (shotsToWin[side][i])
+			{
+				results.shotsToWin[side][i] += shotsToWin[side][i];
+			}
+		}
+	}
+	results.unfinished += unfinished;
+	results.shots += shots;
+}
+
+/****************************************************************
+ * Find a percentile of a histogram
+ *
+ * Preconditions:
+ *  0 < fraction <= 1
+ * Postcondition:
+ *  No changes. Smallest number of shots that at least 'fraction' of the
+ *  games counted in it took returned (0 if it is empty)
+ ****************************************************************/
+long percentile(const std::vector<std::atomic<long> > & histogram, double fraction)
+{
+	long total = 0;
+	for (const std::atomic<long> & count : histogram)
+	{
+		total += count;
+	}
+	long seen = 0;
+	for (size_t i = 0; i < histogram.size(); ++i)
+	{
+		seen += histogram[i];
+		if (total > 0 && seen >= fraction*total)
+		{
+			return i;
+		}
+	}
+	return 0;
+}
+
+/****************************************************************
+ * Print how one side did
+ *
+ * Preconditions:
+ *  Simulation finished
+ * Postcondition:
+ *  wins and the shots-to-win distribution written to stdout
+ ****************************************************************/
+void printSide(const sim_options & options, const sim_results & results, int side)
+{
+	const std::vector<std::atomic<long> > & histogram = results.shotsToWin[side];
+	long wins = results.wins[side];
+	long total = 0;
+	for (size_t i = 0; i < histogram.size(); ++i)
+	{
+		total += i * histogram[i];
+	}
+	printf("%s (%s, %s fleet): %ld wins (%.2f%%)", 0 == side ? "First" : "Second",
+		options.sides[side].strategy.c_str(),
+		BOT_PLACE_EDGES == options.sides[side].placement ? "edges" : "random",
+		wins, 100.0 * wins / options.games);
+	if (wins > 0)
+	{
+		printf(", shots to win: mean %.2f, p50 %ld, p90 %ld, p99 %ld, max %ld",
+			(double)total / wins, percentile(histogram, 0.5), percentile(histogram, 0.9),
+			percentile(histogram, 0.99), percentile(histogram, 1.0));
+	}
+	printf("\n");
+}
+
+/****************************************************************
+ * Print the shots-to-win distribution of both sides
+ *
+ * Preconditions:
+ *  Simulation finished
+ * Postcondition:
+ *  One line per number of shots any game was won in: the shots, then how
+ *  many games each side won in that many
+ ****************************************************************/
+void printHistogram(const sim_results & results)
+{
+	printf("Shots to win  First  Second\n");
+	for (size_t i = 0; i < results.shotsToWin[0].size(); ++i)
+	{
+		long first = results.shotsToWin[0][i];
+		long second = results.shotsToWin[1][i];
+		if (first || second)
+		{
+			printf("%12zu %6ld %7ld\n", i, first, second);
+		}
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	sim_options options;
+	Init_sim_options(options);
+	if (parseOptions(argc, argv, options))
+	{
+		return 1;
+	}
+	const GameRules & rules = *findRules(options.rules);
+
+	sim_results results;
+	results.next = 0;
+	results.wins[0] = 0;
+	results.wins[1] = 0;
+	results.unfinished = 0;
+	results.shots = 0;
+	for (int side = 0; side < 2; ++side)
+	{
+		// A side can fire at every space at most
+		results.shotsToWin[side] = std::vector<std::atomic<long> >(rules.width*rules.height + 1);
+		for (std::atomic<long> & count : results.shotsToWin[side])
+		{
+			count = 0;
+		}
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int i = 1; i < options.threads; ++i)
+	{
+		threads.push_back(std::thread(simulate, std::cref(options), std::ref(results)));
+	}
+	simulate(options, results);
+	for (auto& thread: threads)
+	{
+		thread.join();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printHistogram(results);
+	printSide(options, results, 0);
+	printSide(options, results, 1);
+	if (results.unfinished > 0)
+	{
+		printf("Unfinished: %ld\n", (long)results.unfinished);
+	}
+	// One line to track throughput by
+	printf("games=%ld threads=%d seconds=%.3f games_per_sec=%.0f shots_per_sec=%.0f\n",
+		options.games, options.threads, seconds, options.games / seconds, results.shots / seconds);
+	return 0;
+}